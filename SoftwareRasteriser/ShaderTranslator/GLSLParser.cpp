@@ -0,0 +1,1121 @@
+#include "GLSLParser.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+// Longest first, so the tokeniser matches the longest operator it can
+const char *const OPERATORS[] = {"<<=", ">>=", "++", "--", "+=", "-=", "*=", "/=", "%=", "==",
+                                 "!=",  "<=",  ">=", "&&", "||", "^^", "<<", ">>", "+",  "-",
+                                 "*",   "/",   "%",  "<",  ">",  "=",  "!",  "&",  "|",  "^",
+                                 "~",   "?",   ":",  ";",  ",",  ".",  "(",  ")",  "{",  "}",
+                                 "[",   "]"};
+
+const char *const TYPE_NAMES[] = {"void", "bool", "int",  "float", "vec2",
+                                  "vec3", "vec4", "mat3", "mat4",  "sampler2D"};
+
+// Keywords of stages or features outside of the subset, which are reported by name
+const char *const UNSUPPORTED[] = {"struct",    "layout",   "discard",  "do",      "switch",
+                                   "flat",      "centroid", "patch",    "sample",  "invariant",
+                                   "precise",   "uint",     "double",   "ivec2",   "ivec3",
+                                   "ivec4",     "uvec2",    "uvec3",    "uvec4",   "bvec2",
+                                   "bvec3",     "bvec4",    "dvec2",    "dvec3",   "dvec4",
+                                   "mat2",      "mat2x3",   "mat2x4",   "mat3x2",  "mat3x4",
+                                   "mat4x2",    "mat4x3",   "sampler1D", "sampler3D",
+                                   "samplerCube", "sampler2DShadow", "noperspective"};
+
+template <typename T, size_t N> size_t ArraySize(T (&)[N])
+{
+  return N;
+}
+
+bool IsAssignment(const std::string &op)
+{
+  return op == "=" || op == "+=" || op == "-=" || op == "*=" || op == "/=" || op == "%=";
+}
+
+std::string LineMessage(int line, const std::string &message)
+{
+  std::stringstream s;
+  s << "line " << line << ": " << message;
+  return s.str();
+}
+} // namespace
+
+GLSLShader::~GLSLShader(void)
+{
+  for (size_t i = 0; i < m_exprs.size(); ++i)
+    delete m_exprs[i];
+  for (size_t i = 0; i < m_stmts.size(); ++i)
+    delete m_stmts[i];
+}
+
+/**
+ * Creates an expression node, owned by the shader.
+ *
+ * \param kind Kind of expression
+ * \param text Operator, name or literal (depending on the kind)
+ * \param line Line of the source it came from
+ * \return New expression with no arguments
+ */
+GLSLExpr *GLSLShader::NewExpr(GLSLExpr::Kind kind, const std::string &text, int line)
+{
+  GLSLExpr *e = new GLSLExpr();
+  e->kind = kind;
+  e->text = text;
+  e->line = line;
+  m_exprs.push_back(e);
+  return e;
+}
+
+/**
+ * Creates a statement node, owned by the shader.
+ *
+ * \param kind Kind of statement
+ * \param line Line of the source it came from
+ * \return New, empty statement
+ */
+GLSLStmt *GLSLShader::NewStmt(GLSLStmt::Kind kind, int line)
+{
+  GLSLStmt *s = new GLSLStmt();
+  s->kind = kind;
+  s->isConst = false;
+  s->expr = NULL;
+  s->step = NULL;
+  s->line = line;
+  s->endLine = line;
+  m_stmts.push_back(s);
+  return s;
+}
+
+GLSLParser::GLSLParser(void)
+    : m_pos(0)
+    , m_shader(NULL)
+{
+}
+
+/**
+ * Checks if a name is one of the types in the subset.
+ *
+ * \param name Name to check
+ * \return True if it is a type
+ */
+bool GLSLParser::IsTypeName(const std::string &name)
+{
+  for (size_t i = 0; i < ArraySize(TYPE_NAMES); ++i)
+  {
+    if (name == TYPE_NAMES[i])
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Parses a shader's source.
+ *
+ * \param source GLSL source
+ * \param shader Receives the declarations and functions of the shader
+ * \return True if it was parsed, false if not (see GetError)
+ */
+bool GLSLParser::Parse(const std::string &source, GLSLShader &shader)
+{
+  m_shader = &shader;
+  m_error.clear();
+
+  if (!Tokenise(source))
+    return false;
+
+  while (Peek().kind != GLSLToken::END)
+  {
+    if (!ParseGlobal())
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Splits the source into tokens, dropping comments and the #version directive.
+ *
+ * \param source GLSL source
+ * \return True if it was tokenised, false if it has a character or directive that isn't supported
+ */
+bool GLSLParser::Tokenise(const std::string &source)
+{
+  m_tokens.clear();
+  m_pos = 0;
+
+  int line = 1;
+  bool lineStart = true;
+  size_t i = 0;
+
+  while (i < source.size())
+  {
+    const char c = source[i];
+
+    if (c == '\n')
+    {
+      ++line;
+      lineStart = true;
+      ++i;
+      continue;
+    }
+
+    if (isspace((unsigned char)c))
+    {
+      ++i;
+      continue;
+    }
+
+    if (source.compare(i, 2, "//") == 0)
+    {
+      while (i < source.size() && source[i] != '\n')
+        ++i;
+      continue;
+    }
+
+    if (source.compare(i, 2, "/*") == 0)
+    {
+      const size_t end = source.find("*/", i + 2);
+      if (end == std::string::npos)
+        return Error(line, "unterminated comment");
+
+      for (; i < end + 2; ++i)
+      {
+        if (source[i] == '\n')
+          ++line;
+      }
+      continue;
+    }
+
+    if (c == '#')
+    {
+      if (!lineStart)
+        return Error(line, "unexpected '#'");
+
+      size_t end = source.find('\n', i);
+      if (end == std::string::npos)
+        end = source.size();
+
+      const std::string directive = source.substr(i, end - i);
+      if (directive.compare(0, 8, "#version") != 0)
+        return Error(line, "preprocessor directives other than #version aren't supported");
+
+      i = end;
+      continue;
+    }
+
+    lineStart = false;
+
+    GLSLToken t;
+    t.line = line;
+
+    if (isalpha((unsigned char)c) || c == '_')
+    {
+      size_t end = i;
+      while (end < source.size() && (isalnum((unsigned char)source[end]) || source[end] == '_'))
+        ++end;
+
+      t.kind = GLSLToken::IDENTIFIER;
+      t.text = source.substr(i, end - i);
+      m_tokens.push_back(t);
+      i = end;
+      continue;
+    }
+
+    if (isdigit((unsigned char)c) ||
+        (c == '.' && i + 1 < source.size() && isdigit((unsigned char)source[i + 1])))
+    {
+      size_t end = i;
+      bool isFloat = false;
+
+      while (end < source.size() && isdigit((unsigned char)source[end]))
+        ++end;
+      if (end < source.size() && source[end] == '.')
+      {
+        isFloat = true;
+        ++end;
+        while (end < source.size() && isdigit((unsigned char)source[end]))
+          ++end;
+      }
+      if (end < source.size() && (source[end] == 'e' || source[end] == 'E'))
+      {
+        isFloat = true;
+        ++end;
+        if (end < source.size() && (source[end] == '+' || source[end] == '-'))
+          ++end;
+        while (end < source.size() && isdigit((unsigned char)source[end]))
+          ++end;
+      }
+
+      t.text = source.substr(i, end - i);
+      if (end < source.size() && (source[end] == 'f' || source[end] == 'F'))
+      {
+        isFloat = true;
+        ++end;
+      }
+      else if (end < source.size() && (source[end] == 'x' || source[end] == 'X' ||
+                                         source[end] == 'u' || source[end] == 'U'))
+      {
+        return Error(line, "hexadecimal and unsigned literals aren't supported");
+      }
+
+      t.kind = isFloat ? GLSLToken::FLOAT_LITERAL : GLSLToken::INT_LITERAL;
+      m_tokens.push_back(t);
+      i = end;
+      continue;
+    }
+
+    size_t op = 0;
+    while (op < ArraySize(OPERATORS) && source.compare(i, strlen(OPERATORS[op]), OPERATORS[op]))
+      ++op;
+
+    if (op == ArraySize(OPERATORS))
+      return Error(line, std::string("unexpected character '") + c + "'");
+
+    t.kind = GLSLToken::OPERATOR;
+    t.text = OPERATORS[op];
+    m_tokens.push_back(t);
+    i += t.text.size();
+  }
+
+  GLSLToken end;
+  end.kind = GLSLToken::END;
+  end.line = line;
+  m_tokens.push_back(end);
+
+  return true;
+}
+
+/**
+ * Parses a declaration at global scope: a uniform, input, output, interface block or function.
+ *
+ * \return True if it was parsed
+ */
+bool GLSLParser::ParseGlobal()
+{
+  const int line = Peek().line;
+
+  if (IsIdentifier("precision"))
+  {
+    while (Peek().kind != GLSLToken::END && !IsOperator(";"))
+      Next();
+    return Expect(";");
+  }
+
+  std::string qualifier;
+  if (IsIdentifier("uniform") || IsIdentifier("in") || IsIdentifier("out"))
+    qualifier = Next().text;
+  else if (IsIdentifier("const"))
+    return Error(line, "global constants aren't supported");
+
+  // Interpolation qualifiers that match what the rasteriser does anyway
+  if (IsIdentifier("smooth"))
+    Next();
+
+  if (qualifier != "" && qualifier != "uniform" && Peek().kind == GLSLToken::IDENTIFIER &&
+      IsOperator("{", 1))
+  {
+    return ParseBlock(qualifier);
+  }
+
+  GLSLType type;
+  if (!ParseType(type))
+    return false;
+
+  if (Peek().kind != GLSLToken::IDENTIFIER)
+    return Error(Peek().line, "expected a name");
+  const std::string name = Next().text;
+
+  if (qualifier == "" && IsOperator("("))
+    return ParseFunction(type, name, line);
+
+  if (qualifier == "")
+    return Error(line, "global variables must be uniforms, inputs or outputs");
+
+  if (!ParseArraySize(type))
+    return false;
+
+  if (IsOperator("="))
+    return Error(Peek().line, "uniforms can't be initialised in the shader");
+
+  GLSLVariable v;
+  v.type = type;
+  v.name = name;
+  v.line = line;
+
+  if (qualifier == "uniform")
+    m_shader->uniforms.push_back(v);
+  else if (qualifier == "in")
+    m_shader->inputs.push_back(v);
+  else
+    m_shader->outputs.push_back(v);
+
+  return Expect(";");
+}
+
+/**
+ * Parses an in or out interface block, after its qualifier.
+ *
+ * \param qualifier in or out
+ * \return True if it was parsed
+ */
+bool GLSLParser::ParseBlock(const std::string &qualifier)
+{
+  GLSLBlock block;
+  block.line = Peek().line;
+  block.blockName = Next().text;
+
+  if (!Expect("{"))
+    return false;
+
+  while (!IsOperator("}"))
+  {
+    GLSLVariable field;
+    field.line = Peek().line;
+
+    if (IsIdentifier("smooth"))
+      Next();
+    if (!ParseType(field.type))
+      return false;
+    if (Peek().kind != GLSLToken::IDENTIFIER)
+      return Error(Peek().line, "expected a name");
+    field.name = Next().text;
+    if (!ParseArraySize(field.type))
+      return false;
+    if (field.type.arraySize != 0)
+      return Error(field.line, "arrays in interface blocks aren't supported");
+
+    block.fields.push_back(field);
+
+    if (!Expect(";"))
+      return false;
+  }
+  Next();
+
+  if (Peek().kind != GLSLToken::IDENTIFIER)
+    return Error(Peek().line, "interface blocks must have an instance name");
+  block.instanceName = Next().text;
+
+  if (IsOperator("["))
+    return Error(Peek().line, "arrays of interface blocks aren't supported");
+
+  if (qualifier == "in")
+    m_shader->inBlocks.push_back(block);
+  else
+    m_shader->outBlocks.push_back(block);
+
+  return Expect(";");
+}
+
+/**
+ * Parses a function's parameters and body, after its return type and name.
+ *
+ * \param returnType Type it returns
+ * \param name Name of the function
+ * \param line Line it starts on
+ * \return True if it was parsed
+ */
+bool GLSLParser::ParseFunction(const GLSLType &returnType, const std::string &name, int line)
+{
+  GLSLFunction f;
+  f.returnType = returnType;
+  f.name = name;
+  f.line = line;
+  f.body = NULL;
+
+  if (!Expect("("))
+    return false;
+
+  if (IsIdentifier("void") && IsOperator(")", 1))
+    Next();
+
+  while (!IsOperator(")"))
+  {
+    GLSLVariable param;
+    param.line = Peek().line;
+
+    if (IsIdentifier("const"))
+      Next();
+    if (IsIdentifier("in") || IsIdentifier("out") || IsIdentifier("inout"))
+      param.qualifier = Next().text;
+
+    if (!ParseType(param.type))
+      return false;
+    if (Peek().kind != GLSLToken::IDENTIFIER)
+      return Error(Peek().line, "expected a parameter name");
+    param.name = Next().text;
+    if (!ParseArraySize(param.type))
+      return false;
+    if (param.type.arraySize != 0)
+      return Error(param.line, "array parameters aren't supported");
+
+    f.params.push_back(param);
+
+    if (!IsOperator(")") && !Expect(","))
+      return false;
+  }
+  Next();
+
+  // Prototypes add nothing, as the translated functions are all class members
+  if (Accept(";"))
+    return true;
+
+  f.body = ParseCompound();
+  if (!f.body)
+    return false;
+
+  m_shader->functions.push_back(f);
+  return true;
+}
+
+/**
+ * Parses the name of a type.
+ *
+ * \param type Receives the type
+ * \return True if it was one of the supported types
+ */
+bool GLSLParser::ParseType(GLSLType &type)
+{
+  const GLSLToken &t = Peek();
+  if (t.kind != GLSLToken::IDENTIFIER)
+    return Error(t.line, "expected a type");
+
+  for (size_t i = 0; i < ArraySize(UNSUPPORTED); ++i)
+  {
+    if (t.text == UNSUPPORTED[i])
+      return Error(t.line, "'" + t.text + "' isn't supported");
+  }
+
+  if (!IsTypeName(t.text))
+    return Error(t.line, "unknown type '" + t.text + "'");
+
+  type.name = Next().text;
+  type.arraySize = 0;
+  return true;
+}
+
+/**
+ * Parses an optional array size after a variable's name.
+ *
+ * \param type Type of the variable, which receives the size
+ * \return True if there wasn't one or it was a positive integer
+ */
+bool GLSLParser::ParseArraySize(GLSLType &type)
+{
+  if (!Accept("["))
+    return true;
+
+  if (Peek().kind != GLSLToken::INT_LITERAL)
+    return Error(Peek().line, "array sizes must be integer literals");
+
+  type.arraySize = atoi(Next().text.c_str());
+  if (type.arraySize <= 0)
+    return Error(Peek().line, "array sizes must be positive");
+
+  return Expect("]");
+}
+
+/**
+ * Parses a statement.
+ *
+ * \return The statement, or NULL on error
+ */
+GLSLStmt *GLSLParser::ParseStatement()
+{
+  const GLSLToken &t = Peek();
+  const int line = t.line;
+
+  if (IsOperator("{"))
+    return ParseCompound();
+
+  if (t.kind == GLSLToken::IDENTIFIER)
+  {
+    if (t.text == "if")
+    {
+      Next();
+      GLSLStmt *s = m_shader->NewStmt(GLSLStmt::IF, line);
+      if (!Expect("(") || !(s->expr = ParseExpression()) || !Expect(")"))
+        return NULL;
+
+      GLSLStmt *then = ParseStatement();
+      if (!then)
+        return NULL;
+      s->body.push_back(then);
+
+      if (IsIdentifier("else"))
+      {
+        Next();
+        GLSLStmt *otherwise = ParseStatement();
+        if (!otherwise)
+          return NULL;
+        s->body.push_back(otherwise);
+      }
+      return s;
+    }
+
+    if (t.text == "for")
+    {
+      Next();
+      GLSLStmt *s = m_shader->NewStmt(GLSLStmt::FOR, line);
+      if (!Expect("("))
+        return NULL;
+
+      GLSLStmt *init = NULL;
+      if (!Accept(";"))
+      {
+        init = ParseStatement();
+        if (!init)
+          return NULL;
+        if (init->kind != GLSLStmt::DECLARATION && init->kind != GLSLStmt::EXPRESSION)
+        {
+          Error(line, "for loops must start with a declaration or expression");
+          return NULL;
+        }
+      }
+
+      if (!IsOperator(";") && !(s->expr = ParseExpression()))
+        return NULL;
+      if (!Expect(";"))
+        return NULL;
+      if (!IsOperator(")") && !(s->step = ParseExpression()))
+        return NULL;
+      if (!Expect(")"))
+        return NULL;
+
+      GLSLStmt *body = ParseStatement();
+      if (!body)
+        return NULL;
+
+      s->body.push_back(init);
+      s->body.push_back(body);
+      return s;
+    }
+
+    if (t.text == "while")
+    {
+      Next();
+      GLSLStmt *s = m_shader->NewStmt(GLSLStmt::WHILE, line);
+      if (!Expect("(") || !(s->expr = ParseExpression()) || !Expect(")"))
+        return NULL;
+
+      GLSLStmt *body = ParseStatement();
+      if (!body)
+        return NULL;
+      s->body.push_back(body);
+      return s;
+    }
+
+    if (t.text == "return")
+    {
+      Next();
+      GLSLStmt *s = m_shader->NewStmt(GLSLStmt::RETURN, line);
+      if (!IsOperator(";") && !(s->expr = ParseExpression()))
+        return NULL;
+      return Expect(";") ? s : NULL;
+    }
+
+    if (t.text == "break" || t.text == "continue")
+    {
+      Next();
+      GLSLStmt *s =
+          m_shader->NewStmt(t.text == "break" ? GLSLStmt::BREAK : GLSLStmt::CONTINUE, line);
+      return Expect(";") ? s : NULL;
+    }
+
+    if (t.text == "discard")
+    {
+      Error(line, "discard isn't supported");
+      return NULL;
+    }
+
+    // A type followed by a name declares a variable, otherwise it is a constructor
+    if (t.text == "const" || (IsTypeName(t.text) && Peek(1).kind == GLSLToken::IDENTIFIER))
+      return ParseDeclaration();
+  }
+
+  GLSLStmt *s = m_shader->NewStmt(GLSLStmt::EXPRESSION, line);
+  if (!(s->expr = ParseExpression()))
+    return NULL;
+  return Expect(";") ? s : NULL;
+}
+
+/**
+ * Parses a block of statements in braces.
+ *
+ * \return The block, or NULL on error
+ */
+GLSLStmt *GLSLParser::ParseCompound()
+{
+  GLSLStmt *block = m_shader->NewStmt(GLSLStmt::BLOCK, Peek().line);
+  if (!Expect("{"))
+    return NULL;
+
+  while (!IsOperator("}"))
+  {
+    if (Peek().kind == GLSLToken::END)
+    {
+      Error(block->line, "unterminated block");
+      return NULL;
+    }
+
+    GLSLStmt *s = ParseStatement();
+    if (!s)
+      return NULL;
+    s->endLine = Previous().line;
+    block->body.push_back(s);
+  }
+  Next();
+
+  return block;
+}
+
+/**
+ * Parses the declaration of a local variable.
+ *
+ * \return The declaration, or NULL on error
+ */
+GLSLStmt *GLSLParser::ParseDeclaration()
+{
+  GLSLStmt *s = m_shader->NewStmt(GLSLStmt::DECLARATION, Peek().line);
+
+  if (IsIdentifier("const"))
+  {
+    Next();
+    s->isConst = true;
+  }
+
+  if (!ParseType(s->type))
+    return NULL;
+  if (Peek().kind != GLSLToken::IDENTIFIER)
+  {
+    Error(Peek().line, "expected a name");
+    return NULL;
+  }
+  s->name = Next().text;
+  if (!ParseArraySize(s->type))
+    return NULL;
+
+  if (Accept("="))
+  {
+    if (s->type.arraySize != 0)
+    {
+      Error(s->line, "array initialisers aren't supported");
+      return NULL;
+    }
+    if (!(s->expr = ParseConditional()))
+      return NULL;
+  }
+  else if (s->isConst)
+  {
+    Error(s->line, "constants must be initialised");
+    return NULL;
+  }
+
+  if (IsOperator(","))
+  {
+    Error(s->line, "declare one variable per statement");
+    return NULL;
+  }
+
+  return Expect(";") ? s : NULL;
+}
+
+/**
+ * Parses an expression, including assignments.
+ *
+ * \return The expression, or NULL on error
+ */
+GLSLExpr *GLSLParser::ParseExpression()
+{
+  GLSLExpr *target = ParseConditional();
+  if (!target)
+    return NULL;
+
+  if (Peek().kind != GLSLToken::OPERATOR || !IsAssignment(Peek().text))
+  {
+    if (IsOperator(","))
+    {
+      Error(Peek().line, "the comma operator isn't supported");
+      return NULL;
+    }
+    return target;
+  }
+
+  const GLSLToken op = Next();
+  if (op.text == "%=")
+  {
+    Error(op.line, "'%=' isn't supported");
+    return NULL;
+  }
+
+  GLSLExpr *value = ParseExpression();
+  if (!value)
+    return NULL;
+
+  GLSLExpr *e = m_shader->NewExpr(GLSLExpr::ASSIGN, op.text, op.line);
+  e->args.push_back(target);
+  e->args.push_back(value);
+  return e;
+}
+
+/**
+ * Parses a conditional (a ? b : c) or anything with higher precedence.
+ *
+ * \return The expression, or NULL on error
+ */
+GLSLExpr *GLSLParser::ParseConditional()
+{
+  GLSLExpr *condition = ParseBinary(1);
+  if (!condition || !IsOperator("?"))
+    return condition;
+
+  GLSLExpr *e = m_shader->NewExpr(GLSLExpr::CONDITIONAL, "?", Next().line);
+  e->args.push_back(condition);
+
+  GLSLExpr *a = ParseExpression();
+  if (!a || !Expect(":"))
+    return NULL;
+  GLSLExpr *b = ParseConditional();
+  if (!b)
+    return NULL;
+
+  e->args.push_back(a);
+  e->args.push_back(b);
+  return e;
+}
+
+/**
+ * Gets the precedence of a binary operator.
+ *
+ * \param op Operator
+ * \return Precedence, higher binding tighter, or 0 if it isn't a supported binary operator
+ */
+int GLSLParser::BinaryPrecedence(const std::string &op)
+{
+  if (op == "||")
+    return 1;
+  if (op == "&&")
+    return 2;
+  if (op == "==" || op == "!=")
+    return 3;
+  if (op == "<" || op == ">" || op == "<=" || op == ">=")
+    return 4;
+  if (op == "+" || op == "-")
+    return 5;
+  if (op == "*" || op == "/" || op == "%")
+    return 6;
+  return 0;
+}
+
+/**
+ * Parses binary operators by precedence climbing, which keeps them left associative.
+ *
+ * \param minPrecedence Lowest precedence of operator to consume
+ * \return The expression, or NULL on error
+ */
+GLSLExpr *GLSLParser::ParseBinary(int minPrecedence)
+{
+  GLSLExpr *left = ParseUnary();
+  if (!left)
+    return NULL;
+
+  for (;;)
+  {
+    const GLSLToken &t = Peek();
+    if (t.kind != GLSLToken::OPERATOR)
+      return left;
+
+    if (t.text == "^^" || t.text == "&" || t.text == "|" || t.text == "^" || t.text == "<<" ||
+        t.text == ">>")
+    {
+      Error(t.line, "'" + t.text + "' isn't supported");
+      return NULL;
+    }
+
+    const int precedence = BinaryPrecedence(t.text);
+    if (precedence == 0 || precedence < minPrecedence)
+      return left;
+
+    const GLSLToken op = Next();
+    GLSLExpr *right = ParseBinary(precedence + 1);
+    if (!right)
+      return NULL;
+
+    GLSLExpr *e = m_shader->NewExpr(GLSLExpr::BINARY, op.text, op.line);
+    e->args.push_back(left);
+    e->args.push_back(right);
+    left = e;
+  }
+}
+
+/**
+ * Parses a prefix operator or anything with higher precedence.
+ *
+ * \return The expression, or NULL on error
+ */
+GLSLExpr *GLSLParser::ParseUnary()
+{
+  if (IsOperator("-") || IsOperator("+") || IsOperator("!") || IsOperator("++") ||
+      IsOperator("--"))
+  {
+    const GLSLToken op = Next();
+    GLSLExpr *operand = ParseUnary();
+    if (!operand)
+      return NULL;
+
+    // Unary plus does nothing
+    if (op.text == "+")
+      return operand;
+
+    GLSLExpr *e = m_shader->NewExpr(GLSLExpr::UNARY, op.text, op.line);
+    e->args.push_back(operand);
+    return e;
+  }
+
+  if (IsOperator("~"))
+  {
+    Error(Peek().line, "'~' isn't supported");
+    return NULL;
+  }
+
+  return ParsePostfix();
+}
+
+/**
+ * Parses indexing, member access and postfix operators.
+ *
+ * \return The expression, or NULL on error
+ */
+GLSLExpr *GLSLParser::ParsePostfix()
+{
+  GLSLExpr *e = ParsePrimary();
+  if (!e)
+    return NULL;
+
+  for (;;)
+  {
+    const int line = Peek().line;
+
+    if (Accept("["))
+    {
+      GLSLExpr *index = ParseExpression();
+      if (!index || !Expect("]"))
+        return NULL;
+
+      GLSLExpr *indexed = m_shader->NewExpr(GLSLExpr::INDEX, "", line);
+      indexed->args.push_back(e);
+      indexed->args.push_back(index);
+      e = indexed;
+    }
+    else if (Accept("."))
+    {
+      if (Peek().kind != GLSLToken::IDENTIFIER)
+      {
+        Error(line, "expected a member name");
+        return NULL;
+      }
+
+      GLSLExpr *member = m_shader->NewExpr(GLSLExpr::MEMBER, Next().text, line);
+      if (IsOperator("("))
+      {
+        Error(line, "methods (such as length()) aren't supported");
+        return NULL;
+      }
+      member->args.push_back(e);
+      e = member;
+    }
+    else if (IsOperator("++") || IsOperator("--"))
+    {
+      GLSLExpr *postfix = m_shader->NewExpr(GLSLExpr::POSTFIX, Next().text, line);
+      postfix->args.push_back(e);
+      e = postfix;
+    }
+    else
+    {
+      return e;
+    }
+  }
+}
+
+/**
+ * Parses a name, literal, function call, constructor or bracketed expression.
+ *
+ * \return The expression, or NULL on error
+ */
+GLSLExpr *GLSLParser::ParsePrimary()
+{
+  const GLSLToken t = Next();
+
+  if (t.kind == GLSLToken::INT_LITERAL || t.kind == GLSLToken::FLOAT_LITERAL)
+  {
+    std::string text = t.text;
+    if (t.kind == GLSLToken::FLOAT_LITERAL)
+    {
+      // Written as a C++ float: 1 becomes 1.0f, .5 becomes 0.5f and 2.e3 becomes 2.0e3f
+      if (text[0] == '.')
+        text = "0" + text;
+
+      const size_t point = text.find('.');
+      if (point == std::string::npos)
+      {
+        const size_t exponent = text.find_first_of("eE");
+        text.insert(exponent == std::string::npos ? text.size() : exponent, ".0");
+      }
+      else if (point + 1 == text.size() || !isdigit((unsigned char)text[point + 1]))
+      {
+        text.insert(point + 1, "0");
+      }
+      text += "f";
+    }
+    return m_shader->NewExpr(GLSLExpr::LITERAL, text, t.line);
+  }
+
+  if (t.kind == GLSLToken::OPERATOR && t.text == "(")
+  {
+    GLSLExpr *e = ParseExpression();
+    if (!e || !Expect(")"))
+      return NULL;
+    return e;
+  }
+
+  if (t.kind != GLSLToken::IDENTIFIER)
+  {
+    Error(t.line, t.kind == GLSLToken::END ? "unexpected end of file"
+                                           : "unexpected '" + t.text + "'");
+    return NULL;
+  }
+
+  if (t.text == "true" || t.text == "false")
+    return m_shader->NewExpr(GLSLExpr::LITERAL, t.text, t.line);
+
+  for (size_t i = 0; i < ArraySize(UNSUPPORTED); ++i)
+  {
+    if (t.text == UNSUPPORTED[i])
+    {
+      Error(t.line, "'" + t.text + "' isn't supported");
+      return NULL;
+    }
+  }
+
+  if (IsOperator("("))
+  {
+    GLSLExpr *call = m_shader->NewExpr(GLSLExpr::CALL, t.text, t.line);
+    return ParseArguments(call) ? call : NULL;
+  }
+
+  if (IsTypeName(t.text))
+  {
+    Error(t.line, "expected '(' after '" + t.text + "'");
+    return NULL;
+  }
+
+  return m_shader->NewExpr(GLSLExpr::IDENTIFIER, t.text, t.line);
+}
+
+/**
+ * Parses the bracketed arguments of a call or constructor.
+ *
+ * \param call Call, which receives the arguments
+ * \return True if they were parsed
+ */
+bool GLSLParser::ParseArguments(GLSLExpr *call)
+{
+  if (!Expect("("))
+    return false;
+
+  if (IsIdentifier("void") && IsOperator(")", 1))
+    Next();
+
+  while (!IsOperator(")"))
+  {
+    GLSLExpr *arg = ParseConditional();
+    if (!arg)
+      return false;
+    call->args.push_back(arg);
+
+    if (!IsOperator(")") && !Expect(","))
+      return false;
+  }
+  Next();
+
+  return true;
+}
+
+const GLSLToken &GLSLParser::Peek(int ahead) const
+{
+  const size_t i = m_pos + ahead;
+  return m_tokens[i < m_tokens.size() ? i : m_tokens.size() - 1];
+}
+
+const GLSLToken &GLSLParser::Previous() const
+{
+  return m_tokens[m_pos > 0 ? m_pos - 1 : 0];
+}
+
+GLSLToken GLSLParser::Next()
+{
+  const GLSLToken t = Peek();
+  if (m_pos + 1 < m_tokens.size())
+    ++m_pos;
+  return t;
+}
+
+bool GLSLParser::IsOperator(const std::string &op, int ahead) const
+{
+  const GLSLToken &t = Peek(ahead);
+  return t.kind == GLSLToken::OPERATOR && t.text == op;
+}
+
+bool GLSLParser::IsIdentifier(const std::string &name, int ahead) const
+{
+  const GLSLToken &t = Peek(ahead);
+  return t.kind == GLSLToken::IDENTIFIER && t.text == name;
+}
+
+/**
+ * Consumes an operator if it is next.
+ *
+ * \param op Operator
+ * \return True if it was next
+ */
+bool GLSLParser::Accept(const std::string &op)
+{
+  if (!IsOperator(op))
+    return false;
+  Next();
+  return true;
+}
+
+/**
+ * Consumes an operator that must be next.
+ *
+ * \param op Operator
+ * \return True if it was next, false (with an error) if not
+ */
+bool GLSLParser::Expect(const std::string &op)
+{
+  if (Accept(op))
+    return true;
+
+  const GLSLToken &t = Peek();
+  return Error(t.line, "expected '" + op + "' but found " +
+                           (t.kind == GLSLToken::END ? "the end of the file" : "'" + t.text + "'"));
+}
+
+/**
+ * Records an error, keeping the first if there are several.
+ *
+ * \param line Line it was found on
+ * \param message Description of the error
+ * \return False, so it can be returned by the caller
+ */
+bool GLSLParser::Error(int line, const std::string &message)
+{
+  if (m_error.empty())
+    m_error = LineMessage(line, message);
+  return false;
+}
@@ -0,0 +1,206 @@
+/******************************************************************************
+Class:GLSLParser
+Implements:
+Description: Parses the subset of GLSL used by the OpenGLGraphics shaders into
+a syntax tree, for ShaderEmitter to translate into C++.
+
+The subset is what a single vertex or fragment shader needs: uniforms
+(including arrays and samplers), in and out variables and interface blocks,
+functions, local variables, the usual operators, constructors, swizzles and
+if, for and while statements. Anything else (layout qualifiers, structs,
+preprocessor directives other than #version, geometry and tessellation
+stages and so on) is reported as an error, with the line it was found on,
+rather than translated into something that might behave differently.
+
+Types aren't checked here. The translated C++ is type checked when it is
+compiled, by the glsl types (see GLSLTypes.h).
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct GLSLType
+{
+  GLSLType()
+      : arraySize(0)
+  {
+  }
+
+  std::string name; // float, int, bool, vec2, vec3, vec4, mat3, mat4, sampler2D or void
+  int arraySize;    // 0 if not an array
+};
+
+struct GLSLExpr
+{
+  enum Kind
+  {
+    LITERAL,     // text is the literal as written
+    IDENTIFIER,  // text is the name
+    CALL,        // text is the function or type name, args are the arguments
+    MEMBER,      // text is the member or swizzle, args[0] is the object
+    INDEX,       // args[0] is the array, args[1] the index
+    UNARY,       // text is the operator, args[0] the operand
+    POSTFIX,     // text is ++ or --, args[0] the operand
+    BINARY,      // text is the operator, args[0] and args[1] the operands
+    CONDITIONAL, // args are the condition, then the two results
+    ASSIGN       // text is the operator (=, += and so on), args[0] the target, args[1] the value
+  };
+
+  Kind kind;
+  std::string text;
+  std::vector<GLSLExpr *> args;
+  int line;
+};
+
+struct GLSLStmt
+{
+  enum Kind
+  {
+    BLOCK,       // body holds the statements
+    DECLARATION, // type and name, with expr as the initialiser (if any)
+    EXPRESSION,  // expr
+    IF,          // expr is the condition, body holds then and (optionally) else
+    FOR,         // body holds the initialiser (or NULL) and the loop's body, expr the condition
+                 // (or NULL) and step the step (or NULL)
+    WHILE,       // expr is the condition, body holds the loop's body
+    RETURN,      // expr is the value, or NULL
+    BREAK,
+    CONTINUE
+  };
+
+  Kind kind;
+  GLSLType type;
+  bool isConst;
+  std::string name;
+  GLSLExpr *expr;
+  GLSLExpr *step;
+  std::vector<GLSLStmt *> body;
+  int line;
+  int endLine; // Line of the last token, so blank lines between statements can be kept
+};
+
+struct GLSLVariable
+{
+  GLSLType type;
+  std::string name;
+  std::string qualifier; // in, out or inout for function parameters
+  int line;
+};
+
+// An in or out interface block, such as "out Vertex { vec2 texCoord; } OUT;"
+struct GLSLBlock
+{
+  std::string blockName;
+  std::string instanceName;
+  std::vector<GLSLVariable> fields;
+  int line;
+};
+
+struct GLSLFunction
+{
+  GLSLType returnType;
+  std::string name;
+  std::vector<GLSLVariable> params;
+  GLSLStmt *body;
+  int line;
+};
+
+// Everything declared by a shader, which owns every node of its syntax tree
+class GLSLShader
+{
+public:
+  GLSLShader(void)
+  {
+  }
+
+  ~GLSLShader(void);
+
+  GLSLExpr *NewExpr(GLSLExpr::Kind kind, const std::string &text, int line);
+  GLSLStmt *NewStmt(GLSLStmt::Kind kind, int line);
+
+  std::vector<GLSLVariable> uniforms;
+  std::vector<GLSLVariable> inputs;
+  std::vector<GLSLVariable> outputs;
+  std::vector<GLSLBlock> inBlocks;
+  std::vector<GLSLBlock> outBlocks;
+  std::vector<GLSLFunction> functions;
+
+protected:
+  GLSLShader(const GLSLShader &);
+  GLSLShader &operator=(const GLSLShader &);
+
+  std::vector<GLSLExpr *> m_exprs;
+  std::vector<GLSLStmt *> m_stmts;
+};
+
+struct GLSLToken
+{
+  enum Kind
+  {
+    IDENTIFIER,
+    INT_LITERAL,
+    FLOAT_LITERAL,
+    OPERATOR,
+    END
+  };
+
+  Kind kind;
+  std::string text;
+  int line;
+};
+
+class GLSLParser
+{
+public:
+  GLSLParser(void);
+
+  // Parses a shader's source, returning false (with the reason in GetError) if it isn't valid or
+  // uses something outside of the supported subset
+  bool Parse(const std::string &source, GLSLShader &shader);
+
+  const std::string &GetError() const
+  {
+    return m_error;
+  }
+
+  static bool IsTypeName(const std::string &name);
+  static int BinaryPrecedence(const std::string &op);
+
+protected:
+  bool Tokenise(const std::string &source);
+
+  bool ParseGlobal();
+  bool ParseBlock(const std::string &qualifier);
+  bool ParseFunction(const GLSLType &returnType, const std::string &name, int line);
+  bool ParseType(GLSLType &type);
+  bool ParseArraySize(GLSLType &type);
+
+  GLSLStmt *ParseStatement();
+  GLSLStmt *ParseCompound();
+  GLSLStmt *ParseDeclaration();
+
+  GLSLExpr *ParseExpression();
+  GLSLExpr *ParseConditional();
+  GLSLExpr *ParseBinary(int minPrecedence);
+  GLSLExpr *ParseUnary();
+  GLSLExpr *ParsePostfix();
+  GLSLExpr *ParsePrimary();
+  bool ParseArguments(GLSLExpr *call);
+
+  const GLSLToken &Peek(int ahead = 0) const;
+  const GLSLToken &Previous() const;
+  GLSLToken Next();
+  bool IsOperator(const std::string &op, int ahead = 0) const;
+  bool IsIdentifier(const std::string &name, int ahead = 0) const;
+  bool Accept(const std::string &op);
+  bool Expect(const std::string &op);
+  bool Error(int line, const std::string &message);
+
+  std::vector<GLSLToken> m_tokens;
+  size_t m_pos;
+  GLSLShader *m_shader;
+  std::string m_error;
+};
@@ -0,0 +1,1260 @@
+#include "ShaderEmitter.h"
+
+#include <sstream>
+
+namespace
+{
+const int INDENT_WIDTH = 2;
+const int MAX_LINE_LENGTH = 100;
+
+// Precedence of expressions that never need brackets
+const int PRIMARY_PRECEDENCE = 100;
+const int UNARY_PRECEDENCE = 90;
+const int BINARY_PRECEDENCE = 10;
+const int CONDITIONAL_PRECEDENCE = 3;
+const int ASSIGN_PRECEDENCE = 2;
+
+// A variable that the rasteriser can supply, and how it converts to and from the GLSL type
+struct Binding
+{
+  const char *name;
+  const char *type;
+  const char *toGLSL;   // Expression giving the GLSL value
+  const char *fromGLSL; // Function converting the GLSL value back
+  const char *zero;     // Value when the shader doesn't write it
+};
+
+// Vertex attributes, from the VertexInput "in"
+const Binding ATTRIBUTES[] = {
+    {"position", "vec4", "glsl::vec4(in.position)", "", ""},
+    {"position", "vec3", "glsl::vec3(glsl::vec4(in.position))", "", ""},
+    {"texCoord", "vec2", "glsl::vec2(in.texCoord)", "", ""},
+    {"colour", "vec4", "glsl::FromColour(in.colour)", "", ""},
+    {"normal", "vec3", "glsl::vec3(in.normal)", "", ""}};
+
+// Variables passed from the vertex to the fragment shader, from the Varyings "in" or to "out"
+const Binding VARYINGS[] = {
+    {"colour", "vec4", "glsl::vec4(in.colour)", "glsl::ToVector4",
+     "Vector4(0.0f, 0.0f, 0.0f, 0.0f)"},
+    {"texCoord", "vec2", "glsl::vec2(in.texCoord)", "glsl::ToVector2", "Vector2(0.0f, 0.0f)"},
+    {"worldPos", "vec3", "glsl::vec3(in.worldPos)", "glsl::ToVector3",
+     "Vector3(0.0f, 0.0f, 0.0f)"},
+    {"normal", "vec3", "glsl::vec3(in.normal)", "glsl::ToVector3", "Vector3(0.0f, 0.0f, 0.0f)"}};
+
+// Built in functions implemented by GLSLTypes.h
+const char *const BUILT_INS[] = {
+    "abs",     "sign",        "floor", "ceil", "fract",     "sqrt",     "inversesqrt",
+    "exp",     "log",         "sin",   "cos",  "tan",       "pow",      "mod",
+    "step",    "mix",         "smoothstep", "min", "max",   "clamp",    "dot",
+    "cross",   "length",      "distance", "normalize", "reflect", "transpose", "inverse"};
+
+// Names that can't be used as they mean something else in the translated C++
+const char *const RESERVED[] = {
+    "io",       "in",        "out",      "state",     "matrices", "main",    "glsl",
+    "auto",     "case",      "catch",    "char",      "class",    "default", "delete",
+    "double",   "enum",      "explicit", "extern",    "friend",   "goto",    "inline",
+    "long",     "mutable",   "namespace", "new",      "operator", "private", "protected",
+    "public",   "register",  "short",    "signed",    "sizeof",   "static",  "switch",
+    "template", "this",      "throw",    "try",       "typedef",  "typename", "union",
+    "unsigned", "using",     "virtual",  "volatile",  "NULL",     "Colour",  "Vector2",
+    "Vector3",  "Vector4",   "Matrix4",  "Texture",   "DrawState", "Varyings", "VertexInput",
+    "Globals"};
+
+template <typename T, size_t N> size_t ArraySize(T (&)[N])
+{
+  return N;
+}
+
+bool Contains(const char *const *names, size_t count, const std::string &name)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (name == names[i])
+      return true;
+  }
+  return false;
+}
+
+const Binding *FindBinding(const Binding *bindings, size_t count, const std::string &name,
+                           const std::string &type)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (name == bindings[i].name && type == bindings[i].type)
+      return &bindings[i];
+  }
+  return NULL;
+}
+
+bool IsScalar(const std::string &type)
+{
+  return type == "float" || type == "int" || type == "bool" || type == "sampler2D";
+}
+
+std::string ScalarZero(const std::string &type)
+{
+  if (type == "float")
+    return "0.0f";
+  if (type == "int")
+    return "0";
+  if (type == "bool")
+    return "false";
+  return "NULL";
+}
+
+std::string Indentation(int indent)
+{
+  return std::string(indent * INDENT_WIDTH, ' ');
+}
+} // namespace
+
+ShaderEmitter::ShaderEmitter(void)
+    : m_shader(NULL)
+    , m_stage(STAGE_VERTEX)
+{
+}
+
+/**
+ * Translates a shader into a C++ functor.
+ *
+ * \param shader Parsed shader
+ * \param stage Whether it is a vertex or fragment shader
+ * \param structName Name of the functor
+ * \param sourceName Name of the file it came from, for the comment above the functor
+ * \param out Stream to write the functor to
+ * \return True if it was translated, false if not (see GetError)
+ */
+bool ShaderEmitter::Emit(const GLSLShader &shader, ShaderStage stage,
+                         const std::string &structName, const std::string &sourceName,
+                         std::ostream &out)
+{
+  m_shader = &shader;
+  m_stage = stage;
+  m_structName = structName;
+  m_fragmentOutput.clear();
+  m_scopes.clear();
+  m_error.clear();
+
+  if (!CheckGlobals())
+    return false;
+
+  // Translate the functions first, so nothing is written if any of them fail
+  std::stringstream functions;
+  for (size_t i = 0; i < shader.functions.size(); ++i)
+  {
+    functions << "\n";
+    if (!EmitFunction(shader.functions[i], functions))
+      return false;
+  }
+
+  out << "// Translated from " << sourceName << "\n";
+  out << "struct " << structName << "\n{\n";
+  EmitConstructor(out);
+  EmitCall(out);
+  EmitUniforms(out);
+  out << "protected:\n";
+  EmitGlobals(out);
+  out << functions.str();
+  out << "};\n";
+
+  return true;
+}
+
+/**
+ * Checks that the shader's uniforms, inputs and outputs are ones the rasteriser can supply.
+ *
+ * \return True if they are
+ */
+bool ShaderEmitter::CheckGlobals()
+{
+  const GLSLShader &s = *m_shader;
+  const bool vertex = m_stage == STAGE_VERTEX;
+
+  for (size_t i = 0; i < s.uniforms.size(); ++i)
+  {
+    const GLSLVariable &u = s.uniforms[i];
+    if (u.name == "modelMatrix" || u.name == "viewMatrix" || u.name == "projMatrix")
+    {
+      if (!vertex)
+        return Error(u.line, u.name + " is only available to vertex shaders");
+      if (u.type.name != "mat4" || u.type.arraySize != 0)
+        return Error(u.line, u.name + " must be a mat4");
+    }
+    else if (u.type.name == "void" || !CheckName(u.name, u.line))
+    {
+      return Error(u.line, "'" + u.name + "' can't be a uniform");
+    }
+  }
+
+  // Attributes
+  if (vertex)
+  {
+    if (!s.inBlocks.empty())
+      return Error(s.inBlocks[0].line, "vertex shaders can't have input blocks");
+
+    for (size_t i = 0; i < s.inputs.size(); ++i)
+    {
+      const GLSLVariable &v = s.inputs[i];
+      if (v.type.arraySize != 0 ||
+          !FindBinding(ATTRIBUTES, ArraySize(ATTRIBUTES), v.name, v.type.name))
+      {
+        return Error(v.line, "attributes must be vec3 or vec4 position, vec2 texCoord, vec4 "
+                             "colour or vec3 normal");
+      }
+    }
+  }
+
+  // Outputs of fragment shaders
+  if (!vertex)
+  {
+    if (!s.outBlocks.empty())
+      return Error(s.outBlocks[0].line, "fragment shaders can't have output blocks");
+
+    if (s.outputs.size() != 1 || s.outputs[0].type.name != "vec4" ||
+        s.outputs[0].type.arraySize != 0)
+    {
+      return Error(s.outputs.empty() ? 1 : s.outputs[0].line,
+                   "fragment shaders must have a single vec4 output");
+    }
+
+    m_fragmentOutput = s.outputs[0].name;
+    if (!CheckName(m_fragmentOutput, s.outputs[0].line))
+      return false;
+  }
+
+  // Variables passed from the vertex to the fragment shader
+  const std::vector<GLSLVariable> &plain = vertex ? s.outputs : s.inputs;
+  const std::vector<GLSLBlock> &blocks = vertex ? s.outBlocks : s.inBlocks;
+  std::vector<GLSLVariable> varyings(plain);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (!CheckName(blocks[i].instanceName, blocks[i].line) ||
+        !CheckName(blocks[i].blockName, blocks[i].line))
+    {
+      return false;
+    }
+    varyings.insert(varyings.end(), blocks[i].fields.begin(), blocks[i].fields.end());
+  }
+
+  for (size_t i = 0; i < varyings.size(); ++i)
+  {
+    const GLSLVariable &v = varyings[i];
+    if (v.type.arraySize != 0 ||
+        !FindBinding(VARYINGS, ArraySize(VARYINGS), v.name, v.type.name))
+    {
+      return Error(v.line, "variables passed between shaders must be vec2 texCoord, vec4 colour, "
+                           "vec3 worldPos or vec3 normal");
+    }
+
+    for (size_t j = 0; j < i; ++j)
+    {
+      if (varyings[j].name == v.name)
+        return Error(v.line, "'" + v.name + "' is declared twice");
+    }
+  }
+
+  // Functions
+  bool hasMain = false;
+  for (size_t i = 0; i < s.functions.size(); ++i)
+  {
+    const GLSLFunction &f = s.functions[i];
+    if (f.name == "main")
+    {
+      if (f.returnType.name != "void" || !f.params.empty())
+        return Error(f.line, "main must be void main(void)");
+      hasMain = true;
+    }
+    else if (!CheckName(f.name, f.line))
+    {
+      return false;
+    }
+
+    if (f.returnType.arraySize != 0)
+      return Error(f.line, "functions can't return arrays");
+  }
+
+  if (!hasMain)
+    return Error(1, "there's no main function");
+
+  return true;
+}
+
+/**
+ * Checks that a name doesn't clash with anything in the translated C++.
+ *
+ * \param name Name
+ * \param line Line it was declared on
+ * \return True if it can be used
+ */
+bool ShaderEmitter::CheckName(const std::string &name, int line)
+{
+  if (Contains(RESERVED, ArraySize(RESERVED), name) || name.compare(0, 3, "gl_") == 0 ||
+      name.find("__") != std::string::npos)
+  {
+    return Error(line, "'" + name + "' is reserved");
+  }
+  return true;
+}
+
+/**
+ * Writes the constructor, which zeroes the uniforms as OpenGL does. Vector and matrix uniforms are
+ * zeroed by their own constructors, so shaders with only those don't get one.
+ *
+ * \param out Stream to write to
+ */
+void ShaderEmitter::EmitConstructor(std::ostream &out)
+{
+  const std::vector<GLSLVariable> &uniforms = m_shader->uniforms;
+  std::vector<const GLSLVariable *> initialised;
+  std::vector<const GLSLVariable *> arrays;
+
+  for (size_t i = 0; i < uniforms.size(); ++i)
+  {
+    const GLSLVariable &u = uniforms[i];
+    if (!IsScalar(u.type.name) || u.name == "modelMatrix")
+      continue;
+
+    if (u.type.arraySize == 0)
+      initialised.push_back(&u);
+    else
+      arrays.push_back(&u);
+  }
+
+  if (initialised.empty() && arrays.empty())
+    return;
+
+  out << "  " << m_structName << "()";
+  for (size_t i = 0; i < initialised.size(); ++i)
+  {
+    out << (i == 0 ? "\n      : " : "\n      , ") << initialised[i]->name << "("
+        << ScalarZero(initialised[i]->type.name) << ")";
+  }
+  out << "\n  {\n";
+
+  for (size_t i = 0; i < arrays.size(); ++i)
+  {
+    out << "    for (int i = 0; i < " << arrays[i]->type.arraySize << "; ++i)\n";
+    out << "      " << arrays[i]->name << "[i] = " << ScalarZero(arrays[i]->type.name) << ";\n";
+  }
+  out << "  }\n\n";
+}
+
+/**
+ * Writes operator(), which the Shader template calls per vertex or fragment. It copies the
+ * rasteriser's inputs into the stage globals, runs main and copies the outputs back.
+ *
+ * \param out Stream to write to
+ */
+void ShaderEmitter::EmitCall(std::ostream &out)
+{
+  const GLSLShader &s = *m_shader;
+
+  if (m_stage == STAGE_VERTEX)
+  {
+    out << "  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices, "
+           "Varyings &out) const\n";
+    out << "  {\n";
+    out << "    Globals io(matrices);\n";
+
+    for (size_t i = 0; i < s.inputs.size(); ++i)
+    {
+      const GLSLVariable &v = s.inputs[i];
+      const Binding *b = FindBinding(ATTRIBUTES, ArraySize(ATTRIBUTES), v.name, v.type.name);
+      out << "    io." << v.name << " = " << b->toGLSL << ";\n";
+    }
+
+    out << "\n    main(io);\n\n";
+
+    for (size_t i = 0; i < ArraySize(VARYINGS); ++i)
+    {
+      const Binding &b = VARYINGS[i];
+      std::string value = b.zero;
+
+      if (FindVariable(s.outputs, b.name))
+        value = std::string(b.fromGLSL) + "(io." + b.name + ")";
+      for (size_t j = 0; j < s.outBlocks.size(); ++j)
+      {
+        if (FindVariable(s.outBlocks[j].fields, b.name))
+          value = std::string(b.fromGLSL) + "(io." + s.outBlocks[j].instanceName + "." + b.name +
+                  ")";
+      }
+
+      out << "    out." << b.name << " = " << value << ";\n";
+    }
+
+    out << "\n    return glsl::ToVector4(io.gl_Position);\n";
+    out << "  }\n\n";
+  }
+  else
+  {
+    out << "  Colour operator()(const Varyings &in, const DrawState &state) const\n";
+    out << "  {\n";
+    out << "    Globals io(state);\n";
+
+    for (size_t i = 0; i < ArraySize(VARYINGS); ++i)
+    {
+      const Binding &b = VARYINGS[i];
+      if (FindVariable(s.inputs, b.name))
+        out << "    io." << b.name << " = " << b.toGLSL << ";\n";
+      for (size_t j = 0; j < s.inBlocks.size(); ++j)
+      {
+        if (FindVariable(s.inBlocks[j].fields, b.name))
+          out << "    io." << s.inBlocks[j].instanceName << "." << b.name << " = " << b.toGLSL
+              << ";\n";
+      }
+    }
+
+    out << "\n    main(io);\n\n";
+    out << "    return glsl::ToColour(io." << m_fragmentOutput << ");\n";
+    out << "  }\n\n";
+  }
+}
+
+/**
+ * Writes the uniforms as public members, apart from the matrices the rasteriser supplies.
+ *
+ * \param out Stream to write to
+ */
+void ShaderEmitter::EmitUniforms(std::ostream &out)
+{
+  bool any = false;
+
+  for (size_t i = 0; i < m_shader->uniforms.size(); ++i)
+  {
+    const GLSLVariable &u = m_shader->uniforms[i];
+    if (u.name == "modelMatrix" || u.name == "viewMatrix" || u.name == "projMatrix")
+      continue;
+
+    out << "  " << TypeName(u.type.name) << " " << u.name;
+    if (u.type.arraySize != 0)
+      out << "[" << u.type.arraySize << "]";
+    out << ";\n";
+    any = true;
+  }
+
+  if (any)
+    out << "\n";
+}
+
+/**
+ * Writes the Globals struct, which holds the stage globals of one invocation of the shader.
+ *
+ * \param out Stream to write to
+ */
+void ShaderEmitter::EmitGlobals(std::ostream &out)
+{
+  const GLSLShader &s = *m_shader;
+  const bool vertex = m_stage == STAGE_VERTEX;
+
+  out << "  struct Globals\n  {\n";
+  if (vertex)
+  {
+    out << "    Globals(const ShaderMatrices &matrices)\n";
+    out << "        : modelMatrix(glsl::AsMat4(matrices.modelMatrix))\n";
+    out << "        , viewProjMatrix(glsl::AsMat4(matrices.viewProjMatrix))\n";
+  }
+  else
+  {
+    out << "    Globals(const DrawState &state)\n";
+    out << "        : state(state)\n";
+  }
+  out << "    {\n    }\n\n";
+
+  for (size_t i = 0; i < s.inputs.size(); ++i)
+    out << "    " << TypeName(s.inputs[i].type.name) << " " << s.inputs[i].name << ";\n";
+  for (size_t i = 0; i < s.outputs.size(); ++i)
+    out << "    " << TypeName(s.outputs[i].type.name) << " " << s.outputs[i].name << ";\n";
+
+  const std::vector<GLSLBlock> &blocks = vertex ? s.outBlocks : s.inBlocks;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    out << "    struct " << blocks[i].blockName << "\n    {\n";
+    for (size_t j = 0; j < blocks[i].fields.size(); ++j)
+    {
+      const GLSLVariable &f = blocks[i].fields[j];
+      out << "      " << TypeName(f.type.name) << " " << f.name << ";\n";
+    }
+    out << "    } " << blocks[i].instanceName << ";\n";
+  }
+
+  if (vertex)
+  {
+    out << "    glsl::vec4 gl_Position;\n";
+    out << "    const glsl::mat4 &modelMatrix;\n";
+    out << "    const glsl::mat4 &viewProjMatrix;\n";
+  }
+  else
+  {
+    out << "    const DrawState &state;\n";
+  }
+  out << "  };\n";
+}
+
+/**
+ * Writes a function as a const member function, with the stage globals as its first parameter.
+ *
+ * \param f Function
+ * \param out Stream to write to
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitFunction(const GLSLFunction &f, std::ostream &out)
+{
+  std::string signature = TypeName(f.returnType.name) + " " + f.name + "(Globals &io";
+
+  m_scopes.clear();
+  m_scopes.push_back(std::vector<std::string>());
+
+  for (size_t i = 0; i < f.params.size(); ++i)
+  {
+    const GLSLVariable &p = f.params[i];
+    if (!CheckName(p.name, p.line))
+      return false;
+
+    const bool reference = p.qualifier == "out" || p.qualifier == "inout";
+    signature += ", " + TypeName(p.type.name) + (reference ? " &" : " ") + p.name;
+    m_scopes.back().push_back(p.name);
+  }
+  signature += ") const";
+
+  WriteLine(1, signature, out);
+  if (!EmitBody(f.body, 1, out))
+    return false;
+
+  m_scopes.clear();
+  return true;
+}
+
+/**
+ * Writes a statement.
+ *
+ * \param s Statement
+ * \param indent Indentation level
+ * \param prefix Written before the statement on its first line (for "else ")
+ * \param out Stream to write to
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitStatement(const GLSLStmt *s, int indent, const std::string &prefix,
+                                  std::ostream &out)
+{
+  std::string text;
+
+  switch (s->kind)
+  {
+  case GLSLStmt::BLOCK:
+    if (!prefix.empty())
+      WriteLine(indent, prefix.substr(0, prefix.size() - 1), out);
+    return EmitBody(s, indent, out);
+
+  case GLSLStmt::DECLARATION:
+    if (!EmitDeclaration(s, text))
+      return false;
+    WriteLine(indent, prefix + text + ";", out);
+    return true;
+
+  case GLSLStmt::EXPRESSION:
+    if (!EmitSwizzleAssignment(s->expr, text) || (text.empty() && !EmitExpr(s->expr, text)))
+      return false;
+    WriteLine(indent, prefix + text + ";", out);
+    return true;
+
+  case GLSLStmt::IF:
+  {
+    if (!EmitExpr(s->expr, text))
+      return false;
+    WriteLine(indent, prefix + "if (" + text + ")", out);
+
+    if (!EmitBody(s->body[0], indent, out))
+      return false;
+
+    if (s->body.size() < 2)
+      return true;
+
+    const GLSLStmt *otherwise = s->body[1];
+    if (otherwise->kind == GLSLStmt::IF)
+      return EmitStatement(otherwise, indent, "else ", out);
+
+    WriteLine(indent, "else", out);
+    return EmitBody(otherwise, indent, out);
+  }
+
+  case GLSLStmt::FOR:
+  {
+    m_scopes.push_back(std::vector<std::string>());
+
+    std::string init, condition, step;
+    const GLSLStmt *initStmt = s->body[0];
+    if (initStmt)
+    {
+      const bool ok = initStmt->kind == GLSLStmt::DECLARATION ? EmitDeclaration(initStmt, init)
+                                                             : EmitExpr(initStmt->expr, init);
+      if (!ok)
+        return false;
+    }
+    if ((s->expr && !EmitExpr(s->expr, condition)) || (s->step && !EmitExpr(s->step, step)))
+      return false;
+
+    WriteLine(indent, prefix + "for (" + init + "; " + condition + "; " + step + ")", out);
+    if (!EmitBody(s->body[1], indent, out))
+      return false;
+
+    m_scopes.pop_back();
+    return true;
+  }
+
+  case GLSLStmt::WHILE:
+    if (!EmitExpr(s->expr, text))
+      return false;
+    WriteLine(indent, prefix + "while (" + text + ")", out);
+    return EmitBody(s->body[0], indent, out);
+
+  case GLSLStmt::RETURN:
+    if (s->expr && !EmitExpr(s->expr, text))
+      return false;
+    WriteLine(indent, prefix + (s->expr ? "return " + text : "return") + ";", out);
+    return true;
+
+  case GLSLStmt::BREAK:
+    WriteLine(indent, prefix + "break;", out);
+    return true;
+
+  case GLSLStmt::CONTINUE:
+    WriteLine(indent, prefix + "continue;", out);
+    return true;
+  }
+
+  return Error(s->line, "unknown statement");
+}
+
+/**
+ * Writes the body of a function, if or loop. Blocks are written in braces, with their own scope,
+ * and single statements indented without them.
+ *
+ * \param s Body
+ * \param indent Indentation level of the function or statement it belongs to
+ * \param out Stream to write to
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitBody(const GLSLStmt *s, int indent, std::ostream &out)
+{
+  if (s->kind != GLSLStmt::BLOCK)
+  {
+    m_scopes.push_back(std::vector<std::string>());
+    const bool ok = EmitStatement(s, indent + 1, "", out);
+    m_scopes.pop_back();
+    return ok;
+  }
+
+  WriteLine(indent, "{", out);
+  m_scopes.push_back(std::vector<std::string>());
+
+  for (size_t i = 0; i < s->body.size(); ++i)
+  {
+    const GLSLStmt *child = s->body[i];
+
+    // Keep the blank lines between statements, though not the comments
+    if (i > 0 && child->line > s->body[i - 1]->endLine + 1)
+      out << "\n";
+
+    if (!EmitStatement(child, indent + 1, "", out))
+      return false;
+  }
+
+  m_scopes.pop_back();
+  WriteLine(indent, "}", out);
+  return true;
+}
+
+/**
+ * Translates the declaration of a local variable, and adds it to the current scope.
+ *
+ * \param s Declaration
+ * \param out Receives the declaration, without a semicolon
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitDeclaration(const GLSLStmt *s, std::string &out)
+{
+  if (!CheckName(s->name, s->line))
+    return false;
+  if (s->type.name == "void" || s->type.name == "sampler2D")
+    return Error(s->line, "local variables can't be " + s->type.name);
+
+  std::string init;
+  if (s->expr && !EmitExpr(s->expr, init))
+    return false;
+
+  out = (s->isConst ? "const " : "") + TypeName(s->type.name) + " " + s->name;
+  if (s->type.arraySize != 0)
+  {
+    std::stringstream size;
+    size << "[" << s->type.arraySize << "]";
+    out += size.str();
+  }
+  if (s->expr)
+    out += " = " + init;
+
+  // Added after the initialiser, which can't see the variable it initialises
+  m_scopes.back().push_back(s->name);
+  return true;
+}
+
+/**
+ * Translates an assignment to a swizzle of more than one component, such as "v.rgb = c", which
+ * becomes a call to AssignSwizzle. These are only supported as statements, as the calls have no
+ * result.
+ *
+ * \param e Expression of an expression statement
+ * \param out Receives the call, or is left empty if the expression isn't a swizzle assignment
+ * \return True unless there was an error
+ */
+bool ShaderEmitter::EmitSwizzleAssignment(const GLSLExpr *e, std::string &out)
+{
+  out.clear();
+
+  if (e->kind != GLSLExpr::ASSIGN)
+    return true;
+
+  const GLSLExpr *target = e->args[0];
+  std::string indices;
+  if (!IsSwizzle(target, indices) || target->text.size() < 2)
+    return true;
+
+  for (size_t i = 0; i < target->text.size(); ++i)
+  {
+    if (target->text.find(target->text[i], i + 1) != std::string::npos)
+      return Error(e->line, "swizzles assigned to can't repeat components");
+  }
+
+  std::string object, value;
+  if (!EmitOperand(target->args[0], PRIMARY_PRECEDENCE, false, object) ||
+      !EmitExpr(e->args[1], value))
+  {
+    return false;
+  }
+
+  std::stringstream size;
+  size << target->text.size();
+
+  if (e->text != "=")
+  {
+    std::string operand;
+    if (!EmitOperand(e->args[1], BINARY_PRECEDENCE + GLSLParser::BinaryPrecedence("*"), true,
+                     operand))
+    {
+      return false;
+    }
+    value = "glsl::Swizzle" + size.str() + "<" + indices + ">(" + object + ") " +
+            e->text.substr(0, 1) + " " + operand;
+  }
+
+  out = "glsl::AssignSwizzle" + size.str() + "<" + indices + ">(" + object + ", " + value + ")";
+  return true;
+}
+
+/**
+ * Translates an expression.
+ *
+ * \param e Expression
+ * \param out Receives the C++ expression
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitExpr(const GLSLExpr *e, std::string &out)
+{
+  std::string a, b, c;
+  const int precedence = Precedence(e);
+
+  switch (e->kind)
+  {
+  case GLSLExpr::LITERAL:
+    out = e->text;
+    return true;
+
+  case GLSLExpr::IDENTIFIER:
+    return EmitName(e, out);
+
+  case GLSLExpr::CALL:
+    return EmitCallExpr(e, out);
+
+  case GLSLExpr::MEMBER:
+    return EmitMember(e, out);
+
+  case GLSLExpr::INDEX:
+    if (!EmitOperand(e->args[0], precedence, false, a) || !EmitExpr(e->args[1], b))
+      return false;
+    out = a + "[" + b + "]";
+    return true;
+
+  case GLSLExpr::UNARY:
+    if (!EmitOperand(e->args[0], e->args[0]->kind == GLSLExpr::UNARY ? PRIMARY_PRECEDENCE
+                                                                       : precedence,
+                     true, a))
+    {
+      return false;
+    }
+    out = e->text + a;
+    return true;
+
+  case GLSLExpr::POSTFIX:
+    if (!EmitOperand(e->args[0], precedence, false, a))
+      return false;
+    out = a + e->text;
+    return true;
+
+  case GLSLExpr::BINARY:
+    if (IsViewProjection(e))
+    {
+      out = "io.viewProjMatrix";
+      return true;
+    }
+    if (!EmitOperand(e->args[0], precedence, false, a) ||
+        !EmitOperand(e->args[1], precedence, true, b))
+    {
+      return false;
+    }
+    out = a + " " + e->text + " " + b;
+    return true;
+
+  case GLSLExpr::CONDITIONAL:
+    // Binary conditions are bracketed too, so they stand out from the results
+    if (!EmitOperand(e->args[0], e->args[0]->kind == GLSLExpr::BINARY ? PRIMARY_PRECEDENCE
+                                                                        : precedence + 1,
+                     false, a) ||
+        !EmitOperand(e->args[1], precedence + 1, false, b) ||
+        !EmitOperand(e->args[2], precedence + 1, false, c))
+    {
+      return false;
+    }
+    out = a + " ? " + b + " : " + c;
+    return true;
+
+  case GLSLExpr::ASSIGN:
+  {
+    const GLSLExpr *target = e->args[0];
+    std::string indices;
+    if (IsSwizzle(target, indices) && target->text.size() > 1)
+      return Error(e->line, "assignments to swizzles must be statements of their own");
+
+    if (!EmitExpr(target, a) || !EmitOperand(e->args[1], precedence, true, b))
+      return false;
+    out = a + " " + e->text + " " + b;
+    return true;
+  }
+  }
+
+  return Error(e->line, "unknown expression");
+}
+
+/**
+ * Translates an operand of an operator, in brackets if it needs them. Binary operands get brackets
+ * when they're a different operator, even if C++ doesn't need them, so a + (b * c) reads clearly.
+ *
+ * \param e Operand
+ * \param precedence Precedence of the operator it belongs to
+ * \param right True if it is the right hand operand
+ * \param out Receives the C++ expression
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitOperand(const GLSLExpr *e, int precedence, bool right, std::string &out)
+{
+  if (!EmitExpr(e, out))
+    return false;
+
+  const int own = Precedence(e);
+  const bool binaryInBinary = e->kind == GLSLExpr::BINARY && precedence >= BINARY_PRECEDENCE &&
+                              precedence < UNARY_PRECEDENCE && own != precedence;
+
+  if (own < precedence || (own == precedence && right && own != PRIMARY_PRECEDENCE &&
+                           e->kind != GLSLExpr::ASSIGN) ||
+      binaryInBinary)
+  {
+    // The folded view projection matrix is a name, so never needs them
+    if (!IsViewProjection(e))
+      out = "(" + out + ")";
+  }
+  return true;
+}
+
+/**
+ * Translates a name, which is a local variable, a uniform (a member of the functor) or a stage
+ * global (a member of Globals).
+ *
+ * \param e Identifier
+ * \param out Receives the C++ expression
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitName(const GLSLExpr *e, std::string &out)
+{
+  const std::string &name = e->text;
+  const GLSLShader &s = *m_shader;
+
+  if (IsLocal(name))
+  {
+    out = name;
+    return true;
+  }
+
+  if (name == "viewMatrix" || name == "projMatrix")
+  {
+    return Error(e->line, name + " is only supported as part of projMatrix * viewMatrix, which is "
+                                 "the draw's view projection matrix");
+  }
+
+  if (name == "modelMatrix" && FindVariable(s.uniforms, name))
+  {
+    out = "io.modelMatrix";
+    return true;
+  }
+
+  if (FindVariable(s.uniforms, name))
+  {
+    out = name;
+    return true;
+  }
+
+  if ((m_stage == STAGE_VERTEX && name == "gl_Position") || FindVariable(s.inputs, name) ||
+      FindVariable(s.outputs, name))
+  {
+    out = "io." + name;
+    return true;
+  }
+
+  if (FindBlock(name))
+    return Error(e->line, "interface blocks can only be used to access their members");
+
+  return Error(e->line, "'" + name + "' isn't declared or isn't supported");
+}
+
+/**
+ * Translates a member access, which is either a member of an interface block or a swizzle.
+ *
+ * \param e Member access
+ * \param out Receives the C++ expression
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitMember(const GLSLExpr *e, std::string &out)
+{
+  const GLSLExpr *object = e->args[0];
+  const GLSLBlock *block = MemberBlock(e);
+
+  if (block)
+  {
+    if (!FindVariable(block->fields, e->text))
+      return Error(e->line, "'" + e->text + "' isn't a member of " + block->blockName);
+    out = "io." + object->text + "." + e->text;
+    return true;
+  }
+
+  std::string indices, operand;
+  if (!IsSwizzle(e, indices))
+    return Error(e->line, "'" + e->text + "' isn't a swizzle");
+  if (!EmitOperand(object, PRIMARY_PRECEDENCE, false, operand))
+    return false;
+
+  if (e->text.size() == 1)
+  {
+    out = operand + "." + "xyzw"[indices[0] - '0'];
+    return true;
+  }
+
+  std::stringstream size;
+  size << e->text.size();
+  out = "glsl::Swizzle" + size.str() + "<" + indices + ">(" + operand + ")";
+  return true;
+}
+
+/**
+ * Translates a call to a built in or user function, or a constructor.
+ *
+ * \param e Call
+ * \param out Receives the C++ expression
+ * \return True if it was translated
+ */
+bool ShaderEmitter::EmitCallExpr(const GLSLExpr *e, std::string &out)
+{
+  const std::string &name = e->text;
+  std::vector<std::string> args(e->args.size());
+
+  for (size_t i = 0; i < e->args.size(); ++i)
+  {
+    if (!EmitExpr(e->args[i], args[i]))
+      return false;
+  }
+
+  std::string function;
+  if (IsFunction(name))
+  {
+    function = name;
+    args.insert(args.begin(), "io");
+  }
+  else if (name == "texture")
+  {
+    if (m_stage != STAGE_FRAGMENT)
+      return Error(e->line, "textures can only be sampled by fragment shaders");
+    if (args.size() != 2)
+      return Error(e->line, "texture takes a sampler and texture coordinates");
+
+    function = "glsl::texture";
+    args.insert(args.begin(), "io.state");
+  }
+  else if (name == "min" || name == "max" || name == "clamp")
+  {
+    // Bracketed, as these are macros in Common.h
+    function = "(glsl::" + name + ")";
+  }
+  else if (Contains(BUILT_INS, ArraySize(BUILT_INS), name))
+  {
+    function = "glsl::" + name;
+  }
+  else if (name == "float" || name == "int" || name == "bool")
+  {
+    if (args.size() != 1)
+      return Error(e->line, name + " constructors take one argument");
+    function = name;
+  }
+  else if (GLSLParser::IsTypeName(name) && name != "void" && name != "sampler2D")
+  {
+    function = TypeName(name);
+  }
+  else
+  {
+    return Error(e->line, "'" + name + "' isn't a function or isn't supported");
+  }
+
+  out = function + "(";
+  for (size_t i = 0; i < args.size(); ++i)
+    out += (i == 0 ? "" : ", ") + args[i];
+  out += ")";
+  return true;
+}
+
+/**
+ * Gets the precedence of a translated expression, higher binding tighter.
+ *
+ * \param e Expression
+ * \return Precedence
+ */
+int ShaderEmitter::Precedence(const GLSLExpr *e)
+{
+  switch (e->kind)
+  {
+  case GLSLExpr::UNARY:
+    return UNARY_PRECEDENCE;
+  case GLSLExpr::BINARY:
+    return BINARY_PRECEDENCE + GLSLParser::BinaryPrecedence(e->text);
+  case GLSLExpr::CONDITIONAL:
+    return CONDITIONAL_PRECEDENCE;
+  case GLSLExpr::ASSIGN:
+    return ASSIGN_PRECEDENCE;
+  default:
+    return PRIMARY_PRECEDENCE;
+  }
+}
+
+/**
+ * Gets the C++ type of a GLSL type.
+ *
+ * \param glslType Name of the GLSL type
+ * \return Name of the C++ type
+ */
+std::string ShaderEmitter::TypeName(const std::string &glslType)
+{
+  if (glslType == "float" || glslType == "int" || glslType == "bool" || glslType == "void")
+    return glslType;
+  return "glsl::" + glslType;
+}
+
+/**
+ * Converts the components of a swizzle to indices.
+ *
+ * \param components Components, such as "xyz", "rgb" or "st"
+ * \param indices Receives the indices, such as "0, 1, 2"
+ * \return True if it is a valid swizzle
+ */
+bool ShaderEmitter::Swizzle(const std::string &components, std::string &indices)
+{
+  const char *const SETS[] = {"xyzw", "rgba", "stpq"};
+
+  if (components.empty() || components.size() > 4)
+    return false;
+
+  for (size_t set = 0; set < ArraySize(SETS); ++set)
+  {
+    const std::string names = SETS[set];
+    indices.clear();
+
+    size_t i = 0;
+    for (; i < components.size(); ++i)
+    {
+      const size_t index = names.find(components[i]);
+      if (index == std::string::npos)
+        break;
+
+      if (i > 0)
+        indices += ", ";
+      indices += (char)('0' + index);
+    }
+
+    if (i == components.size())
+      return true;
+  }
+
+  return false;
+}
+
+const GLSLBlock *ShaderEmitter::FindBlock(const std::string &instanceName) const
+{
+  const std::vector<GLSLBlock> &blocks =
+      m_stage == STAGE_VERTEX ? m_shader->outBlocks : m_shader->inBlocks;
+
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (blocks[i].instanceName == instanceName)
+      return &blocks[i];
+  }
+  return NULL;
+}
+
+const GLSLVariable *ShaderEmitter::FindVariable(const std::vector<GLSLVariable> &vars,
+                                                const std::string &name) const
+{
+  for (size_t i = 0; i < vars.size(); ++i)
+  {
+    if (vars[i].name == name)
+      return &vars[i];
+  }
+  return NULL;
+}
+
+/**
+ * Gets the interface block a member access is to.
+ *
+ * \param e Member access
+ * \return The block, or NULL if it isn't to one
+ */
+const GLSLBlock *ShaderEmitter::MemberBlock(const GLSLExpr *e) const
+{
+  const GLSLExpr *object = e->args[0];
+  if (object->kind != GLSLExpr::IDENTIFIER || IsLocal(object->text))
+    return NULL;
+  return FindBlock(object->text);
+}
+
+/**
+ * Checks if an expression is a swizzle.
+ *
+ * \param e Expression
+ * \param indices Receives the indices of its components
+ * \return True if it is a swizzle
+ */
+bool ShaderEmitter::IsSwizzle(const GLSLExpr *e, std::string &indices) const
+{
+  return e->kind == GLSLExpr::MEMBER && !MemberBlock(e) && Swizzle(e->text, indices);
+}
+
+bool ShaderEmitter::IsLocal(const std::string &name) const
+{
+  for (size_t i = 0; i < m_scopes.size(); ++i)
+  {
+    for (size_t j = 0; j < m_scopes[i].size(); ++j)
+    {
+      if (m_scopes[i][j] == name)
+        return true;
+    }
+  }
+  return false;
+}
+
+bool ShaderEmitter::IsFunction(const std::string &name) const
+{
+  for (size_t i = 0; i < m_shader->functions.size(); ++i)
+  {
+    if (m_shader->functions[i].name == name)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Checks if an expression is projMatrix * viewMatrix, which is translated to the draw's view
+ * projection matrix. As * is left associative, this is found in projMatrix * viewMatrix *
+ * modelMatrix * v too.
+ *
+ * \param e Expression
+ * \return True if it is the view projection matrix
+ */
+bool ShaderEmitter::IsViewProjection(const GLSLExpr *e) const
+{
+  if (m_stage != STAGE_VERTEX || e->kind != GLSLExpr::BINARY || e->text != "*")
+    return false;
+
+  const GLSLExpr *a = e->args[0];
+  const GLSLExpr *b = e->args[1];
+  return a->kind == GLSLExpr::IDENTIFIER && a->text == "projMatrix" && !IsLocal(a->text) &&
+         b->kind == GLSLExpr::IDENTIFIER && b->text == "viewMatrix" && !IsLocal(b->text) &&
+         FindVariable(m_shader->uniforms, "projMatrix") &&
+         FindVariable(m_shader->uniforms, "viewMatrix");
+}
+
+/**
+ * Writes a line of code, wrapping it if it is too long. Lines are broken after a comma or binary
+ * operator, as clang-format does, but not inside the arguments of a swizzle's template.
+ *
+ * \param indent Indentation level
+ * \param line Code to write
+ * \param out Stream to write to
+ */
+void ShaderEmitter::WriteLine(int indent, const std::string &line, std::ostream &out)
+{
+  std::string text = Indentation(indent) + line;
+  const std::string continuation = Indentation(indent + 2);
+
+  while ((int)text.size() > MAX_LINE_LENGTH)
+  {
+    size_t split = std::string::npos;
+    bool inTemplate = false;
+
+    for (size_t i = continuation.size(); i < (size_t)MAX_LINE_LENGTH && i + 1 < text.size(); ++i)
+    {
+      if (text[i] == '<' && i >= 8 && text.compare(i - 8, 7, "Swizzle") == 0)
+        inTemplate = true;
+      else if (text[i] == '>' && inTemplate)
+        inTemplate = false;
+
+      if (inTemplate || text[i] != ' ')
+        continue;
+
+      const char previous = text[i - 1];
+      if (previous == ',' ||
+          (text[i - 2] == ' ' && (previous == '+' || previous == '-' || previous == '*' ||
+                                  previous == '/' || previous == '?' || previous == ':')))
+      {
+        split = i;
+      }
+    }
+
+    if (split == std::string::npos)
+      break;
+
+    out << text.substr(0, split) << "\n";
+    text = continuation + text.substr(split + 1);
+  }
+
+  out << text << "\n";
+}
+
+/**
+ * Records an error, keeping the first if there are several.
+ *
+ * \param line Line of the shader it was found on
+ * \param message Description of the error
+ * \return False, so it can be returned by the caller
+ */
+bool ShaderEmitter::Error(int line, const std::string &message)
+{
+  if (m_error.empty())
+  {
+    std::stringstream s;
+    s << "line " << line << ": " << message;
+    m_error = s.str();
+  }
+  return false;
+}
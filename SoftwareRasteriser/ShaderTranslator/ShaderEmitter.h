@@ -0,0 +1,98 @@
+/******************************************************************************
+Class:ShaderEmitter
+Implements:
+Description: Translates a parsed GLSL vertex or fragment shader into a C++
+shader functor, which can be used with the Shader template (see Shader.h in
+the rasteriser).
+
+Each shader becomes a struct with the shader's uniforms as public members
+and an operator() that the rasteriser calls per vertex or per fragment. The
+shader's stage globals (attributes, in and out variables, gl_Position and so
+on) are kept in a Globals struct, which the translated functions take as
+their first argument, so the functor itself stays const and can be called by
+several threads at once.
+
+The rasteriser supplies what the OpenGL renderer sets for every draw: in
+vertex shaders modelMatrix is the draw's model matrix, and projMatrix *
+viewMatrix is its view projection matrix (the two aren't available
+separately). Samplers left NULL sample the draw's texture.
+
+Attributes must be called position, texCoord, colour or normal, and the
+variables passed from the vertex to the fragment shader texCoord, colour,
+worldPos or normal, as those are all the rasteriser has (see Varyings).
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GLSLParser.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum ShaderStage
+{
+  STAGE_VERTEX,
+  STAGE_FRAGMENT
+};
+
+class ShaderEmitter
+{
+public:
+  ShaderEmitter(void);
+
+  // Writes the functor translated from a shader, returning false (with the reason in GetError) if
+  // it can't be translated
+  bool Emit(const GLSLShader &shader, ShaderStage stage, const std::string &structName,
+            const std::string &sourceName, std::ostream &out);
+
+  const std::string &GetError() const
+  {
+    return m_error;
+  }
+
+protected:
+  bool CheckGlobals();
+  bool CheckName(const std::string &name, int line);
+
+  void EmitConstructor(std::ostream &out);
+  void EmitCall(std::ostream &out);
+  void EmitUniforms(std::ostream &out);
+  void EmitGlobals(std::ostream &out);
+  bool EmitFunction(const GLSLFunction &f, std::ostream &out);
+
+  bool EmitStatement(const GLSLStmt *s, int indent, const std::string &prefix, std::ostream &out);
+  bool EmitBody(const GLSLStmt *s, int indent, std::ostream &out);
+  bool EmitDeclaration(const GLSLStmt *s, std::string &out);
+  bool EmitSwizzleAssignment(const GLSLExpr *e, std::string &out);
+
+  bool EmitExpr(const GLSLExpr *e, std::string &out);
+  bool EmitOperand(const GLSLExpr *e, int precedence, bool right, std::string &out);
+  bool EmitName(const GLSLExpr *e, std::string &out);
+  bool EmitMember(const GLSLExpr *e, std::string &out);
+  bool EmitCallExpr(const GLSLExpr *e, std::string &out);
+
+  static int Precedence(const GLSLExpr *e);
+  static std::string TypeName(const std::string &glslType);
+  static bool Swizzle(const std::string &components, std::string &indices);
+
+  const GLSLBlock *FindBlock(const std::string &instanceName) const;
+  const GLSLVariable *FindVariable(const std::vector<GLSLVariable> &vars,
+                                   const std::string &name) const;
+  const GLSLBlock *MemberBlock(const GLSLExpr *e) const;
+  bool IsSwizzle(const GLSLExpr *e, std::string &indices) const;
+  bool IsLocal(const std::string &name) const;
+  bool IsFunction(const std::string &name) const;
+  bool IsViewProjection(const GLSLExpr *e) const;
+
+  void WriteLine(int indent, const std::string &line, std::ostream &out);
+  bool Error(int line, const std::string &message);
+
+  const GLSLShader *m_shader;
+  ShaderStage m_stage;
+  std::string m_structName;
+  std::string m_fragmentOutput;
+  std::vector<std::vector<std::string>> m_scopes;
+  std::string m_error;
+};
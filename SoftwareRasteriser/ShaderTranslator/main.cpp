@@ -0,0 +1,179 @@
+/******************************************************************************
+Description: Translates GLSL vertex and fragment shaders into a header of C++
+shader functors for the software rasteriser, so it can run the shaders
+written for the OpenGL renderer.
+
+Usage: ShaderTranslator <output header> <shader.glsl>...
+
+Each shader's stage comes from its file name, which must end in _vertex or
+_fragment (before the extension), and its functor is named after the file:
+lighting_fragment.glsl becomes LightingFragment.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#include "GLSLParser.h"
+#include "ShaderEmitter.h"
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+const size_t MAX_COMMENT_LENGTH = 80;
+
+// Strips the directory and extension from a path
+std::string FileName(const std::string &path, bool keepExtension)
+{
+  const size_t slash = path.find_last_of("/\\");
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+  if (!keepExtension)
+  {
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos)
+      name = name.substr(0, dot);
+  }
+  return name;
+}
+
+bool EndsWith(const std::string &s, const std::string &suffix)
+{
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Converts a file name such as lighting_fragment to a struct name such as LightingFragment
+std::string StructName(const std::string &name)
+{
+  std::string result;
+  bool upper = true;
+
+  for (size_t i = 0; i < name.size(); ++i)
+  {
+    const char c = name[i];
+    if (!isalnum((unsigned char)c))
+    {
+      upper = true;
+      continue;
+    }
+
+    result += upper ? (char)toupper((unsigned char)c) : c;
+    upper = false;
+  }
+
+  if (result.empty() || isdigit((unsigned char)result[0]))
+    result = "Shader" + result;
+  return result;
+}
+
+bool ReadFile(const std::string &path, std::string &out)
+{
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file)
+    return false;
+
+  std::stringstream s;
+  s << file.rdbuf();
+  out = s.str();
+  return true;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: ShaderTranslator <output header> <shader.glsl>..." << std::endl;
+    return 1;
+  }
+
+  // The command, wrapped to fit in the comment at the top of the header
+  std::string command = "  ShaderTranslator " + FileName(argv[1], true);
+  size_t lineStart = 0;
+  for (int i = 2; i < argc; ++i)
+  {
+    const std::string file = FileName(argv[i], true);
+    if (command.size() - lineStart + file.size() + 1 > MAX_COMMENT_LENGTH)
+    {
+      command += " \\\n   ";
+      lineStart = command.size() - 3;
+    }
+    command += " " + file;
+  }
+
+  std::stringstream out;
+  out << "/******************************************************************************\n";
+  out << "Description: Shaders translated from GLSL by the ShaderTranslator tool. Don't\n";
+  out << "edit this file, edit the shaders, which are translated again before each\n";
+  out << "build with:\n\n";
+  out << command << "\n\n";
+  out << "*/ /////////////////////////////////////////////////////////////////////////////\n\n";
+  out << "#pragma once\n\n";
+  out << "#include \"GLSLTypes.h\"\n";
+  out << "#include \"Shader.h\"\n";
+
+  for (int i = 2; i < argc; ++i)
+  {
+    const std::string path = argv[i];
+    const std::string name = FileName(path, false);
+
+    ShaderStage stage;
+    if (EndsWith(name, "_vertex"))
+    {
+      stage = STAGE_VERTEX;
+    }
+    else if (EndsWith(name, "_fragment"))
+    {
+      stage = STAGE_FRAGMENT;
+    }
+    else
+    {
+      std::cerr << path << ": only vertex and fragment shaders (named *_vertex.glsl or "
+                           "*_fragment.glsl) are supported"
+                << std::endl;
+      return 1;
+    }
+
+    std::string source;
+    if (!ReadFile(path, source))
+    {
+      std::cerr << path << ": couldn't be read" << std::endl;
+      return 1;
+    }
+
+    GLSLShader shader;
+    GLSLParser parser;
+    if (!parser.Parse(source, shader))
+    {
+      std::cerr << path << ": " << parser.GetError() << std::endl;
+      return 1;
+    }
+
+    ShaderEmitter emitter;
+    out << "\n";
+    if (!emitter.Emit(shader, stage, StructName(name), FileName(path, true), out))
+    {
+      std::cerr << path << ": " << emitter.GetError() << std::endl;
+      return 1;
+    }
+  }
+
+  // Only written once everything has been translated, so a failure leaves the old header intact,
+  // and only if it has changed, so it doesn't make everything that includes it build again
+  std::string previous;
+  if (ReadFile(argv[1], previous) && previous == out.str())
+    return 0;
+
+  std::ofstream file(argv[1], std::ios::binary);
+  file << out.str();
+  if (!file)
+  {
+    std::cerr << argv[1] << ": couldn't be written" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,707 @@
+#include "Benchmark.h"
+
+#include "GameTimer.h"
+#include "JobSystem.h"
+#include "SceneGenerators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// Seed for the scene generators, so every run renders the same scenes
+static const unsigned int BENCHMARK_SEED = 3223;
+
+static const char *BENCHMARK_SCENES[] = {"starfield", "stars", "asteroids", "sphere",
+                                         "ring",      "disc",  "spaceship"};
+static const int NUM_BENCHMARK_SCENES = sizeof(BENCHMARK_SCENES) / sizeof(BENCHMARK_SCENES[0]);
+
+struct BenchmarkScene
+{
+  bool textured;
+  float cameraDistance;
+  uint trisPerFrame;
+  vector<RenderObject *> objects;
+};
+
+// Timings and throughput of one scene, resolution, thread count and mode combination
+struct BenchmarkResult
+{
+  std::string scene;
+  uint width;
+  uint height;
+  uint threads;
+  const char *blend;
+  const char *sample;
+
+  float msMean;
+  float msMin;
+  float msP50;
+  float msP90;
+  float msP99;
+  float msMax;
+
+  uint trisPerFrame;
+  double trisPerSec;
+  double outputPixelsPerSec; // Resolution times frame rate, not the pixels filled
+
+  // Only gathered when pipeline statistics are enabled
+  double pixelsShadedPerFrame;
+  double pixelsShadedPerSec;
+};
+
+static const char *SampleModeName(const bool textured, const TextureSampleMode mode)
+{
+  if (!textured)
+    return "colour";
+
+  switch (mode)
+  {
+  case SAMPLE_BILINEAR:
+    return "bilinear";
+  case SAMPLE_MIPMAP_NEAREST:
+    return "mipmap";
+  default:
+    return "nearest";
+  }
+}
+
+static const char *BlendModeName(const BlendMode mode)
+{
+  switch (mode)
+  {
+  case BLEND_ALPHA:
+    return "alpha";
+  case BLEND_ADDITIVE:
+    return "additive";
+  default:
+    return "replace";
+  }
+}
+
+static const char *TraversalName(const TriangleTraversal traversal)
+{
+  return (traversal == TRAVERSAL_SCANLINE) ? "scanline" : "bbox";
+}
+
+static const char *DepthModeName(const DepthMode mode)
+{
+  switch (mode)
+  {
+  case DEPTH_TEST:
+    return "test";
+  case DEPTH_DISABLED:
+    return "off";
+  default:
+    return "test+write";
+  }
+}
+
+/**
+ * Measures triangle throughput of each RasteriseTri permutation by repeatedly
+ * drawing a sphere under every combination of triangle traversal, texturing,
+ * sample mode, blend mode and depth mode.
+ *
+ * The projection matrix must already be set on the rasteriser.
+ *
+ * \param r Rasteriser to benchmark
+ * \param drawsPerPermutation Number of timed draws for each permutation
+ */
+void BenchmarkTriPermutations(SoftwareRasteriser &r, const int drawsPerPermutation)
+{
+  // A sphere close to the camera gives a mix of small and large triangles over much of the screen
+  const int sphereResolution = 20;
+  const int numTris = (sphereResolution * sphereResolution * 2) - 2;
+
+  RenderObject objects[2];
+  for (int i = 0; i < 2; ++i)
+  {
+    objects[i].mesh = Mesh::GenerateSphere(3.0f, sphereResolution, Colour(255, 0, 0, 127));
+    objects[i].modelMatrix = Matrix4::Translation(Vector3(0.0f, 0.0f, -6.0f));
+  }
+  objects[1].texture = Texture::TextureFromTGA("../moon.tga");
+
+  const TextureSampleMode oldSampleMode = r.GetTextureSamplingMode();
+  const BlendMode oldBlendMode = r.GetBlendMode();
+  const DepthMode oldDepthMode = r.GetDepthMode();
+  const TriangleTraversal oldTraversal = r.GetTriangleTraversal();
+
+  r.SetViewMatrix(Matrix4());
+
+  std::cout << "RasteriseTri permutations (" << numTris << " triangles, " << drawsPerPermutation
+            << " draws each)" << std::endl;
+
+  for (int traversal = 0; traversal < 2; ++traversal)
+  {
+    r.SetTriangleTraversal((TriangleTraversal)traversal);
+
+    for (int textured = 0; textured < 2; ++textured)
+    {
+      // Sample mode has no effect on untextured draws
+      const int numSampleModes = textured ? 3 : 1;
+
+      for (int sample = 0; sample < numSampleModes; ++sample)
+      {
+        for (int blend = 0; blend < 3; ++blend)
+        {
+          for (int depth = 0; depth < 3; ++depth)
+          {
+            r.SetTextureSamplingMode((TextureSampleMode)sample);
+            r.SetBlendMode((BlendMode)blend);
+            r.SetDepthMode((DepthMode)depth);
+
+            // Untimed draw to warm up caches
+            r.ClearBuffers();
+            r.DrawObject(&objects[textured]);
+
+            GameTimer timer;
+            for (int i = 0; i < drawsPerPermutation; ++i)
+              r.DrawObject(&objects[textured]);
+            const float msPerDraw = timer.GetMS() / drawsPerPermutation;
+
+            r.SwapBuffers();
+
+            const float mTrisPerSec = (numTris / msPerDraw) / 1000.0f;
+
+            std::cout << std::left << std::setw(10) << TraversalName((TriangleTraversal)traversal)
+                      << std::setw(10) << SampleModeName(textured != 0, (TextureSampleMode)sample)
+                      << std::setw(10) << BlendModeName((BlendMode)blend) << std::setw(12)
+                      << DepthModeName((DepthMode)depth) << std::right << std::fixed
+                      << std::setprecision(3) << std::setw(9) << msPerDraw << " ms/draw"
+                      << std::setw(9) << mTrisPerSec << " Mtri/s" << std::endl;
+          }
+        }
+      }
+    }
+  }
+
+  r.SetTextureSamplingMode(oldSampleMode);
+  r.SetBlendMode(oldBlendMode);
+  r.SetDepthMode(oldDepthMode);
+  r.SetTriangleTraversal(oldTraversal);
+}
+
+static void EmptyJob(const Job &)
+{
+}
+
+/**
+ * Measures the overhead of the job system: spawning and running empty jobs one at a time and as a
+ * range, and ParallelFor calls over a range with nothing to do.
+ *
+ * \param numJobs Number of jobs to time
+ * \param results Microseconds per job for each of the three (per call for ParallelFor)
+ */
+static void BenchmarkJobSpawning(const uint numJobs, float results[3])
+{
+  JobSystem &jobs = *JobSystem::instance;
+
+  Job job;
+  job.function = &EmptyJob;
+  job.data = NULL;
+  job.begin = 0;
+  job.end = 1;
+
+  GameTimer timer;
+  {
+    JobCounter counter;
+    job.counter = &counter;
+    for (uint i = 0; i < numJobs; ++i)
+      jobs.Spawn(job);
+    jobs.Wait(counter);
+  }
+  results[0] = (timer.GetTimedMS() * 1000.0f) / numJobs;
+
+  {
+    JobCounter counter;
+    jobs.SpawnRange(&EmptyJob, NULL, 0, numJobs, 1, counter);
+    jobs.Wait(counter);
+  }
+  results[1] = (timer.GetTimedMS() * 1000.0f) / numJobs;
+
+  const uint parallelForCalls = max(numJobs / 64, 1u);
+  for (uint i = 0; i < parallelForCalls; ++i)
+    JobSystem::ParallelFor(0, 1024, 1, [](uint, uint) {});
+  results[2] = (timer.GetTimedMS() * 1000.0f) / parallelForCalls;
+}
+
+/**
+ * Times a compute bound ParallelFor, roughly the cost of transforming a large batch of vertices.
+ *
+ * \param data Array to fill, its size is the number of elements processed
+ * \return Milliseconds taken
+ */
+static float BenchmarkJobScaling(vector<float> &data)
+{
+  GameTimer timer;
+
+  JobSystem::ParallelFor(0, (uint)data.size(), 1024, [&](uint begin, uint end) {
+    for (uint i = begin; i < end; ++i)
+    {
+      float x = (float)i;
+      for (int j = 0; j < 32; ++j)
+        x = sqrt((x * 1.0001f) + (float)j);
+      data[i] = x;
+    }
+  });
+
+  return timer.GetMS();
+}
+
+/**
+ * Microbenchmarks for the job system. Spawn overhead is measured with the job system as it is,
+ * then scaling is measured by restarting it with each number of workers from none up to its
+ * current count, which it is left with afterwards.
+ *
+ * \param numJobs Number of empty jobs to time spawning
+ * \param scalingElements Number of elements in the scaling test
+ */
+void BenchmarkJobSystem(const uint numJobs, const uint scalingElements)
+{
+  const uint maxWorkers = JobSystem::instance ? JobSystem::instance->GetNumWorkers() : 0;
+  if (!JobSystem::instance)
+    JobSystem::Initialise(0);
+
+  float spawn[3];
+  BenchmarkJobSpawning(numJobs, spawn);
+
+  std::cout << "Job spawn overhead (" << maxWorkers << " workers, " << numJobs << " jobs)"
+            << std::endl
+            << std::fixed << std::setprecision(3) << std::setw(9) << spawn[0]
+            << " us/job  Spawn" << std::endl
+            << std::setw(9) << spawn[1] << " us/job  SpawnRange" << std::endl
+            << std::setw(9) << spawn[2] << " us/call ParallelFor (1024 elements, nothing to do)"
+            << std::endl;
+
+  std::cout << "ParallelFor scaling (" << scalingElements << " elements)" << std::endl;
+
+  vector<float> data(scalingElements);
+  float singleThreaded = 0.0f;
+
+  for (uint workers = 0; workers <= maxWorkers; ++workers)
+  {
+    JobSystem::Initialise(workers);
+
+    // Untimed run to start the workers and warm up caches
+    BenchmarkJobScaling(data);
+    const float ms = BenchmarkJobScaling(data);
+
+    if (workers == 0)
+      singleThreaded = ms;
+
+    std::cout << std::setw(3) << workers << " workers" << std::setw(10) << ms << " ms"
+              << std::setw(8) << std::setprecision(2) << (singleThreaded / ms) << "x"
+              << std::setprecision(3) << std::endl;
+  }
+}
+
+BenchmarkSuiteOptions::BenchmarkSuiteOptions()
+{
+  resolutions.push_back(std::make_pair(320u, 240u));
+  resolutions.push_back(std::make_pair(800u, 600u));
+  resolutions.push_back(std::make_pair(1280u, 720u));
+
+  threadCounts.push_back(1);
+  threadCounts.push_back(2);
+
+  frames = 60;
+  warmupFrames = 5;
+  jobWorkers = JobSystem::DefaultWorkers();
+}
+
+static vector<std::string> SplitList(const std::string &list)
+{
+  vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    if (!item.empty())
+      items.push_back(item);
+  }
+  return items;
+}
+
+/**
+ * Parses benchmark suite options from the command line (see Benchmark.h).
+ *
+ * \param argc Number of arguments
+ * \param argv Arguments, not including the executable or -benchmark-suite
+ * \param options Options to update
+ * \return False if an option was not recognised or was malformed
+ */
+bool ParseBenchmarkSuiteOptions(int argc, char *argv[], BenchmarkSuiteOptions &options)
+{
+  for (int i = 0; i + 1 < argc; i += 2)
+  {
+    const std::string option(argv[i]);
+    const std::string value(argv[i + 1]);
+
+    if (option == "-scenes")
+    {
+      options.scenes = SplitList(value);
+    }
+    else if (option == "-resolutions")
+    {
+      options.resolutions.clear();
+      vector<std::string> items = SplitList(value);
+      for (vector<std::string>::iterator it = items.begin(); it != items.end(); ++it)
+      {
+        uint w, h;
+        char x;
+        std::stringstream ss(*it);
+        if (!(ss >> w >> x >> h) || x != 'x' || w == 0 || h == 0)
+        {
+          std::cout << "Bad resolution: " << *it << std::endl;
+          return false;
+        }
+        options.resolutions.push_back(std::make_pair(w, h));
+      }
+    }
+    else if (option == "-threads")
+    {
+      options.threadCounts.clear();
+      vector<std::string> items = SplitList(value);
+      for (vector<std::string>::iterator it = items.begin(); it != items.end(); ++it)
+        options.threadCounts.push_back(max(atoi(it->c_str()), 1));
+    }
+    else if (option == "-jobs")
+    {
+      options.jobWorkers = max(atoi(value.c_str()), 0);
+    }
+    else if (option == "-frames")
+    {
+      options.frames = max(atoi(value.c_str()), 1);
+    }
+    else if (option == "-warmup")
+    {
+      options.warmupFrames = max(atoi(value.c_str()), 0);
+    }
+    else if (option == "-json")
+    {
+      options.jsonFile = value;
+    }
+    else
+    {
+      std::cout << "Unknown benchmark option: " << option << std::endl;
+      return false;
+    }
+  }
+
+  if (argc % 2 != 0)
+  {
+    std::cout << "Missing value for benchmark option: " << argv[argc - 1] << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+static uint TrisInMesh(Mesh *mesh)
+{
+  const uint n = mesh->GetNumVertices();
+
+  switch (mesh->GetType())
+  {
+  case PRIMITIVE_TRIANGLES:
+    return n / 3;
+  case PRIMITIVE_TRIANGLE_STRIP:
+  case PRIMITIVE_TRIANGLE_FAN:
+    return n >= 3 ? n - 2 : 0;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Builds one of the canned benchmark scenes, centred on the origin.
+ *
+ * \param name Name of the scene
+ * \param scene Scene to populate
+ * \return False if there is no scene with the given name
+ */
+static bool BuildBenchmarkScene(const std::string &name, BenchmarkScene &scene)
+{
+  srand(BENCHMARK_SEED);
+
+  scene.textured = false;
+  scene.cameraDistance = 10.0f;
+  scene.objects.clear();
+
+  if (name == "starfield")
+  {
+    generateRandomStarfield(scene.objects, 10000);
+    scene.cameraDistance = 0.0f;
+  }
+  else if (name == "stars")
+  {
+    // A million stars in a single mesh
+    generateStarfieldMesh(scene.objects, 1000000);
+    scene.cameraDistance = 0.0f;
+  }
+  else if (name == "asteroids")
+  {
+    generateRandomAsteroids(scene.objects, 100);
+    generateRandomAsteroids(scene.objects, 50, 0.5f);
+    scene.cameraDistance = 0.0f;
+  }
+  else if (name == "sphere")
+  {
+    RenderObject *o = new RenderObject();
+    o->mesh = Mesh::GenerateSphere(3.0f, 20, Colour(255, 0, 0, 255));
+    o->texture = Texture::TextureFromTGA("../moon.tga");
+    scene.objects.push_back(o);
+    scene.textured = true;
+  }
+  else if (name == "ring")
+  {
+    RenderObject *o = new RenderObject();
+    o->mesh = Mesh::GenerateRing2D(12, 10, 20);
+    o->texture = Texture::TextureFromTGA("../asteroid_belt.tga");
+    o->modelMatrix = Matrix4::Rotation(90.0f, Vector3(1.0f, 0.0f, 0.0f));
+    scene.objects.push_back(o);
+    scene.textured = true;
+    scene.cameraDistance = 25.0f;
+  }
+  else if (name == "disc")
+  {
+    RenderObject *o = new RenderObject();
+    o->mesh = Mesh::GenerateDisc2D(8.0f, 30);
+    o->texture = Texture::TextureFromTGA("../planet.tga");
+    scene.objects.push_back(o);
+    scene.textured = true;
+    scene.cameraDistance = 20.0f;
+  }
+  else if (name == "spaceship")
+  {
+    RenderObject *o = new RenderObject();
+    o->mesh = Mesh::LoadMeshFile("../spaceship.asciimesh");
+    scene.objects.push_back(o);
+    scene.cameraDistance = 5.0f;
+  }
+  else
+  {
+    return false;
+  }
+
+  scene.trisPerFrame = 0;
+  for (vector<RenderObject *>::iterator it = scene.objects.begin(); it != scene.objects.end();
+       ++it)
+    scene.trisPerFrame += TrisInMesh((*it)->GetMesh());
+
+  return true;
+}
+
+/**
+ * Camera path shared by every scene: one orbit around the origin over the run, tilted down and
+ * moving in and out.
+ *
+ * \param t Position along the path, 0 to 1
+ * \param distance Average distance from the origin
+ * \return View matrix
+ */
+static Matrix4 BenchmarkCamera(const float t, const float distance)
+{
+  const float dolly = distance * (1.0f + (0.25f * sin(t * 2.0f * PI)));
+
+  return Matrix4::Translation(Vector3(0.0f, 0.0f, -dolly)) *
+         Matrix4::Rotation(25.0f, Vector3(1.0f, 0.0f, 0.0f)) *
+         Matrix4::Rotation(t * 360.0f, Vector3(0.0f, 1.0f, 0.0f));
+}
+
+// Nearest rank percentile of sorted values
+static float Percentile(const vector<float> &sorted, const float p)
+{
+  int rank = (int)ceil((p / 100.0f) * sorted.size()) - 1;
+  rank = min(max(rank, 0), (int)sorted.size() - 1);
+  return sorted[rank];
+}
+
+static void WriteBenchmarkJSON(std::ostream &o, const BenchmarkSuiteOptions &options,
+                               const vector<BenchmarkResult> &results)
+{
+  o << "{\n  \"seed\": " << BENCHMARK_SEED << ",\n  \"frames\": " << options.frames
+    << ",\n  \"warmup_frames\": " << options.warmupFrames << ",\n  \"results\": [";
+
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    const BenchmarkResult &r = results[i];
+    o << (i == 0 ? "\n" : ",\n") << "    {\"scene\": \"" << r.scene << "\", \"width\": " << r.width
+      << ", \"height\": " << r.height << ", \"threads\": " << r.threads << ", \"blend\": \""
+      << r.blend << "\", \"sample\": \"" << r.sample << "\", \"ms_mean\": " << r.msMean
+      << ", \"ms_min\": " << r.msMin << ", \"ms_p50\": " << r.msP50 << ", \"ms_p90\": " << r.msP90
+      << ", \"ms_p99\": " << r.msP99 << ", \"ms_max\": " << r.msMax
+      << ", \"tris_per_frame\": " << r.trisPerFrame << ", \"tris_per_sec\": " << r.trisPerSec
+      << ", \"output_pixels_per_sec\": " << r.outputPixelsPerSec;
+
+    if (SoftwareRasteriser::StatisticsEnabled())
+      o << ", \"pixels_shaded_per_frame\": " << r.pixelsShadedPerFrame
+        << ", \"pixels_shaded_per_sec\": " << r.pixelsShadedPerSec;
+
+    o << "}";
+  }
+
+  o << "\n  ]\n}\n";
+}
+
+/**
+ * Renders each scene along its camera path for every combination of resolution, thread count,
+ * blend mode and (for textured scenes) sample mode, printing timing percentiles and throughput
+ * for each and optionally writing them all out as JSON.
+ *
+ * Output pixels per second is the resolution multiplied by the frame rate, however many pixels
+ * each frame fills, so it is only comparable between runs of the same scene. When pipeline
+ * statistics are enabled the number of pixels actually shaded per frame and per second, which is
+ * the real fill rate, is also written to the JSON.
+ *
+ * \param options Benchmark options
+ * \return Exit code for the process
+ */
+int RunBenchmarkSuite(const BenchmarkSuiteOptions &options)
+{
+  vector<std::string> scenes = options.scenes;
+  if (scenes.empty())
+    scenes.assign(BENCHMARK_SCENES, BENCHMARK_SCENES + NUM_BENCHMARK_SCENES);
+
+  vector<BenchmarkResult> results;
+  const uint totalFrames = options.warmupFrames + options.frames;
+
+  std::cout << std::left << std::setw(11) << "scene" << std::setw(11) << "resolution"
+            << std::setw(9) << "threads" << std::setw(10) << "blend" << std::setw(10) << "sample"
+            << std::right << std::setw(9) << "mean ms" << std::setw(9) << "p50" << std::setw(9)
+            << "p90" << std::setw(9) << "p99" << std::setw(10) << "Mtri/s" << std::setw(14)
+            << "out Mpix/s" << std::endl;
+
+  for (size_t res = 0; res < options.resolutions.size(); ++res)
+  {
+    const uint width = options.resolutions[res].first;
+    const uint height = options.resolutions[res].second;
+
+    SoftwareRasteriser r(width, height);
+#ifdef HEADLESS_WINDOW
+    r.SetFrameLimit(0);
+#endif
+    r.SetProjectionMatrix(
+        Matrix4::Perspective(0.1f, 100.0f, (float)width / (float)height, 45.0f));
+
+    for (size_t s = 0; s < scenes.size(); ++s)
+    {
+      BenchmarkScene scene;
+      if (!BuildBenchmarkScene(scenes[s], scene))
+      {
+        std::cout << "Unknown benchmark scene: " << scenes[s] << std::endl;
+        return 1;
+      }
+
+      // Sample mode has no effect on untextured scenes
+      const int numSampleModes = scene.textured ? 3 : 1;
+
+      for (size_t thread = 0; thread < options.threadCounts.size(); ++thread)
+      {
+        for (int blend = 0; blend < 3; ++blend)
+        {
+          for (int sample = 0; sample < numSampleModes; ++sample)
+          {
+            // Beyond the two pipeline stages, extra threads share the geometry stage
+            r.SetPipelined(options.threadCounts[thread] > 1);
+            r.SetGeometryThreads(max(options.threadCounts[thread], 2u) - 1);
+            r.SetBlendMode((BlendMode)blend);
+            r.SetTextureSamplingMode((TextureSampleMode)sample);
+
+            vector<float> frameTimes;
+            frameTimes.reserve(options.frames);
+            double pixelsShaded = 0.0;
+
+            GameTimer timer;
+            for (uint frame = 0; frame < totalFrames; ++frame)
+            {
+              if (!r.UpdateWindow())
+                return 1;
+
+              r.SetViewMatrix(
+                  BenchmarkCamera((float)frame / (float)totalFrames, scene.cameraDistance));
+
+              timer.GetTimedMS();
+              r.ClearBuffers();
+              for (vector<RenderObject *>::iterator it = scene.objects.begin();
+                   it != scene.objects.end(); ++it)
+                r.DrawObject(*it);
+              r.SwapBuffers();
+              const float ms = timer.GetTimedMS();
+
+              if (frame >= options.warmupFrames)
+              {
+                frameTimes.push_back(ms);
+                pixelsShaded += r.GetFrameStatistics().pixelsPassed;
+              }
+            }
+
+            r.SetPipelined(false);
+            r.SetGeometryThreads(1);
+
+            BenchmarkResult result;
+            result.scene = scenes[s];
+            result.width = width;
+            result.height = height;
+            result.threads = options.threadCounts[thread];
+            result.blend = BlendModeName((BlendMode)blend);
+            result.sample = SampleModeName(scene.textured, (TextureSampleMode)sample);
+
+            float total = 0.0f;
+            for (size_t i = 0; i < frameTimes.size(); ++i)
+              total += frameTimes[i];
+            std::sort(frameTimes.begin(), frameTimes.end());
+
+            result.msMean = total / frameTimes.size();
+            result.msMin = frameTimes.front();
+            result.msP50 = Percentile(frameTimes, 50.0f);
+            result.msP90 = Percentile(frameTimes, 90.0f);
+            result.msP99 = Percentile(frameTimes, 99.0f);
+            result.msMax = frameTimes.back();
+
+            const double framesPerSec = 1000.0 / max(result.msMean, 0.001f);
+            result.trisPerFrame = scene.trisPerFrame;
+            result.trisPerSec = scene.trisPerFrame * framesPerSec;
+            result.outputPixelsPerSec = (double)width * height * framesPerSec;
+            result.pixelsShadedPerFrame = pixelsShaded / frameTimes.size();
+            result.pixelsShadedPerSec = result.pixelsShadedPerFrame * framesPerSec;
+
+            results.push_back(result);
+
+            std::stringstream resolution;
+            resolution << width << "x" << height;
+
+            std::cout << std::left << std::setw(11) << result.scene << std::setw(11)
+                      << resolution.str() << std::setw(9) << result.threads << std::setw(10)
+                      << result.blend << std::setw(10) << result.sample << std::right
+                      << std::fixed << std::setprecision(3) << std::setw(9) << result.msMean
+                      << std::setw(9) << result.msP50 << std::setw(9) << result.msP90
+                      << std::setw(9) << result.msP99 << std::setw(10)
+                      << (result.trisPerSec / 1.0e6) << std::setw(14)
+                      << (result.outputPixelsPerSec / 1.0e6) << std::endl;
+          }
+        }
+      }
+
+      // Memory is freed in the RenderObject destructor
+      for (vector<RenderObject *>::iterator it = scene.objects.begin(); it != scene.objects.end();
+           ++it)
+        delete *it;
+    }
+  }
+
+  if (!options.jsonFile.empty())
+  {
+    std::ofstream json(options.jsonFile.c_str());
+    if (!json)
+    {
+      std::cout << "Could not write " << options.jsonFile << std::endl;
+      return 1;
+    }
+    WriteBenchmarkJSON(json, options, results);
+  }
+
+  return 0;
+}
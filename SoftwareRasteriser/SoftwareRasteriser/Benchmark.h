@@ -0,0 +1,51 @@
+/******************************************************************************
+Description: Throughput benchmarks for the software rasteriser.
+
+Run the SoftwareRasteriser executable with -benchmark on the command line to
+print the RasteriseTri permutation results to the console.
+
+Run it with -benchmark-jobs to print the job system spawn overhead, and how a
+ParallelFor scales from no workers up to -jobs workers.
+
+Run it with -benchmark-suite to render a set of canned scenes along fixed
+camera paths, under each blend and sample mode, at several resolutions and
+thread counts. Scenes are generated from a fixed seed so every run renders
+exactly the same frames. Options (all optional):
+  -scenes starfield,stars,asteroids,sphere,ring,disc,spaceship
+  -resolutions 320x240,800x600,1280x720
+  -threads 1,2      (1 renders immediately, 2 pipelines geometry and raster,
+                     more threads also share the geometry stage)
+  -jobs 3           (job system workers, defaults to one less than the cores)
+  -frames 60        (timed frames per run)
+  -warmup 5         (untimed frames per run)
+  -json results.json
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SoftwareRasteriser.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchmarkSuiteOptions
+{
+  BenchmarkSuiteOptions();
+
+  std::vector<std::string> scenes; // All scenes when empty
+  std::vector<std::pair<uint, uint> > resolutions;
+  std::vector<uint> threadCounts;
+  uint jobWorkers;
+  uint frames;
+  uint warmupFrames;
+  std::string jsonFile; // No JSON output when empty
+};
+
+void BenchmarkTriPermutations(SoftwareRasteriser &r, const int drawsPerPermutation = 20);
+
+void BenchmarkJobSystem(const uint numJobs = 100000, const uint scalingElements = 1 << 20);
+
+bool ParseBenchmarkSuiteOptions(int argc, char *argv[], BenchmarkSuiteOptions &options);
+int RunBenchmarkSuite(const BenchmarkSuiteOptions &options);
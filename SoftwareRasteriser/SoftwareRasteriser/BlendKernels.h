@@ -0,0 +1,452 @@
+/******************************************************************************
+Class:BlendSpan
+Implements:
+Description: Span level blend kernels, specialised at compile time for each
+BlendMode.
+
+Each kernel blends a run of source colours into the destination buffer, only
+touching pixels whose entry in the mask is set (~0u). Pixels are processed
+four at a time using SSE2, with a scalar loop for any remainder.
+
+Alpha blending avoids integer division by using the identity
+x / 255 == (x * 0x8081) >> 23, which is exact for all 16 bit x.
+
+ResolveSpan averages the four consecutive samples of each pixel of a 4x
+multisampled buffer, one pixel per register.
+
+The other colour formats have kernels of their own. RGB565 spans are
+unpacked to BGRA a chunk at a time, blended with the kernels above and packed
+again, which is exact as unpacking replicates the top bits of each channel
+into the bottom ones. R11G11B10 channels can go over 255, so they are blended
+at 32 bits per channel, and alpha blended with a division by 255 that stays
+exact for products of up to 24 bits. Pack and Unpack convert whole spans between the
+formats, with the values of R11G11B10 channels clamped to 255 when unpacked.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Colour.h"
+#include "SoftwareRasteriser.h"
+
+#include <emmintrin.h>
+
+// Exact (truncating) division by 255 for 0 <= x <= 65535
+inline unsigned int Div255(unsigned int x)
+{
+  return (x * 0x8081) >> 23;
+}
+
+// Exact (truncating) division by 255 for each unsigned 16 bit lane
+inline __m128i Div255_epu16(__m128i x)
+{
+  return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16((short)0x8081)), 7);
+}
+
+// Exact (truncating) division by 255 for 0 <= x < 2^24 - 1, for products too big for Div255
+inline unsigned int Div255Wide(unsigned int x)
+{
+  return (x + 1 + ((x + 1 + (x >> 8)) >> 8)) >> 8;
+}
+
+// Exact (truncating) division by 255 for each 32 bit lane, over the same range as Div255Wide
+inline __m128i Div255Wide_epi32(__m128i x)
+{
+  const __m128i x1 = _mm_add_epi32(x, _mm_set1_epi32(1));
+  const __m128i q = _mm_srli_epi32(_mm_add_epi32(x1, _mm_srli_epi32(x, 8)), 8);
+  return _mm_srli_epi32(_mm_add_epi32(x1, q), 8);
+}
+
+// Selects src where mask is set, otherwise dest
+inline __m128i MaskSelect(__m128i mask, __m128i src, __m128i dest)
+{
+  return _mm_or_si128(_mm_and_si128(mask, src), _mm_andnot_si128(mask, dest));
+}
+
+template <BlendMode Mode>
+inline void BlendSpan(Colour *dest, const Colour *src, const unsigned int *mask, int count);
+
+template <>
+inline void BlendSpan<BLEND_REPLACE>(Colour *dest, const Colour *src, const unsigned int *mask,
+                                     int count)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+    _mm_storeu_si128((__m128i *)(dest + i), MaskSelect(m, s, d));
+  }
+
+  for (; i < count; ++i)
+  {
+    if (mask[i])
+      dest[i] = src[i];
+  }
+}
+
+template <>
+inline void BlendSpan<BLEND_ADDITIVE>(Colour *dest, const Colour *src, const unsigned int *mask,
+                                      int count)
+{
+  // Channels wrap on overflow, the same as Colour::operator+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+    _mm_storeu_si128((__m128i *)(dest + i), MaskSelect(m, _mm_add_epi8(d, s), d));
+  }
+
+  for (; i < count; ++i)
+  {
+    if (mask[i])
+      dest[i] = dest[i] + src[i];
+  }
+}
+
+template <>
+inline void BlendSpan<BLEND_ALPHA>(Colour *dest, const Colour *src, const unsigned int *mask,
+                                   int count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i full = _mm_set1_epi16(255);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+
+    // Widen to 16 bits per channel, two pixels per register
+    const __m128i sLo = _mm_unpacklo_epi8(s, zero);
+    const __m128i sHi = _mm_unpackhi_epi8(s, zero);
+    const __m128i dLo = _mm_unpacklo_epi8(d, zero);
+    const __m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+    // Broadcast source alpha (the 4th channel in BGRA order) across each pixel
+    const __m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, _MM_SHUFFLE(3, 3, 3, 3)),
+                                            _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, _MM_SHUFFLE(3, 3, 3, 3)),
+                                            _MM_SHUFFLE(3, 3, 3, 3));
+
+    const __m128i rLo = Div255_epu16(_mm_add_epi16(_mm_mullo_epi16(sLo, aLo),
+                                                   _mm_mullo_epi16(dLo, _mm_sub_epi16(full, aLo))));
+    const __m128i rHi = Div255_epu16(_mm_add_epi16(_mm_mullo_epi16(sHi, aHi),
+                                                   _mm_mullo_epi16(dHi, _mm_sub_epi16(full, aHi))));
+
+    _mm_storeu_si128((__m128i *)(dest + i), MaskSelect(m, _mm_packus_epi16(rLo, rHi), d));
+  }
+
+  for (; i < count; ++i)
+  {
+    if (!mask[i])
+      continue;
+
+    const Colour &c = src[i];
+    Colour &out = dest[i];
+    const unsigned int sFactor = c.a;
+    const unsigned int dFactor = 255 - c.a;
+    out.r = Div255((c.r * sFactor) + (out.r * dFactor));
+    out.g = Div255((c.g * sFactor) + (out.g * dFactor));
+    out.b = Div255((c.b * sFactor) + (out.b * dFactor));
+    out.a = Div255((c.a * sFactor) + (out.a * dFactor));
+  }
+}
+
+// Blends a span with the kernel for a blend mode chosen at runtime
+inline void BlendSpan(BlendMode mode, Colour *dest, const Colour *src, const unsigned int *mask,
+                      int count)
+{
+  switch (mode)
+  {
+  case BLEND_ALPHA:
+    BlendSpan<BLEND_ALPHA>(dest, src, mask, count);
+    break;
+  case BLEND_ADDITIVE:
+    BlendSpan<BLEND_ADDITIVE>(dest, src, mask, count);
+    break;
+  default:
+    BlendSpan<BLEND_REPLACE>(dest, src, mask, count);
+  }
+}
+
+// Averages each group of four samples into a pixel, rounding to nearest
+inline void ResolveSpan(Colour *dest, const Colour *samples, int count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(2);
+
+  for (int i = 0; i < count; ++i)
+  {
+    const __m128i s = _mm_loadu_si128((const __m128i *)(samples + (i * 4)));
+
+    // Sum samples 0 + 2 and 1 + 3 at 16 bits per channel, then the two halves of that
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, half), 2);
+
+    dest[i].c = (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+  }
+}
+
+// Pixels of a compact span converted to BGRA at once when blending
+#define COMPACT_BLEND_CHUNK 64
+
+// Largest value of each channel of R11G11B10
+#define R11G11B10_MAX_RG 2047
+#define R11G11B10_MAX_B 1023
+
+inline unsigned short PackRGB565(const Colour &c)
+{
+  return (unsigned short)(((c.r >> 3) << 11) | ((c.g >> 2) << 5) | (c.b >> 3));
+}
+
+inline unsigned int UnpackRGB565(unsigned short p)
+{
+  const unsigned int r = (p >> 11) & 0x1F;
+  const unsigned int g = (p >> 5) & 0x3F;
+  const unsigned int b = p & 0x1F;
+  return 0xFF000000 | (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) |
+         ((b << 3) | (b >> 2));
+}
+
+inline unsigned int PackR11G11B10(unsigned int r, unsigned int g, unsigned int b)
+{
+  return r | (g << 11) | (b << 22);
+}
+
+inline unsigned int UnpackR11G11B10(unsigned int p)
+{
+  const unsigned int r = min(p & 0x7FF, 255u);
+  const unsigned int g = min((p >> 11) & 0x7FF, 255u);
+  const unsigned int b = min(p >> 22, 255u);
+  return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+// Packs four BGRA pixels per 32 bit lane into RGB565, still one per lane
+inline __m128i PackRGB565_epi32(__m128i s)
+{
+  const __m128i r = _mm_and_si128(_mm_srli_epi32(s, 19), _mm_set1_epi32(0x1F));
+  const __m128i g = _mm_and_si128(_mm_srli_epi32(s, 10), _mm_set1_epi32(0x3F));
+  const __m128i b = _mm_and_si128(_mm_srli_epi32(s, 3), _mm_set1_epi32(0x1F));
+  const __m128i p = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 11), _mm_slli_epi32(g, 5)), b);
+
+  // Sign extended, so the signed saturation of _mm_packs_epi32 leaves it alone
+  return _mm_srai_epi32(_mm_slli_epi32(p, 16), 16);
+}
+
+inline void PackSpan(unsigned short *dest, const Colour *src, int count)
+{
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    const __m128i lo = PackRGB565_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+    const __m128i hi = PackRGB565_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)));
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_packs_epi32(lo, hi));
+  }
+
+  for (; i < count; ++i)
+    dest[i] = PackRGB565(src[i]);
+}
+
+inline void UnpackSpan(Colour *dest, const unsigned short *src, int count)
+{
+  const __m128i mask5 = _mm_set1_epi16(0x1F);
+  const __m128i mask6 = _mm_set1_epi16(0x3F);
+  const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    const __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+
+    // Each channel widened to 8 bits, eight pixels per register
+    __m128i r = _mm_and_si128(_mm_srli_epi16(p, 11), mask5);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+    __m128i b = _mm_and_si128(p, mask5);
+    r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+    g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+    b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+    // Interleaving the BG and RA halves of each pixel gives BGRA
+    const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    const __m128i ra = _mm_or_si128(r, alpha);
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i *)(dest + i + 4), _mm_unpackhi_epi16(bg, ra));
+  }
+
+  for (; i < count; ++i)
+    dest[i].c = UnpackRGB565(src[i]);
+}
+
+// Splits four R11G11B10 pixels into one register per channel, 32 bits per lane
+inline void SplitR11G11B10(__m128i p, __m128i &r, __m128i &g, __m128i &b)
+{
+  const __m128i mask11 = _mm_set1_epi32(0x7FF);
+  r = _mm_and_si128(p, mask11);
+  g = _mm_and_si128(_mm_srli_epi32(p, 11), mask11);
+  b = _mm_srli_epi32(p, 22);
+}
+
+// And splits four BGRA pixels the same way
+inline void SplitBGRA(__m128i s, __m128i &r, __m128i &g, __m128i &b)
+{
+  const __m128i mask8 = _mm_set1_epi32(0xFF);
+  r = _mm_and_si128(_mm_srli_epi32(s, 16), mask8);
+  g = _mm_and_si128(_mm_srli_epi32(s, 8), mask8);
+  b = _mm_and_si128(s, mask8);
+}
+
+inline __m128i MergeR11G11B10(__m128i r, __m128i g, __m128i b)
+{
+  return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 11)), _mm_slli_epi32(b, 22));
+}
+
+inline void UnpackSpan(Colour *dest, const unsigned int *src, int count)
+{
+  // Lanes never exceed 16 bits, so the 16 bit minimum works on them
+  const __m128i full = _mm_set1_epi32(255);
+  const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i r, g, b;
+    SplitR11G11B10(_mm_loadu_si128((const __m128i *)(src + i)), r, g, b);
+    r = _mm_min_epi16(r, full);
+    g = _mm_min_epi16(g, full);
+    b = _mm_min_epi16(b, full);
+
+    const __m128i ar = _mm_or_si128(alpha, _mm_slli_epi32(r, 16));
+    const __m128i gb = _mm_or_si128(_mm_slli_epi32(g, 8), b);
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_or_si128(ar, gb));
+  }
+
+  for (; i < count; ++i)
+    dest[i].c = UnpackR11G11B10(src[i]);
+}
+
+template <BlendMode Mode>
+inline void BlendSpan(unsigned short *dest, const Colour *src, const unsigned int *mask, int count)
+{
+  Colour chunk[COMPACT_BLEND_CHUNK];
+
+  for (int i = 0; i < count; i += COMPACT_BLEND_CHUNK)
+  {
+    const int n = min(count - i, COMPACT_BLEND_CHUNK);
+    UnpackSpan(chunk, dest + i, n);
+    BlendSpan<Mode>(chunk, src + i, mask + i, n);
+    PackSpan(dest + i, chunk, n);
+  }
+}
+
+template <BlendMode Mode>
+inline void BlendSpan(unsigned int *dest, const Colour *src, const unsigned int *mask, int count);
+
+template <>
+inline void BlendSpan<BLEND_REPLACE>(unsigned int *dest, const Colour *src,
+                                     const unsigned int *mask, int count)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+
+    __m128i r, g, b;
+    SplitBGRA(_mm_loadu_si128((const __m128i *)(src + i)), r, g, b);
+    _mm_storeu_si128((__m128i *)(dest + i), MaskSelect(m, MergeR11G11B10(r, g, b), d));
+  }
+
+  for (; i < count; ++i)
+  {
+    if (mask[i])
+      dest[i] = PackR11G11B10(src[i].r, src[i].g, src[i].b);
+  }
+}
+
+template <>
+inline void BlendSpan<BLEND_ADDITIVE>(unsigned int *dest, const Colour *src,
+                                      const unsigned int *mask, int count)
+{
+  const __m128i maxRG = _mm_set1_epi32(R11G11B10_MAX_RG);
+  const __m128i maxB = _mm_set1_epi32(R11G11B10_MAX_B);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+
+    __m128i dr, dg, db, sr, sg, sb;
+    SplitR11G11B10(d, dr, dg, db);
+    SplitBGRA(_mm_loadu_si128((const __m128i *)(src + i)), sr, sg, sb);
+
+    // Sums fit in 16 bits, so can be saturated with the 16 bit minimum
+    const __m128i r = _mm_min_epi16(_mm_add_epi32(dr, sr), maxRG);
+    const __m128i g = _mm_min_epi16(_mm_add_epi32(dg, sg), maxRG);
+    const __m128i b = _mm_min_epi16(_mm_add_epi32(db, sb), maxB);
+    _mm_storeu_si128((__m128i *)(dest + i), MaskSelect(m, MergeR11G11B10(r, g, b), d));
+  }
+
+  for (; i < count; ++i)
+  {
+    if (!mask[i])
+      continue;
+
+    const unsigned int p = dest[i];
+    dest[i] = PackR11G11B10(min((p & 0x7FF) + src[i].r, (unsigned int)R11G11B10_MAX_RG),
+                            min(((p >> 11) & 0x7FF) + src[i].g, (unsigned int)R11G11B10_MAX_RG),
+                            min((p >> 22) + src[i].b, (unsigned int)R11G11B10_MAX_B));
+  }
+}
+
+template <>
+inline void BlendSpan<BLEND_ALPHA>(unsigned int *dest, const Colour *src,
+                                   const unsigned int *mask, int count)
+{
+  const __m128i full = _mm_set1_epi32(255);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+    const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+    const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+    __m128i dr, dg, db, sr, sg, sb;
+    SplitR11G11B10(d, dr, dg, db);
+    SplitBGRA(s, sr, sg, sb);
+
+    // Pairing source and destination channels in the two halves of each lane, and the factors
+    // the same way, lets one multiply-add give each weighted sum. Destination channels can
+    // exceed 255, so the sums need the wider division.
+    const __m128i a = _mm_srli_epi32(s, 24);
+    const __m128i factors = _mm_or_si128(a, _mm_slli_epi32(_mm_sub_epi32(full, a), 16));
+    const __m128i r =
+        Div255Wide_epi32(_mm_madd_epi16(_mm_or_si128(sr, _mm_slli_epi32(dr, 16)), factors));
+    const __m128i g =
+        Div255Wide_epi32(_mm_madd_epi16(_mm_or_si128(sg, _mm_slli_epi32(dg, 16)), factors));
+    const __m128i b =
+        Div255Wide_epi32(_mm_madd_epi16(_mm_or_si128(sb, _mm_slli_epi32(db, 16)), factors));
+    _mm_storeu_si128((__m128i *)(dest + i), MaskSelect(m, MergeR11G11B10(r, g, b), d));
+  }
+
+  for (; i < count; ++i)
+  {
+    if (!mask[i])
+      continue;
+
+    const Colour &c = src[i];
+    const unsigned int p = dest[i];
+    const unsigned int sFactor = c.a;
+    const unsigned int dFactor = 255 - c.a;
+    dest[i] = PackR11G11B10(Div255Wide((c.r * sFactor) + ((p & 0x7FF) * dFactor)),
+                            Div255Wide((c.g * sFactor) + (((p >> 11) & 0x7FF) * dFactor)),
+                            Div255Wide((c.b * sFactor) + ((p >> 22) * dFactor)));
+  }
+}
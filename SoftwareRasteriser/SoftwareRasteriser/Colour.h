@@ -71,10 +71,10 @@ struct Colour
 
     float minusBy = 1.0f - by;
 
-    p.r = unsigned char((b.r * by) + (a.r * minusBy));
-    p.g = unsigned char((b.g * by) + (a.g * minusBy));
-    p.b = unsigned char((b.b * by) + (a.b * minusBy));
-    p.a = unsigned char((b.a * by) + (a.a * minusBy));
+    p.r = (unsigned char)((b.r * by) + (a.r * minusBy));
+    p.g = (unsigned char)((b.g * by) + (a.g * minusBy));
+    p.b = (unsigned char)((b.b * by) + (a.b * minusBy));
+    p.a = (unsigned char)((b.a * by) + (a.a * minusBy));
 
     return p;
   }
@@ -0,0 +1,110 @@
+#include "CommandBuffer.h"
+
+CommandBuffer::CommandBuffer(void)
+{
+  m_numDraws = 0;
+  m_texture = NULL;
+  m_textureRecorded = false;
+  m_shader = NULL;
+  m_shaderRecorded = false;
+}
+
+void CommandBuffer::Reset()
+{
+  m_data.clear();
+  m_numDraws = 0;
+  m_texture = NULL;
+  m_textureRecorded = false;
+  m_shader = NULL;
+  m_shaderRecorded = false;
+}
+
+void CommandBuffer::SetViewMatrix(const Matrix4 &m)
+{
+  WriteCommand(COMMAND_SET_VIEW_MATRIX);
+  Write(m.values, sizeof(m.values));
+}
+
+void CommandBuffer::SetProjectionMatrix(const Matrix4 &m)
+{
+  WriteCommand(COMMAND_SET_PROJECTION_MATRIX);
+  Write(m.values, sizeof(m.values));
+}
+
+void CommandBuffer::SetTextureSamplingMode(TextureSampleMode mode)
+{
+  const unsigned char value = (unsigned char)mode;
+  WriteCommand(COMMAND_SET_SAMPLE_MODE);
+  Write(&value, sizeof(value));
+}
+
+void CommandBuffer::SetBlendMode(BlendMode mode)
+{
+  const unsigned char value = (unsigned char)mode;
+  WriteCommand(COMMAND_SET_BLEND_MODE);
+  Write(&value, sizeof(value));
+}
+
+void CommandBuffer::SetDepthMode(DepthMode mode)
+{
+  const unsigned char value = (unsigned char)mode;
+  WriteCommand(COMMAND_SET_DEPTH_MODE);
+  Write(&value, sizeof(value));
+}
+
+void CommandBuffer::SetPointSize(float size)
+{
+  WriteCommand(COMMAND_SET_POINT_SIZE);
+  Write(&size, sizeof(size));
+}
+
+void CommandBuffer::SetTexture(Texture *texture)
+{
+  WriteCommand(COMMAND_SET_TEXTURE);
+  Write(&texture, sizeof(texture));
+
+  m_texture = texture;
+  m_textureRecorded = true;
+}
+
+void CommandBuffer::SetShader(ShaderProgram *shader)
+{
+  WriteCommand(COMMAND_SET_SHADER);
+  Write(&shader, sizeof(shader));
+
+  m_shader = shader;
+  m_shaderRecorded = true;
+}
+
+void CommandBuffer::DrawMesh(Mesh *mesh, const Matrix4 &modelMatrix)
+{
+  WriteCommand(COMMAND_DRAW);
+  Write(&mesh, sizeof(mesh));
+  Write(modelMatrix.values, sizeof(modelMatrix.values));
+
+  m_numDraws++;
+}
+
+void CommandBuffer::DrawObject(RenderObject *o)
+{
+  // The texture state is only known once the buffer has set it
+  if (!m_textureRecorded || o->GetTexure() != m_texture)
+    SetTexture(o->GetTexure());
+
+  if (!m_shaderRecorded || o->GetShader() != m_shader)
+    SetShader(o->GetShader());
+
+  DrawMesh(o->GetMesh(), o->GetModelMatrix());
+}
+
+void CommandBuffer::WriteCommand(RenderCommandType type)
+{
+  m_data.push_back((unsigned char)type);
+}
+
+void CommandBuffer::Write(const void *data, size_t size)
+{
+  const size_t offset = m_data.size();
+  m_data.resize(offset + size);
+  memcpy(&m_data[offset], data, size);
+}
@@ -0,0 +1,120 @@
+/******************************************************************************
+Class:CommandBuffer
+Implements:
+Description: A recorded list of state changes and draws, to be submitted to a
+SoftwareRasteriser later, as many times as needed.
+
+Recording doesn't touch a rasteriser at all, so a buffer can be built on any
+thread. Commands are packed one after another into a single byte array: a
+one byte type followed by its parameters. Draws capture the mesh and model
+matrix when they are recorded, so anything that never moves (the starfield,
+asteroids and so on) can be recorded once and replayed every frame without
+walking the scene again.
+
+State changes made by a buffer stay set on the rasteriser after it has been
+submitted, the same as calling the rasteriser's own Set functions. Draws use
+whatever view matrix, projection matrix and modes are set when they are
+replayed, so a buffer containing only draws picks up the current camera. The
+texture and shader are the exception, they belong to the buffer and every
+submission starts with neither.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SoftwareRasteriser.h"
+
+#include <cstring>
+#include <vector>
+
+enum RenderCommandType
+{
+  COMMAND_SET_VIEW_MATRIX,
+  COMMAND_SET_PROJECTION_MATRIX,
+  COMMAND_SET_SAMPLE_MODE,
+  COMMAND_SET_BLEND_MODE,
+  COMMAND_SET_DEPTH_MODE,
+  COMMAND_SET_POINT_SIZE,
+  COMMAND_SET_TEXTURE,
+  COMMAND_SET_SHADER,
+  COMMAND_DRAW
+};
+
+class CommandBuffer
+{
+public:
+  CommandBuffer(void);
+
+  // Removes every command, keeping the memory for the next recording
+  void Reset();
+
+  bool IsEmpty() const
+  {
+    return m_data.empty();
+  }
+
+  // Bytes used by the recorded commands
+  size_t GetSize() const
+  {
+    return m_data.size();
+  }
+
+  uint GetNumDraws() const
+  {
+    return m_numDraws;
+  }
+
+  void SetViewMatrix(const Matrix4 &m);
+  void SetProjectionMatrix(const Matrix4 &m);
+  void SetTextureSamplingMode(TextureSampleMode mode);
+  void SetBlendMode(BlendMode mode);
+  void SetDepthMode(DepthMode mode);
+  void SetPointSize(float size);
+
+  // Texture used by the draws after it, NULL for untextured
+  void SetTexture(Texture *texture);
+
+  // Shader used by the triangles drawn after it, NULL for fixed function. Only the pointer is
+  // recorded, so the shader must outlive the buffer.
+  void SetShader(ShaderProgram *shader);
+
+  void DrawMesh(Mesh *mesh, const Matrix4 &modelMatrix);
+
+  // Records the object's texture and shader (if they differ from the last ones recorded) and mesh
+  void DrawObject(RenderObject *o);
+
+  // Reads the type of the command at offset, moving offset on to its parameters
+  bool ReadCommand(size_t &offset, RenderCommandType &type) const
+  {
+    if (offset >= m_data.size())
+      return false;
+
+    type = (RenderCommandType)m_data[offset++];
+    return true;
+  }
+
+  template <typename T> void Read(size_t &offset, T &value) const
+  {
+    memcpy(&value, &m_data[offset], sizeof(T));
+    offset += sizeof(T);
+  }
+
+  void ReadMatrix(size_t &offset, Matrix4 &m) const
+  {
+    memcpy(m.values, &m_data[offset], sizeof(m.values));
+    offset += sizeof(m.values);
+  }
+
+protected:
+  void WriteCommand(RenderCommandType type);
+  void Write(const void *data, size_t size);
+
+  std::vector<unsigned char> m_data;
+  uint m_numDraws;
+
+  // Texture and shader state at the end of the buffer, so DrawObject only records changes
+  Texture *m_texture;
+  bool m_textureRecorded;
+  ShaderProgram *m_shader;
+  bool m_shaderRecorded;
+};
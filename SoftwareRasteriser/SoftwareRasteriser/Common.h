@@ -12,6 +12,34 @@ _-_-_-_-_-_-_-""  ""
 
 #pragma once
 
+// Anything other than Win32 gets the off-screen window (see HeadlessWindow.cpp)
+#if !defined(_WIN32) && !defined(HEADLESS_WINDOW)
+#define HEADLESS_WINDOW
+#endif
+
+#ifndef _WIN32
+// The min/max macros below break the standard library headers on other
+// compilers, so make sure everything used by the rasteriser is included first
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#endif
+
 // It's pi(ish)...
 static const float PI = 3.14159265358979323846f;
 
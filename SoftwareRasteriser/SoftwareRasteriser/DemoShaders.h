@@ -0,0 +1,64 @@
+/******************************************************************************
+Description: Shaders used by the demo in main.cpp, and examples of writing
+vertex and fragment shader functors (see Shader.h).
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Shader.h"
+
+// Transforms vertices to world space for per pixel lighting
+struct LitVertex
+{
+  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices, Varyings &out) const
+  {
+    const Vector4 world = matrices.modelMatrix * in.position;
+    const Vector4 normal =
+        matrices.modelMatrix * Vector4(in.normal.x, in.normal.y, in.normal.z, 0.0f);
+
+    out.colour = ColourToVector(in.colour);
+    out.texCoord = in.texCoord;
+    out.worldPos = Vector3(world.x, world.y, world.z);
+    out.normal = Vector3(normal.x, normal.y, normal.z);
+
+    return matrices.viewProjMatrix * world;
+  }
+};
+
+// Lights the texture (or vertex colour if there isn't one) with a single point light
+struct LitFragment
+{
+  LitFragment()
+      : lightPos(10.0f, 10.0f, 0.0f)
+      , lightRadius(40.0f)
+      , ambient(0.15f)
+  {
+  }
+
+  Colour operator()(const Varyings &in, const DrawState &state) const
+  {
+    Vector4 colour = in.colour;
+    if (state.texture)
+      colour = ColourToVector(SampleTexture(state.texture, state.sampleMode, in.texCoord));
+
+    Vector3 normal = in.normal;
+    normal.Normalise();
+
+    Vector3 toLight = lightPos - in.worldPos;
+    const float distance = toLight.Length();
+    toLight.Normalise();
+
+    const float lambert = max(Vector3::Dot(normal, toLight), 0.0f);
+    const float attenuation = 1.0f - min(distance / lightRadius, 1.0f);
+    const float light = ambient + (lambert * attenuation);
+
+    return VectorToColour(Vector4(colour.x * light, colour.y * light, colour.z * light, colour.w));
+  }
+
+  Vector3 lightPos;
+  float lightRadius;
+  float ambient;
+};
+
+typedef Shader<LitVertex, LitFragment> LitShader;
@@ -0,0 +1,242 @@
+#include "FrameCapture.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/**
+ * Opens the output and starts the writer thread.
+ *
+ * \param filename File to write to, "-" writes to stdout
+ * \param width Frame width in pixels
+ * \param height Frame height in pixels
+ * \param format Output stream format
+ * \param ringSize Number of frames that can be waiting to be written
+ * \param frameRate Frame rate written to the Y4M header
+ */
+FrameCapture::FrameCapture(const std::string &filename, uint width, uint height,
+                           CaptureFormat format, uint ringSize, uint frameRate)
+{
+  m_width = width;
+  m_height = height;
+  m_format = format;
+  m_output = NULL;
+  m_ownsOutput = false;
+  m_redirectedCout = NULL;
+
+  m_ringSize = max(ringSize, 1u);
+  m_ringFirst = 0;
+  m_ringCount = 0;
+
+  m_capturedFrames = 0;
+  m_writtenFrames = 0;
+  m_droppedFrames = 0;
+  m_exit = false;
+
+  if (filename == "-")
+  {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    // The video takes over stdout, so anything else logged goes to stderr instead
+    m_output = new std::ostream(std::cout.rdbuf());
+    m_ownsOutput = true;
+    m_redirectedCout = std::cout.rdbuf(std::cerr.rdbuf());
+  }
+  else
+  {
+    std::ofstream *file = new std::ofstream(filename.c_str(), std::ios::binary);
+    if (!file->is_open())
+    {
+      std::cout << "Could not open " << filename << " for frame capture" << std::endl;
+      delete file;
+      return;
+    }
+    m_output = file;
+    m_ownsOutput = true;
+  }
+
+  if (m_format == CAPTURE_Y4M)
+  {
+    *m_output << "YUV4MPEG2 W" << m_width << " H" << m_height << " F" << frameRate
+              << ":1 Ip A1:1 C444\n";
+  }
+
+  // Everything is allocated up front so capturing never allocates
+  m_ring.resize(m_ringSize * m_width * m_height);
+  m_scratch.resize(m_width * m_height * (m_format == CAPTURE_Y4M ? 3 : 4));
+
+  m_writerThread = std::thread(&FrameCapture::WriterThreadMain, this);
+}
+
+/**
+ * Writes any frames still in the ring, then closes the output and reports how many frames were
+ * written and dropped.
+ */
+FrameCapture::~FrameCapture(void)
+{
+  if (!IsOpen())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exit = true;
+  }
+  m_cond.notify_all();
+  m_writerThread.join();
+
+  std::cout << "Frame capture: " << m_writtenFrames << " frames written, " << m_droppedFrames
+            << " dropped" << std::endl;
+
+  m_output->flush();
+  if (m_ownsOutput)
+    delete m_output;
+
+  if (m_redirectedCout)
+    std::cout.rdbuf(m_redirectedCout);
+}
+
+CaptureFormat FrameCapture::FormatFromFilename(const std::string &filename)
+{
+  const std::string ext = ".y4m";
+  if (filename.size() >= ext.size() &&
+      filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0)
+    return CAPTURE_Y4M;
+
+  return CAPTURE_RAW_BGRA;
+}
+
+/**
+ * Copies a frame into the ring to be written by the writer thread. Never blocks on the writer,
+ * if the ring is full the frame is dropped.
+ *
+ * \param buffer Bottom up BGRA frame, as passed to Window::PresentBuffer
+ * \param width Width of buffer
+ * \param height Height of buffer
+ */
+void FrameCapture::CaptureFrame(const Colour *buffer, uint width, uint height)
+{
+  if (!IsOpen())
+    return;
+
+  uint slot;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capturedFrames++;
+
+    // The stream has a fixed size, so frames from after a resize can't be written either
+    if (m_ringCount == m_ringSize || width != m_width || height != m_height)
+    {
+      m_droppedFrames++;
+      return;
+    }
+
+    slot = (m_ringFirst + m_ringCount) % m_ringSize;
+  }
+
+  // The writer only touches queued slots, so this one can be filled without holding the lock
+  const uint frameSize = m_width * m_height;
+  memcpy(&m_ring[slot * frameSize], buffer, frameSize * sizeof(Colour));
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ringCount++;
+  }
+  m_cond.notify_all();
+}
+
+uint FrameCapture::GetCapturedFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_capturedFrames;
+}
+
+uint FrameCapture::GetWrittenFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_writtenFrames;
+}
+
+uint FrameCapture::GetDroppedFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_droppedFrames;
+}
+
+void FrameCapture::WriterThreadMain()
+{
+  const uint frameSize = m_width * m_height;
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true)
+  {
+    while (m_ringCount == 0 && !m_exit)
+      m_cond.wait(lock);
+
+    // Drain the ring before exiting
+    if (m_ringCount == 0)
+      return;
+
+    const Colour *frame = &m_ring[m_ringFirst * frameSize];
+    lock.unlock();
+
+    WriteFrame(frame);
+
+    lock.lock();
+    m_ringFirst = (m_ringFirst + 1) % m_ringSize;
+    m_ringCount--;
+    m_writtenFrames++;
+  }
+}
+
+/**
+ * Converts a frame into the output format and writes it. Rows are flipped so the stream is top
+ * down.
+ *
+ * \param frame Bottom up BGRA frame
+ */
+void FrameCapture::WriteFrame(const Colour *frame)
+{
+  const uint planeSize = m_width * m_height;
+  unsigned char *out = &m_scratch[0];
+
+  if (m_format == CAPTURE_RAW_BGRA)
+  {
+    const uint rowBytes = m_width * sizeof(Colour);
+    for (uint y = 0; y < m_height; ++y)
+      memcpy(out + (y * rowBytes), frame + ((m_height - 1 - y) * m_width), rowBytes);
+
+    m_output->write((const char *)out, planeSize * sizeof(Colour));
+    return;
+  }
+
+  // BT.601 studio range, in 8 bit fixed point
+  unsigned char *yPlane = out;
+  unsigned char *uPlane = out + planeSize;
+  unsigned char *vPlane = out + (planeSize * 2);
+
+  for (uint y = 0; y < m_height; ++y)
+  {
+    const Colour *in = frame + ((m_height - 1 - y) * m_width);
+    const uint row = y * m_width;
+
+    for (uint x = 0; x < m_width; ++x)
+    {
+      const int r = in[x].r;
+      const int g = in[x].g;
+      const int b = in[x].b;
+
+      yPlane[row + x] = (unsigned char)((((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16);
+      uPlane[row + x] = (unsigned char)((((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128);
+      vPlane[row + x] = (unsigned char)((((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128);
+    }
+  }
+
+  *m_output << "FRAME\n";
+  m_output->write((const char *)out, planeSize * 3);
+}
@@ -0,0 +1,92 @@
+/******************************************************************************
+Class:FrameCapture
+Implements:
+Description: Streams presented frames to a file (or stdout) without stalling
+the render loop.
+
+CaptureFrame copies a frame into a ring of preallocated frames and returns
+straight away, a background thread then converts and writes them out. If the
+writer falls behind and the ring is full the frame is dropped rather than
+waiting, the number of dropped frames is reported when the capture is closed.
+
+Frames are written either as a YUV4MPEG2 (4:4:4, BT.601) stream or as raw top
+down BGRA, both of which can be piped straight into an encoder, e.g.:
+  ffmpeg -i - out.mp4
+  ffmpeg -f rawvideo -pix_fmt bgra -s 800x600 -i - out.mp4
+While capturing to stdout anything else written to std::cout goes to stderr.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Colour.h"
+
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat
+{
+  CAPTURE_Y4M,
+  CAPTURE_RAW_BGRA
+};
+
+class FrameCapture
+{
+public:
+  FrameCapture(const std::string &filename, uint width, uint height,
+               CaptureFormat format = CAPTURE_Y4M, uint ringSize = 8, uint frameRate = 60);
+  ~FrameCapture(void);
+
+  // Picks the format from the file extension (.y4m, anything else is raw BGRA)
+  static CaptureFormat FormatFromFilename(const std::string &filename);
+
+  bool IsOpen() const
+  {
+    return m_output != NULL;
+  }
+
+  void CaptureFrame(const Colour *buffer, uint width, uint height);
+
+  // Frames passed to CaptureFrame
+  uint GetCapturedFrames() const;
+
+  // Frames written to the output
+  uint GetWrittenFrames() const;
+
+  // Frames that did not fit in the ring (or were the wrong size)
+  uint GetDroppedFrames() const;
+
+protected:
+  void WriterThreadMain();
+
+  void WriteFrame(const Colour *frame);
+
+  uint m_width;
+  uint m_height;
+  CaptureFormat m_format;
+
+  std::ostream *m_output;
+  bool m_ownsOutput;
+  std::streambuf *m_redirectedCout; // Original stdout buffer when capturing to stdout
+
+  std::vector<Colour> m_ring; // ringSize frames of width * height
+  uint m_ringSize;
+  uint m_ringFirst; // Oldest frame waiting to be written
+  uint m_ringCount; // Frames waiting to be written
+
+  std::vector<unsigned char> m_scratch; // Converted frame, only used by the writer thread
+
+  uint m_capturedFrames;
+  uint m_writtenFrames;
+  uint m_droppedFrames;
+
+  std::thread m_writerThread;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_exit;
+};
@@ -0,0 +1,522 @@
+/******************************************************************************
+Description: Shaders translated from GLSL by the ShaderTranslator tool. Don't
+edit this file, edit the shaders, which are translated again before each
+build with:
+
+  ShaderTranslator GLSLShaders.h basic_vertex.glsl shrink_vertex.glsl \
+    lighting_vertex.glsl nomvp_vertex.glsl basic_fragment.glsl \
+    texfade_fragment.glsl fade_fragment.glsl lighting_fragment.glsl \
+    notex_fragment.glsl
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "GLSLTypes.h"
+#include "Shader.h"
+
+// Translated from basic_vertex.glsl
+struct BasicVertex
+{
+  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices, Varyings &out) const
+  {
+    Globals io(matrices);
+    io.position = glsl::vec3(glsl::vec4(in.position));
+    io.texCoord = glsl::vec2(in.texCoord);
+    io.colour = glsl::FromColour(in.colour);
+
+    main(io);
+
+    out.colour = glsl::ToVector4(io.OUT.colour);
+    out.texCoord = glsl::ToVector2(io.OUT.texCoord);
+    out.worldPos = Vector3(0.0f, 0.0f, 0.0f);
+    out.normal = Vector3(0.0f, 0.0f, 0.0f);
+
+    return glsl::ToVector4(io.gl_Position);
+  }
+
+protected:
+  struct Globals
+  {
+    Globals(const ShaderMatrices &matrices)
+        : modelMatrix(glsl::AsMat4(matrices.modelMatrix))
+        , viewProjMatrix(glsl::AsMat4(matrices.viewProjMatrix))
+    {
+    }
+
+    glsl::vec3 position;
+    glsl::vec2 texCoord;
+    glsl::vec4 colour;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } OUT;
+    glsl::vec4 gl_Position;
+    const glsl::mat4 &modelMatrix;
+    const glsl::mat4 &viewProjMatrix;
+  };
+
+  void main(Globals &io) const
+  {
+    io.gl_Position = io.viewProjMatrix * io.modelMatrix * glsl::vec4(io.position, 1.0f);
+
+    io.OUT.texCoord = io.texCoord;
+    io.OUT.colour = io.colour;
+  }
+};
+
+// Translated from shrink_vertex.glsl
+struct ShrinkVertex
+{
+  ShrinkVertex()
+      : animPosition(0.0f)
+  {
+  }
+
+  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices, Varyings &out) const
+  {
+    Globals io(matrices);
+    io.position = glsl::vec3(glsl::vec4(in.position));
+    io.texCoord = glsl::vec2(in.texCoord);
+    io.colour = glsl::FromColour(in.colour);
+
+    main(io);
+
+    out.colour = glsl::ToVector4(io.OUT.colour);
+    out.texCoord = glsl::ToVector2(io.OUT.texCoord);
+    out.worldPos = Vector3(0.0f, 0.0f, 0.0f);
+    out.normal = Vector3(0.0f, 0.0f, 0.0f);
+
+    return glsl::ToVector4(io.gl_Position);
+  }
+
+  float animPosition;
+
+protected:
+  struct Globals
+  {
+    Globals(const ShaderMatrices &matrices)
+        : modelMatrix(glsl::AsMat4(matrices.modelMatrix))
+        , viewProjMatrix(glsl::AsMat4(matrices.viewProjMatrix))
+    {
+    }
+
+    glsl::vec3 position;
+    glsl::vec2 texCoord;
+    glsl::vec4 colour;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } OUT;
+    glsl::vec4 gl_Position;
+    const glsl::mat4 &modelMatrix;
+    const glsl::mat4 &viewProjMatrix;
+  };
+
+  void main(Globals &io) const
+  {
+    float f = 1 - animPosition;
+    io.gl_Position = io.viewProjMatrix * io.modelMatrix * glsl::vec4(io.position, 1.0f) *
+        glsl::mat4(glsl::vec4(f, 0, 0, 0), glsl::vec4(0, f, 0, 0), glsl::vec4(0, 0, f, 0),
+        glsl::vec4(0, 0, 0, 1));
+
+    io.OUT.texCoord = io.texCoord;
+    io.OUT.colour = io.colour;
+  }
+};
+
+// Translated from lighting_vertex.glsl
+struct LightingVertex
+{
+  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices, Varyings &out) const
+  {
+    Globals io(matrices);
+    io.position = glsl::vec3(glsl::vec4(in.position));
+    io.texCoord = glsl::vec2(in.texCoord);
+    io.colour = glsl::FromColour(in.colour);
+    io.normal = glsl::vec3(in.normal);
+
+    main(io);
+
+    out.colour = glsl::ToVector4(io.OUT.colour);
+    out.texCoord = glsl::ToVector2(io.OUT.texCoord);
+    out.worldPos = glsl::ToVector3(io.OUT.worldPos);
+    out.normal = glsl::ToVector3(io.OUT.normal);
+
+    return glsl::ToVector4(io.gl_Position);
+  }
+
+protected:
+  struct Globals
+  {
+    Globals(const ShaderMatrices &matrices)
+        : modelMatrix(glsl::AsMat4(matrices.modelMatrix))
+        , viewProjMatrix(glsl::AsMat4(matrices.viewProjMatrix))
+    {
+    }
+
+    glsl::vec3 position;
+    glsl::vec2 texCoord;
+    glsl::vec4 colour;
+    glsl::vec3 normal;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+      glsl::vec3 worldPos;
+      glsl::vec3 normal;
+    } OUT;
+    glsl::vec4 gl_Position;
+    const glsl::mat4 &modelMatrix;
+    const glsl::mat4 &viewProjMatrix;
+  };
+
+  void main(Globals &io) const
+  {
+    glsl::vec4 worldPos = io.modelMatrix * glsl::vec4(io.position, 1.0f);
+
+    io.OUT.texCoord = io.texCoord;
+    io.OUT.colour = io.colour;
+    io.OUT.worldPos = glsl::Swizzle3<0, 1, 2>(worldPos);
+
+    glsl::mat3 normalMatrix = glsl::transpose(glsl::inverse(glsl::mat3(io.modelMatrix)));
+    io.OUT.normal = glsl::normalize(normalMatrix * glsl::normalize(io.normal));
+
+    io.gl_Position = io.viewProjMatrix * worldPos;
+  }
+};
+
+// Translated from nomvp_vertex.glsl
+struct NomvpVertex
+{
+  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices, Varyings &out) const
+  {
+    Globals io(matrices);
+    io.position = glsl::vec3(glsl::vec4(in.position));
+    io.texCoord = glsl::vec2(in.texCoord);
+    io.colour = glsl::FromColour(in.colour);
+
+    main(io);
+
+    out.colour = glsl::ToVector4(io.OUT.colour);
+    out.texCoord = glsl::ToVector2(io.OUT.texCoord);
+    out.worldPos = Vector3(0.0f, 0.0f, 0.0f);
+    out.normal = Vector3(0.0f, 0.0f, 0.0f);
+
+    return glsl::ToVector4(io.gl_Position);
+  }
+
+protected:
+  struct Globals
+  {
+    Globals(const ShaderMatrices &matrices)
+        : modelMatrix(glsl::AsMat4(matrices.modelMatrix))
+        , viewProjMatrix(glsl::AsMat4(matrices.viewProjMatrix))
+    {
+    }
+
+    glsl::vec3 position;
+    glsl::vec2 texCoord;
+    glsl::vec4 colour;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } OUT;
+    glsl::vec4 gl_Position;
+    const glsl::mat4 &modelMatrix;
+    const glsl::mat4 &viewProjMatrix;
+  };
+
+  void main(Globals &io) const
+  {
+    io.gl_Position = glsl::vec4(io.position, 1.0f);
+
+    io.OUT.texCoord = io.texCoord;
+    io.OUT.colour = io.colour;
+  }
+};
+
+// Translated from basic_fragment.glsl
+struct BasicFragment
+{
+  BasicFragment()
+      : animPosition(0.0f)
+      , objectTexture(NULL)
+  {
+  }
+
+  Colour operator()(const Varyings &in, const DrawState &state) const
+  {
+    Globals io(state);
+    io.IN.colour = glsl::vec4(in.colour);
+    io.IN.texCoord = glsl::vec2(in.texCoord);
+
+    main(io);
+
+    return glsl::ToColour(io.fragCol);
+  }
+
+  float animPosition;
+  glsl::sampler2D objectTexture;
+
+protected:
+  struct Globals
+  {
+    Globals(const DrawState &state)
+        : state(state)
+    {
+    }
+
+    glsl::vec4 fragCol;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } IN;
+    const DrawState &state;
+  };
+
+  void main(Globals &io) const
+  {
+    io.fragCol = glsl::texture(io.state, objectTexture, io.IN.texCoord);
+  }
+};
+
+// Translated from texfade_fragment.glsl
+struct TexfadeFragment
+{
+  TexfadeFragment()
+      : animPosition(0.0f)
+  {
+    for (int i = 0; i < 5; ++i)
+      objectTextures[i] = NULL;
+  }
+
+  Colour operator()(const Varyings &in, const DrawState &state) const
+  {
+    Globals io(state);
+    io.IN.colour = glsl::vec4(in.colour);
+    io.IN.texCoord = glsl::vec2(in.texCoord);
+
+    main(io);
+
+    return glsl::ToColour(io.fragCol);
+  }
+
+  float animPosition;
+  glsl::sampler2D objectTextures[5];
+
+protected:
+  struct Globals
+  {
+    Globals(const DrawState &state)
+        : state(state)
+    {
+    }
+
+    glsl::vec4 fragCol;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } IN;
+    const DrawState &state;
+  };
+
+  void main(Globals &io) const
+  {
+    glsl::vec4 normalCol = glsl::texture(io.state, objectTextures[0], io.IN.texCoord);
+    glsl::vec4 destroyedCol = glsl::texture(io.state, objectTextures[1], io.IN.texCoord);
+
+    io.fragCol = (normalCol * (1 - animPosition)) + (destroyedCol * animPosition);
+  }
+};
+
+// Translated from fade_fragment.glsl
+struct FadeFragment
+{
+  FadeFragment()
+      : animPosition(0.0f)
+  {
+    for (int i = 0; i < 5; ++i)
+      objectTextures[i] = NULL;
+  }
+
+  Colour operator()(const Varyings &in, const DrawState &state) const
+  {
+    Globals io(state);
+    io.IN.colour = glsl::vec4(in.colour);
+    io.IN.texCoord = glsl::vec2(in.texCoord);
+
+    main(io);
+
+    return glsl::ToColour(io.fragCol);
+  }
+
+  float animPosition;
+  glsl::sampler2D objectTextures[5];
+
+protected:
+  struct Globals
+  {
+    Globals(const DrawState &state)
+        : state(state)
+    {
+    }
+
+    glsl::vec4 fragCol;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } IN;
+    const DrawState &state;
+  };
+
+  void main(Globals &io) const
+  {
+    glsl::vec4 col = glsl::texture(io.state, objectTextures[0], io.IN.texCoord);
+    col.w = 1 - animPosition;
+    io.fragCol = col;
+  }
+};
+
+// Translated from lighting_fragment.glsl
+struct LightingFragment
+{
+  LightingFragment()
+      : animPosition(0.0f)
+      , objectTexture(NULL)
+  {
+    for (int i = 0; i < 2; ++i)
+      lightRadius[i] = 0.0f;
+  }
+
+  Colour operator()(const Varyings &in, const DrawState &state) const
+  {
+    Globals io(state);
+    io.IN.colour = glsl::vec4(in.colour);
+    io.IN.texCoord = glsl::vec2(in.texCoord);
+    io.IN.worldPos = glsl::vec3(in.worldPos);
+    io.IN.normal = glsl::vec3(in.normal);
+
+    main(io);
+
+    return glsl::ToColour(io.fragCol);
+  }
+
+  float animPosition;
+  glsl::sampler2D objectTexture;
+  glsl::vec3 cameraPos;
+  glsl::vec3 lightColour[2];
+  glsl::vec3 lightPos[2];
+  float lightRadius[2];
+
+protected:
+  struct Globals
+  {
+    Globals(const DrawState &state)
+        : state(state)
+    {
+    }
+
+    glsl::vec4 fragCol;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+      glsl::vec3 worldPos;
+      glsl::vec3 normal;
+    } IN;
+    const DrawState &state;
+  };
+
+  glsl::mat4 processLight(Globals &io, int idx) const
+  {
+    glsl::vec3 incident = glsl::normalize(lightPos[idx] - io.IN.worldPos);
+    glsl::vec3 viewDir = glsl::normalize(cameraPos - io.IN.worldPos);
+    glsl::vec3 halfDir = glsl::normalize(incident + viewDir);
+
+    float dist = glsl::length(lightPos[idx] - io.IN.worldPos);
+    float atten = 1.0f - (glsl::clamp)(dist / lightRadius[idx], 0.0f, 1.0f);
+    float lambert = (glsl::max)(0.0f, glsl::dot(incident, io.IN.normal));
+
+    float rFactor = (glsl::max)(0.0f, glsl::dot(halfDir, io.IN.normal));
+    float sFactor = glsl::pow(rFactor, 100.0f);
+
+    glsl::vec4 texCol = glsl::texture(io.state, objectTexture, io.IN.texCoord);
+
+    glsl::mat4 light;
+
+    light[0] = texCol;
+
+    glsl::AssignSwizzle3<0, 1, 2>(light[1], glsl::Swizzle3<0, 1, 2>(texCol) * lightColour[idx] *
+        0.1f);
+
+    glsl::AssignSwizzle3<0, 1, 2>(light[2], glsl::Swizzle3<0, 1, 2>(texCol) * lightColour[idx] *
+        lambert * atten);
+
+    glsl::AssignSwizzle3<0, 1, 2>(light[3], lightColour[idx] * sFactor * atten);
+
+    return light;
+  }
+
+  void main(Globals &io) const
+  {
+    glsl::mat4 light1 = processLight(io, 0);
+    glsl::mat4 light2 = processLight(io, 1);
+
+    io.fragCol = glsl::vec4(glsl::Swizzle3<0, 1, 2>(light1[1]) +
+        glsl::Swizzle3<0, 1, 2>(light1[2]) + glsl::Swizzle3<0, 1, 2>(light1[3]) +
+        glsl::Swizzle3<0, 1, 2>(light2[3]), light1[0].w);
+  }
+};
+
+// Translated from notex_fragment.glsl
+struct NotexFragment
+{
+  NotexFragment()
+      : animPosition(0.0f)
+      , objectTexture(NULL)
+  {
+  }
+
+  Colour operator()(const Varyings &in, const DrawState &state) const
+  {
+    Globals io(state);
+    io.IN.colour = glsl::vec4(in.colour);
+    io.IN.texCoord = glsl::vec2(in.texCoord);
+
+    main(io);
+
+    return glsl::ToColour(io.fragCol);
+  }
+
+  float animPosition;
+  glsl::sampler2D objectTexture;
+
+protected:
+  struct Globals
+  {
+    Globals(const DrawState &state)
+        : state(state)
+    {
+    }
+
+    glsl::vec4 fragCol;
+    struct Vertex
+    {
+      glsl::vec2 texCoord;
+      glsl::vec4 colour;
+    } IN;
+    const DrawState &state;
+  };
+
+  void main(Globals &io) const
+  {
+    io.fragCol = io.IN.colour;
+  }
+};
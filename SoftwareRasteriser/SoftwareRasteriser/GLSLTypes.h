@@ -0,0 +1,825 @@
+/******************************************************************************
+Namespace:glsl
+Implements:
+Description: Vector and matrix types and built in functions that behave like
+their GLSL namesakes, for shaders translated from GLSL by the
+ShaderTranslator tool (see GLSLShaders.h).
+
+vec3 and vec4 are both four floats, so their arithmetic is done four lanes
+at a time with SSE. They're loaded and stored unaligned, so they can be
+passed by value and kept in anything (including a Shader allocated with new)
+without alignment restrictions. Their constructors write all four floats
+with one store, as an SSE load straight after four separate float stores
+can't be forwarded from them and stalls. vec2 is plain scalar code.
+Matrices are column major, the same as GLSL and Matrix4, and indexing one
+gives a column.
+
+Swizzles are functions: Swizzle3<0, 1, 2>(v) reads v.xyz, and
+AssignSwizzle3<0, 1, 2>(v, value) writes it.
+
+min, max and clamp are macros in Common.h, so they are called with their
+names in brackets, as (glsl::max)(a, b), which stops the macros expanding.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Colour.h"
+#include "Common.h"
+#include "Matrix4.h"
+#include "SoftwareRasteriser.h"
+#include "Texture.h"
+#include "Vector2.h"
+#include "Vector3.h"
+#include "Vector4.h"
+
+#include <cmath>
+#include <emmintrin.h>
+#include <type_traits>
+
+namespace glsl
+{
+struct vec4;
+struct mat4;
+
+struct vec2
+{
+  vec2()
+      : x(0.0f)
+      , y(0.0f)
+  {
+  }
+
+  explicit vec2(float s)
+      : x(s)
+      , y(s)
+  {
+  }
+
+  vec2(float x, float y)
+      : x(x)
+      , y(y)
+  {
+  }
+
+  explicit vec2(const Vector2 &v)
+      : x(v.x)
+      , y(v.y)
+  {
+  }
+
+  float &operator[](int i)
+  {
+    return (&x)[i];
+  }
+
+  float operator[](int i) const
+  {
+    return (&x)[i];
+  }
+
+  float x;
+  float y;
+};
+
+struct vec3
+{
+  vec3()
+  {
+    _mm_storeu_ps(&x, _mm_setzero_ps());
+  }
+
+  explicit vec3(float s)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(0.0f, s, s, s));
+  }
+
+  vec3(float x, float y, float z)
+  {
+    _mm_storeu_ps(&this->x, _mm_set_ps(0.0f, z, y, x));
+  }
+
+  vec3(const vec2 &v, float z)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(0.0f, z, v.y, v.x));
+  }
+
+  explicit vec3(const Vector3 &v)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(0.0f, v.z, v.y, v.x));
+  }
+
+  // Drops w, as GLSL's vec3(vec4) does
+  explicit vec3(const vec4 &v);
+
+  explicit vec3(__m128 m)
+  {
+    _mm_storeu_ps(&x, m);
+  }
+
+  __m128 sse() const
+  {
+    return _mm_loadu_ps(&x);
+  }
+
+  float &operator[](int i)
+  {
+    return (&x)[i];
+  }
+
+  float operator[](int i) const
+  {
+    return (&x)[i];
+  }
+
+  float x;
+  float y;
+  float z;
+  float unused; // Pads to a whole SSE register
+};
+
+struct vec4
+{
+  vec4()
+  {
+    _mm_storeu_ps(&x, _mm_setzero_ps());
+  }
+
+  explicit vec4(float s)
+  {
+    _mm_storeu_ps(&x, _mm_set1_ps(s));
+  }
+
+  vec4(float x, float y, float z, float w)
+  {
+    _mm_storeu_ps(&this->x, _mm_set_ps(w, z, y, x));
+  }
+
+  vec4(const vec3 &v, float w)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(w, v.z, v.y, v.x));
+  }
+
+  vec4(const vec2 &v, float z, float w)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(w, z, v.y, v.x));
+  }
+
+  vec4(const vec2 &a, const vec2 &b)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(b.y, b.x, a.y, a.x));
+  }
+
+  explicit vec4(const Vector4 &v)
+  {
+    _mm_storeu_ps(&x, _mm_set_ps(v.w, v.z, v.y, v.x));
+  }
+
+  explicit vec4(__m128 m)
+  {
+    _mm_storeu_ps(&x, m);
+  }
+
+  __m128 sse() const
+  {
+    return _mm_loadu_ps(&x);
+  }
+
+  float &operator[](int i)
+  {
+    return (&x)[i];
+  }
+
+  float operator[](int i) const
+  {
+    return (&x)[i];
+  }
+
+  float x;
+  float y;
+  float z;
+  float w;
+};
+
+inline vec3::vec3(const vec4 &v)
+{
+  _mm_storeu_ps(&x, _mm_and_ps(v.sse(), _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1))));
+}
+
+// Arithmetic, component wise and with scalars on either side
+inline vec2 operator+(const vec2 &a, const vec2 &b)
+{
+  return vec2(a.x + b.x, a.y + b.y);
+}
+
+inline vec2 operator-(const vec2 &a, const vec2 &b)
+{
+  return vec2(a.x - b.x, a.y - b.y);
+}
+
+inline vec2 operator*(const vec2 &a, const vec2 &b)
+{
+  return vec2(a.x * b.x, a.y * b.y);
+}
+
+inline vec2 operator/(const vec2 &a, const vec2 &b)
+{
+  return vec2(a.x / b.x, a.y / b.y);
+}
+
+inline vec2 operator-(const vec2 &a)
+{
+  return vec2(-a.x, -a.y);
+}
+
+#define GLSL_SSE_OPERATOR(type, op, intrinsic)                                                     \
+  inline type operator op(const type &a, const type &b)                                            \
+  {                                                                                                \
+    return type(intrinsic(a.sse(), b.sse()));                                                      \
+  }                                                                                                \
+  inline type operator op(const type &a, float b)                                                  \
+  {                                                                                                \
+    return type(intrinsic(a.sse(), _mm_set1_ps(b)));                                               \
+  }                                                                                                \
+  inline type operator op(float a, const type &b)                                                  \
+  {                                                                                                \
+    return type(intrinsic(_mm_set1_ps(a), b.sse()));                                               \
+  }
+
+GLSL_SSE_OPERATOR(vec3, +, _mm_add_ps)
+GLSL_SSE_OPERATOR(vec3, -, _mm_sub_ps)
+GLSL_SSE_OPERATOR(vec3, *, _mm_mul_ps)
+GLSL_SSE_OPERATOR(vec3, /, _mm_div_ps)
+GLSL_SSE_OPERATOR(vec4, +, _mm_add_ps)
+GLSL_SSE_OPERATOR(vec4, -, _mm_sub_ps)
+GLSL_SSE_OPERATOR(vec4, *, _mm_mul_ps)
+GLSL_SSE_OPERATOR(vec4, /, _mm_div_ps)
+
+#undef GLSL_SSE_OPERATOR
+
+inline vec2 operator+(const vec2 &a, float b)
+{
+  return vec2(a.x + b, a.y + b);
+}
+
+inline vec2 operator+(float a, const vec2 &b)
+{
+  return vec2(a + b.x, a + b.y);
+}
+
+inline vec2 operator-(const vec2 &a, float b)
+{
+  return vec2(a.x - b, a.y - b);
+}
+
+inline vec2 operator-(float a, const vec2 &b)
+{
+  return vec2(a - b.x, a - b.y);
+}
+
+inline vec2 operator*(const vec2 &a, float b)
+{
+  return vec2(a.x * b, a.y * b);
+}
+
+inline vec2 operator*(float a, const vec2 &b)
+{
+  return vec2(a * b.x, a * b.y);
+}
+
+inline vec2 operator/(const vec2 &a, float b)
+{
+  return vec2(a.x / b, a.y / b);
+}
+
+inline vec2 operator/(float a, const vec2 &b)
+{
+  return vec2(a / b.x, a / b.y);
+}
+
+inline vec3 operator-(const vec3 &a)
+{
+  return vec3(_mm_sub_ps(_mm_setzero_ps(), a.sse()));
+}
+
+inline vec4 operator-(const vec4 &a)
+{
+  return vec4(_mm_sub_ps(_mm_setzero_ps(), a.sse()));
+}
+
+#define GLSL_COMPOUND_OPERATORS(type)                                                              \
+  inline type &operator+=(type &a, const type &b)                                                  \
+  {                                                                                                \
+    return a = a + b;                                                                              \
+  }                                                                                                \
+  inline type &operator-=(type &a, const type &b)                                                  \
+  {                                                                                                \
+    return a = a - b;                                                                              \
+  }                                                                                                \
+  inline type &operator*=(type &a, const type &b)                                                  \
+  {                                                                                                \
+    return a = a * b;                                                                              \
+  }                                                                                                \
+  inline type &operator/=(type &a, const type &b)                                                  \
+  {                                                                                                \
+    return a = a / b;                                                                              \
+  }                                                                                                \
+  inline type &operator*=(type &a, float b)                                                        \
+  {                                                                                                \
+    return a = a * b;                                                                              \
+  }                                                                                                \
+  inline type &operator/=(type &a, float b)                                                        \
+  {                                                                                                \
+    return a = a / b;                                                                              \
+  }
+
+GLSL_COMPOUND_OPERATORS(vec2)
+GLSL_COMPOUND_OPERATORS(vec3)
+GLSL_COMPOUND_OPERATORS(vec4)
+
+#undef GLSL_COMPOUND_OPERATORS
+
+// Swizzles, reading or writing the listed components in order
+template <int A, int B, typename V> inline vec2 Swizzle2(const V &v)
+{
+  return vec2(v[A], v[B]);
+}
+
+template <int A, int B, int C, typename V> inline vec3 Swizzle3(const V &v)
+{
+  return vec3(v[A], v[B], v[C]);
+}
+
+template <int A, int B, int C, int D, typename V> inline vec4 Swizzle4(const V &v)
+{
+  return vec4(v[A], v[B], v[C], v[D]);
+}
+
+template <int A, int B, typename V> inline void AssignSwizzle2(V &v, const vec2 &value)
+{
+  v[A] = value.x;
+  v[B] = value.y;
+}
+
+template <int A, int B, int C, typename V> inline void AssignSwizzle3(V &v, const vec3 &value)
+{
+  v[A] = value.x;
+  v[B] = value.y;
+  v[C] = value.z;
+}
+
+template <int A, int B, int C, int D, typename V>
+inline void AssignSwizzle4(V &v, const vec4 &value)
+{
+  v[A] = value.x;
+  v[B] = value.y;
+  v[C] = value.z;
+  v[D] = value.w;
+}
+
+struct mat3
+{
+  // Zero, rather than GLSL's undefined
+  mat3()
+  {
+  }
+
+  // Diagonal matrix
+  explicit mat3(float s)
+  {
+    c[0].x = s;
+    c[1].y = s;
+    c[2].z = s;
+  }
+
+  mat3(const vec3 &c0, const vec3 &c1, const vec3 &c2)
+  {
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+  }
+
+  // Top left 3x3
+  explicit mat3(const mat4 &m);
+
+  vec3 &operator[](int i)
+  {
+    return c[i];
+  }
+
+  const vec3 &operator[](int i) const
+  {
+    return c[i];
+  }
+
+  vec3 c[3];
+};
+
+struct mat4
+{
+  mat4()
+  {
+  }
+
+  explicit mat4(float s)
+  {
+    c[0].x = s;
+    c[1].y = s;
+    c[2].z = s;
+    c[3].w = s;
+  }
+
+  mat4(const vec4 &c0, const vec4 &c1, const vec4 &c2, const vec4 &c3)
+  {
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+    c[3] = c3;
+  }
+
+  vec4 &operator[](int i)
+  {
+    return c[i];
+  }
+
+  const vec4 &operator[](int i) const
+  {
+    return c[i];
+  }
+
+  vec4 c[4];
+};
+
+inline mat3::mat3(const mat4 &m)
+{
+  for (int i = 0; i < 3; ++i)
+    c[i] = vec3(m.c[i]);
+}
+
+// Matrix4 has the same column major layout, so can be used without copying
+inline const mat4 &AsMat4(const Matrix4 &m)
+{
+  static_assert(sizeof(mat4) == sizeof(Matrix4), "mat4 must match the layout of Matrix4");
+  return *reinterpret_cast<const mat4 *>(m.values);
+}
+
+inline vec4 operator*(const mat4 &m, const vec4 &v)
+{
+  __m128 r = _mm_mul_ps(m.c[0].sse(), _mm_set1_ps(v.x));
+  r = _mm_add_ps(r, _mm_mul_ps(m.c[1].sse(), _mm_set1_ps(v.y)));
+  r = _mm_add_ps(r, _mm_mul_ps(m.c[2].sse(), _mm_set1_ps(v.z)));
+  r = _mm_add_ps(r, _mm_mul_ps(m.c[3].sse(), _mm_set1_ps(v.w)));
+  return vec4(r);
+}
+
+inline vec3 operator*(const mat3 &m, const vec3 &v)
+{
+  __m128 r = _mm_mul_ps(m.c[0].sse(), _mm_set1_ps(v.x));
+  r = _mm_add_ps(r, _mm_mul_ps(m.c[1].sse(), _mm_set1_ps(v.y)));
+  r = _mm_add_ps(r, _mm_mul_ps(m.c[2].sse(), _mm_set1_ps(v.z)));
+  return vec3(r);
+}
+
+inline mat4 operator*(const mat4 &a, const mat4 &b)
+{
+  return mat4(a * b.c[0], a * b.c[1], a * b.c[2], a * b.c[3]);
+}
+
+inline mat3 operator*(const mat3 &a, const mat3 &b)
+{
+  return mat3(a * b.c[0], a * b.c[1], a * b.c[2]);
+}
+
+inline mat4 operator*(const mat4 &m, float s)
+{
+  return mat4(m.c[0] * s, m.c[1] * s, m.c[2] * s, m.c[3] * s);
+}
+
+inline mat3 operator*(const mat3 &m, float s)
+{
+  return mat3(m.c[0] * s, m.c[1] * s, m.c[2] * s);
+}
+
+// Geometric functions
+inline float dot(const vec2 &a, const vec2 &b)
+{
+  return (a.x * b.x) + (a.y * b.y);
+}
+
+inline float dot(const vec3 &a, const vec3 &b)
+{
+  return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+}
+
+inline float dot(const vec4 &a, const vec4 &b)
+{
+  return (a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w);
+}
+
+// A row vector times a matrix, which is the vector times the matrix's transpose
+inline vec4 operator*(const vec4 &v, const mat4 &m)
+{
+  return vec4(dot(v, m.c[0]), dot(v, m.c[1]), dot(v, m.c[2]), dot(v, m.c[3]));
+}
+
+inline vec3 operator*(const vec3 &v, const mat3 &m)
+{
+  return vec3(dot(v, m.c[0]), dot(v, m.c[1]), dot(v, m.c[2]));
+}
+
+inline vec3 cross(const vec3 &a, const vec3 &b)
+{
+  return vec3((a.y * b.z) - (a.z * b.y), (a.z * b.x) - (a.x * b.z), (a.x * b.y) - (a.y * b.x));
+}
+
+template <typename V> inline float length(const V &v)
+{
+  return sqrtf(dot(v, v));
+}
+
+inline float length(float f)
+{
+  return fabsf(f);
+}
+
+template <typename V> inline float distance(const V &a, const V &b)
+{
+  return length(a - b);
+}
+
+template <typename V> inline V normalize(const V &v)
+{
+  return v * (1.0f / length(v));
+}
+
+template <typename V> inline V reflect(const V &i, const V &n)
+{
+  return i - (n * (2.0f * dot(n, i)));
+}
+
+inline mat4 transpose(const mat4 &m)
+{
+  mat4 t;
+  for (int i = 0; i < 4; ++i)
+  {
+    for (int j = 0; j < 4; ++j)
+      t.c[i][j] = m.c[j][i];
+  }
+  return t;
+}
+
+inline mat3 transpose(const mat3 &m)
+{
+  mat3 t;
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+      t.c[i][j] = m.c[j][i];
+  }
+  return t;
+}
+
+inline mat3 inverse(const mat3 &m)
+{
+  // The rows of the inverse are the cross products of the columns, over the determinant
+  const vec3 r0 = cross(m.c[1], m.c[2]);
+  const vec3 r1 = cross(m.c[2], m.c[0]);
+  const vec3 r2 = cross(m.c[0], m.c[1]);
+  const float invDet = 1.0f / dot(m.c[0], r0);
+  return transpose(mat3(r0 * invDet, r1 * invDet, r2 * invDet));
+}
+
+// Functions of a float, applied to each component of a vector
+#define GLSL_COMPONENT_FUNCTION(name, f)                                                           \
+  inline float name(float a)                                                                       \
+  {                                                                                                \
+    return f(a);                                                                                   \
+  }                                                                                                \
+  inline vec2 name(const vec2 &a)                                                                  \
+  {                                                                                                \
+    return vec2(f(a.x), f(a.y));                                                                   \
+  }                                                                                                \
+  inline vec3 name(const vec3 &a)                                                                  \
+  {                                                                                                \
+    return vec3(f(a.x), f(a.y), f(a.z));                                                           \
+  }                                                                                                \
+  inline vec4 name(const vec4 &a)                                                                  \
+  {                                                                                                \
+    return vec4(f(a.x), f(a.y), f(a.z), f(a.w));                                                   \
+  }
+
+inline float Fract(float a)
+{
+  return a - floorf(a);
+}
+
+inline float Sign(float a)
+{
+  return a > 0.0f ? 1.0f : (a < 0.0f ? -1.0f : 0.0f);
+}
+
+inline float InverseSqrt(float a)
+{
+  return 1.0f / sqrtf(a);
+}
+
+GLSL_COMPONENT_FUNCTION(abs, fabsf)
+GLSL_COMPONENT_FUNCTION(sign, Sign)
+GLSL_COMPONENT_FUNCTION(floor, floorf)
+GLSL_COMPONENT_FUNCTION(ceil, ceilf)
+GLSL_COMPONENT_FUNCTION(fract, Fract)
+GLSL_COMPONENT_FUNCTION(sqrt, sqrtf)
+GLSL_COMPONENT_FUNCTION(inversesqrt, InverseSqrt)
+GLSL_COMPONENT_FUNCTION(exp, expf)
+GLSL_COMPONENT_FUNCTION(log, logf)
+GLSL_COMPONENT_FUNCTION(sin, sinf)
+GLSL_COMPONENT_FUNCTION(cos, cosf)
+GLSL_COMPONENT_FUNCTION(tan, tanf)
+
+#undef GLSL_COMPONENT_FUNCTION
+
+// Functions of two or three floats, applied to each component of vectors, where any argument
+// may instead be a float used for every component
+inline float(min)(float a, float b)
+{
+  return a < b ? a : b;
+}
+
+inline float(max)(float a, float b)
+{
+  return a > b ? a : b;
+}
+
+inline float(clamp)(float a, float lo, float hi)
+{
+  return a < lo ? lo : (a > hi ? hi : a);
+}
+
+inline float pow(float a, float b)
+{
+  return powf(a, b);
+}
+
+inline float mod(float a, float b)
+{
+  return a - (b * floorf(a / b));
+}
+
+inline float step(float edge, float a)
+{
+  return a < edge ? 0.0f : 1.0f;
+}
+
+inline float mix(float a, float b, float t)
+{
+  return a + ((b - a) * t);
+}
+
+inline float smoothstep(float lo, float hi, float a)
+{
+  const float t = (clamp)((a - lo) / (hi - lo), 0.0f, 1.0f);
+  return t * t * (3.0f - (2.0f * t));
+}
+
+inline int Components(const vec2 &)
+{
+  return 2;
+}
+
+inline int Components(const vec3 &)
+{
+  return 3;
+}
+
+inline int Components(const vec4 &)
+{
+  return 4;
+}
+
+inline float Component(float a, int)
+{
+  return a;
+}
+
+inline float Component(const vec2 &a, int i)
+{
+  return a[i];
+}
+
+inline float Component(const vec3 &a, int i)
+{
+  return a[i];
+}
+
+inline float Component(const vec4 &a, int i)
+{
+  return a[i];
+}
+
+template <typename T> struct IsVector : std::false_type
+{
+};
+
+template <> struct IsVector<vec2> : std::true_type
+{
+};
+
+template <> struct IsVector<vec3> : std::true_type
+{
+};
+
+template <> struct IsVector<vec4> : std::true_type
+{
+};
+
+// Result of a function of vectors and floats, which is the type of its vector arguments. Only
+// defined when there is one, so the vector versions aren't used for plain floats.
+template <typename A, typename B, typename C = float>
+struct VectorOf
+    : std::enable_if<IsVector<A>::value || IsVector<B>::value || IsVector<C>::value,
+                     typename std::conditional<
+                         IsVector<A>::value, A,
+                         typename std::conditional<IsVector<B>::value, B, C>::type>::type>
+{
+};
+
+#define GLSL_VECTOR_FUNCTION2(name)                                                                \
+  template <typename A, typename B>                                                                \
+  inline typename VectorOf<A, B>::type(name)(const A &a, const B &b)                               \
+  {                                                                                                \
+    typename VectorOf<A, B>::type r;                                                               \
+    for (int i = 0; i < Components(r); ++i)                                                        \
+      r[i] = (name)(Component(a, i), Component(b, i));                                             \
+    return r;                                                                                      \
+  }
+
+#define GLSL_VECTOR_FUNCTION3(name)                                                                \
+  template <typename A, typename B, typename C>                                                    \
+  inline typename VectorOf<A, B, C>::type(name)(const A &a, const B &b, const C &c)                \
+  {                                                                                                \
+    typename VectorOf<A, B, C>::type r;                                                            \
+    for (int i = 0; i < Components(r); ++i)                                                        \
+      r[i] = (name)(Component(a, i), Component(b, i), Component(c, i));                            \
+    return r;                                                                                      \
+  }
+
+GLSL_VECTOR_FUNCTION2(min)
+GLSL_VECTOR_FUNCTION2(max)
+GLSL_VECTOR_FUNCTION2(pow)
+GLSL_VECTOR_FUNCTION2(mod)
+GLSL_VECTOR_FUNCTION2(step)
+GLSL_VECTOR_FUNCTION3(clamp)
+GLSL_VECTOR_FUNCTION3(mix)
+GLSL_VECTOR_FUNCTION3(smoothstep)
+
+#undef GLSL_VECTOR_FUNCTION2
+#undef GLSL_VECTOR_FUNCTION3
+
+// Conversions to and from the pipeline's own types. Colours are 0 to 1 per channel.
+inline vec4 FromColour(const Colour &c)
+{
+  return vec4(_mm_mul_ps(_mm_set_ps(c.a, c.b, c.g, c.r), _mm_set1_ps(1.0f / 255.0f)));
+}
+
+inline Colour ToColour(const vec4 &v)
+{
+  __m128 c = _mm_min_ps(_mm_max_ps(v.sse(), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  c = _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+
+  float channels[4];
+  _mm_storeu_ps(channels, c);
+  return Colour((unsigned char)channels[0], (unsigned char)channels[1],
+                (unsigned char)channels[2], (unsigned char)channels[3]);
+}
+
+inline Vector2 ToVector2(const vec2 &v)
+{
+  return Vector2(v.x, v.y);
+}
+
+inline Vector3 ToVector3(const vec3 &v)
+{
+  return Vector3(v.x, v.y, v.z);
+}
+
+inline Vector4 ToVector4(const vec4 &v)
+{
+  return Vector4(v.x, v.y, v.z, v.w);
+}
+
+// Samplers are textures. A NULL sampler samples the draw's texture, so shaders written for a
+// single texture work with the texture of whatever they draw. Without either, samples are black.
+typedef Texture *sampler2D;
+
+inline vec4 texture(const DrawState &state, sampler2D sampler, const vec2 &texCoord)
+{
+  Texture *t = sampler ? sampler : state.texture;
+  if (!t)
+    return vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+  const Vector3 coords(texCoord.x, texCoord.y, 1.0f);
+  if (state.sampleMode == SAMPLE_BILINEAR)
+    return FromColour(t->BilinearTexSample(coords));
+  return FromColour(t->NearestTexSample(coords));
+}
+} // namespace glsl
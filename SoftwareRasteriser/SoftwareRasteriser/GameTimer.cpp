@@ -0,0 +1,35 @@
+#include "GameTimer.h"
+
+GameTimer::GameTimer(void)
+{
+#ifdef _WIN32
+  QueryPerformanceFrequency((LARGE_INTEGER *)&frequency);
+  QueryPerformanceCounter((LARGE_INTEGER *)&start);
+#else
+  start = std::chrono::steady_clock::now();
+#endif
+
+  lastTime = GetMS();
+}
+
+/*
+Returns the Milliseconds since timer was started
+*/
+float GameTimer::GetMS() const
+{
+#ifdef _WIN32
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (float)((t.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart);
+#else
+  return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+float GameTimer::GetTimedMS()
+{
+  float a = GetMS();
+  float b = a - lastTime;
+  lastTime = a;
+  return b;
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+Class:GameTimer
+Implements:
+Author:Rich Davison	<richard.davison4@newcastle.ac.uk>
+Description:Wraps Windows PerformanceCounter (or std::chrono::steady_clock
+on other platforms). GameTimers keep track of how much
+time has passed since they were last polled - so you could use multiple
+GameTimers to trigger events at different time periods.
+
+-_-_-_-_-_-_-_,------,
+_-_-_-_-_-_-_-|   /\_/\   NYANYANYAN
+-_-_-_-_-_-_-~|__( ^ .^) /
+_-_-_-_-_-_-_-""  ""
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+class GameTimer
+{
+public:
+  GameTimer(void);
+  ~GameTimer(void)
+  {
+  }
+
+  // How many milliseconds have passed since the GameTimer was created
+  float GetMS() const;
+
+  // How many milliseconds have passed since GetTimedMS was last called
+  float GetTimedMS();
+
+protected:
+#ifdef _WIN32
+  LARGE_INTEGER start;     // Start of timer
+  LARGE_INTEGER frequency; // Ticks Per Second
+#else
+  std::chrono::steady_clock::time_point start; // Start of timer
+#endif
+
+  float lastTime; // Last time GetTimedMS was called
+};
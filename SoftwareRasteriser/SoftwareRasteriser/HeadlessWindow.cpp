@@ -0,0 +1,148 @@
+#include "Window.h"
+
+#ifdef HEADLESS_WINDOW
+
+// Frames run when nothing sets a limit, so a headless run always terminates
+static const uint DEFAULT_FRAME_LIMIT = 100;
+
+Window::Window(uint width, uint height)
+{
+  hasInit = false;
+
+  screenWidth = width;
+  screenHeight = height;
+
+  bufferData[0] = NULL;
+  bufferData[1] = NULL;
+  BuildBitmap();
+
+  frameLimit = DEFAULT_FRAME_LIMIT;
+  frameCount = 0;
+  updateCount = 0;
+  frameSink = NULL;
+
+  // There's no OS window, but the input devices still need to exist so that
+  // polling them simply reports nothing
+  HWND windowHandle = NULL;
+  Keyboard::Initialise(windowHandle);
+  Mouse::Initialise(windowHandle);
+
+  hasInit = true;
+  forceQuit = false;
+}
+
+Window::~Window(void)
+{
+  delete[](unsigned int *)bufferData[0];
+  delete[](unsigned int *)bufferData[1];
+
+  Keyboard::Destroy();
+  Mouse::Destroy();
+}
+
+/*
+Allocates the two buffers the Win32 window would get from its DIB sections.
+*/
+void Window::BuildBitmap()
+{
+  delete[](unsigned int *)bufferData[0];
+  delete[](unsigned int *)bufferData[1];
+
+  for (int i = 0; i < 2; ++i)
+  {
+    bufferData[i] = new unsigned int[screenWidth * screenHeight];
+    memset(bufferData[i], 0, screenWidth * screenHeight * sizeof(unsigned int));
+  }
+}
+
+/*
+"Presents" a frame by copying it into the second buffer (as the Win32 window
+does before a BitBlt), then passes it on to the dump file and frame sink.
+*/
+void Window::PresentBuffer(Colour *buffer)
+{
+  if ((void *)buffer != bufferData[1])
+    memcpy(bufferData[1], buffer, screenWidth * screenHeight * sizeof(unsigned int));
+
+  FinishPresent();
+}
+
+/*
+As above, but only copies the rectangles that have changed. The rest of the
+second buffer still holds the last frame presented.
+*/
+void Window::PresentBuffer(Colour *buffer, const std::vector<ScreenRect> &rects)
+{
+  if ((void *)buffer != bufferData[1])
+    CopyBufferRects(bufferData[1], buffer, screenWidth, rects);
+
+  FinishPresent();
+}
+
+/*
+Passes the frame that has just been presented on to the dump file and frame
+sink.
+*/
+void Window::FinishPresent()
+{
+  const Colour *frame = (const Colour *)bufferData[1];
+
+  if (!dumpPrefix.empty())
+    DumpFrame(frame);
+
+  if (frameSink)
+    frameSink->ReceiveFrame(frame, screenWidth, screenHeight, frameCount);
+
+  frameCount++;
+}
+
+/*
+Writes a frame as a binary PPM. The buffer is bottom-up BGRA, so rows are
+written in reverse and channels swizzled to RGB.
+*/
+void Window::DumpFrame(const Colour *buffer) const
+{
+  std::stringstream filename;
+  filename << dumpPrefix << std::setw(5) << std::setfill('0') << frameCount << ".ppm";
+
+  std::ofstream file(filename.str().c_str(), std::ios::binary);
+  if (!file)
+  {
+    std::cout << "Could not write frame to " << filename.str() << std::endl;
+    return;
+  }
+
+  file << "P6\n" << screenWidth << " " << screenHeight << "\n255\n";
+
+  std::vector<unsigned char> row(screenWidth * 3);
+  for (int y = (int)screenHeight - 1; y >= 0; --y)
+  {
+    const Colour *in = buffer + (y * screenWidth);
+    for (uint x = 0; x < screenWidth; ++x)
+    {
+      row[(x * 3) + 0] = in[x].r;
+      row[(x * 3) + 1] = in[x].g;
+      row[(x * 3) + 2] = in[x].b;
+    }
+    file.write((const char *)&row[0], row.size());
+  }
+}
+
+/*
+Advances the scripted frame count, returning false once the frame limit has
+been reached.
+*/
+bool Window::UpdateWindow()
+{
+  Keyboard::instance->UpdateHolds();
+  Mouse::instance->UpdateHolds();
+
+  if (frameLimit > 0 && updateCount >= frameLimit)
+    forceQuit = true;
+
+  updateCount++;
+
+  return !forceQuit;
+}
+
+#endif
@@ -0,0 +1,99 @@
+#include "Impostor.h"
+
+Impostor::Impostor(uint maxSize)
+{
+  m_maxSize = max(maxSize, 1u);
+  m_maxAngle = 1.0f;
+  m_maxDistanceChange = 0.1f;
+
+  m_boundsValid = false;
+
+  m_rendered = false;
+  m_distance = 0.0f;
+  m_quad = Mesh::GenerateQuad();
+
+  for (int i = 0; i < 2; ++i)
+    m_textures[i] = new Texture();
+  m_currentTexture = 0;
+  m_refreshCount = 0;
+}
+
+Impostor::~Impostor(void)
+{
+  for (int i = 0; i < 2; ++i)
+    delete m_textures[i];
+  delete m_quad;
+}
+
+void Impostor::AddObject(RenderObject *o)
+{
+  m_objects.push_back(o);
+  Invalidate();
+}
+
+/**
+ * Transforms the corners of each object's bounding box into world space, and finds the centre of
+ * the group from them.
+ */
+void Impostor::UpdateBounds()
+{
+  if (m_boundsValid)
+    return;
+
+  m_corners.clear();
+  Vector3 groupMin;
+  Vector3 groupMax;
+
+  for (size_t i = 0; i < m_objects.size(); ++i)
+  {
+    Mesh *mesh = m_objects[i]->GetMesh();
+    if (mesh->GetNumVertices() == 0)
+      continue;
+
+    Vector3 boundsMin;
+    Vector3 boundsMax;
+    mesh->GetBounds(boundsMin, boundsMax);
+
+    const Matrix4 modelMatrix = m_objects[i]->GetModelMatrix();
+    for (int c = 0; c < 8; ++c)
+    {
+      const Vector3 corner = modelMatrix * Vector3((c & 1) ? boundsMax.x : boundsMin.x,
+                                                   (c & 2) ? boundsMax.y : boundsMin.y,
+                                                   (c & 4) ? boundsMax.z : boundsMin.z);
+      if (m_corners.empty())
+      {
+        groupMin = corner;
+        groupMax = corner;
+      }
+
+      groupMin = Vector3(min(groupMin.x, corner.x), min(groupMin.y, corner.y),
+                         min(groupMin.z, corner.z));
+      groupMax = Vector3(max(groupMax.x, corner.x), max(groupMax.y, corner.y),
+                         max(groupMax.z, corner.z));
+      m_corners.push_back(corner);
+    }
+  }
+
+  m_centre = (groupMin + groupMax) * 0.5f;
+  m_boundsValid = true;
+}
+
+/**
+ * Checks whether the group has been viewed from far enough away from where it was last rendered
+ * to need rendering again.
+ *
+ * \param direction Normalised direction from the camera to the centre of the group
+ * \param distance Distance from the camera to the centre of the group
+ * \return True if the group needs rendering again
+ */
+bool Impostor::NeedsRefresh(const Vector3 &direction, float distance) const
+{
+  if (!m_rendered)
+    return true;
+
+  const float cosAngle = clamp(Vector3::Dot(direction, m_direction), -1.0f, 1.0f);
+  if (RadToDeg(acos(cosAngle)) > m_maxAngle)
+    return true;
+
+  return abs((distance / m_distance) - 1.0f) > m_maxDistanceChange;
+}
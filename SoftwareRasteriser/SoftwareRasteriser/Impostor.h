@@ -0,0 +1,98 @@
+/******************************************************************************
+Class:Impostor
+Implements:
+Description: A group of distant objects drawn as a single textured quad.
+
+SoftwareRasteriser::DrawImpostor renders the group into a texture from the
+camera's position, with a view just containing the bounding boxes of its
+objects, then draws the texture on a quad through the centre of the group,
+facing the position it was rendered from. Later frames draw only the quad,
+until the direction or distance to the group changes by more than the
+impostor's thresholds and it is rendered again. Turning the camera on the
+spot never needs a refresh, as the group still looks the same from where the
+camera is.
+
+The objects are expected to keep still relative to each other: call
+Invalidate if any of them move. The quad is drawn alpha blended and without
+writing depth, as its transparent texels would otherwise hide anything drawn
+behind them later, so impostors should be drawn after whatever they may
+cover. Groups that are close enough to cover more pixels than the
+impostor's largest texture size (or the window) are drawn normally instead,
+as are groups the camera is within the bounds of.
+
+Two textures are kept and swapped at each refresh, so a frame recorded before
+a refresh (in pipelined mode, or kept for comparison by incremental
+rendering) never sees the texture change under it.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SoftwareRasteriser.h"
+
+#include <vector>
+
+class Impostor
+{
+public:
+  // maxSize is the largest texture width and height used, in pixels
+  Impostor(uint maxSize = 256);
+  ~Impostor(void);
+
+  // Adds an object to the group, which doesn't own it
+  void AddObject(RenderObject *o);
+
+  const vector<RenderObject *> &GetObjects() const
+  {
+    return m_objects;
+  }
+
+  // Sets how far the direction to the group (in degrees) and the distance to it (as a fraction of
+  // the distance it was rendered from) can change before it is rendered again
+  void SetRefreshThresholds(float maxAngle, float maxDistanceChange)
+  {
+    m_maxAngle = maxAngle;
+    m_maxDistanceChange = maxDistanceChange;
+  }
+
+  // Makes the next draw render the group again, and recalculate its bounds
+  void Invalidate()
+  {
+    m_boundsValid = false;
+    m_rendered = false;
+  }
+
+  // Number of times the group has been rendered into a texture
+  uint GetRefreshCount() const
+  {
+    return m_refreshCount;
+  }
+
+protected:
+  friend class SoftwareRasteriser;
+
+  void UpdateBounds();
+  bool NeedsRefresh(const Vector3 &direction, float distance) const;
+
+  vector<RenderObject *> m_objects;
+
+  uint m_maxSize;
+  float m_maxAngle;
+  float m_maxDistanceChange;
+
+  // World space corners of each object's bounding box, and the centre of the box around them all
+  bool m_boundsValid;
+  vector<Vector3> m_corners;
+  Vector3 m_centre;
+
+  // Where the group was last rendered from, and the quad showing it from there
+  bool m_rendered;
+  Vector3 m_direction; // Normalised, from the camera to the centre
+  float m_distance;
+  Matrix4 m_quadMatrix;
+  Mesh *m_quad;
+
+  Texture *m_textures[2];
+  int m_currentTexture;
+  uint m_refreshCount;
+};
@@ -19,6 +19,17 @@ _-_-_-_-_-_-_-""  ""
 */ /////////////////////////////////////////////////////////////////////////////
 
 #pragma once
+#include "Common.h"
+
+#ifdef HEADLESS_WINDOW
+// Stand-ins for the Win32 types used by the input devices, which never see any
+// OS input when running headless
+typedef void *HWND;
+struct RAWINPUT;
+struct RAWINPUTDEVICE
+{
+};
+#else
 #include <windows.h>
 
 /*
@@ -36,6 +47,7 @@ despite it being how RAW input works....GG guys.
 #ifndef HID_USAGE_GENERIC_KEYBOARD
 #define HID_USAGE_GENERIC_KEYBOARD ((USHORT)0x06)
 #endif
+#endif
 
 class InputDevice
 {
@@ -0,0 +1,273 @@
+#include "JobSystem.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+JobSystem *JobSystem::instance = NULL;
+
+void JobCounter::Add(int jobs)
+{
+  // A child counter holds one job of its parent while it has any of its own
+  if (m_count.fetch_add(jobs) == 0 && m_parent)
+    m_parent->Add(1);
+}
+
+void JobCounter::Finish()
+{
+  // Whoever is waiting may destroy the counter as soon as it reaches zero
+  JobCounter *parent = m_parent;
+  if (m_count.fetch_sub(1) == 1 && parent)
+    parent->Finish();
+}
+
+void JobSystem::Initialise(uint workers, bool pinThreads)
+{
+  delete instance;
+  instance = new JobSystem(workers, pinThreads);
+}
+
+void JobSystem::Destroy()
+{
+  delete instance;
+  instance = NULL;
+}
+
+uint JobSystem::DefaultWorkers()
+{
+  const uint cores = std::thread::hardware_concurrency();
+  return cores > 1 ? cores - 1 : 0;
+}
+
+JobSystem::JobSystem(uint workers, bool pinThreads)
+{
+  m_queuedJobs = 0;
+  m_sleepingWorkers = 0;
+  m_exit = false;
+
+  for (uint i = 0; i <= workers; ++i)
+    m_queues.push_back(new JobQueue());
+
+  m_threads.reserve(workers);
+  m_threadIds.reserve(workers);
+  for (uint i = 0; i < workers; ++i)
+  {
+    m_threads.push_back(std::thread(&JobSystem::WorkerMain, this, i + 1, pinThreads));
+    m_threadIds.push_back(m_threads.back().get_id());
+  }
+}
+
+/**
+ * Stops the workers. Every job must have been waited for first.
+ */
+JobSystem::~JobSystem(void)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_exit = true;
+  }
+  m_sleepCond.notify_all();
+
+  for (size_t i = 0; i < m_threads.size(); ++i)
+    m_threads[i].join();
+
+  for (size_t i = 0; i < m_queues.size(); ++i)
+    delete m_queues[i];
+}
+
+void JobSystem::Spawn(const Job &job)
+{
+  if (job.counter)
+    job.counter->Add(1);
+
+  JobQueue &queue = *m_queues[QueueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(job);
+    m_queuedJobs++;
+  }
+
+  WakeWorkers(1);
+}
+
+/**
+ * Spawns a job for each chunk of a range. The jobs are all pushed while holding the queue's lock
+ * once, which is a lot cheaper than spawning them one at a time.
+ *
+ * \param function Function every job runs
+ * \param data Data passed to every job
+ * \param begin First element of the range
+ * \param end One past the last element of the range
+ * \param chunkSize Elements per job (the last may get fewer)
+ * \param counter Counter for the jobs
+ */
+void JobSystem::SpawnRange(JobFunction function, void *data, uint begin, uint end,
+                           uint chunkSize, JobCounter &counter)
+{
+  if (end <= begin)
+    return;
+
+  chunkSize = max(chunkSize, 1u);
+  const uint jobs = ((end - begin) + chunkSize - 1) / chunkSize;
+  counter.Add(jobs);
+
+  Job job;
+  job.function = function;
+  job.data = data;
+  job.counter = &counter;
+
+  JobQueue &queue = *m_queues[QueueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    // Pushed last to first, so the owner pops them in order and thieves take the end of the range
+    for (uint i = jobs; i-- > 0;)
+    {
+      job.begin = begin + (i * chunkSize);
+      job.end = min(job.begin + chunkSize, end);
+      queue.jobs.push_back(job);
+    }
+    m_queuedJobs += jobs;
+  }
+
+  WakeWorkers(jobs);
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+  const uint queue = QueueIndex();
+
+  while (!counter.IsDone())
+  {
+    // Anything left is already running on another thread
+    if (!RunJob(queue))
+      std::this_thread::yield();
+  }
+}
+
+void JobSystem::WorkerMain(uint queue, bool pinThread)
+{
+  if (pinThread)
+    PinThread(queue - 1);
+
+  while (true)
+  {
+    if (RunJob(queue))
+      continue;
+
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_sleepingWorkers++;
+    while (m_queuedJobs == 0 && !m_exit)
+      m_sleepCond.wait(lock);
+    m_sleepingWorkers--;
+
+    if (m_exit)
+      return;
+  }
+}
+
+// Queue used by the calling thread
+uint JobSystem::QueueIndex() const
+{
+  const std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < m_threadIds.size(); ++i)
+  {
+    if (m_threadIds[i] == id)
+      return (uint)i + 1;
+  }
+  return 0;
+}
+
+/**
+ * Runs one job, from the thread's own queue if it has any or otherwise stolen from another.
+ *
+ * \param queue Queue owned by the calling thread
+ * \return False if there were no jobs to run
+ */
+bool JobSystem::RunJob(uint queue)
+{
+  Job job;
+  if (!PopJob(queue, job) && !StealJob(queue, job))
+    return false;
+
+  job.function(job);
+
+  if (job.counter)
+    job.counter->Finish();
+
+  return true;
+}
+
+bool JobSystem::PopJob(uint queue, Job &job)
+{
+  JobQueue &q = *m_queues[queue];
+  std::lock_guard<std::mutex> lock(q.mutex);
+
+  if (q.jobs.empty())
+    return false;
+
+  job = q.jobs.back();
+  q.jobs.pop_back();
+  m_queuedJobs--;
+  return true;
+}
+
+bool JobSystem::StealJob(uint thief, Job &job)
+{
+  if (m_queuedJobs == 0)
+    return false;
+
+  // Start with the next queue along, so thieves don't all go for the same victim
+  const uint numQueues = (uint)m_queues.size();
+  for (uint i = 1; i < numQueues; ++i)
+  {
+    JobQueue &q = *m_queues[(thief + i) % numQueues];
+    std::lock_guard<std::mutex> lock(q.mutex);
+
+    if (q.jobs.empty())
+      continue;
+
+    job = q.jobs.front();
+    q.jobs.pop_front();
+    m_queuedJobs--;
+    return true;
+  }
+
+  return false;
+}
+
+void JobSystem::WakeWorkers(uint jobs)
+{
+  // Workers count themselves as sleeping before checking for jobs, so either they see the new
+  // jobs or this sees them
+  if (m_sleepingWorkers == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+  }
+
+  if (jobs == 1)
+    m_sleepCond.notify_one();
+  else
+    m_sleepCond.notify_all();
+}
+
+void JobSystem::PinThread(uint core)
+{
+  const uint cores = max(std::thread::hardware_concurrency(), 1u);
+
+#ifdef _WIN32
+  SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % cores));
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core % cores, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cores;
+#endif
+}
@@ -0,0 +1,169 @@
+/******************************************************************************
+Class:JobSystem
+Implements:
+Description: A pool of worker threads that run small jobs, shared by anything
+that wants to split work across cores.
+
+Each worker has its own deque of jobs. A worker pushes and pops jobs at the
+back of its own deque, and when that is empty it steals from the front of the
+others. Threads that aren't workers share one extra deque, and while they wait
+for their jobs to finish they run jobs too, rather than blocking.
+
+Jobs are plain structs copied into the deques, so spawning one never
+allocates. Each job decrements a JobCounter when it finishes, which is how
+callers wait for their work. A counter can have a parent, which counts as one
+unfinished job for as long as the child counter has any, so a job can spawn
+children into a counter of its own and anyone waiting on the parent also
+waits for them.
+
+ParallelFor is the usual way in: it splits a range into chunks, runs them as
+jobs and returns once they're all done. If there is no job system (or it has
+no workers) the range is just run on the calling thread.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter
+{
+public:
+  JobCounter(JobCounter *parent = NULL)
+      : m_count(0)
+      , m_parent(parent)
+  {
+  }
+
+  bool IsDone() const
+  {
+    return m_count.load() == 0;
+  }
+
+protected:
+  friend class JobSystem;
+
+  void Add(int jobs);
+  void Finish();
+
+  std::atomic<int> m_count;
+  JobCounter *m_parent;
+};
+
+struct Job;
+typedef void (*JobFunction)(const Job &job);
+
+struct Job
+{
+  JobFunction function;
+  void *data;
+  uint begin;
+  uint end;
+  JobCounter *counter; // Decremented when the job has run
+};
+
+class JobSystem
+{
+public:
+  // Starts the shared job system with a number of worker threads (0 runs everything on the
+  // threads that spawn jobs), optionally pinning each worker to its own core
+  static void Initialise(uint workers, bool pinThreads = false);
+  static void Destroy();
+
+  static JobSystem *instance;
+
+  // Worker threads to use when nothing else says, leaving one core for the main thread
+  static uint DefaultWorkers();
+
+  uint GetNumWorkers() const
+  {
+    return (uint)m_threads.size();
+  }
+
+  void Spawn(const Job &job);
+
+  // Spawns a job for each chunkSize elements of [begin, end), all sharing a function and data
+  void SpawnRange(JobFunction function, void *data, uint begin, uint end, uint chunkSize,
+                  JobCounter &counter);
+
+  // Runs jobs on the calling thread until every job counted by the counter has run
+  void Wait(JobCounter &counter);
+
+  /**
+   * Calls f(chunkBegin, chunkEnd) over chunks of [begin, end) in parallel, returning once every
+   * chunk has been processed. The first chunk is run on the calling thread.
+   *
+   * \param begin First element
+   * \param end One past the last element
+   * \param grainSize Smallest chunk worth a job of its own
+   * \param f Function to call for each chunk
+   */
+  template <typename F> static void ParallelFor(uint begin, uint end, uint grainSize, const F &f)
+  {
+    if (end <= begin)
+      return;
+
+    const uint count = end - begin;
+    grainSize = max(grainSize, 1u);
+
+    if (instance == NULL || instance->m_threads.empty() || count <= grainSize)
+    {
+      f(begin, end);
+      return;
+    }
+
+    // A few chunks per thread, so threads that finish early can steal the rest
+    const uint maxChunks = (instance->GetNumWorkers() + 1) * 4;
+    const uint chunks = min((count + grainSize - 1) / grainSize, maxChunks);
+    const uint chunkSize = (count + chunks - 1) / chunks;
+
+    JobCounter counter;
+    instance->SpawnRange(&RunParallelForChunk<F>, (void *)&f, begin + chunkSize, end, chunkSize,
+                         counter);
+    f(begin, begin + chunkSize);
+    instance->Wait(counter);
+  }
+
+protected:
+  JobSystem(uint workers, bool pinThreads);
+  ~JobSystem(void);
+
+  template <typename F> static void RunParallelForChunk(const Job &job)
+  {
+    (*(const F *)job.data)(job.begin, job.end);
+  }
+
+  struct JobQueue
+  {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  void WorkerMain(uint queue, bool pinThread);
+
+  uint QueueIndex() const;
+  bool RunJob(uint queue);
+  bool PopJob(uint queue, Job &job);
+  bool StealJob(uint thief, Job &job);
+  void WakeWorkers(uint jobs);
+
+  static void PinThread(uint core);
+
+  // Queue 0 is shared by threads that aren't workers, worker i owns queue i + 1
+  std::vector<JobQueue *> m_queues;
+  std::vector<std::thread> m_threads;
+  std::vector<std::thread::id> m_threadIds;
+
+  std::atomic<int> m_queuedJobs;
+  std::atomic<int> m_sleepingWorkers;
+  std::mutex m_sleepMutex;
+  std::condition_variable m_sleepCond;
+  bool m_exit;
+};
@@ -5,15 +5,17 @@ Keyboard *Keyboard::instance = 0;
 Keyboard::Keyboard(HWND &hwnd)
 {
   // Initialise the arrays to false!
-  ZeroMemory(keyStates, KEY_MAX * sizeof(bool));
-  ZeroMemory(holdStates, KEY_MAX * sizeof(bool));
+  memset(keyStates, 0, KEY_MAX * sizeof(bool));
+  memset(holdStates, 0, KEY_MAX * sizeof(bool));
 
+#ifndef HEADLESS_WINDOW
   // Tedious windows RAW input stuff
   rid.usUsagePage = HID_USAGE_PAGE_GENERIC; // The keyboard isn't anything fancy
   rid.usUsage = HID_USAGE_GENERIC_KEYBOARD; // but it's definitely a keyboard!
   rid.dwFlags = RIDEV_INPUTSINK; // Yes, we want to always receive RAW input...
   rid.hwndTarget = hwnd; // Windows OS window handle
   RegisterRawInputDevices(&rid, 1, sizeof(rid)); // We just want one keyboard, please!
+#endif
 }
 
 void Keyboard::Initialise(HWND &hwnd)
@@ -43,8 +45,8 @@ void Keyboard::Sleep()
 {
   isAwake = false; // Night night!
   // Prevents incorrectly thinking keys have been held / pressed when waking back up
-  ZeroMemory(instance->keyStates, KEY_MAX * sizeof(bool));
-  ZeroMemory(instance->holdStates, KEY_MAX * sizeof(bool));
+  memset(instance->keyStates, 0, KEY_MAX * sizeof(bool));
+  memset(instance->holdStates, 0, KEY_MAX * sizeof(bool));
 }
 
 /*
@@ -83,6 +85,7 @@ Updates the keyboard state with data received from the OS.
 */
 void Keyboard::Update(RAWINPUT *raw)
 {
+#ifndef HEADLESS_WINDOW
   if (isAwake)
   {
     DWORD key = (DWORD)raw->data.keyboard.VKey;
@@ -96,4 +99,5 @@ void Keyboard::Update(RAWINPUT *raw)
     // First bit of the flags tag determines whether the key is down or up
     keyStates[key] = !(raw->data.keyboard.Flags & RI_KEY_BREAK);
   }
+#endif
 }
@@ -73,6 +73,26 @@ Matrix4 Matrix4::Perspective(float znear, float zfar, float aspect, float fov)
   return m;
 }
 
+// http://www.opengl.org/sdk/docs/man/xhtml/glFrustum.xml
+Matrix4 Matrix4::Frustum(float left, float right, float bottom, float top, float znear,
+                         float zfar)
+{
+  Matrix4 m;
+
+  float negDepth = znear - zfar;
+
+  m.values[0] = 2.0f * znear / (right - left);
+  m.values[5] = 2.0f * znear / (top - bottom);
+  m.values[8] = (right + left) / (right - left);
+  m.values[9] = (top + bottom) / (top - bottom);
+  m.values[10] = (zfar + znear) / negDepth;
+  m.values[11] = -1.0f;
+  m.values[14] = 2.0f * (znear * zfar) / negDepth;
+  m.values[15] = 0.0f;
+
+  return m;
+}
+
 // http://www.opengl.org/sdk/docs/man/xhtml/glOrtho.xml
 Matrix4 Matrix4::Orthographic(float znear, float zfar, float right, float left, float top,
                               float bottom)
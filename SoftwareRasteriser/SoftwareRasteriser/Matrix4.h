@@ -16,7 +16,7 @@ _-_-_-_-_-_-_-""  ""
 #pragma once
 
 #include <iostream>
-#include "common.h"
+#include "Common.h"
 #include "Vector3.h"
 #include "Vector4.h"
 
@@ -63,6 +63,11 @@ public:
   // field of vision, respectively.
   static Matrix4 Perspective(float znear, float zfar, float aspect, float fov);
 
+  // Creates a perspective matrix that can be off centre, with 'left', 'right',
+  // 'bottom' and 'top' as the edges of the near plane. Analogous to glFrustum
+  static Matrix4 Frustum(float left, float right, float bottom, float top, float znear,
+                         float zfar);
+
   // Creates an orthographic matrix with 'znear' and 'zfar' as the near and
   // far planes, and so on. Descriptive variable names are a good thing!
   static Matrix4 Orthographic(float znear, float zfar, float right, float left, float top,
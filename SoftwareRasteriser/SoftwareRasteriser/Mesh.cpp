@@ -10,6 +10,10 @@ Mesh::Mesh(void)
   vertices = NULL;
   colours = NULL;
   textureCoords = NULL;
+  normals = NULL;
+
+  boundsValid = false;
+  blockBounds = NULL;
 }
 
 Mesh::~Mesh(void)
@@ -17,6 +21,85 @@ Mesh::~Mesh(void)
   delete[] vertices;
   delete[] colours;
   delete[] textureCoords;
+  delete[] normals;
+  delete[] blockBounds;
+}
+
+/**
+ * Gets the axis aligned bounding box of the mesh's vertices. It is only calculated once, so the
+ * vertices must not change after the first call.
+ *
+ * \param outMin Receives the smallest coordinate on each axis
+ * \param outMax Receives the largest coordinate on each axis
+ */
+void Mesh::GetBounds(Vector3 &outMin, Vector3 &outMax)
+{
+  if (!boundsValid)
+  {
+    boundsMin = Vector3(0, 0, 0);
+    boundsMax = Vector3(0, 0, 0);
+
+    for (uint i = 0; i < numVertices; ++i)
+    {
+      const Vector4 &v = vertices[i];
+      if (i == 0)
+      {
+        boundsMin = Vector3(v.x, v.y, v.z);
+        boundsMax = boundsMin;
+        continue;
+      }
+
+      boundsMin.x = min(boundsMin.x, v.x);
+      boundsMin.y = min(boundsMin.y, v.y);
+      boundsMin.z = min(boundsMin.z, v.z);
+      boundsMax.x = max(boundsMax.x, v.x);
+      boundsMax.y = max(boundsMax.y, v.y);
+      boundsMax.z = max(boundsMax.z, v.z);
+    }
+
+    boundsValid = true;
+  }
+
+  outMin = boundsMin;
+  outMax = boundsMax;
+}
+
+/**
+ * Gets the axis aligned bounding box of each block of POINTS_PER_BLOCK vertices, the last block
+ * holding whatever is left over. They are only calculated once, so the vertices must not change
+ * after the first call.
+ *
+ * \return Smallest then largest corner of each block's box
+ */
+const Vector3 *Mesh::GetBlockBounds()
+{
+  if (!blockBounds)
+  {
+    const uint numBlocks = (numVertices + POINTS_PER_BLOCK - 1) / POINTS_PER_BLOCK;
+    blockBounds = new Vector3[max(numBlocks, 1u) * 2];
+
+    for (uint i = 0; i < numVertices; ++i)
+    {
+      const Vector4 &v = vertices[i];
+      Vector3 &blockMin = blockBounds[(i / POINTS_PER_BLOCK) * 2];
+      Vector3 &blockMax = blockBounds[((i / POINTS_PER_BLOCK) * 2) + 1];
+      if (i % POINTS_PER_BLOCK == 0)
+      {
+        blockMin = Vector3(v.x, v.y, v.z);
+        blockMax = blockMin;
+        continue;
+      }
+
+      blockMin.x = min(blockMin.x, v.x);
+      blockMin.y = min(blockMin.y, v.y);
+      blockMin.z = min(blockMin.z, v.z);
+      blockMax.x = max(blockMax.x, v.x);
+      blockMax.y = max(blockMax.y, v.y);
+      blockMax.z = max(blockMax.z, v.z);
+    }
+  }
+
+  return blockBounds;
 }
 
 Mesh *Mesh::LoadMeshFile(const string &filename)
@@ -87,6 +170,34 @@ Mesh *Mesh::GeneratePoint(const Vector3 &from, const Colour &col)
   return m;
 }
 
+/**
+ * Generates a mesh of many points, so they can be drawn in one go.
+ *
+ * \param positions Position of each point
+ * \param colours Colour of each point
+ * \param count Number of points
+ * \return New mesh
+ */
+Mesh *Mesh::GeneratePoints(const Vector3 *positions, const Colour *colours, const uint count)
+{
+  Mesh *m = new Mesh();
+  m->type = PRIMITIVE_POINTS;
+
+  m->numVertices = count;
+  m->vertices = new Vector4[m->numVertices];
+  m->colours = new Colour[m->numVertices];
+  m->textureCoords = new Vector2[m->numVertices];
+
+  for (uint i = 0; i < m->numVertices; ++i)
+  {
+    m->vertices[i] = Vector4(positions[i].x, positions[i].y, positions[i].z, 1.0f);
+    m->colours[i] = colours[i];
+    m->textureCoords[i] = Vector2(0.0f, 0.0f);
+  }
+
+  return m;
+}
+
 Mesh *Mesh::GenerateLine(const Vector3 &from, const Vector3 &to)
 {
   Mesh *m = new Mesh();
@@ -226,6 +337,35 @@ Mesh *Mesh::GenerateTriangleFan()
   return m;
 }
 
+/**
+ * Generates a white square from (-1, -1) to (1, 1) in the XY plane, with texture coordinates
+ * running from 0 to 1 across it.
+ *
+ * \return New mesh
+ */
+Mesh *Mesh::GenerateQuad()
+{
+  Mesh *m = new Mesh();
+  m->type = PRIMITIVE_TRIANGLE_STRIP;
+
+  m->numVertices = 4;
+  m->vertices = new Vector4[m->numVertices];
+  m->colours = new Colour[m->numVertices];
+  m->textureCoords = new Vector2[m->numVertices];
+
+  for (uint i = 0; i < m->numVertices; ++i)
+  {
+    const float x = (i & 1) ? 1.0f : 0.0f;
+    const float y = (i & 2) ? 1.0f : 0.0f;
+
+    m->vertices[i] = Vector4((x * 2.0f) - 1.0f, (y * 2.0f) - 1.0f, 0.0f, 1.0f);
+    m->colours[i] = Colour::White;
+    m->textureCoords[i] = Vector2(x, y);
+  }
+
+  return m;
+}
+
 /**
  * Generates a 3D sphere.
  *
@@ -243,6 +383,7 @@ Mesh *Mesh::GenerateSphere(const float radius, const int resolution, const Colou
   m->vertices = new Vector4[m->numVertices];
   m->colours = new Colour[m->numVertices];
   m->textureCoords = new Vector2[m->numVertices];
+  m->normals = new Vector3[m->numVertices];
 
   const float deltaTheta = (PI / resolution);
   const float deltaPhi = ((PI * 2) / resolution);
@@ -268,12 +409,14 @@ Mesh *Mesh::GenerateSphere(const float radius, const int resolution, const Colou
                                cos(phi) * radius, 1.0f);
       m->colours[n] = c;
       m->textureCoords[n] = Vector2(u1, v);
+      m->normals[n] = Vector3(cos(theta1) * sin(phi), sin(theta1) * sin(phi), cos(phi));
       n++;
 
       m->vertices[n] = Vector4(cos(theta2) * sin(phi) * radius, sin(theta2) * sin(phi) * radius,
                                cos(phi) * radius, 1.0f);
       m->colours[n] = c;
       m->textureCoords[n] = Vector2(u2, v);
+      m->normals[n] = Vector3(cos(theta2) * sin(phi), sin(theta2) * sin(phi), cos(phi));
       n++;
     }
   }
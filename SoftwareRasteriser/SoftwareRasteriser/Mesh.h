@@ -26,6 +26,10 @@ _-_-_-_-_-_-_-""  ""
 using std::ifstream;
 using std::string;
 
+// Points meshes have a bounding box for each block of this many points, so that blocks entirely
+// off screen can be skipped without transforming their points
+#define POINTS_PER_BLOCK 256
+
 enum PrimitiveType
 {
   PRIMITIVE_POINTS,
@@ -45,11 +49,13 @@ public:
 
   static Mesh *LoadMeshFile(const string &filename);
   static Mesh *GeneratePoint(const Vector3 &pos, const Colour &col = Colour(255, 255, 255, 255));
+  static Mesh *GeneratePoints(const Vector3 *positions, const Colour *colours, const uint count);
   static Mesh *GenerateLine(const Vector3 &from, const Vector3 &to);
   static Mesh *GenerateNSided2D(const int n);
   static Mesh *GenerateTriangle();
   static Mesh *GenerateTriangleStrip();
   static Mesh *GenerateTriangleFan();
+  static Mesh *GenerateQuad();
   static Mesh *GenerateSphere(const float radius = 1.0f, const int resolution = 10,
                               const Colour &c = Colour::White);
   static Mesh *GenerateDisc2D(const float radius = 1.0f, const int resolution = 10);
@@ -61,12 +67,31 @@ public:
     return type;
   }
 
+  uint GetNumVertices()
+  {
+    return numVertices;
+  }
+
+  // Object space bounding box of the vertices, calculated the first time it is asked for
+  void GetBounds(Vector3 &outMin, Vector3 &outMax);
+
+  // Object space bounding box of each block of POINTS_PER_BLOCK vertices, as pairs of smallest and
+  // largest corners, calculated the first time they are asked for. Blocks are only small enough to
+  // be worth culling if neighbouring vertices are near each other.
+  const Vector3 *GetBlockBounds();
+
 protected:
   PrimitiveType type;
 
+  bool boundsValid;
+  Vector3 boundsMin;
+  Vector3 boundsMax;
+  Vector3 *blockBounds;
+
   uint numVertices;
 
   Vector4 *vertices;
   Colour *colours;
   Vector2 *textureCoords;
+  Vector3 *normals; // Only used by shaders, NULL if the mesh doesn't have any
 };
@@ -4,22 +4,24 @@ Mouse *Mouse::instance = 0;
 
 Mouse::Mouse(HWND &hwnd)
 {
-  ZeroMemory(buttons, sizeof(bool) * MOUSE_MAX);
-  ZeroMemory(holdButtons, sizeof(bool) * MOUSE_MAX);
+  memset(buttons, 0, sizeof(bool) * MOUSE_MAX);
+  memset(holdButtons, 0, sizeof(bool) * MOUSE_MAX);
 
-  ZeroMemory(doubleClicks, sizeof(bool) * MOUSE_MAX);
-  ZeroMemory(lastClickTime, sizeof(float) * MOUSE_MAX);
+  memset(doubleClicks, 0, sizeof(bool) * MOUSE_MAX);
+  memset(lastClickTime, 0, sizeof(float) * MOUSE_MAX);
 
   lastWheel = 0;
   frameWheel = 0;
   sensitivity = 0.07f; // Chosen for no other reason than it's a nice value for my Deathadder ;)
   clickLimit = 200.0f;
 
+#ifndef HEADLESS_WINDOW
   rid.usUsagePage = HID_USAGE_PAGE_GENERIC;
   rid.usUsage = HID_USAGE_GENERIC_MOUSE;
   rid.dwFlags = RIDEV_INPUTSINK;
   rid.hwndTarget = hwnd;
   RegisterRawInputDevices(&rid, 1, sizeof(rid));
+#endif
 }
 
 void Mouse::Initialise(HWND &hwnd)
@@ -34,6 +36,7 @@ void Mouse::Destroy()
 
 void Mouse::Update(RAWINPUT *raw)
 {
+#ifndef HEADLESS_WINDOW
   if (isAwake)
   {
     /*
@@ -107,6 +110,7 @@ void Mouse::Update(RAWINPUT *raw)
       }
     }
   }
+#endif
 }
 
 /*
@@ -143,8 +147,8 @@ movement or buttons until it receives a Wake()
 void Mouse::Sleep()
 {
   isAwake = false; // Bye bye for now
-  ZeroMemory(holdButtons, MOUSE_MAX * sizeof(bool));
-  ZeroMemory(buttons, MOUSE_MAX * sizeof(bool));
+  memset(holdButtons, 0, MOUSE_MAX * sizeof(bool));
+  memset(buttons, 0, MOUSE_MAX * sizeof(bool));
 }
 
 /*
@@ -4,6 +4,7 @@ RenderObject::RenderObject(void)
 {
   texture = NULL;
   mesh = NULL;
+  shader = NULL;
 }
 
 RenderObject::~RenderObject(void)
@@ -18,6 +18,7 @@ _-_-_-_-_-_-_-""  ""
 #include "Matrix4.h"
 
 class Texture;
+class ShaderProgram;
 
 class RenderObject
 {
@@ -35,6 +36,11 @@ public:
     return texture;
   }
 
+  ShaderProgram *GetShader()
+  {
+    return shader;
+  }
+
   Matrix4 GetModelMatrix()
   {
     return modelMatrix;
@@ -45,4 +51,5 @@ public:
 
   Texture *texture;
   Mesh *mesh;
+  ShaderProgram *shader; // Not owned, as shaders are usually shared by many objects
 };
@@ -0,0 +1,141 @@
+#include "SceneGenerators.h"
+
+/**
+ * Generates a star field composed of points at random positions.
+ *
+ * \param out Vector to add render objects to
+ * \param num Number of points to generate
+ * \param xyFact Span in X and Y axis
+ * \param zFact Span in Z axis
+ */
+void generateRandomStarfield(vector<RenderObject *> &out, const int num, const float xyFact,
+                             const float zFact)
+{
+  for (int i = 0; i < num; ++i)
+  {
+    const float x = ((float)((rand() % 100) - 50)) * xyFact;
+    const float y = ((float)((rand() % 100) - 50)) * xyFact;
+    const float z = ((float)((rand() % 100) - 50)) * zFact;
+
+    // Generate random colour
+    const int r = (rand() % 100) + 155;
+    const int g = (rand() % 100) + 155;
+    const int b = (rand() % 100) + 155;
+    Colour c = Colour(r, g, b, 255);
+
+    RenderObject *o = new RenderObject();
+    o->mesh = Mesh::GeneratePoint(Vector3(), c);
+    o->modelMatrix = Matrix4::Translation(Vector3(x, y, z));
+    out.push_back(o);
+  }
+}
+
+/**
+ * Generates the same stars as generateRandomStarfield, as a single points mesh rather than an
+ * object per star, which is far cheaper to draw once there are many stars.
+ *
+ * \param out Vector to add the render object to
+ * \param num Number of points to generate
+ * \param xyFact Span in X and Y axis
+ * \param zFact Span in Z axis
+ */
+void generateStarfieldMesh(vector<RenderObject *> &out, const int num, const float xyFact,
+                           const float zFact)
+{
+  // Stars are stored grouped by the cell of a STARFIELD_CELLS^3 grid that they are in, so each
+  // block of the mesh covers a small part of the field, and the blocks off screen can be culled
+  const int STARFIELD_CELLS = 10;
+  const int numCells = STARFIELD_CELLS * STARFIELD_CELLS * STARFIELD_CELLS;
+
+  vector<Vector3> positions(num);
+  vector<Colour> colours(num);
+  vector<int> cells(num);
+  vector<int> cellStarts(numCells + 1, 0);
+
+  for (int i = 0; i < num; ++i)
+  {
+    const int gridX = rand() % 100;
+    const int gridY = rand() % 100;
+    const int gridZ = rand() % 100;
+    positions[i] = Vector3(((float)(gridX - 50)) * xyFact, ((float)(gridY - 50)) * xyFact,
+                           ((float)(gridZ - 50)) * zFact);
+
+    const int r = (rand() % 100) + 155;
+    const int g = (rand() % 100) + 155;
+    const int b = (rand() % 100) + 155;
+    colours[i] = Colour(r, g, b, 255);
+
+    const int cellSize = 100 / STARFIELD_CELLS;
+    cells[i] = ((((gridZ / cellSize) * STARFIELD_CELLS) + (gridY / cellSize)) * STARFIELD_CELLS) +
+               (gridX / cellSize);
+    cellStarts[cells[i] + 1]++;
+  }
+
+  // Counting sort, keeping the stars of each cell in the order they were generated
+  for (int c = 0; c < numCells; ++c)
+    cellStarts[c + 1] += cellStarts[c];
+
+  vector<Vector3> sortedPositions(num);
+  vector<Colour> sortedColours(num);
+  for (int i = 0; i < num; ++i)
+  {
+    const int index = cellStarts[cells[i]]++;
+    sortedPositions[index] = positions[i];
+    sortedColours[index] = colours[i];
+  }
+
+  RenderObject *o = new RenderObject();
+  o->mesh = Mesh::GeneratePoints(num > 0 ? &sortedPositions[0] : NULL,
+                                 num > 0 ? &sortedColours[0] : NULL, (uint)num);
+  out.push_back(o);
+}
+
+/**
+ *Generates a random field of asteroids of random sizes.
+ *
+ * \param out Vector to add render objects to
+ * \param num Number of asteroids to generate
+ * \param xyFact Span in X and Y axis
+ * \param zFact Span in Z axis
+ */
+void generateRandomAsteroids(vector<RenderObject *> &out, const int num, const float xyFact,
+                             const float zFact)
+{
+  for (int i = 0; i < num; ++i)
+  {
+    const float x = ((float)((rand() % 100) - 50)) * xyFact;
+    const float y = ((float)((rand() % 100) - 50)) * xyFact;
+    const float z = ((float)((rand() % 100) - 50)) * zFact;
+    const float scale = ((float)(rand() % 100)) / 100.0f;
+
+    generateAsteroid2D(out, Vector3(x, y, z), scale);
+  }
+}
+
+/**
+ * Generates a 2D asteroid.
+ *
+ * \param out Vector to add render objects to
+ * \param position Position to translate to
+ * \param scale Scale factor
+ */
+void generateAsteroid2D(vector<RenderObject *> &out, const Vector3 &position, const float scale)
+{
+  const Matrix4 modelMat =
+      Matrix4::Translation(position) * Matrix4::Scale(Vector3(scale, scale, scale));
+
+  // Random rotation between 160 - 200
+  const float rot = (float)((rand() % 40) + 160);
+
+  RenderObject *o1 = new RenderObject();
+  o1->mesh = Mesh::GenerateNSided2D(5);
+  o1->modelMatrix = modelMat;
+
+  RenderObject *o2 = new RenderObject();
+  o2->mesh = Mesh::GenerateNSided2D(7);
+  o2->modelMatrix = modelMat * Matrix4::Scale(Vector3(0.85f, 0.85f, 0.85f)) *
+                    Matrix4::Rotation(rot, Vector3(0.0f, 0.0f, 1.0f));
+
+  out.push_back(o1);
+  out.push_back(o2);
+}
@@ -0,0 +1,22 @@
+/******************************************************************************
+Description: Procedural scene content, shared by the demo in main.cpp and the
+benchmarks.
+
+All of these use rand(), so seed it first for repeatable scenes.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RenderObject.h"
+
+#include <vector>
+
+void generateRandomStarfield(std::vector<RenderObject *> &out, const int num = 100,
+                             const float xyFact = 1.0f, const float zFact = 1.0f);
+void generateStarfieldMesh(std::vector<RenderObject *> &out, const int num = 100,
+                           const float xyFact = 1.0f, const float zFact = 1.0f);
+void generateRandomAsteroids(std::vector<RenderObject *> &out, const int num = 100,
+                             const float xyFact = 1.0f, const float zFact = 1.0f);
+void generateAsteroid2D(std::vector<RenderObject *> &out, const Vector3 &position,
+                        const float scale);
@@ -0,0 +1,393 @@
+/******************************************************************************
+Class:Shader
+Implements:ShaderProgram
+Description: Programmable vertex and fragment stages, for triangles that need
+more than a vertex colour or a single texture sample.
+
+A shader is a pair of functors. The vertex shader is called once per vertex
+of a draw, with the vertex's attributes and the draw's matrices, and returns
+the clip space position along with the Varyings for the fragment shader:
+
+  Vector4 operator()(const VertexInput &in, const ShaderMatrices &matrices,
+                     Varyings &out) const;
+
+The fragment shader is called for every pixel that passes the depth test,
+with the Varyings interpolated perspective correctly, and the draw's state
+(for its texture and sampling mode):
+
+  Colour operator()(const Varyings &in, const DrawState &state) const;
+
+Anything else a shader needs (lights, animation and so on) are members of the
+functors, which act as its uniforms.
+
+Shader<VertexShader, FragmentShader> instantiates the geometry stage and the
+triangle rasteriser as templates over its functors, so they're inlined into
+the vertex and span loops with no virtual calls. The rasteriser only calls
+through a function pointer once per batch, selected when the batch's state is
+set, in the same way as the fixed function permutations.
+
+A RenderObject (or a CommandBuffer) uses a shader by pointing at it, so one
+shader can be shared by many objects. Draws only keep the pointer too, so a
+shader's uniforms must not change until every frame that draws with it has
+been presented, which is a frame later in pipelined mode.
+
+Points and lines are always drawn with fixed function shading. Triangles with
+a shader are never occlusion culled, and always redrawn in full when
+rendering incrementally, since the vertex shader can move them anywhere.
+
+*/ /////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SoftwareRasteriser.h"
+
+// Attributes of a mesh vertex, as passed to a vertex shader
+struct VertexInput
+{
+  Vector4 position;
+  Colour colour;
+  Vector2 texCoord;
+  Vector3 normal; // Zero if the mesh doesn't have normals
+};
+
+// Matrices of a draw, as passed to a vertex shader
+struct ShaderMatrices
+{
+  Matrix4 modelMatrix;
+  Matrix4 viewProjMatrix;
+  Matrix4 mvp;
+};
+
+// The part of a shader the rasteriser sees, which doesn't depend on the functor types
+class ShaderProgram
+{
+public:
+  virtual ~ShaderProgram(void)
+  {
+  }
+
+protected:
+  friend class SoftwareRasteriser;
+
+  SoftwareRasteriser::ProcessShadedFunc m_process;
+
+  // Indexed by [multisampled][depth mode]. Blending happens a span at a time, so isn't a template
+  // parameter.
+  SoftwareRasteriser::RasteriseShadedFunc m_rasterise[2][3];
+};
+
+template <typename VertexShader, typename FragmentShader> class Shader : public ShaderProgram
+{
+public:
+  Shader(const VertexShader &vs = VertexShader(), const FragmentShader &fs = FragmentShader())
+      : vertex(vs)
+      , fragment(fs)
+  {
+    typedef Shader<VertexShader, FragmentShader> Program;
+
+    m_process = &SoftwareRasteriser::ProcessShadedDraw<Program>;
+
+    m_rasterise[0][DEPTH_TEST_WRITE] =
+        &SoftwareRasteriser::RasteriseShadedTris<Program, false, DEPTH_TEST_WRITE>;
+    m_rasterise[0][DEPTH_TEST] =
+        &SoftwareRasteriser::RasteriseShadedTris<Program, false, DEPTH_TEST>;
+    m_rasterise[0][DEPTH_DISABLED] =
+        &SoftwareRasteriser::RasteriseShadedTris<Program, false, DEPTH_DISABLED>;
+    m_rasterise[1][DEPTH_TEST_WRITE] =
+        &SoftwareRasteriser::RasteriseShadedTris<Program, true, DEPTH_TEST_WRITE>;
+    m_rasterise[1][DEPTH_TEST] =
+        &SoftwareRasteriser::RasteriseShadedTris<Program, true, DEPTH_TEST>;
+    m_rasterise[1][DEPTH_DISABLED] =
+        &SoftwareRasteriser::RasteriseShadedTris<Program, true, DEPTH_DISABLED>;
+  }
+
+  VertexShader vertex;
+  FragmentShader fragment;
+};
+
+// Converts a colour to 0 to 1 per channel, as used by Varyings
+inline Vector4 ColourToVector(const Colour &c)
+{
+  const float scale = 1.0f / 255.0f;
+  return Vector4(c.r * scale, c.g * scale, c.b * scale, c.a * scale);
+}
+
+// And back again, clamping each channel
+inline Colour VectorToColour(const Vector4 &v)
+{
+  return Colour((unsigned char)(clamp(v.x, 0.0f, 1.0f) * 255.0f + 0.5f),
+                (unsigned char)(clamp(v.y, 0.0f, 1.0f) * 255.0f + 0.5f),
+                (unsigned char)(clamp(v.z, 0.0f, 1.0f) * 255.0f + 0.5f),
+                (unsigned char)(clamp(v.w, 0.0f, 1.0f) * 255.0f + 0.5f));
+}
+
+/**
+ * Samples a texture in a fragment shader. Shaders don't have screen space derivatives, so
+ * mipmapped sampling reads the top level.
+ *
+ * \param texture Texture to sample
+ * \param sampleMode How to filter the sample
+ * \param texCoord Texture coordinates, 0 to 1
+ * \return Colour of the sample
+ */
+inline Colour SampleTexture(Texture *texture, TextureSampleMode sampleMode,
+                            const Vector2 &texCoord)
+{
+  const Vector3 coords(texCoord.x, texCoord.y, 1.0f);
+  if (sampleMode == SAMPLE_BILINEAR)
+    return texture->BilinearTexSample(coords);
+  return texture->NearestTexSample(coords);
+}
+
+/**
+ * Runs a draw's vertices through the vertex shader, then assembles, clips and projects its
+ * triangles. Each vertex is shaded once, however many triangles share it.
+ *
+ * \param cmd Draw to process, whose state has a shader of type Program
+ * \param out List to add the triangles to
+ */
+template <typename Program>
+void SoftwareRasteriser::ProcessShadedDraw(const DrawCommand &cmd, PrimitiveList &out)
+{
+  const Program &program = *static_cast<const Program *>(cmd.state.shader);
+  const Mesh &m = *cmd.mesh;
+
+  ShaderMatrices matrices;
+  matrices.modelMatrix = cmd.modelMatrix;
+  matrices.viewProjMatrix = cmd.viewProjMatrix;
+  matrices.mvp = cmd.viewProjMatrix * cmd.modelMatrix;
+
+  out.shadedVertices.resize(m.numVertices);
+  out.outcodes.resize(m.numVertices);
+  PIPELINE_STAT(out.stats.verticesTransformed += m.numVertices);
+
+  VertexInput in;
+  in.normal = Vector3(0.0f, 0.0f, 0.0f);
+  for (uint i = 0; i < m.numVertices; ++i)
+  {
+    in.position = m.vertices[i];
+    in.colour = m.colours[i];
+    in.texCoord = m.textureCoords[i];
+    if (m.normals)
+      in.normal = m.normals[i];
+
+    ShadedVertex &v = out.shadedVertices[i];
+    v.pos = program.vertex(in, matrices, v.varyings);
+    out.outcodes[i] = HomogeneousOutcode(v.pos);
+  }
+
+  AssembleShadedTris(m.type, m.numVertices, out);
+}
+
+/**
+ * Finds the pixels of a row that may be covered by a triangle, from where each edge crosses it.
+ * Edges are intersected a pixel further out than they need to be, to allow for rounding, and when
+ * multisampling across the height of the row, as samples are offset from the pixel's centre.
+ *
+ * \param s Setup of the triangle
+ * \param y Row to find the pixels of
+ * \param multisample True if the row's samples are offset from its pixels
+ * \param xStart First pixel that may be covered
+ * \param xEnd One past the last
+ * \return False if no pixels of the row can be covered
+ */
+inline bool ShadedTriRow(const ShadedTriSetup &s, int y, bool multisample, int &xStart, int &xEnd)
+{
+  const float yOffset = multisample ? 0.5f : 0.0f;
+  const float slack = multisample ? 1.5f : 1.0f;
+
+  float left = (float)s.xStart;
+  float right = (float)s.xEnd;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    // Weight of the edge where x = 0, at whichever end of the row it is larger
+    const float c = (s.edgeY[i] * y) + s.edgeC[i] + fabs(s.edgeY[i] * yOffset);
+
+    if (s.edgeX[i] > 0.0f)
+      left = max(left, (-c / s.edgeX[i]) - slack);
+    else if (s.edgeX[i] < 0.0f)
+      right = min(right, (-c / s.edgeX[i]) + slack);
+  }
+
+  if (left >= right)
+    return false;
+
+  xStart = (int)ceil(left);
+  xEnd = min((int)ceil(right), s.xEnd);
+  return xStart < xEnd;
+}
+
+/**
+ * Rasterises triangles with a shader, calling its fragment shader for every pixel that passes
+ * the depth test. Coverage is tested with the edge functions, depth and the varyings (divided by
+ * w) are stepped across each row, and the varyings are divided by the interpolated 1/w for each
+ * shaded pixel.
+ *
+ * When multisampling, coverage and depth are tested per sample, and the fragment shader is
+ * called once per pixel: at its centre if that is covered, otherwise at its first covered
+ * sample.
+ *
+ * \param tris Triangles to rasterise
+ * \param count Number of triangles
+ */
+template <typename Program, bool Multisample, DepthMode Depth>
+void SoftwareRasteriser::RasteriseShadedTris(const ShadedTri *tris, uint count)
+{
+  const Program &program = *static_cast<const Program *>(m_rasterState.shader);
+  const DrawState &state = m_rasterState;
+
+  Colour *spanColours = &m_spanColours[0];
+  unsigned int *spanMask = &m_spanMask[0];
+
+  Varyings varyings;
+  float *v = (float *)&varyings;
+
+  PIPELINE_STAT(uint pixelsTested = 0);
+  PIPELINE_STAT(uint pixelsPassed = 0);
+  PIPELINE_STAT(const bool heatmap = (m_heatmapMode != HEATMAP_OFF));
+
+  ShadedTriSetup s;
+  for (uint t = 0; t < count; ++t)
+  {
+    if (!SetupShadedTri(tris[t], s))
+      continue;
+
+    for (int y = s.yStart; y < s.yEnd; ++y)
+    {
+      int xStart;
+      int xEnd;
+      if (!ShadedTriRow(s, y, Multisample, xStart, xEnd))
+        continue;
+
+      // Edge functions are evaluated afresh at each pixel rather than stepped, so they come out
+      // exactly opposite for a triangle sharing the edge, wherever its spans start
+      float rowC[3];
+      for (int i = 0; i < 3; ++i)
+        rowC[i] = s.edgeC[i] + (s.edgeY[i] * y);
+
+      float a[SHADED_ATTRIBUTES];
+      for (int i = 0; i < SHADED_ATTRIBUTES; ++i)
+        a[i] = s.base[i] + (s.dy[i] * y) + (s.dx[i] * xStart);
+
+      int spanStart = -1;
+      int spanEnd = -1;
+
+      for (int x = xStart; x < xEnd; ++x)
+      {
+        spanMask[x] = 0;
+
+        const float w[3] = {rowC[0] + (s.edgeX[0] * x), rowC[1] + (s.edgeX[1] * x),
+                            rowC[2] + (s.edgeX[2] * x)};
+
+        const int index = (y * screenWidth) + x;
+        unsigned int coverage = 0;
+        float sx = 0.0f;
+        float sy = 0.0f;
+
+        if (Multisample)
+        {
+          unsigned int covered = 0;
+          for (int i = 0; i < MSAA_SAMPLES; ++i)
+          {
+            const float ws[3] = {w[0] + s.sampleWeight[0][i], w[1] + s.sampleWeight[1][i],
+                                 w[2] + s.sampleWeight[2][i]};
+            if (EdgesCover(ws, s.topLeft))
+              covered |= 1u << i;
+          }
+
+          if (covered)
+          {
+            PIPELINE_STAT(pixelsTested++);
+            PIPELINE_STAT(if (heatmap) m_heatmap[0][index]++);
+
+            int firstCovered = -1;
+            for (int i = 0; i < MSAA_SAMPLES; ++i)
+            {
+              if (!(covered & (1u << i)))
+                continue;
+
+              if (Depth != DEPTH_DISABLED)
+              {
+                const float zVal = a[0] + (s.dx[0] * s.sampleX[i]) + (s.dy[0] * s.sampleY[i]);
+                unsigned short &sampleDepth = m_depthBuffer[(index * MSAA_SAMPLES) + i];
+                const unsigned int castVal = (unsigned int)zVal;
+                if (castVal > sampleDepth)
+                  continue;
+
+                if (Depth == DEPTH_TEST_WRITE)
+                  sampleDepth = (unsigned short)castVal;
+              }
+
+              coverage |= 1u << i;
+              if (firstCovered < 0)
+                firstCovered = i;
+            }
+
+            if (coverage && !EdgesCover(w, s.topLeft))
+            {
+              sx = s.sampleX[firstCovered];
+              sy = s.sampleY[firstCovered];
+            }
+          }
+        }
+        else if (EdgesCover(w, s.topLeft))
+        {
+          PIPELINE_STAT(pixelsTested++);
+          PIPELINE_STAT(if (heatmap) m_heatmap[0][index]++);
+
+          coverage = ~0u;
+          if (Depth != DEPTH_DISABLED)
+          {
+            const unsigned int castVal = (unsigned int)a[0];
+            if (castVal > m_depthBuffer[index])
+              coverage = 0;
+            else if (Depth == DEPTH_TEST_WRITE)
+              m_depthBuffer[index] = (unsigned short)castVal;
+          }
+        }
+
+        if (coverage)
+        {
+#ifdef PIPELINE_STATISTICS
+          pixelsPassed++;
+          if (heatmap)
+          {
+            m_heatmap[1][index]++;
+            if (state.blendMode != BLEND_REPLACE)
+              m_heatmap[2][index]++;
+          }
+#endif
+
+          const float invW = a[1] + (s.dx[1] * sx) + (s.dy[1] * sy);
+          const float pixelW = 1.0f / invW;
+          for (int i = 0; i < SHADER_VARYINGS; ++i)
+            v[i] = (a[i + 2] + (s.dx[i + 2] * sx) + (s.dy[i + 2] * sy)) * pixelW;
+
+          spanMask[x] = coverage;
+          spanColours[x] = program.fragment(varyings, state);
+
+          if (spanStart < 0)
+            spanStart = x;
+          spanEnd = x;
+        }
+
+        for (int i = 0; i < SHADED_ATTRIBUTES; ++i)
+          a[i] += s.dx[i];
+      }
+
+      if (spanStart >= 0)
+      {
+        WriteSpan(spanStart, y, spanColours + spanStart, spanMask + spanStart,
+                  (spanEnd - spanStart) + 1);
+      }
+    }
+  }
+
+#ifdef PIPELINE_STATISTICS
+  m_frameStats.pixelsTested += pixelsTested;
+  m_frameStats.pixelsPassed += pixelsPassed;
+  if (state.blendMode != BLEND_REPLACE)
+    m_frameStats.pixelsBlended += pixelsPassed;
+#endif
+}
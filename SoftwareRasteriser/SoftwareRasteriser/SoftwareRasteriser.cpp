@@ -1,6 +1,15 @@
 #include "SoftwareRasteriser.h"
+#include "BlendKernels.h"
+#include "CommandBuffer.h"
+#include "FrameCapture.h"
+#include "Impostor.h"
+#include "JobSystem.h"
+#include "Shader.h"
+#include <algorithm>
 #include <cmath>
+#include <emmintrin.h>
 #include <math.h>
+#include <utility>
 /*
 While less 'neat' than just doing a 'new', like in the tutorials, it's usually
 possible to render a bit quicker to use direct pointers to the drawing area
@@ -33,7 +42,7 @@ get exceptions if you resized to a bigger screen area. Sorry about that.
 */
 //#define USE_OS_BUFFERS
 
-#define MAX_VERTS 16
+#define MAX_LINE_SPAN 64
 
 const int INSIDE_CS = 0;
 const int LEFT_CS = 1;
@@ -43,6 +52,66 @@ const int TOP_CS = 8;
 const int FAR_CS = 16;
 const int NEAR_CS = 32;
 
+// Fractional bits used for fixed point attribute stepping along lines
+const int LINE_DEPTH_FRAC_BITS = 12;
+const int LINE_COLOUR_FRAC_BITS = 16;
+
+// Smallest number of rows worth a job of their own in full screen passes
+const uint ROWS_PER_JOB = 16;
+
+// Size of the tiles incremental rendering tracks changes in
+const int REDRAW_TILE_SIZE = 32;
+
+// Sample positions within a pixel, relative to its centre (the 4x rotated grid pattern)
+static const float MSAA_SAMPLE_OFFSETS[MSAA_SAMPLES][2] = {
+    {-0.125f, -0.375f}, {0.375f, -0.125f}, {-0.375f, 0.125f}, {0.125f, 0.375f}};
+
+void PipelineStatistics::Reset()
+{
+  memset(this, 0, sizeof(PipelineStatistics));
+}
+
+void PipelineStatistics::Add(const PipelineStatistics &other)
+{
+  objects += other.objects;
+  objectsOccluded += other.objectsOccluded;
+  verticesTransformed += other.verticesTransformed;
+
+  stateChangesSubmitted += other.stateChangesSubmitted;
+  stateChanges += other.stateChanges;
+
+  trianglesSubmitted += other.trianglesSubmitted;
+  trianglesCulled += other.trianglesCulled;
+  trianglesAccepted += other.trianglesAccepted;
+  trianglesClipped += other.trianglesClipped;
+  clippedTriangles += other.clippedTriangles;
+
+  pointsSubmitted += other.pointsSubmitted;
+  pointsCulled += other.pointsCulled;
+
+  pixelsCleared += other.pixelsCleared;
+  pixelsTested += other.pixelsTested;
+  pixelsPassed += other.pixelsPassed;
+  pixelsBlended += other.pixelsBlended;
+  pixelsPresented += other.pixelsPresented;
+  for (int i = 0; i < 3; ++i)
+    texelsFetched[i] += other.texelsFetched[i];
+}
+
+void PipelineStatistics::Print(std::ostream &o) const
+{
+  o << "objects " << objects << " (occluded " << objectsOccluded << "), vertices "
+    << verticesTransformed << ", triangles " << trianglesSubmitted << " (culled " << trianglesCulled
+    << ", accepted " << trianglesAccepted << ", clipped " << trianglesClipped << " into "
+    << clippedTriangles << "), points " << pointsSubmitted << " (culled " << pointsCulled
+    << "), pixels cleared " << pixelsCleared << ", tested " << pixelsTested
+    << ", passed " << pixelsPassed << ", blended " << pixelsBlended << ", presented "
+    << pixelsPresented << ", texels "
+    << texelsFetched[SAMPLE_NEAREST] << " nearest / " << texelsFetched[SAMPLE_BILINEAR]
+    << " bilinear / " << texelsFetched[SAMPLE_MIPMAP_NEAREST] << " mipmap, state changes "
+    << stateChanges << " (" << stateChangesSubmitted << " as submitted)";
+}
+
 float SoftwareRasteriser::ScreenAreaOfTri(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2)
 {
   float area = ((v0.x * v1.y) + (v1.x * v2.y) + (v2.x * v0.y)) -
@@ -57,6 +126,42 @@ SoftwareRasteriser::SoftwareRasteriser(uint width, uint height)
   m_currentTexture = NULL;
   m_texSampleState = SAMPLE_NEAREST;
   m_blendState = BLEND_REPLACE;
+  m_depthState = DEPTH_TEST_WRITE;
+  m_pointSizeState = 1.0f;
+
+  m_rasterState.shader = NULL;
+  m_rasterState.texture = NULL;
+  m_rasterState.sampleMode = SAMPLE_NEAREST;
+  m_rasterState.blendMode = BLEND_REPLACE;
+  m_rasterState.depthMode = DEPTH_TEST_WRITE;
+  m_rasterState.pointSize = 1.0f;
+  m_multisample = false;
+  m_colourFormat = COLOUR_BGRA8;
+  m_triangleTraversal = TRAVERSAL_BOUNDING_BOX;
+  SetRasterState(m_rasterState);
+
+  m_pipelined = false;
+  m_recordFrame = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    m_frames[i].clear = false;
+    m_frames[i].ready = false;
+  }
+  m_geometryFrame = NULL;
+  m_geometryExit = false;
+
+  m_geometryThreads = 1;
+  m_sortDraws = false;
+  m_occlusionCulling = false;
+  m_incremental = false;
+  m_redrawAll = true;
+  m_presentAll = true;
+
+  m_frameCapture = NULL;
+
+  m_statsFrame = 0;
+  m_dumpStats = false;
+  m_heatmapMode = HEATMAP_OFF;
 
 #ifndef USE_OS_BUFFERS
   // Hi! In the tutorials, it's mentioned that we need to form our front + back buffer like so:
@@ -73,17 +178,23 @@ SoftwareRasteriser::SoftwareRasteriser(uint width, uint height)
   }
 #endif
 
+  // Cleared here too, as occlusion queries can read it before the first frame is rasterised
   m_depthBuffer = new unsigned short[screenWidth * screenHeight];
+  std::fill(m_depthBuffer, m_depthBuffer + (screenWidth * screenHeight), (unsigned short)~0);
 
-  float zScale = (pow(2.0f, 16) - 1) * 0.5f;
-
-  Vector3 halfScreen = Vector3((screenWidth - 1) * 0.5f, (screenHeight - 1) * 0.5f, zScale);
+  m_spanColours.resize(screenWidth);
+  m_spanMask.resize(screenWidth);
 
-  m_portMatrix = Matrix4::Translation(halfScreen) * Matrix4::Scale(halfScreen);
+  m_targetFrameTime = 0.0f;
+  m_minResolutionScale = 0.5f;
+  m_frameTimeCount = 0;
+  SetResolutionScale(1.0f);
 }
 
 SoftwareRasteriser::~SoftwareRasteriser(void)
 {
+  SetPipelined(false);
+
 #ifndef USE_OS_BUFFERS
   for (int i = 0; i < 2; ++i)
   {
@@ -110,14 +221,12 @@ void SoftwareRasteriser::Resize()
   }
 #endif
 
-  delete[] m_depthBuffer;
-  m_depthBuffer = new unsigned short[screenWidth * screenHeight];
-
-  float zScale = (pow(2.0f, 16) - 1) * 0.5f;
-
-  Vector3 halfScreen = Vector3((screenWidth - 1) * 0.5f, (screenHeight - 1) * 0.5f, zScale);
-
-  m_portMatrix = Matrix4::Translation(halfScreen) * Matrix4::Scale(halfScreen);
+  // Reallocates the depth buffer, sample buffer, colour format buffers and span scratch space for
+  // the new size
+  SetMultisampling(m_multisample);
+  SetColourFormat(m_colourFormat);
+  SetHeatmapMode(m_heatmapMode);
+  SetResolutionScale(m_resolutionScale);
 }
 
 Colour *SoftwareRasteriser::GetCurrentBuffer()
@@ -125,325 +234,2739 @@ Colour *SoftwareRasteriser::GetCurrentBuffer()
   return m_buffers[m_currentDrawBuffer];
 }
 
+/**
+ * Sets the area of the buffers being rasterised to, which also becomes the clip rectangle.
+ *
+ * \param width Width of the viewport in pixels
+ * \param height Height of the viewport in pixels
+ */
+void SoftwareRasteriser::SetViewport(uint width, uint height)
+{
+  m_viewportWidth = width;
+  m_viewportHeight = height;
+
+  m_clipRect.minX = 0;
+  m_clipRect.minY = 0;
+  m_clipRect.maxX = (int)width;
+  m_clipRect.maxY = (int)height;
+}
+
 void SoftwareRasteriser::ClearBuffers()
+{
+  // When recording the clear happens when the frame is rasterised
+  if (IsRecording())
+    m_frames[m_recordFrame].clear = true;
+  else
+    ClearCurrentBuffers(m_clipRect);
+}
+
+/**
+ * Clears a rectangle of the colour, depth and sample buffers. Only the area being rendered to
+ * ever needs clearing.
+ *
+ * \param rect Area to clear, within the viewport
+ */
+void SoftwareRasteriser::ClearCurrentBuffers(const ScreenRect &rect)
 {
   Colour *buffer = GetCurrentBuffer();
 
   unsigned int clearVal = 0xFF000000;
   unsigned int depthVal = ~0;
 
-  for (uint y = 0; y < screenHeight; ++y)
+  const uint samples = m_multisample ? MSAA_SAMPLES : 1;
+
+  PIPELINE_STAT(m_frameStats.pixelsCleared += (rect.maxX - rect.minX) * (rect.maxY - rect.minY));
+
+  JobSystem::ParallelFor(rect.minY, rect.maxY, ROWS_PER_JOB, [&](uint begin, uint end) {
+    for (uint y = begin; y < end; ++y)
+    {
+      const uint first = (y * screenWidth) + rect.minX;
+      const uint last = (y * screenWidth) + rect.maxX;
+
+      // Black is 0 in both of the other formats
+      if (m_multisample || m_colourFormat == COLOUR_BGRA8)
+      {
+        for (uint x = first; x < last; ++x)
+          buffer[x].c = clearVal;
+      }
+      else if (m_colourFormat == COLOUR_RGB565)
+      {
+        std::fill(m_bufferRGB565.begin() + first, m_bufferRGB565.begin() + last,
+                  (unsigned short)0);
+      }
+      else
+      {
+        std::fill(m_bufferR11G11B10.begin() + first, m_bufferR11G11B10.begin() + last, 0u);
+      }
+
+      for (uint i = first * samples; i < last * samples; ++i)
+        m_depthBuffer[i] = depthVal;
+
+      if (m_multisample)
+      {
+        for (uint i = first * samples; i < last * samples; ++i)
+          m_sampleBuffer[i].c = clearVal;
+      }
+    }
+  });
+}
+
+/**
+ * Presents the buffer that has just been drawn (passing it to the frame capture, if there is one)
+ * and flips to the other buffer. When multisampling the samples are resolved into the buffer
+ * first, or when not drawing in BGRA8 the frame is converted into the buffer, and a frame
+ * rendered at a reduced resolution is upscaled to the window size.
+ */
+void SoftwareRasteriser::PresentCurrentBuffer()
+{
+  Colour *buffer = m_buffers[m_currentDrawBuffer];
+
+  if (m_multisample)
+    ResolveSamples(buffer);
+  else if (m_colourFormat != COLOUR_BGRA8)
+    ConvertColourBuffer(buffer);
+
+  if (m_heatmapMode != HEATMAP_OFF)
+    ResolveHeatmap(buffer);
+
+  Colour *presented = buffer;
+  if (m_viewportWidth != screenWidth || m_viewportHeight != screenHeight)
+  {
+    presented = &m_upscaleBuffer[0];
+    UpscaleViewport(buffer, presented);
+    m_presentAll = true;
+  }
+
+  // Only the parts of the frame that changed since the last one need copying to the window
+  if (m_presentAll || m_heatmapMode != HEATMAP_OFF)
+  {
+    PresentBuffer(presented);
+    PIPELINE_STAT(m_frameStats.pixelsPresented = screenWidth * screenHeight);
+  }
+  else
   {
-    for (uint x = 0; x < screenWidth; ++x)
+    PresentBuffer(presented, m_presentRects);
+#ifdef PIPELINE_STATISTICS
+    for (size_t i = 0; i < m_presentRects.size(); ++i)
     {
-      buffer[(y * screenWidth) + x].c = clearVal;
-      m_depthBuffer[(y * screenWidth) + x] = depthVal;
+      const ScreenRect &rect = m_presentRects[i];
+      m_frameStats.pixelsPresented += (rect.maxX - rect.minX) * (rect.maxY - rect.minY);
     }
+#endif
+  }
+
+  // Frames not drawn through FindRedrawRects may have changed anywhere
+  m_presentAll = true;
+  m_presentedTiles.swap(m_drawnTiles);
+  m_drawnTiles.clear();
+
+  if (m_frameCapture)
+    m_frameCapture->CaptureFrame(presented, screenWidth, screenHeight);
+
+  m_lastFrameStats = m_frameStats;
+  m_frameStats.Reset();
+  if (m_dumpStats)
+  {
+    std::cout << "Frame " << m_statsFrame << ": ";
+    m_lastFrameStats.Print(std::cout);
+    std::cout << std::endl;
   }
+  m_statsFrame++;
+
+  m_currentDrawBuffer = !m_currentDrawBuffer;
 }
 
-void SoftwareRasteriser::SwapBuffers()
+/**
+ * Shows per pixel counts of how often each pixel was depth tested, shaded or blended in place of
+ * the rendered frame. Heatmaps are gathered along with the other pipeline statistics, so are only
+ * available when PIPELINE_STATISTICS is defined, and the mode stays off otherwise.
+ *
+ * \param mode Count to show, or HEATMAP_OFF to show the frame as normal
+ */
+void SoftwareRasteriser::SetHeatmapMode(HeatmapMode mode)
 {
-  PresentBuffer(m_buffers[m_currentDrawBuffer]);
-  m_currentDrawBuffer = !m_currentDrawBuffer;
+#ifndef PIPELINE_STATISTICS
+  // Nothing would be counted, so the heatmap would only replace the frame with black
+  if (mode != HEATMAP_OFF)
+    std::cout << "Heatmaps need PIPELINE_STATISTICS to be defined" << std::endl;
+#else
+  m_heatmapMode = mode;
+  m_redrawAll = true;
+
+  const uint size = (mode == HEATMAP_OFF) ? 0 : screenWidth * screenHeight;
+  for (int i = 0; i < 3; ++i)
+    m_heatmap[i].assign(size, 0);
+#endif
 }
 
-void SoftwareRasteriser::DrawObject(RenderObject *o)
+/**
+ * Replaces the frame with a false colour image of the selected heatmap counts, then resets the
+ * counts for the next frame.
+ *
+ * Counts use a fixed scale so images from different runs can be compared: 0 is black, then 1 to
+ * 7 go through blue, cyan, green, yellow and orange to red, and 8 or more is white.
+ *
+ * \param buffer Colour buffer to overwrite
+ */
+void SoftwareRasteriser::ResolveHeatmap(Colour *buffer)
+{
+  static const Colour ramp[9] = {
+      Colour(0, 0, 0, 255),     Colour(0, 0, 128, 255),   Colour(0, 0, 255, 255),
+      Colour(0, 255, 255, 255), Colour(0, 255, 0, 255),   Colour(255, 255, 0, 255),
+      Colour(255, 128, 0, 255), Colour(255, 0, 0, 255),   Colour(255, 255, 255, 255)};
+
+  const vector<unsigned short> &counts = m_heatmap[m_heatmapMode - 1];
+
+  for (size_t i = 0; i < counts.size(); ++i)
+    buffer[i] = ramp[min(counts[i], (unsigned short)8)];
+
+  for (int i = 0; i < 3; ++i)
+    std::fill(m_heatmap[i].begin(), m_heatmap[i].end(), (unsigned short)0);
+}
+
+/**
+ * Enables or disables 4x multisampling.
+ *
+ * Triangle coverage and depth are evaluated at MSAA_SAMPLES positions per pixel, but shading is
+ * still done once per pixel and written to every covered sample. Lines and points cover all of
+ * the samples of their pixels. The samples are averaged into the colour buffer by SwapBuffers.
+ *
+ * \param multisample True to enable multisampling
+ */
+void SoftwareRasteriser::SetMultisampling(bool multisample)
+{
+  m_multisample = multisample;
+
+  const uint pixels = screenWidth * screenHeight;
+  const uint samples = multisample ? MSAA_SAMPLES : 1;
+
+  delete[] m_depthBuffer;
+  m_depthBuffer = new unsigned short[pixels * samples];
+  std::fill(m_depthBuffer, m_depthBuffer + (pixels * samples), (unsigned short)~0);
+
+  m_sampleBuffer.assign(multisample ? pixels * MSAA_SAMPLES : 0, Colour(0, 0, 0, 255));
+  m_redrawAll = true;
+
+  m_spanColours.resize(screenWidth * samples);
+  m_spanMask.resize(screenWidth * samples);
+
+  // The triangle rasteriser differs when multisampling
+  SetRasterState(m_rasterState);
+}
+
+/**
+ * Selects how triangles are rasterised: by testing every pixel of their bounding box, or by
+ * walking their edges and filling the span between them on each row. Multisampled triangles
+ * always use bounding box traversal.
+ *
+ * \param traversal Triangle traversal to use
+ */
+void SoftwareRasteriser::SetTriangleTraversal(TriangleTraversal traversal)
+{
+  m_triangleTraversal = traversal;
+  m_redrawAll = true;
+  SetRasterState(m_rasterState);
+}
+
+/**
+ * Averages the samples of each pixel into the colour buffer.
+ *
+ * \param buffer Colour buffer to write the resolved frame to
+ */
+void SoftwareRasteriser::ResolveSamples(Colour *buffer)
 {
-  m_currentTexture = o->GetTexure();
+  JobSystem::ParallelFor(0, m_viewportHeight, ROWS_PER_JOB, [&](uint begin, uint end) {
+    for (uint y = begin; y < end; ++y)
+    {
+      const uint row = y * screenWidth;
+      ResolveSpan(buffer + row, &m_sampleBuffer[row * MSAA_SAMPLES], m_viewportWidth);
+    }
+  });
+}
+
+/**
+ * Selects the format of the buffer that frames are drawn into. RGB565 moves half the bytes of
+ * BGRA8 when filling and blending. R11G11B10 is as large as BGRA8, and gives additive blending
+ * headroom to saturate in rather than a bandwidth saving. Both are converted to BGRA as each frame
+ * is presented. Multisampled frames are always drawn in BGRA8, as the samples are resolved
+ * straight into the colour buffer.
+ *
+ * \param format Colour format to draw in
+ */
+void SoftwareRasteriser::SetColourFormat(ColourFormat format)
+{
+  m_colourFormat = format;
+
+  const uint pixels = screenWidth * screenHeight;
+  m_bufferRGB565.assign(format == COLOUR_RGB565 ? pixels : 0, 0);
+  m_bufferR11G11B10.assign(format == COLOUR_R11G11B10 ? pixels : 0, 0);
+  m_redrawAll = true;
+}
 
-  switch (o->GetMesh()->GetType())
+/**
+ * Converts the buffer for the colour format into the colour buffer. The colour buffer was last
+ * presented two frames ago, so when only part of the frame was redrawn (which covers the changes
+ * of both frames since) only that part needs converting.
+ *
+ * \param buffer Colour buffer to write the converted frame to
+ */
+void SoftwareRasteriser::ConvertColourBuffer(Colour *buffer)
+{
+  if (m_presentAll)
   {
-  case PRIMITIVE_POINTS:
-    RasterisePointsMesh(o);
-    break;
-  case PRIMITIVE_LINES:
-    RasteriseLinesMesh(o);
-    break;
-  case PRIMITIVE_TRIANGLES:
-    RasteriseTriMesh(o);
-    break;
-  case PRIMITIVE_TRIANGLE_STRIP:
-    RasteriseTriMeshStrip(o);
-    break;
-  case PRIMITIVE_TRIANGLE_FAN:
-    RasteriseTriMeshFan(o);
-    break;
+    const ScreenRect viewport = {0, 0, (int)m_viewportWidth, (int)m_viewportHeight};
+    ConvertColourRect(buffer, viewport);
+    return;
   }
+
+  for (size_t i = 0; i < m_redrawRects.size(); ++i)
+    ConvertColourRect(buffer, m_redrawRects[i]);
 }
 
-void SoftwareRasteriser::CalculateWeights(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
-                                          const Vector4 &p, float &alpha, float &beta, float &gamma)
+void SoftwareRasteriser::ConvertColourRect(Colour *buffer, const ScreenRect &rect)
 {
-  const float triArea = ScreenAreaOfTri(v0, v1, v2);
-  const float areaRecip = 1.0f / triArea;
+  JobSystem::ParallelFor(rect.minY, rect.maxY, ROWS_PER_JOB, [&](uint begin, uint end) {
+    for (uint y = begin; y < end; ++y)
+    {
+      const uint first = (y * screenWidth) + rect.minX;
+      const int count = rect.maxX - rect.minX;
 
-  float subTriArea[3];
-  subTriArea[0] = abs(ScreenAreaOfTri(v0, p, v1));
-  subTriArea[1] = abs(ScreenAreaOfTri(v1, p, v2));
-  subTriArea[2] = abs(ScreenAreaOfTri(v2, p, v0));
+      if (m_colourFormat == COLOUR_RGB565)
+        UnpackSpan(buffer + first, &m_bufferRGB565[first], count);
+      else
+        UnpackSpan(buffer + first, &m_bufferR11G11B10[first], count);
+    }
+  });
+}
 
-  alpha = subTriArea[1] * areaRecip;
-  beta = subTriArea[2] * areaRecip;
-  gamma = subTriArea[0] * areaRecip;
+// Interpolates between two BGRA pixels with a weight out of 256, two channels at a time
+static inline unsigned int LerpPixel(unsigned int a, unsigned int b, unsigned int weight)
+{
+  const unsigned int rb =
+      ((((a & 0x00FF00FF) * (256 - weight)) + ((b & 0x00FF00FF) * weight)) >> 8) & 0x00FF00FF;
+  const unsigned int ga =
+      ((((a >> 8) & 0x00FF00FF) * (256 - weight)) + (((b >> 8) & 0x00FF00FF) * weight)) &
+      0xFF00FF00;
+  return rb | ga;
 }
 
-bool SoftwareRasteriser::CohenSutherlandLine(Vector4 &inA, Vector4 &inB, Colour &colA, Colour &colB,
-                                             Vector3 &texA, Vector3 &texB)
+/**
+ * Bilinearly upscales the viewport area of a buffer to fill the window.
+ *
+ * \param src Buffer holding the frame in its viewport area
+ * \param dest Window sized buffer to write to
+ */
+void SoftwareRasteriser::UpscaleViewport(const Colour *src, Colour *dest)
 {
-  for (int i = 0; i < 6; ++i)
+  // Pixel centres of the window map to pixel centres of the viewport
+  const float xRatio = (float)m_viewportWidth / (float)screenWidth;
+  const float yRatio = (float)m_viewportHeight / (float)screenHeight;
+
+  for (uint x = 0; x < screenWidth; ++x)
   {
-    int planeCode = 1 << i;
-    int outsideA = (HomogeneousOutcode(inA) & planeCode);
-    int outsideB = (HomogeneousOutcode(inB) & planeCode);
+    const float sx = clamp(((x + 0.5f) * xRatio) - 0.5f, 0.0f, (float)(m_viewportWidth - 1));
+    m_upscaleColumns[x] = (uint)sx;
+    m_upscaleWeights[x] = (uint)((sx - (uint)sx) * 256.0f);
+  }
 
-    if (outsideA && outsideB)
-      return false;
+  JobSystem::ParallelFor(0, screenHeight, ROWS_PER_JOB, [&](uint begin, uint end) {
+    for (uint y = begin; y < end; ++y)
+    {
+      const float sy =
+          clamp(((y + 0.5f) * yRatio) - 0.5f, 0.0f, (float)(m_viewportHeight - 1));
+      const uint y0 = (uint)sy;
+      const uint y1 = min(y0 + 1, m_viewportHeight - 1);
+      const uint yWeight = (uint)((sy - y0) * 256.0f);
 
-    if (!outsideA && !outsideB)
-      continue;
+      const Colour *row0 = src + (y0 * screenWidth);
+      const Colour *row1 = src + (y1 * screenWidth);
+      Colour *out = dest + (y * screenWidth);
 
-    float clipRatio = ClipEdge(inA, inB, planeCode);
-    if (outsideA)
+      for (uint x = 0; x < screenWidth; ++x)
+      {
+        const uint x0 = m_upscaleColumns[x];
+        const uint x1 = min(x0 + 1, m_viewportWidth - 1);
+        const uint xWeight = m_upscaleWeights[x];
+
+        const unsigned int top = LerpPixel(row0[x0].c, row0[x1].c, xWeight);
+        const unsigned int bottom = LerpPixel(row1[x0].c, row1[x1].c, xWeight);
+        out[x].c = LerpPixel(top, bottom, yWeight);
+      }
+    }
+  });
+}
+
+/**
+ * Enables dynamic resolution scaling. Frames are then rendered into a smaller area of the
+ * buffers whenever recent frames have taken longer than the target, and upscaled to the window
+ * size by SwapBuffers.
+ *
+ * \param targetFrameTime Frame time to aim for in milliseconds, 0 disables scaling
+ * \param minScale Smallest fraction of the window's width and height to render at
+ */
+void SoftwareRasteriser::SetDynamicResolution(float targetFrameTime, float minScale)
+{
+  m_targetFrameTime = targetFrameTime;
+  m_minResolutionScale = clamp(minScale, 0.1f, 1.0f);
+  m_frameTimeCount = 0;
+  m_frameTimer.GetTimedMS();
+
+  if (m_targetFrameTime <= 0.0f)
+    SetResolutionScale(1.0f);
+}
+
+/**
+ * Sets the size of the area of the buffers that is rendered to, as a fraction of the window's
+ * width and height.
+ *
+ * Only changes the projection used by the geometry stage (and, when not pipelined, the raster
+ * stage), so must not be called while the geometry thread is processing a frame.
+ *
+ * \param scale Fraction of the window size to render at
+ */
+void SoftwareRasteriser::SetResolutionScale(float scale)
+{
+  m_resolutionScale = scale;
+  m_renderWidth = clamp((uint)((screenWidth * scale) + 0.5f), 1u, screenWidth);
+  m_renderHeight = clamp((uint)((screenHeight * scale) + 0.5f), 1u, screenHeight);
+
+  if (!m_pipelined)
+    SetViewport(m_renderWidth, m_renderHeight);
+
+  // Frames already drawn were drawn at the old size
+  m_redrawAll = true;
+
+  if (scale < 1.0f)
+  {
+    m_upscaleBuffer.resize(screenWidth * screenHeight);
+    m_upscaleColumns.resize(screenWidth);
+    m_upscaleWeights.resize(screenWidth);
+  }
+
+  m_portMatrix = ViewportMatrix(m_renderWidth, m_renderHeight);
+}
+
+/**
+ * Builds the matrix that maps normalised device coordinates to pixel coordinates and depth buffer
+ * values in a viewport.
+ *
+ * \param width Width of the viewport in pixels
+ * \param height Height of the viewport in pixels
+ * \return Viewport matrix
+ */
+Matrix4 SoftwareRasteriser::ViewportMatrix(uint width, uint height)
+{
+  float zScale = (pow(2.0f, 16) - 1) * 0.5f;
+
+  Vector3 halfScreen = Vector3((width - 1) * 0.5f, (height - 1) * 0.5f, zScale);
+
+  return Matrix4::Translation(halfScreen) * Matrix4::Scale(halfScreen);
+}
+
+/**
+ * Feeds the time since the last frame to the dynamic resolution controller, which adjusts the
+ * resolution scale once every DYNAMIC_RESOLUTION_HISTORY frames from their average frame time.
+ */
+void SoftwareRasteriser::UpdateResolutionScale()
+{
+  const float frameTime = m_frameTimer.GetTimedMS();
+  if (m_targetFrameTime <= 0.0f)
+    return;
+
+  m_frameTimes[m_frameTimeCount++] = frameTime;
+  if (m_frameTimeCount < DYNAMIC_RESOLUTION_HISTORY)
+    return;
+
+  // Frames in the history were all rendered at the current scale
+  m_frameTimeCount = 0;
+
+  float average = 0.0f;
+  for (int i = 0; i < DYNAMIC_RESOLUTION_HISTORY; ++i)
+    average += m_frameTimes[i];
+  average /= DYNAMIC_RESOLUTION_HISTORY;
+
+  // Rasterisation cost goes roughly with the number of pixels, so each axis is scaled by the
+  // square root of how far off the target the frames are. The scale drops quickly when over
+  // budget but only grows back slowly, and is left alone while frames are a little under the
+  // target so it doesn't oscillate.
+  float scale = m_resolutionScale;
+  if (average > m_targetFrameTime)
+    scale *= max(sqrt(m_targetFrameTime / average), 0.7f);
+  else if (average < m_targetFrameTime * 0.8f)
+    scale *= min(sqrt(m_targetFrameTime / average), 1.1f);
+
+  scale = clamp(scale, m_minResolutionScale, 1.0f);
+  if (scale != m_resolutionScale)
+    SetResolutionScale(scale);
+}
+
+void SoftwareRasteriser::SwapBuffers()
+{
+  if (!m_pipelined)
+  {
+    // Draws were only recorded, so their vertices can be processed in parallel
+    if (IsRecording())
     {
-      texA = Vector3::Lerp(texA, texB, clipRatio);
-      colA = Colour::Lerp(colA, colB, clipRatio);
-      inA = Vector4::Lerp(inA, inB, clipRatio);
+      PipelinedFrame &recorded = m_frames[m_recordFrame];
+      recorded.viewportWidth = m_renderWidth;
+      recorded.viewportHeight = m_renderHeight;
+      ProcessFrameGeometry(recorded);
+      RasteriseFrame(recorded);
+      ResetFrame(recorded);
     }
-    else
+
+    PresentCurrentBuffer();
+    UpdateResolutionScale();
+    return;
+  }
+
+  PipelinedFrame &recorded = m_frames[m_recordFrame];
+  PipelinedFrame &previous = m_frames[!m_recordFrame];
+
+  // Start vertex processing and clipping of the frame that has just been recorded...
+  recorded.viewportWidth = m_renderWidth;
+  recorded.viewportHeight = m_renderHeight;
+  {
+    std::lock_guard<std::mutex> lock(m_geometryMutex);
+    m_geometryFrame = &recorded;
+  }
+  m_geometryCond.notify_all();
+
+  // ...while the previous frame is rasterised and presented on this thread
+  if (previous.ready)
+  {
+    RasteriseFrame(previous);
+    PresentCurrentBuffer();
+  }
+
+  ResetFrame(previous);
+
+  // Wait for the geometry thread, so a frame is never more than one behind
+  {
+    std::unique_lock<std::mutex> lock(m_geometryMutex);
+    while (m_geometryFrame != NULL)
+      m_geometryCond.wait(lock);
+  }
+
+  recorded.ready = true;
+  m_recordFrame = !m_recordFrame;
+
+  // The geometry thread is idle, so the render size can change here
+  UpdateResolutionScale();
+}
+
+/**
+ * Enables or disables pipelined mode.
+ *
+ * In pipelined mode DrawObject and ClearBuffers only record the frame. SwapBuffers then processes
+ * the geometry of the recorded frame on a worker thread while the previous frame is rasterised
+ * and presented, so presentation lags submission by one frame.
+ *
+ * \param pipelined True to enable pipelined mode
+ */
+void SoftwareRasteriser::SetPipelined(bool pipelined)
+{
+  if (pipelined == m_pipelined)
+    return;
+
+  if (pipelined)
+  {
+    m_geometryExit = false;
+    m_geometryThread = std::thread(&SoftwareRasteriser::GeometryThreadMain, this);
+  }
+  else
+  {
+    // Flush the frame that is still waiting to be rasterised
+    PipelinedFrame &previous = m_frames[!m_recordFrame];
+    if (previous.ready)
     {
-      texB = Vector3::Lerp(texA, texB, clipRatio);
-      colB = Colour::Lerp(colA, colB, clipRatio);
-      inB = Vector4::Lerp(inA, inB, clipRatio);
+      RasteriseFrame(previous);
+      PresentCurrentBuffer();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_geometryMutex);
+      m_geometryExit = true;
+    }
+    m_geometryCond.notify_all();
+    m_geometryThread.join();
+
+    for (int i = 0; i < 2; ++i)
+      ResetFrame(m_frames[i]);
+    m_recordFrame = 0;
+
+    SetViewport(m_renderWidth, m_renderHeight);
+  }
+
+  m_pipelined = pipelined;
+}
+
+void SoftwareRasteriser::GeometryThreadMain()
+{
+  std::unique_lock<std::mutex> lock(m_geometryMutex);
+
+  while (true)
+  {
+    while (m_geometryFrame == NULL && !m_geometryExit)
+      m_geometryCond.wait(lock);
+
+    if (m_geometryExit)
+      return;
+
+    PipelinedFrame *frame = m_geometryFrame;
+    lock.unlock();
+
+    ProcessFrameGeometry(*frame);
+
+    lock.lock();
+    m_geometryFrame = NULL;
+    m_geometryCond.notify_all();
+  }
+}
+
+/**
+ * Sets the number of threads that process the vertices of a frame. With more than one, draws are
+ * recorded (as in pipelined mode) and SwapBuffers splits them into a contiguous range per thread,
+ * each processed by a job into its own primitive list. The lists are then rasterised in order, so
+ * blending still happens in submission order.
+ *
+ * The jobs run on the JobSystem, so without one the ranges are processed one after another.
+ * Must be called between frames.
+ *
+ * \param threads Number of ranges to split the draws of a frame into
+ */
+void SoftwareRasteriser::SetGeometryThreads(uint threads)
+{
+  m_geometryThreads = max(threads, 1u);
+}
+
+/**
+ * Performs vertex processing and clipping for every draw of a recorded frame, one job per range
+ * of draws.
+ *
+ * \param frame Frame to process
+ */
+void SoftwareRasteriser::ProcessFrameGeometry(PipelinedFrame &frame)
+{
+  PIPELINE_STAT(frame.stats.stateChangesSubmitted = CountStateChanges(frame.draws));
+  if (m_sortDraws)
+    SortDraws(frame);
+  PIPELINE_STAT(frame.stats.stateChanges = CountStateChanges(frame.draws));
+
+  const uint ranges = m_geometryThreads;
+  const uint numDraws = (uint)frame.draws.size();
+
+  frame.primitives.resize(ranges);
+  frame.drawRanges.resize(ranges + 1);
+  frame.drawRanges[0] = 0;
+  frame.drawRanges[ranges] = numDraws;
+
+  if (ranges == 1)
+  {
+    ProcessDrawRange(frame, 0);
+    return;
+  }
+
+  // Split the draws so each range has about the same number of vertices to transform. Every draw
+  // also has a fixed cost, which matters when there are lots of tiny ones.
+  const uint drawCost = 16;
+  uint totalCost = 0;
+  for (uint i = 0; i < numDraws; ++i)
+    totalCost += frame.draws[i].mesh->GetNumVertices() + drawCost;
+
+  uint cost = 0;
+  uint range = 1;
+  for (uint i = 0; i < numDraws && range < ranges; ++i)
+  {
+    cost += frame.draws[i].mesh->GetNumVertices() + drawCost;
+    while (range < ranges && (unsigned long long)cost * ranges >=
+                                 (unsigned long long)totalCost * range)
+      frame.drawRanges[range++] = i + 1;
+  }
+  while (range < ranges)
+    frame.drawRanges[range++] = numDraws;
+
+  JobSystem::ParallelFor(0, ranges, 1, [&](uint begin, uint end) {
+    for (uint i = begin; i < end; ++i)
+      ProcessDrawRange(frame, i);
+  });
+}
+
+/**
+ * Enables or disables sorting of draws to reduce state changes. Opaque draws (replaced colour,
+ * depth tested and written) don't depend on the order they are drawn in, so they are drawn first,
+ * grouped by raster permutation, texture and mesh and then front to back. Every other draw follows
+ * them in the order it was submitted.
+ *
+ * Only a whole frame can be sorted, so while sorting draws are recorded and rendered by
+ * SwapBuffers, as with parallel vertex processing. Must be called between frames.
+ *
+ * \param sort True to sort draws
+ */
+void SoftwareRasteriser::SetDrawSorting(bool sort)
+{
+  m_sortDraws = sort;
+}
+
+/**
+ * Enables or disables incremental rendering, for scenes where little changes from frame to frame.
+ * Each frame's draws are compared with the last frame's, and only the tiles covered by the draws
+ * that have changed are cleared and redrawn, leaving the rest of the buffers as they were.
+ *
+ * A draw has changed if its mesh, model matrix, view and projection matrices or raster state
+ * differ. Changes to the contents of a mesh or texture aren't noticed. Frames are recorded and
+ * rendered by SwapBuffers, as when sorting, and every frame must start with ClearBuffers. Must be
+ * called between frames.
+ *
+ * \param incremental True to render incrementally
+ */
+void SoftwareRasteriser::SetIncrementalRendering(bool incremental)
+{
+  m_incremental = incremental;
+  m_redrawAll = true;
+  m_lastDraws.clear();
+}
+
+// Small id for a pointer, in order of first appearance so sorting is the same on every run
+static uint SortId(std::unordered_map<const void *, uint> &ids, const void *p)
+{
+  const uint next = (uint)ids.size();
+  return ids.insert(std::make_pair(p, next)).first->second;
+}
+
+/**
+ * Reorders the draws of a recorded frame by sort key. From the most significant bits down the key
+ * is: pass (opaque first), raster permutation, texture, mesh and distance from the camera. Draws
+ * after the opaque pass only have a pass, so they keep their order.
+ *
+ * \param frame Frame to sort
+ */
+void SoftwareRasteriser::SortDraws(PipelinedFrame &frame)
+{
+  const uint numDraws = (uint)frame.draws.size();
+
+  m_sortTextureIds.clear();
+  m_sortMeshIds.clear();
+  m_drawSortKeys.resize(numDraws);
+
+  for (uint i = 0; i < numDraws; ++i)
+  {
+    const DrawCommand &cmd = frame.draws[i];
+    unsigned long long key = 1ull << 63;
+
+    if (cmd.state.blendMode == BLEND_REPLACE && cmd.state.depthMode == DEPTH_TEST_WRITE)
+    {
+      // Blend and depth mode are the same for every opaque draw. Shaded draws are grouped by
+      // shader, then texture.
+      uint permutation = ((cmd.state.texture != NULL) << 2) | cmd.state.sampleMode;
+      uint texture = min(SortId(m_sortTextureIds, cmd.state.texture), 0xFFFFu);
+      if (cmd.state.shader)
+      {
+        permutation = 8;
+        const uint shader = min(SortId(m_sortTextureIds, cmd.state.shader), 0xFFu);
+        texture = (shader << 8) | min(texture, 0xFFu);
+      }
+      const uint mesh = min(SortId(m_sortMeshIds, cmd.mesh), 0xFFFFu);
+
+      // Positive floats sort the same as their bits, the top 24 of which are plenty
+      const Vector4 origin = cmd.viewProjMatrix * (cmd.modelMatrix * Vector4(0, 0, 0, 1));
+      uint depth = 0;
+      if (origin.w > 0.0f)
+      {
+        memcpy(&depth, &origin.w, sizeof(depth));
+        depth >>= 7;
+      }
+
+      key = ((unsigned long long)permutation << 56) | ((unsigned long long)texture << 40) |
+            ((unsigned long long)mesh << 24) | depth;
+    }
+
+    // Draws with the same key stay in submission order
+    m_drawSortKeys[i] = std::make_pair(key, i);
+  }
+
+  std::sort(m_drawSortKeys.begin(), m_drawSortKeys.end());
+
+  m_sortedDraws.clear();
+  for (uint i = 0; i < numDraws; ++i)
+    m_sortedDraws.push_back(frame.draws[m_drawSortKeys[i].second]);
+
+  frame.draws.swap(m_sortedDraws);
+}
+
+uint SoftwareRasteriser::CountStateChanges(const vector<DrawCommand> &draws)
+{
+  uint changes = 0;
+  for (size_t i = 1; i < draws.size(); ++i)
+  {
+    const DrawState &a = draws[i - 1].state;
+    const DrawState &b = draws[i].state;
+    if (a.shader != b.shader || a.texture != b.texture || a.sampleMode != b.sampleMode ||
+        a.blendMode != b.blendMode || a.depthMode != b.depthMode || a.pointSize != b.pointSize)
+      changes++;
+  }
+  return changes;
+}
+
+void SoftwareRasteriser::ProcessDrawRange(PipelinedFrame &frame, uint range)
+{
+  PrimitiveList &out = frame.primitives[range];
+  for (uint i = frame.drawRanges[range]; i < frame.drawRanges[range + 1]; ++i)
+    ProcessDraw(frame.draws[i], out);
+}
+
+void SoftwareRasteriser::RasteriseFrame(PipelinedFrame &frame)
+{
+  SetViewport(frame.viewportWidth, frame.viewportHeight);
+  FindRedrawRects(frame);
+
+#ifdef PIPELINE_STATISTICS
+  m_frameStats.Add(frame.stats);
+  for (size_t i = 0; i < frame.primitives.size(); ++i)
+    m_frameStats.Add(frame.primitives[i].stats);
+#endif
+
+  // Every primitive is rasterised into each rectangle, clipped to it. The rectangles don't
+  // overlap, so nothing is blended twice.
+  for (size_t r = 0; r < m_redrawRects.size(); ++r)
+  {
+    m_clipRect = m_redrawRects[r];
+
+    if (frame.clear)
+      ClearCurrentBuffers(m_clipRect);
+
+    for (size_t i = 0; i < frame.primitives.size(); ++i)
+      RasterisePrimitives(frame.primitives[i]);
+  }
+
+  SetViewport(frame.viewportWidth, frame.viewportHeight);
+
+  // Kept to compare the next frame's draws with
+  if (m_incremental)
+    m_lastDraws.swap(frame.draws);
+  else
+    m_lastDraws.clear();
+}
+
+// Distance the squares a draw's points are drawn as can reach past the points themselves, in
+// pixels
+static float SpritePadding(const DrawCommand &cmd)
+{
+  return cmd.mesh->GetType() == PRIMITIVE_POINTS ? cmd.state.pointSize * 0.5f : 0.0f;
+}
+
+// True if two draws render exactly the same thing. A shader's uniforms may have changed between
+// frames, so draws with one never are.
+static bool SameDraw(const DrawCommand &a, const DrawCommand &b)
+{
+  return a.mesh == b.mesh && !a.state.shader && !b.state.shader &&
+         a.state.texture == b.state.texture && a.state.sampleMode == b.state.sampleMode &&
+         a.state.blendMode == b.state.blendMode && a.state.depthMode == b.state.depthMode &&
+         a.state.pointSize == b.state.pointSize && a.occlusionCull == b.occlusionCull &&
+         memcmp(a.modelMatrix.values, b.modelMatrix.values, sizeof(a.modelMatrix.values)) == 0 &&
+         memcmp(a.viewProjMatrix.values, b.viewProjMatrix.values,
+                sizeof(a.viewProjMatrix.values)) == 0;
+}
+
+/**
+ * Finds the rectangles of a frame that need to be drawn. That's normally the whole viewport, but
+ * when rendering incrementally each draw is compared with the draw in the same position in the
+ * last frame, and only the tiles covered by draws that differ (where they were, and where they are
+ * now) are redrawn. The buffer being drawn into was last drawn two frames ago, so the tiles that
+ * changed in the last frame are redrawn too.
+ *
+ * Whole frames are drawn when the number of draws changes, when a changed draw's bounds cross the
+ * near plane, and when more than half of the tiles would be redrawn anyway. Frames that aren't
+ * rendered incrementally are still only presented where their draws' bounds may have changed.
+ *
+ * \param frame Frame about to be rasterised, with its viewport set
+ */
+void SoftwareRasteriser::FindRedrawRects(const PipelinedFrame &frame)
+{
+  const uint tilesX = (m_viewportWidth + REDRAW_TILE_SIZE - 1) / REDRAW_TILE_SIZE;
+  const uint tilesY = (m_viewportHeight + REDRAW_TILE_SIZE - 1) / REDRAW_TILE_SIZE;
+  const uint numTiles = tilesX * tilesY;
+
+  // The last frame's changes move to the second list, and this frame's are found in the first
+  vector<unsigned char> &changed = m_changedTiles[0];
+  vector<unsigned char> &redraw = m_changedTiles[1];
+  changed.swap(redraw);
+  changed.assign(numTiles, 0);
+
+  // Bounds are projected at the current render size, so a frame processed at another size can't
+  // be compared
+  const bool settingsChanged = m_redrawAll;
+  bool redrawAll = !m_incremental || settingsChanged || !frame.clear ||
+                   m_heatmapMode != HEATMAP_OFF || frame.viewportWidth != m_renderWidth ||
+                   frame.viewportHeight != m_renderHeight || redraw.size() != numTiles ||
+                   frame.draws.size() != m_lastDraws.size();
+  m_redrawAll = false;
+
+  for (size_t i = 0; i < frame.draws.size() && !redrawAll; ++i)
+  {
+    if (!SameDraw(frame.draws[i], m_lastDraws[i]))
+    {
+      redrawAll = !MarkDrawTiles(frame.draws[i], changed, tilesX) ||
+                  !MarkDrawTiles(m_lastDraws[i], changed, tilesX);
+    }
+  }
+
+  // The last frame's changes are no longer needed once they have been added to the redraw
+  uint redrawTiles = 0;
+  for (uint i = 0; i < numTiles && !redrawAll; ++i)
+  {
+    redraw[i] |= changed[i];
+    redrawTiles += redraw[i];
+  }
+
+  m_redrawRects.clear();
+  m_presentAll = true;
+
+  if (redrawAll || redrawTiles * 2 > numTiles)
+  {
+    // When the changes aren't known the next frame has to be drawn in full too
+    if (redrawAll)
+      changed.assign(numTiles, 1);
+
+    ScreenRect rect = {0, 0, (int)m_viewportWidth, (int)m_viewportHeight};
+    m_redrawRects.push_back(rect);
+
+    if (!m_incremental)
+      FindDrawnPresentRects(frame, settingsChanged, tilesX, tilesY);
+    return;
+  }
+
+  TilesToRects(redraw, tilesX, tilesY, m_redrawRects);
+
+  // Only the tiles changed by this frame differ from the last frame presented
+  TilesToRects(changed, tilesX, tilesY, m_presentRects);
+  m_presentAll = false;
+}
+
+/**
+ * Finds the rectangles of a frame that need presenting when not rendering incrementally. Frames
+ * are cleared to black, so outside of the tiles covered by this frame's draws and the last frame's
+ * nothing has changed. Everything is presented when either frame's tiles aren't known, or when
+ * more than half of the tiles are covered anyway.
+ *
+ * \param frame Frame about to be rasterised, with its viewport set
+ * \param settingsChanged True if settings have changed that may change the whole frame
+ * \param tilesX Tiles per row
+ * \param tilesY Rows of tiles
+ */
+void SoftwareRasteriser::FindDrawnPresentRects(const PipelinedFrame &frame, bool settingsChanged,
+                                               uint tilesX, uint tilesY)
+{
+  const uint numTiles = tilesX * tilesY;
+
+  // Upscaled frames and heatmaps are presented in full, and bounds are projected at the current
+  // render size
+  bool known = frame.clear && !settingsChanged && m_heatmapMode == HEATMAP_OFF &&
+               m_viewportWidth == screenWidth && m_viewportHeight == screenHeight &&
+               frame.viewportWidth == m_renderWidth && frame.viewportHeight == m_renderHeight;
+
+  m_drawnTiles.assign(numTiles, 0);
+  for (size_t i = 0; i < frame.draws.size() && known; ++i)
+    known = MarkDrawTiles(frame.draws[i], m_drawnTiles, tilesX);
+
+  if (!known)
+  {
+    m_drawnTiles.clear();
+    return;
+  }
+
+  if (m_presentedTiles.size() != numTiles)
+    return;
+
+  // The last frame's tiles aren't needed once this frame is presented, so they become the union
+  uint presentTiles = 0;
+  for (uint i = 0; i < numTiles; ++i)
+  {
+    m_presentedTiles[i] |= m_drawnTiles[i];
+    presentTiles += m_presentedTiles[i];
+  }
+
+  if (presentTiles * 2 > numTiles)
+    return;
+
+  TilesToRects(m_presentedTiles, tilesX, tilesY, m_presentRects);
+  m_presentAll = false;
+}
+
+/**
+ * Converts flagged tiles into rectangles that don't overlap. Each run of tiles on a row becomes a
+ * rectangle, or extends the rectangle of an identical run on the row above.
+ *
+ * \param tiles Flag for each tile, row by row
+ * \param tilesX Tiles per row
+ * \param tilesY Rows of tiles
+ * \param rects Cleared, then receives the rectangles, clipped to the viewport
+ */
+void SoftwareRasteriser::TilesToRects(const vector<unsigned char> &tiles, uint tilesX, uint tilesY,
+                                      vector<ScreenRect> &rects) const
+{
+  rects.clear();
+
+  for (uint y = 0; y < tilesY; ++y)
+  {
+    uint x = 0;
+    while (x < tilesX)
+    {
+      if (!tiles[(y * tilesX) + x])
+      {
+        ++x;
+        continue;
+      }
+
+      uint end = x + 1;
+      while (end < tilesX && tiles[(y * tilesX) + end])
+        ++end;
+
+      ScreenRect rect;
+      rect.minX = (int)x * REDRAW_TILE_SIZE;
+      rect.minY = (int)y * REDRAW_TILE_SIZE;
+      rect.maxX = min((int)end * REDRAW_TILE_SIZE, (int)m_viewportWidth);
+      rect.maxY = min((int)(y + 1) * REDRAW_TILE_SIZE, (int)m_viewportHeight);
+
+      bool extended = false;
+      for (size_t r = 0; r < rects.size() && !extended; ++r)
+      {
+        ScreenRect &above = rects[r];
+        if (above.minX == rect.minX && above.maxX == rect.maxX && above.maxY == rect.minY)
+        {
+          above.maxY = rect.maxY;
+          extended = true;
+        }
+      }
+
+      if (!extended)
+        rects.push_back(rect);
+
+      x = end;
+    }
+  }
+}
+
+/**
+ * Flags the tiles covered by the screen space bounds of a draw.
+ *
+ * \param cmd Draw to find the tiles of
+ * \param tiles Flag for each tile, row by row
+ * \param tilesX Tiles per row
+ * \return False if the draw's bounds cross the near plane, or it has a vertex shader that may move
+ * its vertices anywhere, so the tiles it covers aren't known
+ */
+bool SoftwareRasteriser::MarkDrawTiles(const DrawCommand &cmd, vector<unsigned char> &tiles,
+                                       uint tilesX) const
+{
+  if (cmd.state.shader)
+    return false;
+
+  Vector3 boundsMin;
+  Vector3 boundsMax;
+  cmd.mesh->GetBounds(boundsMin, boundsMax);
+
+  OcclusionBounds bounds;
+  if (!ProjectBounds(boundsMin, boundsMax, cmd.viewProjMatrix * cmd.modelMatrix, bounds,
+                     SpritePadding(cmd)))
+    return false;
+
+  // Grown by a pixel, as the rasterisers can touch pixels just outside of the projected box
+  const int minX = max(bounds.minX - 1, 0);
+  const int minY = max(bounds.minY - 1, 0);
+  const int maxX = min(bounds.maxX + 1, (int)m_viewportWidth - 1);
+  const int maxY = min(bounds.maxY + 1, (int)m_viewportHeight - 1);
+  if (minX > maxX || minY > maxY)
+    return true;
+
+  for (int y = minY / REDRAW_TILE_SIZE; y <= maxY / REDRAW_TILE_SIZE; ++y)
+  {
+    for (int x = minX / REDRAW_TILE_SIZE; x <= maxX / REDRAW_TILE_SIZE; ++x)
+      tiles[(y * tilesX) + x] = 1;
+  }
+
+  return true;
+}
+
+void SoftwareRasteriser::ResetFrame(PipelinedFrame &frame)
+{
+  frame.draws.clear();
+  for (size_t i = 0; i < frame.primitives.size(); ++i)
+    frame.primitives[i].Clear();
+  frame.stats.Reset();
+  frame.clear = false;
+  frame.ready = false;
+}
+
+void SoftwareRasteriser::DrawObject(RenderObject *o)
+{
+  DrawMesh(o->GetMesh(), o->GetModelMatrix(), o->GetTexure(), o->GetShader());
+}
+
+/**
+ * Replays a command buffer. State changes it makes stay set afterwards, and its draws are handled
+ * the same as calls to DrawObject.
+ *
+ * \param commands Commands to replay
+ */
+void SoftwareRasteriser::Submit(const CommandBuffer &commands)
+{
+  Texture *texture = NULL;
+  ShaderProgram *shader = NULL;
+  Matrix4 m;
+  Mesh *mesh;
+  unsigned char mode;
+  float size;
+
+  size_t offset = 0;
+  RenderCommandType type;
+  while (commands.ReadCommand(offset, type))
+  {
+    switch (type)
+    {
+    case COMMAND_SET_VIEW_MATRIX:
+      commands.ReadMatrix(offset, m);
+      SetViewMatrix(m);
+      break;
+    case COMMAND_SET_PROJECTION_MATRIX:
+      commands.ReadMatrix(offset, m);
+      SetProjectionMatrix(m);
+      break;
+    case COMMAND_SET_SAMPLE_MODE:
+      commands.Read(offset, mode);
+      SetTextureSamplingMode((TextureSampleMode)mode);
+      break;
+    case COMMAND_SET_BLEND_MODE:
+      commands.Read(offset, mode);
+      SetBlendMode((BlendMode)mode);
+      break;
+    case COMMAND_SET_DEPTH_MODE:
+      commands.Read(offset, mode);
+      SetDepthMode((DepthMode)mode);
+      break;
+    case COMMAND_SET_POINT_SIZE:
+      commands.Read(offset, size);
+      SetPointSize(size);
+      break;
+    case COMMAND_SET_TEXTURE:
+      commands.Read(offset, texture);
+      break;
+    case COMMAND_SET_SHADER:
+      commands.Read(offset, shader);
+      break;
+    case COMMAND_DRAW:
+      commands.Read(offset, mesh);
+      commands.ReadMatrix(offset, m);
+      DrawMesh(mesh, m, texture, shader);
+      break;
+    }
+  }
+}
+
+void SoftwareRasteriser::DrawMesh(Mesh *mesh, const Matrix4 &modelMatrix, Texture *texture,
+                                  ShaderProgram *shader)
+{
+  DrawCommand cmd;
+  cmd.mesh = mesh;
+  cmd.modelMatrix = modelMatrix;
+  cmd.viewProjMatrix = m_viewProjMatrix;
+  cmd.state.shader = shader;
+  cmd.state.texture = texture;
+  cmd.state.sampleMode = m_texSampleState;
+  cmd.state.blendMode = m_blendState;
+  cmd.state.depthMode = m_depthState;
+  cmd.state.pointSize = m_pointSizeState;
+
+  // A vertex shader can move a mesh outside of its bounds
+  cmd.occlusionCull = m_occlusionCulling && m_depthState != DEPTH_DISABLED && !shader;
+
+  // The bounds are calculated here so that geometry threads only ever read them
+  Vector3 boundsMin;
+  Vector3 boundsMax;
+  if (cmd.occlusionCull || m_incremental)
+    mesh->GetBounds(boundsMin, boundsMax);
+  if (mesh->GetType() == PRIMITIVE_POINTS)
+    mesh->GetBlockBounds();
+
+  if (cmd.occlusionCull)
+  {
+    // Immediate draws are rasterised straight away, so can be tested before their vertices are
+    // processed, saving that work too
+    if (!IsRecording())
+    {
+      cmd.occlusionCull = false;
+
+      OcclusionBounds bounds;
+      if (ProjectBounds(boundsMin, boundsMax, m_viewProjMatrix * modelMatrix, bounds,
+                        SpritePadding(cmd)) &&
+          CountVisiblePixels(bounds, true) == 0)
+      {
+        PIPELINE_STAT(m_frameStats.objects++);
+        PIPELINE_STAT(m_frameStats.objectsOccluded++);
+        return;
+      }
+    }
+  }
+
+  if (IsRecording())
+  {
+    m_frames[m_recordFrame].draws.push_back(cmd);
+    return;
+  }
+
+  m_immediatePrimitives.Clear();
+  ProcessDraw(cmd, m_immediatePrimitives);
+  PIPELINE_STAT(m_frameStats.Add(m_immediatePrimitives.stats));
+  RasterisePrimitives(m_immediatePrimitives);
+}
+
+/**
+ * Draws a group of objects as an impostor, rendering it into the impostor's texture first if the
+ * direction or distance to it has changed by more than the impostor's thresholds since it was
+ * last rendered.
+ *
+ * \param impostor Impostor to draw
+ */
+void SoftwareRasteriser::DrawImpostor(Impostor *impostor)
+{
+  impostor->UpdateBounds();
+
+  Matrix4 inverseView = m_viewMatrix.Inverse();
+  Vector3 direction = impostor->m_centre - inverseView.GetPositionVector();
+  const float distance = direction.Length();
+  if (distance > 0.0f)
+    direction = direction / distance;
+
+  if (impostor->NeedsRefresh(direction, distance) &&
+      !RenderImpostor(impostor, inverseView, direction, distance))
+  {
+    for (size_t i = 0; i < impostor->m_objects.size(); ++i)
+      DrawObject(impostor->m_objects[i]);
+    return;
+  }
+
+  // Transparent texels mustn't hide anything drawn behind the quad later
+  const BlendMode blendMode = m_blendState;
+  const DepthMode depthMode = m_depthState;
+  m_blendState = BLEND_ALPHA;
+  if (m_depthState == DEPTH_TEST_WRITE)
+    m_depthState = DEPTH_TEST;
+
+  DrawMesh(impostor->m_quad, impostor->m_quadMatrix,
+           impostor->m_textures[impostor->m_currentTexture], NULL);
+
+  m_blendState = blendMode;
+  m_depthState = depthMode;
+}
+
+/**
+ * Renders an impostor's group into its texture from the camera's position, looking at the centre
+ * of the group with a frustum just containing its objects' bounding boxes, and places its quad
+ * across that frustum. The texture is sized to cover about as many pixels as the group does on
+ * screen, found from the projection matrix, which is expected to be a perspective projection.
+ *
+ * \param impostor Impostor to render
+ * \param inverseView Inverse of the current view matrix
+ * \param direction Normalised direction from the camera to the centre of the group
+ * \param distance Distance from the camera to the centre of the group
+ * \return False if the group can't be drawn as an impostor from here, because the camera is
+ * within its bounds or it would need a larger texture than the impostor's largest
+ */
+bool SoftwareRasteriser::RenderImpostor(Impostor *impostor, const Matrix4 &inverseView,
+                                        const Vector3 &direction, float distance)
+{
+  const Vector3 cameraPos = inverseView.GetPositionVector();
+
+  // Rendered with the camera's up direction, unless the group is straight above or below it
+  Vector3 up(inverseView.values[4], inverseView.values[5], inverseView.values[6]);
+  Vector3 right = Vector3::Cross(direction, up);
+  if (right.LengthSquared() < 1e-6f)
+  {
+    right = Vector3::Cross(direction, Vector3(inverseView.values[8], inverseView.values[9],
+                                              inverseView.values[10]));
+  }
+  right.Normalise();
+  up = Vector3::Cross(right, direction);
+
+  // Extent of the corners along the direction, and across it as tangents of their angles from it
+  const vector<Vector3> &corners = impostor->m_corners;
+  float minX = 0.0f;
+  float minY = 0.0f;
+  float minZ = 0.0f;
+  float maxX = 0.0f;
+  float maxY = 0.0f;
+  float maxZ = 0.0f;
+
+  for (size_t i = 0; i < corners.size(); ++i)
+  {
+    const Vector3 toCorner = corners[i] - cameraPos;
+    const float z = Vector3::Dot(toCorner, direction);
+    if (z < distance * 0.01f)
+      return false;
+
+    const float x = Vector3::Dot(toCorner, right) / z;
+    const float y = Vector3::Dot(toCorner, up) / z;
+    if (i == 0)
+    {
+      minX = maxX = x;
+      minY = maxY = y;
+      minZ = maxZ = z;
+      continue;
+    }
+
+    minX = min(minX, x);
+    minY = min(minY, y);
+    minZ = min(minZ, z);
+    maxX = max(maxX, x);
+    maxY = max(maxY, y);
+    maxZ = max(maxZ, z);
+  }
+
+  // Size of the group on screen (values[5] of a perspective projection is 1 / tan(fov / 2))
+  const float pixelsPerTangent = m_projectionMatrix.values[5] * m_renderHeight * 0.5f;
+  const float width = (maxX - minX) * pixelsPerTangent;
+  const float height = (maxY - minY) * pixelsPerTangent;
+  const uint maxWidth = min(impostor->m_maxSize, screenWidth);
+  const uint maxHeight = min(impostor->m_maxSize, screenHeight);
+  if (width <= 0.0f || height <= 0.0f || width > maxWidth || height > maxHeight)
+    return false;
+
+  // With enough texels for the group to come closer by the distance threshold before the next
+  // refresh
+  const float headroom = 1.0f + impostor->m_maxDistanceChange;
+  const uint textureWidth = clamp((uint)ceil(width * headroom), 1u, maxWidth);
+  const uint textureHeight = clamp((uint)ceil(height * headroom), 1u, maxHeight);
+
+  const float znear = minZ * 0.99f;
+  const float zfar = maxZ * 1.01f;
+  const Matrix4 viewProj =
+      Matrix4::Frustum(minX * znear, maxX * znear, minY * znear, maxY * znear, znear, zfar) *
+      Matrix4::BuildViewMatrix(cameraPos, impostor->m_centre, up);
+
+  // The other texture may still be used by a recorded frame
+  impostor->m_currentTexture = !impostor->m_currentTexture;
+  RenderToTexture(impostor->m_objects, viewProj, impostor->m_textures[impostor->m_currentTexture],
+                  textureWidth, textureHeight);
+
+  // The quad passes through the centre of the group, filling the frustum it was rendered with
+  const float halfWidth = (maxX - minX) * 0.5f * distance;
+  const float halfHeight = (maxY - minY) * 0.5f * distance;
+  const Vector3 quadCentre = impostor->m_centre + (right * ((maxX + minX) * 0.5f * distance)) +
+                             (up * ((maxY + minY) * 0.5f * distance));
+
+  Matrix4 &quad = impostor->m_quadMatrix;
+  quad.SetColumn(0, Vector4(right.x * halfWidth, right.y * halfWidth, right.z * halfWidth, 0.0f));
+  quad.SetColumn(1, Vector4(up.x * halfHeight, up.y * halfHeight, up.z * halfHeight, 0.0f));
+  quad.SetColumn(2, Vector4(-direction.x, -direction.y, -direction.z, 0.0f));
+  quad.SetPositionVector(quadCentre);
+
+  impostor->m_direction = direction;
+  impostor->m_distance = distance;
+  impostor->m_rendered = true;
+  impostor->m_refreshCount++;
+  return true;
+}
+
+/**
+ * Renders objects into a texture straight away, even when draws are being recorded, using the
+ * current sample, blend and depth modes. The texture is cleared to transparent black first, so
+ * texels the objects don't cover have an alpha of 0, and its mipmaps are regenerated afterwards.
+ *
+ * The objects are drawn by the raster stage, which in pipelined mode is only busy during
+ * SwapBuffers, so this must be called between frames.
+ *
+ * \param objects Objects to render
+ * \param viewProjMatrix View projection matrix to render them with
+ * \param target Texture to render into, which is resized if needed
+ * \param width Width of the texture, no larger than the window
+ * \param height Height of the texture, no larger than the window
+ */
+void SoftwareRasteriser::RenderToTexture(const vector<RenderObject *> &objects,
+                                         const Matrix4 &viewProjMatrix, Texture *target,
+                                         uint width, uint height)
+{
+  width = clamp(width, 1u, screenWidth);
+  height = clamp(height, 1u, screenHeight);
+
+  if (m_textureColours.size() < screenWidth * height)
+  {
+    m_textureColours.resize(screenWidth * height);
+    m_textureDepth.resize(screenWidth * height);
+  }
+
+  // The raster stage draws into the current colour and depth buffers, so they're swapped for the
+  // texture's, with anything that would draw elsewhere (multisampling, other colour formats and
+  // heatmaps) switched off
+  Colour *frameColours = m_buffers[m_currentDrawBuffer];
+  unsigned short *frameDepth = m_depthBuffer;
+  const bool multisample = m_multisample;
+  const ColourFormat colourFormat = m_colourFormat;
+  const HeatmapMode heatmapMode = m_heatmapMode;
+  const uint viewportWidth = m_viewportWidth;
+  const uint viewportHeight = m_viewportHeight;
+  const ScreenRect clipRect = m_clipRect;
+  const Matrix4 portMatrix = m_portMatrix;
+  const DrawState rasterState = m_rasterState;
+
+  m_buffers[m_currentDrawBuffer] = &m_textureColours[0];
+  m_depthBuffer = &m_textureDepth[0];
+  m_multisample = false;
+  m_colourFormat = COLOUR_BGRA8;
+  m_heatmapMode = HEATMAP_OFF;
+  SetViewport(width, height);
+  m_portMatrix = ViewportMatrix(width, height);
+
+  for (uint y = 0; y < height; ++y)
+  {
+    const uint first = y * screenWidth;
+    std::fill(m_textureColours.begin() + first, m_textureColours.begin() + first + width,
+              Colour(0, 0, 0, 0));
+    std::fill(m_textureDepth.begin() + first, m_textureDepth.begin() + first + width,
+              (unsigned short)~0);
+  }
+
+  for (size_t i = 0; i < objects.size(); ++i)
+  {
+    DrawCommand cmd;
+    cmd.mesh = objects[i]->GetMesh();
+    cmd.modelMatrix = objects[i]->GetModelMatrix();
+    cmd.viewProjMatrix = viewProjMatrix;
+    cmd.state.shader = objects[i]->GetShader();
+    cmd.state.texture = objects[i]->GetTexure();
+    cmd.state.sampleMode = m_texSampleState;
+    cmd.state.blendMode = m_blendState;
+    cmd.state.depthMode = m_depthState;
+    cmd.state.pointSize = m_pointSizeState;
+    cmd.occlusionCull = false;
+
+    m_immediatePrimitives.Clear();
+    ProcessDraw(cmd, m_immediatePrimitives);
+    PIPELINE_STAT(m_frameStats.Add(m_immediatePrimitives.stats));
+    RasterisePrimitives(m_immediatePrimitives);
+  }
+
+  m_buffers[m_currentDrawBuffer] = frameColours;
+  m_depthBuffer = frameDepth;
+  m_multisample = multisample;
+  m_colourFormat = colourFormat;
+  m_heatmapMode = heatmapMode;
+  m_viewportWidth = viewportWidth;
+  m_viewportHeight = viewportHeight;
+  m_clipRect = clipRect;
+  m_portMatrix = portMatrix;
+  SetRasterState(rasterState);
+
+  if (target->width != width || target->height != height)
+  {
+    delete[] target->texels;
+    target->texels = new Colour[width * height];
+    target->width = width;
+    target->height = height;
+  }
+
+  for (uint y = 0; y < height; ++y)
+  {
+    memcpy(target->texels + (y * width), &m_textureColours[y * screenWidth],
+           width * sizeof(Colour));
+  }
+
+  target->CreateMipMaps();
+}
+
+/**
+ * Counts the pixels of an object's bounding box that would pass the depth test against what has
+ * been drawn so far.
+ *
+ * \param o Object to test, with the current view and projection matrices
+ * \return Number of visible pixels
+ */
+uint SoftwareRasteriser::OcclusionQuery(RenderObject *o)
+{
+  Vector3 boundsMin;
+  Vector3 boundsMax;
+  o->GetMesh()->GetBounds(boundsMin, boundsMax);
+
+  return OcclusionQuery(boundsMin, boundsMax, o->GetModelMatrix());
+}
+
+/**
+ * Counts the pixels of a box that would pass the depth test against the depth buffer, without
+ * writing anything. The box is tested as the screen space rectangle around its corners at the
+ * depth of its nearest corner, so the count is conservative: it can include pixels that the box
+ * itself wouldn't cover, but never misses one that it would.
+ *
+ * Draws that are recorded rather than rendered straight away (in pipelined mode, or when
+ * sorting draws or sharing vertex processing between threads) haven't reached the depth buffer
+ * yet, so the query tests against the last frame that was rasterised instead.
+ *
+ * \param boundsMin Smallest corner of the box, in object space
+ * \param boundsMax Largest corner of the box, in object space
+ * \param modelMatrix Object's model matrix, used with the current view and projection matrices
+ * \return Number of visible pixels, counting any box crossing the near plane as entirely visible
+ */
+uint SoftwareRasteriser::OcclusionQuery(const Vector3 &boundsMin, const Vector3 &boundsMax,
+                                        const Matrix4 &modelMatrix)
+{
+  OcclusionBounds bounds;
+  if (!ProjectBounds(boundsMin, boundsMax, m_viewProjMatrix * modelMatrix, bounds))
+    return m_viewportWidth * m_viewportHeight;
+
+  return CountVisiblePixels(bounds, false);
+}
+
+/**
+ * Projects the corners of a box to the screen, finding the rectangle that covers them and the
+ * depth of the nearest.
+ *
+ * Only reads state that is fixed while a frame is in flight, so may run on a worker thread.
+ *
+ * \param boundsMin Smallest corner of the box, in object space
+ * \param boundsMax Largest corner of the box, in object space
+ * \param mvp Model view projection matrix
+ * \param out Receives the screen space bounds
+ * \param padding Pixels to grow the rectangle by on each side, for point sprites
+ * \return False if the box crosses the near plane, in which case it can't be tested
+ */
+bool SoftwareRasteriser::ProjectBounds(const Vector3 &boundsMin, const Vector3 &boundsMax,
+                                       const Matrix4 &mvp, OcclusionBounds &out,
+                                       float padding) const
+{
+  out.testable = false;
+
+  float minX = 0.0f;
+  float minY = 0.0f;
+  float minZ = 0.0f;
+  float maxX = 0.0f;
+  float maxY = 0.0f;
+
+  for (int i = 0; i < 8; ++i)
+  {
+    Vector4 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y,
+                   (i & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+    corner = mvp * corner;
+
+    // Corners behind the near plane don't project to anywhere sensible
+    if (corner.w <= 0.0f || corner.z < -corner.w)
+      return false;
+
+    corner.SelfDivisionByW();
+    corner = m_portMatrix * corner;
+
+    if (i == 0)
+    {
+      minX = maxX = corner.x;
+      minY = maxY = corner.y;
+      minZ = corner.z;
+      continue;
+    }
+
+    minX = min(minX, corner.x);
+    minY = min(minY, corner.y);
+    minZ = min(minZ, corner.z);
+    maxX = max(maxX, corner.x);
+    maxY = max(maxY, corner.y);
+  }
+
+  // Clamped before converting, as boxes reaching far off screen can have huge coordinates. The
+  // viewport can still shrink before the bounds are tested, so they're clamped again then.
+  const float width = (float)screenWidth;
+  const float height = (float)screenHeight;
+  out.minX = (int)clamp(floor(minX - padding), -1.0f, width);
+  out.minY = (int)clamp(floor(minY - padding), -1.0f, height);
+  out.maxX = (int)clamp(ceil(maxX + padding), -1.0f, width);
+  out.maxY = (int)clamp(ceil(maxY + padding), -1.0f, height);
+  out.depth = (uint)clamp(floor(minZ), 0.0f, 65535.0f);
+  out.testable = true;
+  return true;
+}
+
+/**
+ * Counts the pixels in a rectangle (and the clip rectangle) where the depth buffer is no nearer
+ * than the rectangle's depth. When multisampling a pixel is visible if any of its samples are.
+ *
+ * \param bounds Screen space bounds to test
+ * \param stopAtFirst True to stop counting once any pixel is visible, when only whether the
+ * bounds are visible at all matters
+ * \return Number of visible pixels
+ */
+uint SoftwareRasteriser::CountVisiblePixels(const OcclusionBounds &bounds, bool stopAtFirst)
+{
+  const int minX = max(bounds.minX, m_clipRect.minX);
+  const int minY = max(bounds.minY, m_clipRect.minY);
+  const int maxX = min(bounds.maxX, m_clipRect.maxX - 1);
+  const int maxY = min(bounds.maxY, m_clipRect.maxY - 1);
+  const uint samples = m_multisample ? MSAA_SAMPLES : 1;
+
+  uint visible = 0;
+  for (int y = minY; y <= maxY; ++y)
+  {
+    const unsigned short *depth = m_depthBuffer + (((y * screenWidth) + minX) * samples);
+    for (int x = minX; x <= maxX; ++x, depth += samples)
+    {
+      for (uint s = 0; s < samples; ++s)
+      {
+        if (bounds.depth <= depth[s])
+        {
+          visible++;
+          break;
+        }
+      }
+    }
+
+    if (stopAtFirst && visible > 0)
+      break;
+  }
+
+  return visible;
+}
+
+/**
+ * Performs vertex processing and clipping for a single draw, appending the resulting screen space
+ * primitives to a list.
+ *
+ * Only reads state that is fixed while a frame is in flight, so may run on a worker thread.
+ *
+ * \param cmd Draw to process
+ * \param out List to append primitives to
+ */
+void SoftwareRasteriser::ProcessDraw(const DrawCommand &cmd, PrimitiveList &out)
+{
+  const Matrix4 mvp = cmd.viewProjMatrix * cmd.modelMatrix;
+  PIPELINE_STAT(out.stats.objects++);
+
+  PrimitiveBatch batch;
+  batch.state = cmd.state;
+  batch.occlusion.testable = false;
+  if (cmd.occlusionCull)
+  {
+    Vector3 boundsMin;
+    Vector3 boundsMax;
+    cmd.mesh->GetBounds(boundsMin, boundsMax);
+    ProjectBounds(boundsMin, boundsMax, mvp, batch.occlusion, SpritePadding(cmd));
+  }
+
+  switch (cmd.mesh->GetType())
+  {
+  // Points and lines are never shaded
+  case PRIMITIVE_POINTS:
+    batch.type = PRIMITIVE_POINTS;
+    batch.state.shader = NULL;
+    batch.first = (uint)out.points.size();
+    ProcessPointsMesh(mvp, cmd.mesh, cmd.state.pointSize, out);
+    batch.count = (uint)out.points.size() - batch.first;
+    break;
+  case PRIMITIVE_LINES:
+    batch.type = PRIMITIVE_LINES;
+    batch.state.shader = NULL;
+    batch.first = (uint)out.lines.size();
+    ProcessLinesMesh(mvp, cmd.mesh, out);
+    batch.count = (uint)out.lines.size() - batch.first;
+    break;
+  default:
+    batch.type = PRIMITIVE_TRIANGLES;
+    if (cmd.state.shader)
+    {
+      batch.first = (uint)out.shadedTris.size();
+      (this->*cmd.state.shader->m_process)(cmd, out);
+      batch.count = (uint)out.shadedTris.size() - batch.first;
+      break;
+    }
+
+    batch.first = (uint)out.tris.size();
+    if (cmd.mesh->GetType() == PRIMITIVE_TRIANGLE_STRIP)
+      ProcessTriMeshStrip(mvp, cmd.mesh, out);
+    else if (cmd.mesh->GetType() == PRIMITIVE_TRIANGLE_FAN)
+      ProcessTriMeshFan(mvp, cmd.mesh, out);
+    else
+      ProcessTriMesh(mvp, cmd.mesh, out);
+    batch.count = (uint)out.tris.size() - batch.first;
+  }
+
+  if (batch.count > 0)
+    out.batches.push_back(batch);
+}
+
+void SoftwareRasteriser::SetRasterState(const DrawState &state)
+{
+  m_rasterState = state;
+  m_currentTexture = state.texture;
+
+  // Select the line and triangle rasterisers for this state up front, so the per pixel loops have
+  // no state checks
+  m_rasteriseLine = s_rasteriseLinePermutations[state.depthMode];
+  if (state.shader)
+  {
+    m_rasteriseShadedTris = state.shader->m_rasterise[m_multisample][state.depthMode];
+    return;
+  }
+
+  const bool textured = (m_currentTexture != NULL);
+  const TextureSampleMode sampleMode = textured ? state.sampleMode : SAMPLE_NEAREST;
+  if (m_multisample)
+  {
+    m_rasteriseTri = s_rasteriseTriMultisamplePermutations[textured][sampleMode][state.blendMode]
+                                                          [state.depthMode];
+  }
+  else if (m_triangleTraversal == TRAVERSAL_SCANLINE)
+  {
+    m_rasteriseTri =
+        s_rasteriseTriSpanPermutations[textured][sampleMode][state.blendMode][state.depthMode];
+  }
+  else
+  {
+    m_rasteriseTri =
+        s_rasteriseTriPermutations[textured][sampleMode][state.blendMode][state.depthMode];
+  }
+}
+
+void SoftwareRasteriser::RasterisePrimitives(const PrimitiveList &list)
+{
+  for (vector<PrimitiveBatch>::const_iterator it = list.batches.begin(); it != list.batches.end();
+       ++it)
+  {
+    const PrimitiveBatch &batch = *it;
+
+    // Earlier batches may have hidden this one since its geometry was processed
+    if (batch.occlusion.testable && CountVisiblePixels(batch.occlusion, true) == 0)
+    {
+      PIPELINE_STAT(m_frameStats.objectsOccluded++);
+      continue;
+    }
+
+    SetRasterState(batch.state);
+
+    const uint end = batch.first + batch.count;
+    switch (batch.type)
+    {
+    case PRIMITIVE_POINTS:
+      RasterisePoints(&list.points[batch.first], batch.count);
+      break;
+    case PRIMITIVE_LINES:
+      for (uint i = batch.first; i < end; ++i)
+      {
+        const ScreenLine &l = list.lines[i];
+        RasteriseLine(l.v[0], l.v[1], l.c[0], l.c[1], l.t[0], l.t[1]);
+      }
+      break;
+    default:
+      if (batch.state.shader)
+      {
+        (this->*m_rasteriseShadedTris)(&list.shadedTris[batch.first], batch.count);
+        break;
+      }
+
+      for (uint i = batch.first; i < end; ++i)
+      {
+        const ScreenTri &t = list.tris[i];
+        RasteriseTri(t.v[0], t.v[1], t.v[2], t.c[0], t.c[1], t.c[2], t.t[0], t.t[1], t.t[2]);
+      }
+    }
+  }
+}
+
+void SoftwareRasteriser::CalculateWeights(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
+                                          const Vector4 &p, float &alpha, float &beta, float &gamma)
+{
+  const float triArea = ScreenAreaOfTri(v0, v1, v2);
+  const float areaRecip = 1.0f / triArea;
+
+  float subTriArea[3];
+  subTriArea[0] = abs(ScreenAreaOfTri(v0, p, v1));
+  subTriArea[1] = abs(ScreenAreaOfTri(v1, p, v2));
+  subTriArea[2] = abs(ScreenAreaOfTri(v2, p, v0));
+
+  alpha = subTriArea[1] * areaRecip;
+  beta = subTriArea[2] * areaRecip;
+  gamma = subTriArea[0] * areaRecip;
+}
+
+bool SoftwareRasteriser::CohenSutherlandLine(Vector4 &inA, Vector4 &inB, Colour &colA, Colour &colB,
+                                             Vector3 &texA, Vector3 &texB)
+{
+  for (int i = 0; i < 6; ++i)
+  {
+    int planeCode = 1 << i;
+    int outsideA = (HomogeneousOutcode(inA) & planeCode);
+    int outsideB = (HomogeneousOutcode(inB) & planeCode);
+
+    if (outsideA && outsideB)
+      return false;
+
+    if (!outsideA && !outsideB)
+      continue;
+
+    float clipRatio = ClipEdge(inA, inB, planeCode);
+    if (outsideA)
+    {
+      texA = Vector3::Lerp(texA, texB, clipRatio);
+      colA = Colour::Lerp(colA, colB, clipRatio);
+      inA = Vector4::Lerp(inA, inB, clipRatio);
+    }
+    else
+    {
+      texB = Vector3::Lerp(texA, texB, clipRatio);
+      colB = Colour::Lerp(colA, colB, clipRatio);
+      inB = Vector4::Lerp(inA, inB, clipRatio);
+    }
+  }
+
+  return true;
+}
+
+// Attributes carried through the triangle clipper: colour rgba then texture uv
+const int TRI_CLIP_ATTRIBUTES = 6;
+
+/**
+ * Signed distance of a clip space vertex from one of the clip planes, scaled by w. Negative when
+ * the vertex is outside of the plane, matching HomogeneousOutcode.
+ *
+ * \param v Clip space vertex
+ * \param planeCode Outcode bit of the plane
+ */
+static inline float ClipPlaneDistance(const Vector4 &v, int planeCode)
+{
+  switch (planeCode)
+  {
+  case LEFT_CS:
+    return v.w + v.x;
+  case RIGHT_CS:
+    return v.w - v.x;
+  case BOTTOM_CS:
+    return v.w + v.y;
+  case TOP_CS:
+    return v.w - v.y;
+  case NEAR_CS:
+    return v.w + v.z;
+  default:
+    return v.w - v.z;
+  }
+}
+
+void SoftwareRasteriser::SutherlandHodgmanTri(PrimitiveList &out, Vector4 &v0, Vector4 &v1,
+                                              Vector4 &v2, const Colour &c0, const Colour &c1,
+                                              const Colour &c2, const Vector2 &t0,
+                                              const Vector2 &t1, const Vector2 &t2)
+{
+  const int outcode0 = HomogeneousOutcode(v0);
+  const int outcode1 = HomogeneousOutcode(v1);
+  const int outcode2 = HomogeneousOutcode(v2);
+  PIPELINE_STAT(out.stats.trianglesSubmitted++);
+
+  // Entirely outside of one of the planes, nothing to draw
+  if (outcode0 & outcode1 & outcode2)
+  {
+    PIPELINE_STAT(out.stats.trianglesCulled++);
+    return;
+  }
+
+  // Only planes that a vertex is outside of can clip the triangle, when there are none it is
+  // trivially accepted and skips the clipper entirely
+  const int clipPlanes = outcode0 | outcode1 | outcode2;
+  if (!clipPlanes)
+  {
+    PIPELINE_STAT(out.stats.trianglesAccepted++);
+
+    Vector4 pos[3] = {v0, v1, v2};
+    const Colour col[3] = {c0, c1, c2};
+    Vector3 tex[3] = {Vector3(t0.x, t0.y, 1.0f), Vector3(t1.x, t1.y, 1.0f),
+                      Vector3(t2.x, t2.y, 1.0f)};
+    EmitPolygon(out, pos, col, tex, 3);
+    return;
+  }
+
+  PIPELINE_STAT(out.stats.trianglesClipped++);
+
+  ClipPolygon buffers[2];
+  ClipPolygon *poly = &buffers[0];
+  ClipPolygon *scratch = &buffers[1];
+
+  const Vector4 *v[3] = {&v0, &v1, &v2};
+  const Colour *c[3] = {&c0, &c1, &c2};
+  const Vector2 *t[3] = {&t0, &t1, &t2};
+
+  poly->count = 3;
+  for (int i = 0; i < 3; ++i)
+  {
+    poly->pos[i] = *v[i];
+    poly->attributes[0][i] = c[i]->r;
+    poly->attributes[1][i] = c[i]->g;
+    poly->attributes[2][i] = c[i]->b;
+    poly->attributes[3][i] = c[i]->a;
+    poly->attributes[4][i] = t[i]->x;
+    poly->attributes[5][i] = t[i]->y;
+  }
+
+  ClipPolygonToPlanes(poly, scratch, TRI_CLIP_ATTRIBUTES, clipPlanes);
+
+  if (poly->count < 3)
+    return;
+
+  Colour col[MAX_CLIP_VERTS];
+  Vector3 tex[MAX_CLIP_VERTS];
+  for (int i = 0; i < poly->count; ++i)
+  {
+    col[i] = Colour((unsigned char)poly->attributes[0][i], (unsigned char)poly->attributes[1][i],
+                    (unsigned char)poly->attributes[2][i], (unsigned char)poly->attributes[3][i]);
+    tex[i] = Vector3(poly->attributes[4][i], poly->attributes[5][i], 1.0f);
+  }
+
+  PIPELINE_STAT(out.stats.clippedTriangles += poly->count - 2);
+
+  EmitPolygon(out, poly->pos, col, tex, poly->count);
+}
+
+/**
+ * Clips a convex polygon against a set of clip planes. Vertices ping-pong between the two
+ * buffers rather than being copied back after each plane, on return poly points at whichever
+ * holds the result. Each vertex's distance to a plane is calculated once per plane.
+ *
+ * \param poly Polygon to clip, updated to point at the clipped polygon
+ * \param scratch Buffer for intermediate results, updated to point at the other buffer
+ * \param numAttributes Number of attributes per vertex to interpolate
+ * \param clipPlanes Outcode bits of the planes to clip against
+ */
+void SoftwareRasteriser::ClipPolygonToPlanes(ClipPolygon *&poly, ClipPolygon *&scratch,
+                                             int numAttributes, int clipPlanes)
+{
+  float dist[MAX_CLIP_VERTS];
+
+  for (int plane = 0; plane < 6 && poly->count >= 3; ++plane)
+  {
+    const int planeCode = 1 << plane;
+    if (!(clipPlanes & planeCode))
+      continue;
+
+    const int inSize = poly->count;
+    for (int i = 0; i < inSize; ++i)
+      dist[i] = ClipPlaneDistance(poly->pos[i], planeCode);
+
+    int outSize = 0;
+    int prev = inSize - 1;
+
+    for (int j = 0; j < inSize; prev = j++)
+    {
+      const bool inside = (dist[j] >= 0.0f);
+
+      // Edge crosses the plane, emit the intersection
+      if (inside != (dist[prev] >= 0.0f))
+      {
+        const float ratio = min(1.0f, dist[j] / (dist[j] - dist[prev]));
+
+        scratch->pos[outSize] = Vector4::Lerp(poly->pos[j], poly->pos[prev], ratio);
+        for (int a = 0; a < numAttributes; ++a)
+        {
+          const float *attribute = poly->attributes[a];
+          scratch->attributes[a][outSize] =
+              attribute[j] + ((attribute[prev] - attribute[j]) * ratio);
+        }
+        outSize++;
+      }
+
+      if (inside)
+      {
+        scratch->pos[outSize] = poly->pos[j];
+        for (int a = 0; a < numAttributes; ++a)
+          scratch->attributes[a][outSize] = poly->attributes[a][j];
+        outSize++;
+      }
+    }
+
+    scratch->count = outSize;
+
+    ClipPolygon *temp = poly;
+    poly = scratch;
+    scratch = temp;
+  }
+}
+
+/**
+ * Projects a clipped convex polygon to the screen and adds it to the primitive list as a fan of
+ * triangles.
+ *
+ * \param out List to add triangles to
+ * \param pos Clip space positions, projected in place
+ * \param col Vertex colours
+ * \param tex Texture coordinates with z of 1, divided by w in place
+ * \param count Number of vertices
+ */
+void SoftwareRasteriser::EmitPolygon(PrimitiveList &out, Vector4 *pos, const Colour *col,
+                                     Vector3 *tex, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    tex[i] = tex[i] / pos[i].w;
+    pos[i].SelfDivisionByW();
+    pos[i] = m_portMatrix * pos[i];
+  }
+
+  for (int i = 2; i < count; ++i)
+  {
+    ScreenTri tri;
+    tri.v[0] = pos[0];
+    tri.v[1] = pos[i - 1];
+    tri.v[2] = pos[i];
+    tri.c[0] = col[0];
+    tri.c[1] = col[i - 1];
+    tri.c[2] = col[i];
+    tri.t[0] = tex[0];
+    tri.t[1] = tex[i - 1];
+    tri.t[2] = tex[i];
+    out.tris.push_back(tri);
+  }
+}
+
+/**
+ * Assembles the triangles of a draw whose vertices have been shaded, and clips them.
+ *
+ * \param type Primitive type of the mesh
+ * \param numVertices Number of vertices, already in the list's shadedVertices
+ * \param out List to add the triangles to
+ */
+void SoftwareRasteriser::AssembleShadedTris(PrimitiveType type, uint numVertices,
+                                            PrimitiveList &out)
+{
+  if (numVertices < 3)
+    return;
+
+  switch (type)
+  {
+  case PRIMITIVE_TRIANGLE_STRIP:
+    for (uint i = 0; i < numVertices - 2; ++i)
+      ClipShadedTri(out, i, i + 1, i + 2);
+    break;
+  case PRIMITIVE_TRIANGLE_FAN:
+    for (uint i = 1; i < numVertices - 1; ++i)
+      ClipShadedTri(out, 0, i, i + 1);
+    break;
+  default:
+    for (uint i = 0; i + 2 < numVertices; i += 3)
+      ClipShadedTri(out, i, i + 1, i + 2);
+  }
+}
+
+/**
+ * Shaded version of SutherlandHodgmanTri, clipping every varying along with the position.
+ *
+ * \param out List holding the shaded vertices and outcodes, to add the triangle to
+ * \param i0 Index of the first vertex
+ * \param i1 Index of the second vertex
+ * \param i2 Index of the third vertex
+ */
+void SoftwareRasteriser::ClipShadedTri(PrimitiveList &out, uint i0, uint i1, uint i2)
+{
+  const int outcode0 = out.outcodes[i0];
+  const int outcode1 = out.outcodes[i1];
+  const int outcode2 = out.outcodes[i2];
+  PIPELINE_STAT(out.stats.trianglesSubmitted++);
+
+  if (outcode0 & outcode1 & outcode2)
+  {
+    PIPELINE_STAT(out.stats.trianglesCulled++);
+    return;
+  }
+
+  ShadedVertex verts[MAX_CLIP_VERTS];
+
+  const int clipPlanes = outcode0 | outcode1 | outcode2;
+  if (!clipPlanes)
+  {
+    PIPELINE_STAT(out.stats.trianglesAccepted++);
+
+    verts[0] = out.shadedVertices[i0];
+    verts[1] = out.shadedVertices[i1];
+    verts[2] = out.shadedVertices[i2];
+    EmitShadedPolygon(out, verts, 3);
+    return;
+  }
+
+  PIPELINE_STAT(out.stats.trianglesClipped++);
+
+  ClipPolygon buffers[2];
+  ClipPolygon *poly = &buffers[0];
+  ClipPolygon *scratch = &buffers[1];
+
+  const uint index[3] = {i0, i1, i2};
+
+  poly->count = 3;
+  for (int i = 0; i < 3; ++i)
+  {
+    const ShadedVertex &v = out.shadedVertices[index[i]];
+    const float *varyings = (const float *)&v.varyings;
+
+    poly->pos[i] = v.pos;
+    for (int a = 0; a < SHADER_VARYINGS; ++a)
+      poly->attributes[a][i] = varyings[a];
+  }
+
+  ClipPolygonToPlanes(poly, scratch, SHADER_VARYINGS, clipPlanes);
+
+  if (poly->count < 3)
+    return;
+
+  for (int i = 0; i < poly->count; ++i)
+  {
+    float *varyings = (float *)&verts[i].varyings;
+
+    verts[i].pos = poly->pos[i];
+    for (int a = 0; a < SHADER_VARYINGS; ++a)
+      varyings[a] = poly->attributes[a][i];
+  }
+
+  PIPELINE_STAT(out.stats.clippedTriangles += poly->count - 2);
+
+  EmitShadedPolygon(out, verts, poly->count);
+}
+
+/**
+ * Shaded version of EmitPolygon. Each vertex's w is replaced by 1/w after projection, and its
+ * varyings are divided by w.
+ *
+ * \param out List to add triangles to
+ * \param verts Clip space vertices, projected in place
+ * \param count Number of vertices
+ */
+void SoftwareRasteriser::EmitShadedPolygon(PrimitiveList &out, ShadedVertex *verts, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    const float invW = 1.0f / verts[i].pos.w;
+
+    float *varyings = (float *)&verts[i].varyings;
+    for (int a = 0; a < SHADER_VARYINGS; ++a)
+      varyings[a] *= invW;
+
+    verts[i].pos.SelfDivisionByW();
+    verts[i].pos = m_portMatrix * verts[i].pos;
+    verts[i].pos.w = invW;
+  }
+
+  for (int i = 2; i < count; ++i)
+  {
+    const int corners[3] = {0, i - 1, i};
+
+    ShadedTri tri;
+    for (int j = 0; j < 3; ++j)
+    {
+      tri.v[j] = verts[corners[j]].pos;
+      tri.varyings[j] = verts[corners[j]].varyings;
+    }
+    out.shadedTris.push_back(tri);
+  }
+}
+
+/**
+ * Calculates the edge functions and attribute gradients of a shaded triangle, and the pixels it
+ * may cover inside the clip rectangle.
+ *
+ * \param tri Triangle to set up
+ * \param setup Filled with the triangle's setup
+ * \return False if the triangle covers no pixels
+ */
+bool SoftwareRasteriser::SetupShadedTri(const ShadedTri &tri, ShadedTriSetup &setup) const
+{
+  const Vector4 &v0 = tri.v[0];
+  const Vector4 &v1 = tri.v[1];
+  const Vector4 &v2 = tri.v[2];
+
+  const float area = ((v1.x - v0.x) * (v2.y - v0.y)) - ((v1.y - v0.y) * (v2.x - v0.x));
+  if (area == 0.0f)
+    return false;
+
+  // Samples can be half a pixel from their pixel's centre
+  const float border = m_multisample ? 0.5f : 0.0f;
+  const float minX = min(v0.x, min(v1.x, v2.x)) - border;
+  const float minY = min(v0.y, min(v1.y, v2.y)) - border;
+  const float maxX = max(v0.x, max(v1.x, v2.x)) + border;
+  const float maxY = max(v0.y, max(v1.y, v2.y)) + border;
+
+  setup.xStart = max((int)ceil(minX), m_clipRect.minX);
+  setup.yStart = max((int)ceil(minY), m_clipRect.minY);
+  setup.xEnd = min((int)floor(maxX) + 1, m_clipRect.maxX);
+  setup.yEnd = min((int)floor(maxY) + 1, m_clipRect.maxY);
+
+  if (setup.xStart >= setup.xEnd || setup.yStart >= setup.yEnd)
+    return false;
+
+  const float sign = (area > 0.0f) ? 1.0f : -1.0f;
+  for (int i = 0; i < 3; ++i)
+  {
+    setup.topLeft[i] = SetupEdgeFunction(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], sign,
+                                         setup.edgeX[i], setup.edgeY[i], setup.edgeC[i]);
+  }
+
+  // Each attribute is the sum of its value at each vertex times that vertex's weight
+  for (int a = 0; a < SHADED_ATTRIBUTES; ++a)
+  {
+    setup.base[a] = 0.0f;
+    setup.dx[a] = 0.0f;
+    setup.dy[a] = 0.0f;
+  }
+
+  const float weightScale = 1.0f / fabs(area);
+  for (int i = 0; i < 3; ++i)
+  {
+    float values[SHADED_ATTRIBUTES];
+    values[0] = tri.v[i].z;
+    values[1] = tri.v[i].w;
+    memcpy(values + 2, &tri.varyings[i], sizeof(Varyings));
+
+    const float weightC = setup.edgeC[i] * weightScale;
+    const float weightX = setup.edgeX[i] * weightScale;
+    const float weightY = setup.edgeY[i] * weightScale;
+    for (int a = 0; a < SHADED_ATTRIBUTES; ++a)
+    {
+      setup.base[a] += weightC * values[a];
+      setup.dx[a] += weightX * values[a];
+      setup.dy[a] += weightY * values[a];
+    }
+  }
+
+  if (m_multisample)
+  {
+    for (int s = 0; s < MSAA_SAMPLES; ++s)
+    {
+      setup.sampleX[s] = MSAA_SAMPLE_OFFSETS[s][0];
+      setup.sampleY[s] = MSAA_SAMPLE_OFFSETS[s][1];
+
+      for (int i = 0; i < 3; ++i)
+      {
+        setup.sampleWeight[i][s] =
+            (setup.edgeX[i] * setup.sampleX[s]) + (setup.edgeY[i] * setup.sampleY[s]);
+      }
+    }
+  }
+
+  return true;
+}
+
+float SoftwareRasteriser::ClipEdge(const Vector4 &inA, const Vector4 &inB, int axis)
+{
+  const float distA = ClipPlaneDistance(inA, axis);
+  const float distB = ClipPlaneDistance(inB, axis);
+
+  return min(1.0f, distA / (distA - distB));
+}
+
+int SoftwareRasteriser::HomogeneousOutcode(const Vector4 &in)
+{
+  int outCode = INSIDE_CS;
+
+  if (in.x < -in.w)
+    outCode |= LEFT_CS;
+  else if (in.x > in.w)
+    outCode |= RIGHT_CS;
+
+  if (in.y < -in.w)
+    outCode |= BOTTOM_CS;
+  else if (in.y > in.w)
+    outCode |= TOP_CS;
+
+  if (in.z < -in.w)
+    outCode |= NEAR_CS;
+  else if (in.z > in.w)
+    outCode |= FAR_CS;
+
+  return outCode;
+}
+
+/**
+ * Draws points a single pixel in size without multisampling. Each is depth tested and then written
+ * straight into the colour buffer when it is opaque and needs no conversion, or blended through
+ * the kernel for the buffer format otherwise.
+ *
+ * \param points Points to draw
+ * \param count Number of points
+ */
+template <BlendMode Blend>
+void SoftwareRasteriser::RasteriseSinglePixelPoints(const ScreenPoint *points, uint count)
+{
+  const DepthMode depthMode = m_rasterState.depthMode;
+  const bool bgra = (m_colourFormat == COLOUR_BGRA8);
+  Colour *colourBuffer = m_buffers[m_currentDrawBuffer];
+  const unsigned int coverage = ~0u;
+
+#ifdef PIPELINE_STATISTICS
+  const bool blended = (Blend != BLEND_REPLACE);
+  const bool heatmap = (m_heatmapMode != HEATMAP_OFF);
+#endif
+
+  for (uint i = 0; i < count; ++i)
+  {
+    // Same rounding as RasterisePoints uses for a size of 1
+    const ScreenPoint &p = points[i];
+    const int x = (int)(p.v.x + 1.0f) - 1;
+    const int y = (int)(p.v.y + 1.0f) - 1;
+    if (!InsideClipRect(x, y))
+      continue;
+
+    const int index = (y * screenWidth) + x;
+    PIPELINE_STAT(m_frameStats.pixelsTested++);
+    PIPELINE_STAT(if (heatmap) m_heatmap[0][index]++);
+
+    if (depthMode != DEPTH_DISABLED)
+    {
+      const unsigned int depth = (unsigned int)p.v.z;
+      if (depth > m_depthBuffer[index])
+        continue;
+
+      if (depthMode == DEPTH_TEST_WRITE)
+        m_depthBuffer[index] = (unsigned short)depth;
+    }
+
+    if (Blend == BLEND_REPLACE && bgra)
+      colourBuffer[index] = p.c;
+    else if (bgra)
+      BlendSpan<Blend>(colourBuffer + index, &p.c, &coverage, 1);
+    else
+      BlendColourSpan<Blend>((uint)x, (uint)y, &p.c, &coverage, 1);
+
+#ifdef PIPELINE_STATISTICS
+    m_frameStats.pixelsPassed++;
+    if (blended)
+      m_frameStats.pixelsBlended++;
+    if (heatmap)
+    {
+      m_heatmap[1][index]++;
+      if (blended)
+        m_heatmap[2][index]++;
+    }
+#endif
+  }
+}
+
+/**
+ * Draws points as squares of the current point size, covering every pixel whose centre is inside
+ * the square. A square has a single depth and colour, so each of its rows is depth tested and then
+ * written as a single span, or straight into the colour buffer when it is opaque and needs no
+ * conversion. When multisampling the square covers whole pixels, so every sample of them is
+ * tested.
+ *
+ * \param points Points to draw
+ * \param count Number of points
+ */
+void SoftwareRasteriser::RasterisePoints(const ScreenPoint *points, uint count)
+{
+  const DepthMode depthMode = m_rasterState.depthMode;
+  const uint samples = m_multisample ? MSAA_SAMPLES : 1;
+
+  // The geometry stage culls points whose square can't reach the viewport, so the corner of any
+  // square is over -size, and truncating after adding size floors it
+  const int size = max((int)(m_rasterState.pointSize + 0.5f), 1);
+  const float offset = (0.5f - (size * 0.5f)) + size;
+
+#ifdef PIPELINE_STATISTICS
+  const bool blended = (m_rasterState.blendMode != BLEND_REPLACE);
+  const bool heatmap = (m_heatmapMode != HEATMAP_OFF);
+#endif
+
+  // Single pixels with a sample each skip the spans, and choose their blend once for the batch
+  if (size == 1 && samples == 1)
+  {
+    switch (m_rasterState.blendMode)
+    {
+    case BLEND_ALPHA:
+      RasteriseSinglePixelPoints<BLEND_ALPHA>(points, count);
+      break;
+    case BLEND_ADDITIVE:
+      RasteriseSinglePixelPoints<BLEND_ADDITIVE>(points, count);
+      break;
+    default:
+      RasteriseSinglePixelPoints<BLEND_REPLACE>(points, count);
+    }
+    return;
+  }
+
+  const bool directWrite = !m_multisample && m_colourFormat == COLOUR_BGRA8 &&
+                           m_rasterState.blendMode == BLEND_REPLACE;
+  Colour *spanColours = &m_spanColours[0];
+  unsigned int *spanMask = &m_spanMask[0];
+
+  for (uint i = 0; i < count; ++i)
+  {
+    const ScreenPoint &p = points[i];
+    const int x0 = (int)(p.v.x + offset) - size;
+    const int y0 = (int)(p.v.y + offset) - size;
+
+    const int minX = max(x0, m_clipRect.minX);
+    const int minY = max(y0, m_clipRect.minY);
+    const int maxX = min(x0 + size, m_clipRect.maxX);
+    const int maxY = min(y0 + size, m_clipRect.maxY);
+    if (minX >= maxX || minY >= maxY)
+      continue;
+
+    const int width = maxX - minX;
+    const unsigned int depth = (unsigned int)p.v.z;
+    for (int x = 0; x < width; ++x)
+      spanColours[x] = p.c;
+
+    for (int y = minY; y < maxY; ++y)
+    {
+      unsigned short *depthRow = m_depthBuffer + (((y * screenWidth) + minX) * samples);
+      Colour *colourRow = m_buffers[m_currentDrawBuffer] + (y * screenWidth) + minX;
+      bool anyPassed = false;
+
+      for (int x = 0; x < width; ++x)
+      {
+        unsigned int coverage = 0;
+        if (samples == 1)
+        {
+          // Selected rather than branched on, as whether overlapping stars pass is unpredictable
+          const bool pass = (depthMode == DEPTH_DISABLED || depth <= depthRow[x]);
+          if (depthMode == DEPTH_TEST_WRITE)
+            depthRow[x] = pass ? (unsigned short)depth : depthRow[x];
+          if (directWrite)
+            colourRow[x] = pass ? p.c : colourRow[x];
+          coverage = pass ? ~0u : 0u;
+        }
+        else
+        {
+          for (uint s = 0; s < samples; ++s)
+          {
+            unsigned short &sampleDepth = depthRow[(x * samples) + s];
+            if (depthMode != DEPTH_DISABLED && depth > sampleDepth)
+              continue;
+
+            if (depthMode == DEPTH_TEST_WRITE)
+              sampleDepth = (unsigned short)depth;
+            coverage |= 1u << s;
+          }
+        }
+
+        spanMask[x] = coverage;
+        anyPassed |= (coverage != 0);
+
+#ifdef PIPELINE_STATISTICS
+        const int index = (y * screenWidth) + minX + x;
+        m_frameStats.pixelsTested++;
+        if (heatmap)
+          m_heatmap[0][index]++;
+        if (coverage != 0)
+        {
+          m_frameStats.pixelsPassed++;
+          if (blended)
+            m_frameStats.pixelsBlended++;
+          if (heatmap)
+          {
+            m_heatmap[1][index]++;
+            if (blended)
+              m_heatmap[2][index]++;
+          }
+        }
+#endif
+      }
+
+      if (anyPassed && !directWrite)
+        WriteSpan(minX, y, spanColours, spanMask, width);
+    }
+  }
+}
+
+template <DepthMode Depth>
+void SoftwareRasteriser::RasteriseLinePermutation(const Vector4 &v0, const Vector4 &v1,
+                                                  const Colour &colA, const Colour &colB,
+                                                  const Vector3 &texA, const Vector3 &texB)
+{
+  Vector4 v0p = v0;
+  Vector4 v1p = v1;
+
+  // Clipping can leave endpoints a fraction outside of the screen, clamping them here means the
+  // pixel loop only has to check the clip rectangle
+  int x0 = clamp((int)v0p.x, 0, (int)m_viewportWidth - 1);
+  int y0 = clamp((int)v0p.y, 0, (int)m_viewportHeight - 1);
+  int x1 = clamp((int)v1p.x, 0, (int)m_viewportWidth - 1);
+  int y1 = clamp((int)v1p.y, 0, (int)m_viewportHeight - 1);
+
+  const int range = max(abs(x1 - x0), abs(y1 - y0));
+  if (range == 0)
+    return;
+
+  const bool xMajor = abs(x1 - x0) >= abs(y1 - y0);
+
+  // X major lines are always walked left to right so that each row of pixels can be written as a
+  // span. The line still excludes its end point, which is now the first pixel walked.
+  Colour cA = colA;
+  Colour cB = colB;
+  Vector3 tA = texA;
+  Vector3 tB = texB;
+  int first = 0;
+  if (xMajor && x1 < x0)
+  {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+    std::swap(v0p, v1p);
+    std::swap(cA, cB);
+    std::swap(tA, tB);
+    first = 1;
+  }
+
+  const int dx = abs(x1 - x0);
+  const int dy = abs(y1 - y0);
+  const int xStep = (x1 < x0) ? -1 : 1;
+  const int yStep = (y1 < y0) ? -1 : 1;
+
+  // Depth and colour are stepped incrementally in fixed point
+  const float depthScale = (float)(1 << LINE_DEPTH_FRAC_BITS);
+  const float z0 = clamp(v0p.z, 0.0f, 65535.0f);
+  const float z1 = clamp(v1p.z, 0.0f, 65535.0f);
+  int z = (int)(z0 * depthScale);
+  const int zStep = (int)((z1 - z0) * depthScale) / range;
+
+  const int colourScale = 1 << LINE_COLOUR_FRAC_BITS;
+  int r = cA.r * colourScale;
+  int g = cA.g * colourScale;
+  int b = cA.b * colourScale;
+  int a = cA.a * colourScale;
+  const int rStep = ((cB.r - cA.r) * colourScale) / range;
+  const int gStep = ((cB.g - cA.g) * colourScale) / range;
+  const int bStep = ((cB.b - cA.b) * colourScale) / range;
+  const int aStep = ((cB.a - cA.a) * colourScale) / range;
+
+  Vector3 tex = tA;
+  const Vector3 texStep = (tB - tA) / (float)range;
+
+  // Integer Bresenham error term, in units of twice the minor axis delta
+  const int majorDelta = xMajor ? dx : dy;
+  const int minorDelta = xMajor ? dy : dx;
+  int error = 2 * minorDelta - majorDelta;
+
+  int x = x0;
+  int y = y0;
+
+  Colour span[MAX_LINE_SPAN];
+  unsigned int mask[MAX_LINE_SPAN];
+  int spanStart = x;
+  int spanLength = 0;
+
+  for (int i = 0; i < range + first; ++i)
+  {
+    if (i >= first && !InsideClipRect(x, y))
+    {
+      // Pixels outside of the clip rectangle end the current span
+      if (spanLength > 0)
+      {
+        WriteSpan(spanStart, y, span, mask, spanLength);
+        spanLength = 0;
+      }
     }
-  }
+    else if (i >= first)
+    {
+      const int index = (y * screenWidth) + x;
+      const unsigned short depth = (unsigned short)(z >> LINE_DEPTH_FRAC_BITS);
 
-  return true;
-}
+      Colour c;
+      if (m_currentTexture == NULL)
+      {
+        c.Set(r >> LINE_COLOUR_FRAC_BITS, g >> LINE_COLOUR_FRAC_BITS, b >> LINE_COLOUR_FRAC_BITS,
+              a >> LINE_COLOUR_FRAC_BITS);
+      }
+      else
+      {
+        c = m_currentTexture->NearestTexSample(Vector3(tex.x / tex.z, tex.y / tex.z, 1.0f));
+      }
 
-void SoftwareRasteriser::SutherlandHodgmanTri(Vector4 &v0, Vector4 &v1, Vector4 &v2,
-                                              const Colour &c0, const Colour &c1, const Colour &c2,
-                                              const Vector2 &t0, const Vector2 &t1,
-                                              const Vector2 &t2)
-{
-  Vector4 posIn[MAX_VERTS];
-  Colour colIn[MAX_VERTS];
-  Vector3 texIn[MAX_VERTS];
+      // When multisampling each sample is tested, with coverage held as a bit per sample
+      unsigned int coverage = 0;
+      if (Depth == DEPTH_DISABLED)
+      {
+        coverage = ~0u;
+      }
+      else if (m_multisample)
+      {
+        unsigned short *sampleDepth = m_depthBuffer + (index * MSAA_SAMPLES);
+        for (int s = 0; s < MSAA_SAMPLES; ++s)
+        {
+          if (depth <= sampleDepth[s])
+          {
+            if (Depth == DEPTH_TEST_WRITE)
+              sampleDepth[s] = depth;
+            coverage |= 1u << s;
+          }
+        }
+      }
+      else if (depth <= m_depthBuffer[index])
+      {
+        if (Depth == DEPTH_TEST_WRITE)
+          m_depthBuffer[index] = depth;
+        coverage = ~0u;
+      }
 
-  Vector4 posOut[MAX_VERTS];
-  Colour colOut[MAX_VERTS];
-  Vector3 texOut[MAX_VERTS];
-  posIn[0] = v0;
-  posIn[1] = v1;
-  posIn[2] = v2;
+      const bool pass = (coverage != 0);
 
-  colIn[0] = c0;
-  colIn[1] = c1;
-  colIn[2] = c2;
+#ifdef PIPELINE_STATISTICS
+      m_frameStats.pixelsTested++;
+      if (pass)
+      {
+        m_frameStats.pixelsPassed++;
+        if (m_rasterState.blendMode != BLEND_REPLACE)
+          m_frameStats.pixelsBlended++;
+      }
+      if (m_currentTexture != NULL)
+        m_frameStats.texelsFetched[SAMPLE_NEAREST]++;
 
-  texIn[0] = Vector3(t0.x, t0.y, 1);
-  texIn[1] = Vector3(t1.x, t1.y, 1);
-  texIn[2] = Vector3(t2.x, t2.y, 1);
+      // Lines are shaded before the depth test
+      if (m_heatmapMode != HEATMAP_OFF)
+      {
+        m_heatmap[0][index]++;
+        m_heatmap[1][index]++;
+        if (pass && m_rasterState.blendMode != BLEND_REPLACE)
+          m_heatmap[2][index]++;
+      }
+#endif
 
-  int inSize = 3;
+      if (xMajor)
+      {
+        if (spanLength == 0)
+          spanStart = x;
 
-  for (int i = 0; i <= 6; i++)
-  {
-    int planeCode = 1 << i;
-    Vector4 prevPos = posIn[inSize - 1];
-    Colour prevCol = colIn[inSize - 1];
-    Vector3 prevTex = texIn[inSize - 1];
+        span[spanLength] = c;
+        mask[spanLength] = coverage;
+        spanLength++;
+      }
+      else if (pass)
+      {
+        WriteSpan(x, y, &c, &coverage, 1);
+      }
+    }
 
-    int outSize = 0;
+    z += zStep;
+    r += rStep;
+    g += gStep;
+    b += bStep;
+    a += aStep;
+    tex += texStep;
 
-    for (int j = 0; j < inSize; ++j)
+    if (error > 0)
     {
-      int outsideA = HomogeneousOutcode(posIn[j]) & planeCode;
-      int outsideB = HomogeneousOutcode(prevPos) & planeCode;
-
-      if (outsideA ^ outsideB)
+      // Moving to a new row ends the current span
+      if (xMajor && spanLength > 0)
       {
-        float clipRatio = ClipEdge(posIn[j], prevPos, planeCode);
-
-        colOut[outSize] = Colour::Lerp(colIn[j], prevCol, clipRatio);
-        texOut[outSize] = Vector3::Lerp(texIn[j], prevTex, clipRatio);
-        posOut[outSize] = Vector4::Lerp(posIn[j], prevPos, clipRatio);
-        outSize++;
+        WriteSpan(spanStart, y, span, mask, spanLength);
+        spanLength = 0;
       }
 
-      if (!outsideA)
-      {
-        posOut[outSize] = posIn[j];
-        colOut[outSize] = colIn[j];
-        texOut[outSize] = texIn[j];
-        outSize++;
-      }
+      if (xMajor)
+        y += yStep;
+      else
+        x += xStep;
 
-      prevPos = posIn[j];
-      prevCol = colIn[j];
-      prevTex = texIn[j];
+      error -= 2 * majorDelta;
     }
+    error += 2 * minorDelta;
+
+    if (xMajor)
+      x += xStep;
+    else
+      y += yStep;
 
-    for (int j = 0; j < outSize; ++j)
+    if (spanLength == MAX_LINE_SPAN)
     {
-      posIn[j] = posOut[j];
-      colIn[j] = colOut[j];
-      texIn[j] = texOut[j];
+      WriteSpan(spanStart, y, span, mask, spanLength);
+      spanLength = 0;
     }
-
-    inSize = outSize;
-  }
-
-  for (int i = 0; i < inSize; ++i)
-  {
-    texIn[i] = Vector3(texIn[i].x, texIn[i].y, 1.0f) / posIn[i].w;
-    posIn[i].SelfDivisionByW();
   }
 
-  for (int i = 2; i < inSize; ++i)
-  {
-    RasteriseTri(posIn[0], posIn[i - 1], posIn[i], colIn[0], colIn[i - 1], colIn[i], texIn[0],
-                 texIn[i - 1], texIn[i]);
-  }
+  if (spanLength > 0)
+    WriteSpan(spanStart, y, span, mask, spanLength);
 }
 
-float SoftwareRasteriser::ClipEdge(const Vector4 &inA, const Vector4 &inB, int axis)
+const SoftwareRasteriser::RasteriseLineFunc SoftwareRasteriser::s_rasteriseLinePermutations[3] = {
+    &SoftwareRasteriser::RasteriseLinePermutation<DEPTH_TEST_WRITE>,
+    &SoftwareRasteriser::RasteriseLinePermutation<DEPTH_TEST>,
+    &SoftwareRasteriser::RasteriseLinePermutation<DEPTH_DISABLED>};
+
+/**
+ * Blends a span of pixels into the buffer for the current colour format, which is the colour
+ * buffer itself for BGRA8. Only used when not multisampling.
+ *
+ * \param x First pixel of the span
+ * \param y Row of the span
+ * \param colours Colour of each pixel
+ * \param mask Coverage of each pixel, 0 to leave the pixel untouched
+ * \param count Number of pixels
+ */
+template <BlendMode Blend>
+void SoftwareRasteriser::BlendColourSpan(uint x, uint y, const Colour *colours,
+                                         const unsigned int *mask, int count)
 {
-  float ratio = 0.0f;
+  const uint index = (y * screenWidth) + x;
 
-  switch (axis)
+  switch (m_colourFormat)
   {
-  case LEFT_CS:
-    ratio = (-inA.w - inA.x) / ((inB.x - inA.x) + inB.w - inA.w);
-    break;
-  case RIGHT_CS:
-    ratio = (inA.w - inA.x) / ((inB.x - inA.x) + inB.w - inA.w);
-    break;
-  case BOTTOM_CS:
-    ratio = (-inA.w - inA.y) / ((inB.y - inA.y) + inB.w - inA.w);
-    break;
-  case TOP_CS:
-    ratio = (inA.w - inA.y) / ((inB.y - inA.y) + inB.w - inA.w);
-    break;
-  case NEAR_CS:
-    ratio = (-inA.w - inA.z) / ((inB.z - inA.z) + inB.w - inA.w);
+  case COLOUR_RGB565:
+    BlendSpan<Blend>(&m_bufferRGB565[index], colours, mask, count);
     break;
-  case FAR_CS:
-    ratio = (inA.w - inA.z) / ((inB.z - inA.z) + inB.w - inA.w);
+  case COLOUR_R11G11B10:
+    BlendSpan<Blend>(&m_bufferR11G11B10[index], colours, mask, count);
     break;
+  default:
+    BlendSpan<Blend>(m_buffers[m_currentDrawBuffer] + index, colours, mask, count);
   }
-
-  return min(1.0f, ratio);
-}
-
-int SoftwareRasteriser::HomogeneousOutcode(const Vector4 &in)
-{
-  int outCode = INSIDE_CS;
-
-  if (in.x < -in.w)
-    outCode |= LEFT_CS;
-  else if (in.x > in.w)
-    outCode |= RIGHT_CS;
-
-  if (in.y < -in.w)
-    outCode |= BOTTOM_CS;
-  else if (in.y > in.w)
-    outCode |= TOP_CS;
-
-  if (in.z < -in.w)
-    outCode |= NEAR_CS;
-  else if (in.z > in.w)
-    outCode |= FAR_CS;
-
-  return outCode;
 }
 
-void SoftwareRasteriser::RasteriseLine(const Vector4 &v0, const Vector4 &v1, const Colour &colA,
-                                       const Colour &colB, const Vector3 &texA, const Vector3 &texB)
+/**
+ * Blends a run of pixels on a row into the colour buffer.
+ *
+ * When multisampling, bit n of each mask entry is the coverage of sample n (so ~0u still covers
+ * the whole pixel) and the pixel's colour is blended into each covered sample.
+ *
+ * \param x First pixel of the span
+ * \param y Row of the span
+ * \param colours Colour of each pixel
+ * \param mask Coverage of each pixel, 0 to leave the pixel untouched
+ * \param count Number of pixels
+ */
+void SoftwareRasteriser::WriteSpan(uint x, uint y, const Colour *colours, const unsigned int *mask,
+                                   int count)
 {
-  Vector4 v0p = m_portMatrix * v0;
-  Vector4 v1p = m_portMatrix * v1;
-  Vector4 dir = v1p - v0p;
-
-  int xDir = (dir.x < 0.0f) ? -1 : 1;
-  int yDir = (dir.y < 0.0f) ? -1 : 1;
-
-  int x = (int)v0p.x;
-  int y = (int)v0p.y;
-
-  int *target = NULL;
-  int *scan = NULL;
-  int targetVal = 0;
-  int scanVal = 0;
-
-  float slope = 0.0f;
-  int range = 0;
-
-  if (abs(dir.y) > abs(dir.x))
-  {
-    slope = dir.x / dir.y;
-    range = (int)abs(dir.y);
-
-    target = &x;
-    scan = &y;
-    targetVal = xDir;
-    scanVal = yDir;
-  }
-  else
+  if (!m_multisample)
   {
-    slope = dir.y / dir.x;
-    range = (int)abs(dir.x);
-
-    target = &y;
-    scan = &x;
-    targetVal = yDir;
-    scanVal = xDir;
+    switch (m_rasterState.blendMode)
+    {
+    case BLEND_ALPHA:
+      BlendColourSpan<BLEND_ALPHA>(x, y, colours, mask, count);
+      break;
+    case BLEND_ADDITIVE:
+      BlendColourSpan<BLEND_ADDITIVE>(x, y, colours, mask, count);
+      break;
+    default:
+      BlendColourSpan<BLEND_REPLACE>(x, y, colours, mask, count);
+    }
+    return;
   }
 
-  const float absSlope = abs(slope);
-  float error = 0.0f;
+  Colour *dest = &m_sampleBuffer[((y * screenWidth) + x) * MSAA_SAMPLES];
 
-  const float reciprocalRange = 1.0f / range;
+  Colour sampleColours[MAX_LINE_SPAN * MSAA_SAMPLES];
+  unsigned int sampleMask[MAX_LINE_SPAN * MSAA_SAMPLES];
 
-  for (int i = 0; i < range; i++)
+  for (int first = 0; first < count; first += MAX_LINE_SPAN)
   {
-    const float t = i * reciprocalRange;
-    const float zVal = v1p.z * (i * reciprocalRange) + v0p.z * (1.0 - (i * reciprocalRange));
+    const int length = min(count - first, MAX_LINE_SPAN);
 
-    Colour c;
-    if (m_currentTexture == NULL)
+    for (int i = 0; i < length; ++i)
     {
-      c = colB * t + colA * (1.0f - t);
-    }
-    else
-    {
-      Vector3 subTex = texA * (i * reciprocalRange) + texB * (1.0f - (i * reciprocalRange));
-      subTex.x /= subTex.z;
-      subTex.y /= subTex.z;
-      c = m_currentTexture->ColourAtPoint((int)subTex.x, (int)subTex.y);
+      for (int s = 0; s < MSAA_SAMPLES; ++s)
+      {
+        sampleColours[(i * MSAA_SAMPLES) + s] = colours[first + i];
+        sampleMask[(i * MSAA_SAMPLES) + s] = ((mask[first + i] >> s) & 1) ? ~0u : 0u;
+      }
     }
 
-    if (DepthFunc((int)x, (int)y, zVal))
-      BlendPixel(x, y, c);
-
-    error += absSlope;
-
-    if (error > 0.5f)
-    {
-      error -= 1.0f;
-      (*target) += targetVal;
-    }
-    (*scan) += scanVal;
+    BlendSpan(m_rasterState.blendMode, dest + (first * MSAA_SAMPLES), sampleColours, sampleMask,
+              length * MSAA_SAMPLES);
   }
 }
 
-void SoftwareRasteriser::RasteriseTri(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
-                                      const Colour &c0, const Colour &c1, const Colour &c2,
-                                      const Vector3 &t0, const Vector3 &t1, const Vector3 &t2)
+template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+void SoftwareRasteriser::RasteriseTriPermutation(const Vector4 &v0, const Vector4 &v1,
+                                                 const Vector4 &v2, const Colour &c0,
+                                                 const Colour &c1, const Colour &c2,
+                                                 const Vector3 &t0, const Vector3 &t1,
+                                                 const Vector3 &t2)
 {
-  Vector4 v0p = m_portMatrix * v0;
-  Vector4 v1p = m_portMatrix * v1;
-  Vector4 v2p = m_portMatrix * v2;
+  const Vector4 &v0p = v0;
+  const Vector4 &v1p = v1;
+  const Vector4 &v2p = v2;
 
   const BoundingBox b = CalculateBoxForTri(v0p, v1p, v2p);
   const float triArea = abs(ScreenAreaOfTri(v0p, v1p, v2p));
@@ -453,10 +2976,24 @@ void SoftwareRasteriser::RasteriseTri(const Vector4 &v0, const Vector4 &v1, cons
   float subTriArea[3];
   Vector4 screenPos(0, 0, 0, 1);
 
+  Colour *spanColours = &m_spanColours[0];
+  unsigned int *spanMask = &m_spanMask[0];
+
+  PIPELINE_STAT(uint pixelsTested = 0);
+  PIPELINE_STAT(uint pixelsPassed = 0);
+  PIPELINE_STAT(const bool heatmap = (m_heatmapMode != HEATMAP_OFF));
+
   for (float y = b.topLeft.y; y < b.bottomRight.y; ++y)
   {
+    // Covered pixels on this row are collected into a span and blended in one go
+    int spanStart = -1;
+    int spanEnd = -1;
+
     for (float x = b.topLeft.x; x < b.bottomRight.x; ++x)
     {
+      const int px = (int)x;
+      spanMask[px] = 0;
+
       screenPos.x = x;
       screenPos.y = y;
 
@@ -479,21 +3016,47 @@ void SoftwareRasteriser::RasteriseTri(const Vector4 &v0, const Vector4 &v1, cons
       const float gamma = subTriArea[0] * areaRecip;
 
       float zVal = (v0p.z * alpha) + (v1p.z * beta) + (v2p.z * gamma);
+      PIPELINE_STAT(pixelsTested++);
+      PIPELINE_STAT(if (heatmap) m_heatmap[0][((int)y * screenWidth) + px]++);
 
-      if (!DepthFunc((int)x, (int)y, zVal))
-        continue;
+      if (Depth != DEPTH_DISABLED)
+      {
+        const int index = ((int)y * screenWidth) + px;
+        const unsigned int castVal = (unsigned int)zVal;
+        if (castVal > m_depthBuffer[index])
+          continue;
+
+        if (Depth == DEPTH_TEST_WRITE)
+          m_depthBuffer[index] = castVal;
+      }
+
+      if (spanStart < 0)
+        spanStart = px;
+      spanEnd = px;
+      spanMask[px] = ~0u;
+
+#ifdef PIPELINE_STATISTICS
+      pixelsPassed++;
+      if (heatmap)
+      {
+        const int index = ((int)y * screenWidth) + px;
+        m_heatmap[1][index]++;
+        if (Blend != BLEND_REPLACE)
+          m_heatmap[2][index]++;
+      }
+#endif
 
       // Pixel is in triangle, so shade it
-      if (m_currentTexture)
+      if (Textured)
       {
         Vector3 subTex = (t0 * alpha) + (t1 * beta) + (t2 * gamma);
         subTex.x /= subTex.z;
         subTex.y /= subTex.z;
 
-        switch (m_texSampleState)
+        switch (SampleMode)
         {
         case SAMPLE_BILINEAR:
-          BlendPixel((int)x, (int)y, m_currentTexture->BilinearTexSample(subTex));
+          spanColours[px] = m_currentTexture->BilinearTexSample(subTex);
           break;
         case SAMPLE_MIPMAP_NEAREST:
         {
@@ -502,143 +3065,693 @@ void SoftwareRasteriser::RasteriseTri(const Vector4 &v0, const Vector4 &v1, cons
           CalculateWeights(v0p, v1p, v2p, screenPos + Vector4(1, 0, 0, 0), xAlpha, xBeta, xGamma);
           CalculateWeights(v0p, v1p, v2p, screenPos + Vector4(0, 1, 0, 0), yAlpha, yBeta, yGamma);
 
-          Vector3 xDerivs = (t0 * xAlpha) + (t1 * xBeta) + (t2 * xGamma);
-          Vector3 yDerivs = (t0 * yAlpha) + (t1 * yBeta) + (t2 * yGamma);
-
-          xDerivs.x /= xDerivs.z;
-          xDerivs.y /= xDerivs.z;
-
-          yDerivs.x /= yDerivs.z;
-          yDerivs.y /= yDerivs.z;
+          const Vector3 xDerivs = (t0 * xAlpha) + (t1 * xBeta) + (t2 * xGamma);
+          const Vector3 yDerivs = (t0 * yAlpha) + (t1 * yBeta) + (t2 * yGamma);
 
-          xDerivs = xDerivs - subTex;
-          yDerivs = yDerivs - subTex;
-
-          const float maxU = max(abs(xDerivs.x), abs(yDerivs.y));
-          const float maxV = max(abs(xDerivs.y), abs(yDerivs.y));
-          const float maxChange = abs(max(maxU, maxV));
-          const int lambda = (int)(abs(log(maxChange) / log(2.0)));
-
-          BlendPixel((int)x, (int)y, m_currentTexture->NearestTexSample(subTex, lambda));
+          spanColours[px] =
+              m_currentTexture->NearestTexSample(subTex, MipmapLevel(subTex, xDerivs, yDerivs));
           break;
         }
         default:
-          BlendPixel((int)x, (int)y, m_currentTexture->NearestTexSample(subTex));
+          spanColours[px] = m_currentTexture->NearestTexSample(subTex);
         }
       }
       else
       {
-        Colour c = ((c0 * alpha) + (c1 * beta) + (c2 * gamma));
-        BlendPixel((int)x, (int)y, c);
+        spanColours[px] = ((c0 * alpha) + (c1 * beta) + (c2 * gamma));
       }
     }
+
+    if (spanStart >= 0)
+      BlendColourSpan<Blend>(spanStart, (uint)y, spanColours + spanStart, spanMask + spanStart,
+                             (spanEnd - spanStart) + 1);
+  }
+
+#ifdef PIPELINE_STATISTICS
+  m_frameStats.pixelsTested += pixelsTested;
+  m_frameStats.pixelsPassed += pixelsPassed;
+  if (Blend != BLEND_REPLACE)
+    m_frameStats.pixelsBlended += pixelsPassed;
+  if (Textured)
+  {
+    // Bilinear filtering reads four texels per sample
+    m_frameStats.texelsFetched[SampleMode] +=
+        pixelsPassed * (SampleMode == SAMPLE_BILINEAR ? 4 : 1);
   }
+#endif
 }
 
-void SoftwareRasteriser::RasteriseTriSpans(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
-                                           const Colour &c0, const Colour &c1, const Colour &c2,
-                                           const Vector3 &t0, const Vector3 &t1, const Vector3 &t2)
+/**
+ * Mipmap level to sample for a pixel, from how far the texture coordinates move one pixel to the
+ * right and one pixel down.
+ *
+ * \param subTex Perspective divided texture coordinates of the pixel
+ * \param xDerivs Texture coordinates one pixel to the right, before the perspective divide
+ * \param yDerivs Texture coordinates one pixel down, before the perspective divide
+ */
+int SoftwareRasteriser::MipmapLevel(const Vector3 &subTex, Vector3 xDerivs, Vector3 yDerivs)
 {
-  Vector4 v0p = m_portMatrix * v0;
-  Vector4 v1p = m_portMatrix * v1;
-  Vector4 v2p = m_portMatrix * v2;
+  xDerivs.x /= xDerivs.z;
+  xDerivs.y /= xDerivs.z;
+
+  yDerivs.x /= yDerivs.z;
+  yDerivs.y /= yDerivs.z;
 
-  float edge0y = abs(v0p.y - v1p.y);
-  float edge1y = abs(v1p.y - v2p.y);
-  float edge2y = abs(v2p.y - v0p.y);
+  xDerivs = xDerivs - subTex;
+  yDerivs = yDerivs - subTex;
 
-  // Edhe 0 is longest
-  if (edge0y >= edge1y && edge0y >= edge2y)
+  const float maxU = max(abs(xDerivs.x), abs(yDerivs.x));
+  const float maxV = max(abs(xDerivs.y), abs(yDerivs.y));
+  const float maxChange = abs(max(maxU, maxV));
+  return (int)(abs(log(maxChange) / log(2.0)));
+}
+
+/**
+ * Multisampled version of RasteriseTriPermutation.
+ *
+ * Each edge is a linear function of screen position, giving the barycentric weights of a point
+ * scaled by the triangle's area. They are evaluated at every sample for coverage and depth, and
+ * shading is done once per pixel, at the pixel centre if it is inside the triangle or otherwise at
+ * the first covered sample so colours are never extrapolated.
+ */
+template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+void SoftwareRasteriser::RasteriseTriMultisample(const Vector4 &v0, const Vector4 &v1,
+                                                 const Vector4 &v2, const Colour &c0,
+                                                 const Colour &c1, const Colour &c2,
+                                                 const Vector3 &t0, const Vector3 &t1,
+                                                 const Vector3 &t2)
+{
+  const float area = ((v1.x - v0.x) * (v2.y - v0.y)) - ((v1.y - v0.y) * (v2.x - v0.x));
+  if (area == 0.0f)
+    return;
+
+  // Weight of vertex i at (x, y) is ((edgeX[i] * x) + (edgeY[i] * y) + edgeC[i]) * weightScale,
+  // from the edge opposite it
+  const Vector4 *v[3] = {&v0, &v1, &v2};
+  const float sign = (area > 0.0f) ? 1.0f : -1.0f;
+  const float weightScale = 1.0f / fabs(area);
+  float edgeX[3];
+  float edgeY[3];
+  float edgeC[3];
+  bool topLeft[3];
+  float sampleOffset[3][MSAA_SAMPLES];
+
+  for (int i = 0; i < 3; ++i)
   {
-    RasteriseTriEdgeSpans(v0p, v1p, v2p, v0p);
-    RasteriseTriEdgeSpans(v0p, v1p, v1p, v2p);
+    topLeft[i] =
+        SetupEdgeFunction(*v[(i + 1) % 3], *v[(i + 2) % 3], sign, edgeX[i], edgeY[i], edgeC[i]);
+
+    for (int s = 0; s < MSAA_SAMPLES; ++s)
+    {
+      sampleOffset[i][s] =
+          (edgeX[i] * MSAA_SAMPLE_OFFSETS[s][0]) + (edgeY[i] * MSAA_SAMPLE_OFFSETS[s][1]);
+    }
   }
-  // Edge 1 is longest
-  else if (edge1y >= edge0y && edge1y >= edge2y)
+
+  // Depths are scaled in place of the weights they are multiplied by
+  const float z[3] = {v0.z * weightScale, v1.z * weightScale, v2.z * weightScale};
+
+  // Any pixel with a sample inside the triangle
+  const BoundingBox b = CalculateBoxForTri(v0, v1, v2);
+  const int xStart = max((int)floor(b.topLeft.x - 0.5f), m_clipRect.minX);
+  const int yStart = max((int)floor(b.topLeft.y - 0.5f), m_clipRect.minY);
+  const int xEnd = min((int)ceil(b.bottomRight.x + 0.5f), m_clipRect.maxX);
+  const int yEnd = min((int)ceil(b.bottomRight.y + 0.5f), m_clipRect.maxY);
+
+  Colour *spanColours = &m_spanColours[0];
+  unsigned int *spanMask = &m_spanMask[0];
+
+  PIPELINE_STAT(uint pixelsTested = 0);
+  PIPELINE_STAT(uint pixelsPassed = 0);
+  PIPELINE_STAT(const bool heatmap = (m_heatmapMode != HEATMAP_OFF));
+
+  for (int y = yStart; y < yEnd; ++y)
   {
-    RasteriseTriEdgeSpans(v1p, v2p, v2p, v0p);
-    RasteriseTriEdgeSpans(v1p, v2p, v0p, v1p);
+    int spanStart = -1;
+    int spanEnd = -1;
+
+    for (int x = xStart; x < xEnd; ++x)
+    {
+      unsigned int *pixelMask = spanMask + (x * MSAA_SAMPLES);
+      for (int s = 0; s < MSAA_SAMPLES; ++s)
+        pixelMask[s] = 0;
+
+      float centre[3];
+      for (int i = 0; i < 3; ++i)
+        centre[i] = (edgeX[i] * x) + (edgeY[i] * y) + edgeC[i];
+
+      float weights[MSAA_SAMPLES][3];
+      unsigned int coverage = 0;
+      for (int s = 0; s < MSAA_SAMPLES; ++s)
+      {
+        weights[s][0] = centre[0] + sampleOffset[0][s];
+        weights[s][1] = centre[1] + sampleOffset[1][s];
+        weights[s][2] = centre[2] + sampleOffset[2][s];
+
+        if (EdgesCover(weights[s], topLeft))
+          coverage |= 1u << s;
+      }
+
+      if (coverage == 0)
+        continue;
+
+      const int index = (y * screenWidth) + x;
+      PIPELINE_STAT(pixelsTested++);
+      PIPELINE_STAT(if (heatmap) m_heatmap[0][index]++);
+
+      int firstCovered = -1;
+      for (int s = 0; s < MSAA_SAMPLES; ++s)
+      {
+        if (!(coverage & (1u << s)))
+          continue;
+
+        if (Depth != DEPTH_DISABLED)
+        {
+          const float zVal =
+              (z[0] * weights[s][0]) + (z[1] * weights[s][1]) + (z[2] * weights[s][2]);
+          unsigned short &sampleDepth = m_depthBuffer[(index * MSAA_SAMPLES) + s];
+          const unsigned int castVal = (unsigned int)zVal;
+          if (castVal > sampleDepth)
+            continue;
+
+          if (Depth == DEPTH_TEST_WRITE)
+            sampleDepth = (unsigned short)castVal;
+        }
+
+        pixelMask[s] = ~0u;
+        if (firstCovered < 0)
+          firstCovered = s;
+      }
+
+      if (firstCovered < 0)
+        continue;
+
+      if (spanStart < 0)
+        spanStart = x;
+      spanEnd = x;
+
+#ifdef PIPELINE_STATISTICS
+      pixelsPassed++;
+      if (heatmap)
+      {
+        m_heatmap[1][index]++;
+        if (Blend != BLEND_REPLACE)
+          m_heatmap[2][index]++;
+      }
+#endif
+
+      const bool centreInside = EdgesCover(centre, topLeft);
+      const float *e = centreInside ? centre : weights[firstCovered];
+      const float w[3] = {e[0] * weightScale, e[1] * weightScale, e[2] * weightScale};
+
+      Colour shaded;
+      if (Textured)
+      {
+        Vector3 subTex = (t0 * w[0]) + (t1 * w[1]) + (t2 * w[2]);
+        subTex.x /= subTex.z;
+        subTex.y /= subTex.z;
+
+        switch (SampleMode)
+        {
+        case SAMPLE_BILINEAR:
+          shaded = m_currentTexture->BilinearTexSample(subTex);
+          break;
+        case SAMPLE_MIPMAP_NEAREST:
+        {
+          // Weights are linear, so one pixel across or down just adds the edge gradients
+          const Vector3 xDerivs = (t0 * (w[0] + (edgeX[0] * weightScale))) +
+                                  (t1 * (w[1] + (edgeX[1] * weightScale))) +
+                                  (t2 * (w[2] + (edgeX[2] * weightScale)));
+          const Vector3 yDerivs = (t0 * (w[0] + (edgeY[0] * weightScale))) +
+                                  (t1 * (w[1] + (edgeY[1] * weightScale))) +
+                                  (t2 * (w[2] + (edgeY[2] * weightScale)));
+
+          shaded =
+              m_currentTexture->NearestTexSample(subTex, MipmapLevel(subTex, xDerivs, yDerivs));
+          break;
+        }
+        default:
+          shaded = m_currentTexture->NearestTexSample(subTex);
+        }
+      }
+      else
+      {
+        shaded = ((c0 * w[0]) + (c1 * w[1]) + (c2 * w[2]));
+      }
+
+      Colour *pixelColours = spanColours + (x * MSAA_SAMPLES);
+      for (int s = 0; s < MSAA_SAMPLES; ++s)
+        pixelColours[s] = shaded;
+    }
+
+    if (spanStart >= 0)
+    {
+      BlendSpan<Blend>(&m_sampleBuffer[((y * screenWidth) + spanStart) * MSAA_SAMPLES],
+                       spanColours + (spanStart * MSAA_SAMPLES),
+                       spanMask + (spanStart * MSAA_SAMPLES),
+                       ((spanEnd - spanStart) + 1) * MSAA_SAMPLES);
+    }
   }
-  // Edge 2 is longest
-  else
+
+#ifdef PIPELINE_STATISTICS
+  m_frameStats.pixelsTested += pixelsTested;
+  m_frameStats.pixelsPassed += pixelsPassed;
+  if (Blend != BLEND_REPLACE)
+    m_frameStats.pixelsBlended += pixelsPassed;
+  if (Textured)
   {
-    RasteriseTriEdgeSpans(v2p, v0p, v0p, v1p);
-    RasteriseTriEdgeSpans(v2p, v0p, v1p, v2p);
+    m_frameStats.texelsFetched[SampleMode] +=
+        pixelsPassed * (SampleMode == SAMPLE_BILINEAR ? 4 : 1);
   }
+#endif
 }
 
-void SoftwareRasteriser::RasteriseTriEdgeSpans(const Vector4 &v0, const Vector4 &v1,
-                                               const Vector4 &v2, const Vector4 &v3)
+/**
+ * Scanline version of RasteriseTriPermutation.
+ *
+ * Every attribute is linear in screen space (texture coordinates having been divided by w), so
+ * their gradients are calculated once per triangle. The triangle is then split at its middle
+ * vertex and each half filled by RasteriseTriEdgeSpans.
+ */
+template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+void SoftwareRasteriser::RasteriseTriSpans(const Vector4 &v0, const Vector4 &v1,
+                                           const Vector4 &v2, const Colour &c0, const Colour &c1,
+                                           const Colour &c2, const Vector3 &t0, const Vector3 &t1,
+                                           const Vector3 &t2)
 {
-  Vector4 longEdge0 = v0;
-  Vector4 longEdge1 = v1;
-  Vector4 shortEdge0 = v2;
-  Vector4 shortEdge1 = v3;
+  const float e1x = v1.x - v0.x;
+  const float e1y = v1.y - v0.y;
+  const float e2x = v2.x - v0.x;
+  const float e2y = v2.y - v0.y;
+
+  const float area = (e1x * e2y) - (e2x * e1y);
+  if (area == 0.0f)
+    return;
+
+  const float areaRecip = 1.0f / area;
 
-  if (longEdge1.y < longEdge0.y)
+  const Vector4 *v[3] = {&v0, &v1, &v2};
+  const Colour *c[3] = {&c0, &c1, &c2};
+  const Vector3 *t[3] = {&t0, &t1, &t2};
+
+  const int numAttributes = Textured ? 4 : 5;
+  float attributes[3][MAX_SPAN_ATTRIBUTES];
+  for (int i = 0; i < 3; ++i)
   {
-    longEdge0 = v1;
-    longEdge1 = v0;
+    attributes[i][0] = v[i]->z;
+    if (Textured)
+    {
+      attributes[i][1] = t[i]->x;
+      attributes[i][2] = t[i]->y;
+      attributes[i][3] = t[i]->z;
+    }
+    else
+    {
+      attributes[i][1] = c[i]->r;
+      attributes[i][2] = c[i]->g;
+      attributes[i][3] = c[i]->b;
+      attributes[i][4] = c[i]->a;
+    }
   }
-  if (shortEdge1.y < shortEdge0.y)
+
+  SpanGradients g;
+  for (int i = 0; i < numAttributes; ++i)
   {
-    shortEdge0 = v3;
-    shortEdge1 = v2;
+    const float d1 = attributes[1][i] - attributes[0][i];
+    const float d2 = attributes[2][i] - attributes[0][i];
+    g.dx[i] = ((d1 * e2y) - (d2 * e1y)) * areaRecip;
+    g.dy[i] = ((d2 * e1x) - (d1 * e2x)) * areaRecip;
+    g.base[i] = attributes[0][i] - (g.dx[i] * v0.x) - (g.dy[i] * v0.y);
   }
 
-  Vector4 longDiff = longEdge1 - longEdge0;
-  Vector4 shortDiff = shortEdge1 - shortEdge0;
+  // Sort the vertices top to bottom, the edge from top to bottom is then one side of every span
+  const Vector4 *top = &v0;
+  const Vector4 *middle = &v1;
+  const Vector4 *bottom = &v2;
+  if (middle->y < top->y)
+    std::swap(top, middle);
+  if (bottom->y < middle->y)
+    std::swap(middle, bottom);
+  if (middle->y < top->y)
+    std::swap(top, middle);
+
+  RasteriseTriEdgeSpans<Textured, SampleMode, Blend, Depth>(g, *top, *bottom, *top, *middle);
+  RasteriseTriEdgeSpans<Textured, SampleMode, Blend, Depth>(g, *top, *bottom, *middle, *bottom);
+}
+
+/**
+ * Fills the spans between the long edge of a triangle and one of its short edges, for each row
+ * of pixel centres the short edge covers. Edge positions and attributes are stepped
+ * incrementally, down rows and across each span.
+ *
+ * \param g Attribute gradients of the triangle
+ * \param longTop Top of the edge that spans the full height of the triangle
+ * \param longBottom Bottom of the long edge
+ * \param shortTop Top of the short edge
+ * \param shortBottom Bottom of the short edge
+ */
+template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+void SoftwareRasteriser::RasteriseTriEdgeSpans(const SpanGradients &g, const Vector4 &longTop,
+                                               const Vector4 &longBottom,
+                                               const Vector4 &shortTop,
+                                               const Vector4 &shortBottom)
+{
+  const int yStart = max((int)ceil(shortTop.y), m_clipRect.minY);
+  const int yEnd = min((int)ceil(shortBottom.y), m_clipRect.maxY);
+  if (yStart >= yEnd)
+    return;
+
+  // Both edges have some height, as there is at least one row between the ends of the short one
+  const float longStep = (longBottom.x - longTop.x) / (longBottom.y - longTop.y);
+  const float shortStep = (shortBottom.x - shortTop.x) / (shortBottom.y - shortTop.y);
+
+  float longX = longTop.x + ((yStart - longTop.y) * longStep);
+  float shortX = shortTop.x + ((yStart - shortTop.y) * shortStep);
 
-  float longStep = longDiff.x / longDiff.y;
-  float shortStep = shortDiff.x / shortDiff.y;
+  const int numAttributes = Textured ? 4 : 5;
 
-  float startOff = (shortEdge0.y - longEdge0.y) / longDiff.y;
-  Vector4 start = longEdge0 + (longDiff * startOff);
+  Colour *spanColours = &m_spanColours[0];
+  unsigned int *spanMask = &m_spanMask[0];
 
-  float endOff = (start.y - shortEdge0.y) / shortDiff.y;
-  Vector4 end = shortEdge0 + (shortDiff * endOff);
+  PIPELINE_STAT(uint pixelsTested = 0);
+  PIPELINE_STAT(uint pixelsPassed = 0);
+  PIPELINE_STAT(const bool heatmap = (m_heatmapMode != HEATMAP_OFF));
 
-  for (float y = shortEdge0.y; y < shortEdge1.y; ++y)
+  for (int y = yStart; y < yEnd; ++y, longX += longStep, shortX += shortStep)
   {
-    float minX = min(start.x, end.x);
-    float maxX = max(start.x, end.x);
+    const int xStart = max((int)ceil(min(longX, shortX)), m_clipRect.minX);
+    const int xEnd = min((int)ceil(max(longX, shortX)), m_clipRect.maxX);
+    if (xStart >= xEnd)
+      continue;
+
+    float a[MAX_SPAN_ATTRIBUTES];
+    for (int i = 0; i < numAttributes; ++i)
+      a[i] = g.base[i] + (g.dx[i] * xStart) + (g.dy[i] * y);
+
+    for (int x = xStart; x < xEnd; ++x)
+    {
+      const int index = (y * screenWidth) + x;
+      PIPELINE_STAT(pixelsTested++);
+      PIPELINE_STAT(if (heatmap) m_heatmap[0][index]++);
+
+      bool pass = true;
+      if (Depth != DEPTH_DISABLED)
+      {
+        const unsigned int castVal = (unsigned int)a[0];
+        pass = (castVal <= m_depthBuffer[index]);
+
+        if (Depth == DEPTH_TEST_WRITE && pass)
+          m_depthBuffer[index] = (unsigned short)castVal;
+      }
 
-    for (float x = minX; x < maxX; ++x)
-      BlendPixel((int)x, (int)y, Colour::White);
+      spanMask[x] = pass ? ~0u : 0u;
 
-    start.x += longStep;
-    end.x += shortStep;
+      if (pass)
+      {
+#ifdef PIPELINE_STATISTICS
+        pixelsPassed++;
+        if (heatmap)
+        {
+          m_heatmap[1][index]++;
+          if (Blend != BLEND_REPLACE)
+            m_heatmap[2][index]++;
+        }
+#endif
+
+        if (Textured)
+        {
+          Vector3 subTex(a[1], a[2], a[3]);
+          subTex.x /= subTex.z;
+          subTex.y /= subTex.z;
+
+          switch (SampleMode)
+          {
+          case SAMPLE_BILINEAR:
+            spanColours[x] = m_currentTexture->BilinearTexSample(subTex);
+            break;
+          case SAMPLE_MIPMAP_NEAREST:
+          {
+            const Vector3 xDerivs(a[1] + g.dx[1], a[2] + g.dx[2], a[3] + g.dx[3]);
+            const Vector3 yDerivs(a[1] + g.dy[1], a[2] + g.dy[2], a[3] + g.dy[3]);
+
+            spanColours[x] =
+                m_currentTexture->NearestTexSample(subTex, MipmapLevel(subTex, xDerivs, yDerivs));
+            break;
+          }
+          default:
+            spanColours[x] = m_currentTexture->NearestTexSample(subTex);
+          }
+        }
+        else
+        {
+          spanColours[x] = Colour((unsigned char)clamp(a[1], 0.0f, 255.0f),
+                                  (unsigned char)clamp(a[2], 0.0f, 255.0f),
+                                  (unsigned char)clamp(a[3], 0.0f, 255.0f),
+                                  (unsigned char)clamp(a[4], 0.0f, 255.0f));
+        }
+      }
+
+      for (int i = 0; i < numAttributes; ++i)
+        a[i] += g.dx[i];
+    }
+
+    BlendColourSpan<Blend>(xStart, y, spanColours + xStart, spanMask + xStart, xEnd - xStart);
+  }
+
+#ifdef PIPELINE_STATISTICS
+  m_frameStats.pixelsTested += pixelsTested;
+  m_frameStats.pixelsPassed += pixelsPassed;
+  if (Blend != BLEND_REPLACE)
+    m_frameStats.pixelsBlended += pixelsPassed;
+  if (Textured)
+  {
+    m_frameStats.texelsFetched[SampleMode] +=
+        pixelsPassed * (SampleMode == SAMPLE_BILINEAR ? 4 : 1);
   }
+#endif
 }
 
-void SoftwareRasteriser::RasterisePointsMesh(RenderObject *o)
+// Builds the table of every instantiation of a triangle rasteriser template F
+#define TRI_PERMUTATIONS_DEPTH(F, T, S, B)                                                         \
+  {                                                                                                \
+    &SoftwareRasteriser::F<T, S, B, DEPTH_TEST_WRITE>,                                             \
+        &SoftwareRasteriser::F<T, S, B, DEPTH_TEST>,                                               \
+        &SoftwareRasteriser::F<T, S, B, DEPTH_DISABLED>                                            \
+  }
+#define TRI_PERMUTATIONS_BLEND(F, T, S)                                                            \
+  {                                                                                                \
+    TRI_PERMUTATIONS_DEPTH(F, T, S, BLEND_REPLACE), TRI_PERMUTATIONS_DEPTH(F, T, S, BLEND_ALPHA),  \
+        TRI_PERMUTATIONS_DEPTH(F, T, S, BLEND_ADDITIVE)                                            \
+  }
+#define TRI_PERMUTATIONS_SAMPLE(F, T)                                                              \
+  {                                                                                                \
+    TRI_PERMUTATIONS_BLEND(F, T, SAMPLE_NEAREST), TRI_PERMUTATIONS_BLEND(F, T, SAMPLE_BILINEAR),   \
+        TRI_PERMUTATIONS_BLEND(F, T, SAMPLE_MIPMAP_NEAREST)                                        \
+  }
+
+const SoftwareRasteriser::RasteriseTriFunc
+    SoftwareRasteriser::s_rasteriseTriPermutations[2][3][3][3] = {
+        TRI_PERMUTATIONS_SAMPLE(RasteriseTriPermutation, false),
+        TRI_PERMUTATIONS_SAMPLE(RasteriseTriPermutation, true)};
+
+const SoftwareRasteriser::RasteriseTriFunc
+    SoftwareRasteriser::s_rasteriseTriSpanPermutations[2][3][3][3] = {
+        TRI_PERMUTATIONS_SAMPLE(RasteriseTriSpans, false),
+        TRI_PERMUTATIONS_SAMPLE(RasteriseTriSpans, true)};
+
+const SoftwareRasteriser::RasteriseTriFunc
+    SoftwareRasteriser::s_rasteriseTriMultisamplePermutations[2][3][3][3] = {
+        TRI_PERMUTATIONS_SAMPLE(RasteriseTriMultisample, false),
+        TRI_PERMUTATIONS_SAMPLE(RasteriseTriMultisample, true)};
+
+#undef TRI_PERMUTATIONS_DEPTH
+#undef TRI_PERMUTATIONS_BLEND
+#undef TRI_PERMUTATIONS_SAMPLE
+
+/**
+ * Transforms the points of a mesh to the screen, four at a time. Points outside of the near or far
+ * plane are culled, as are points far enough outside of the others that their square can't reach
+ * the viewport.
+ *
+ * Only reads state that is fixed while a frame is in flight, so may run on a worker thread.
+ *
+ * \param mvp Model view projection matrix
+ * \param m Mesh to process
+ * \param pointSize Width and height of the square each point is drawn as, in pixels
+ * \param out List to append the points to
+ */
+void SoftwareRasteriser::ProcessPointsMesh(const Matrix4 &mvp, Mesh *m, float pointSize,
+                                           PrimitiveList &out)
 {
-  Matrix4 mvp = m_viewProjMatrix * o->GetModelMatrix();
-  for (uint i = 0; i < o->GetMesh()->numVertices; i++)
+  const uint numVertices = m->numVertices;
+  PIPELINE_STAT(out.stats.pointsSubmitted += numVertices);
+
+  const size_t first = out.points.size();
+  out.points.reserve(first + numVertices);
+
+  // Each element of the matrix in every lane, so a register of each of the components of four
+  // points can be transformed at once
+  __m128 matrix[16];
+  for (int i = 0; i < 16; ++i)
+    matrix[i] = _mm_set1_ps(mvp.values[i]);
+
+  // The x and y planes are pushed out by half a square, so points are only culled once no part of
+  // their square can be on screen
+  const float padding = max((int)(pointSize + 0.5f), 1) * 0.5f;
+  const float guardScaleX = 1.0f + (padding / max(m_portMatrix.values[0], 0.5f));
+  const float guardScaleY = 1.0f + (padding / max(m_portMatrix.values[5], 0.5f));
+  const __m128 guardX = _mm_set1_ps(guardScaleX);
+  const __m128 guardY = _mm_set1_ps(guardScaleY);
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  const __m128 portScaleX = _mm_set1_ps(m_portMatrix.values[0]);
+  const __m128 portScaleY = _mm_set1_ps(m_portMatrix.values[5]);
+  const __m128 portScaleZ = _mm_set1_ps(m_portMatrix.values[10]);
+  const __m128 portOffsetX = _mm_set1_ps(m_portMatrix.values[12]);
+  const __m128 portOffsetY = _mm_set1_ps(m_portMatrix.values[13]);
+  const __m128 portOffsetZ = _mm_set1_ps(m_portMatrix.values[14]);
+
+  // The last few points are copied out, so the lanes past the end of the mesh read (and cull)
+  // default vertices
+  Vector4 last[4];
+
+  const Vector3 *blockBounds = m->GetBlockBounds();
+  for (uint block = 0; block < numVertices; block += POINTS_PER_BLOCK)
   {
-    Vector4 vertexPos = mvp * o->GetMesh()->vertices[i];
-    vertexPos.SelfDivisionByW();
-    Vector4 screenPos = m_portMatrix * vertexPos;
-    BlendPixel((uint)screenPos.x, (uint)screenPos.y, o->GetMesh()->colours[i]);
+    const uint blockEnd = min(block + POINTS_PER_BLOCK, numVertices);
+
+    // Blocks with every corner of their box outside of the same plane are skipped whole
+    const Vector3 &blockMin = blockBounds[(block / POINTS_PER_BLOCK) * 2];
+    const Vector3 &blockMax = blockBounds[((block / POINTS_PER_BLOCK) * 2) + 1];
+    int outside = ~0;
+    for (int c = 0; c < 8 && outside != 0; ++c)
+    {
+      const Vector4 corner = mvp * Vector4((c & 1) ? blockMax.x : blockMin.x,
+                                           (c & 2) ? blockMax.y : blockMin.y,
+                                           (c & 4) ? blockMax.z : blockMin.z, 1.0f);
+      const float bandX = corner.w * guardScaleX;
+      const float bandY = corner.w * guardScaleY;
+      outside &= (corner.x > bandX) | ((corner.x < -bandX) << 1) | ((corner.y > bandY) << 2) |
+                 ((corner.y < -bandY) << 3) | ((corner.z > corner.w) << 4) |
+                 ((corner.z < -corner.w) << 5);
+    }
+    if (outside != 0)
+      continue;
+
+    PIPELINE_STAT(out.stats.verticesTransformed += blockEnd - block);
+
+    for (uint i = block; i < blockEnd; i += 4)
+    {
+      const uint remaining = min(blockEnd - i, 4u);
+      const Vector4 *v = &m->vertices[i];
+      if (remaining < 4)
+      {
+        for (uint j = 0; j < remaining; ++j)
+          last[j] = v[j];
+        v = last;
+      }
+
+      __m128 x = _mm_loadu_ps(&v[0].x);
+      __m128 y = _mm_loadu_ps(&v[1].x);
+      __m128 z = _mm_loadu_ps(&v[2].x);
+      __m128 w = _mm_loadu_ps(&v[3].x);
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+
+      const __m128 clipX =
+          _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, matrix[0]), _mm_mul_ps(y, matrix[4])),
+                                _mm_mul_ps(z, matrix[8])),
+                     _mm_mul_ps(w, matrix[12]));
+      const __m128 clipY =
+          _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, matrix[1]), _mm_mul_ps(y, matrix[5])),
+                                _mm_mul_ps(z, matrix[9])),
+                     _mm_mul_ps(w, matrix[13]));
+      const __m128 clipZ =
+          _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, matrix[2]), _mm_mul_ps(y, matrix[6])),
+                                _mm_mul_ps(z, matrix[10])),
+                     _mm_mul_ps(w, matrix[14]));
+      const __m128 clipW =
+          _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, matrix[3]), _mm_mul_ps(y, matrix[7])),
+                                _mm_mul_ps(z, matrix[11])),
+                     _mm_mul_ps(w, matrix[15]));
+
+      // Outcode test, with a lane's bits set only if it's inside every plane. Each pair of
+      // opposite planes is tested at once against the absolute value of the coordinate.
+      __m128 inside = _mm_and_ps(_mm_cmpgt_ps(clipW, zero),
+                                 _mm_cmple_ps(_mm_and_ps(clipZ, absMask), clipW));
+      inside = _mm_and_ps(inside,
+                          _mm_cmple_ps(_mm_and_ps(clipX, absMask), _mm_mul_ps(clipW, guardX)));
+      inside = _mm_and_ps(inside,
+                          _mm_cmple_ps(_mm_and_ps(clipY, absMask), _mm_mul_ps(clipW, guardY)));
+
+      const int visible = _mm_movemask_ps(inside) & ((1 << remaining) - 1);
+      if (visible == 0)
+        continue;
+
+      // Perspective divide, then the viewport transform
+      const __m128 recip = _mm_div_ps(one, clipW);
+      float screenX[4];
+      float screenY[4];
+      float screenZ[4];
+      _mm_storeu_ps(screenX,
+                    _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipX, recip), portScaleX), portOffsetX));
+      _mm_storeu_ps(screenY,
+                    _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipY, recip), portScaleY), portOffsetY));
+      _mm_storeu_ps(screenZ,
+                    _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipZ, recip), portScaleZ), portOffsetZ));
+
+      for (uint j = 0; j < remaining; ++j)
+      {
+        if ((visible & (1 << j)) == 0)
+          continue;
+
+        ScreenPoint p;
+        p.v = Vector4(screenX[j], screenY[j], screenZ[j], 1.0f);
+        p.c = m->colours[i + j];
+        out.points.push_back(p);
+      }
+    }
   }
+
+  PIPELINE_STAT(out.stats.pointsCulled += numVertices - (uint)(out.points.size() - first));
 }
 
-void SoftwareRasteriser::RasteriseLinesMesh(RenderObject *o)
+void SoftwareRasteriser::ProcessLinesMesh(const Matrix4 &mvp, Mesh *m, PrimitiveList &out)
 {
-  Matrix4 mvp = m_viewProjMatrix * o->GetModelMatrix();
-  for (uint i = 0; i < o->GetMesh()->numVertices; i += 2)
+  const uint numVertices = m->numVertices & ~1u;
+
+  // Transform the whole line list up front, so each vertex is transformed and has its outcode
+  // calculated exactly once
+  out.transformed.resize(numVertices);
+  out.outcodes.resize(numVertices);
+  PIPELINE_STAT(out.stats.verticesTransformed += numVertices);
+  for (uint i = 0; i < numVertices; ++i)
+  {
+    out.transformed[i] = mvp * m->vertices[i];
+    out.outcodes[i] = HomogeneousOutcode(out.transformed[i]);
+  }
+
+  for (uint i = 0; i < numVertices; i += 2)
   {
-    Vector4 v0 = mvp * o->GetMesh()->vertices[i];
-    Vector4 v1 = mvp * o->GetMesh()->vertices[i + 1];
+    const int outcodeA = out.outcodes[i];
+    const int outcodeB = out.outcodes[i + 1];
+
+    // Both ends outside of the same plane, nothing to draw
+    if (outcodeA & outcodeB)
+      continue;
+
+    Vector4 v0 = out.transformed[i];
+    Vector4 v1 = out.transformed[i + 1];
 
-    Colour c0 = o->GetMesh()->colours[0];
-    Colour c1 = o->GetMesh()->colours[1];
+    Colour c0 = m->colours[i];
+    Colour c1 = m->colours[i + 1];
 
-    Vector3 t0 = Vector3(o->GetMesh()->textureCoords[i].x, o->GetMesh()->textureCoords[i].y, 1.0f);
-    Vector3 t1 =
-        Vector3(o->GetMesh()->textureCoords[i + 1].x, o->GetMesh()->textureCoords[i + 1].y, 1.0f);
+    Vector3 t0 = Vector3(m->textureCoords[i].x, m->textureCoords[i].y, 1.0f);
+    Vector3 t1 = Vector3(m->textureCoords[i + 1].x, m->textureCoords[i + 1].y, 1.0f);
 
-    if (!CohenSutherlandLine(v0, v1, c0, c1, t0, t1))
+    // Only lines that straddle a plane need clipping
+    if ((outcodeA | outcodeB) && !CohenSutherlandLine(v0, v1, c0, c1, t0, t1))
       continue;
 
     t0.z = 1.0f;
@@ -649,58 +3762,57 @@ void SoftwareRasteriser::RasteriseLinesMesh(RenderObject *o)
     v0.SelfDivisionByW();
     v1.SelfDivisionByW();
 
-    RasteriseLine(v0, v1, c0, c1, t0, t1);
+    ScreenLine l;
+    l.v[0] = m_portMatrix * v0;
+    l.v[1] = m_portMatrix * v1;
+    l.c[0] = c0;
+    l.c[1] = c1;
+    l.t[0] = t0;
+    l.t[1] = t1;
+    out.lines.push_back(l);
   }
 }
 
-void SoftwareRasteriser::RasteriseTriMesh(RenderObject *o)
+void SoftwareRasteriser::ProcessTriMesh(const Matrix4 &mvp, Mesh *m, PrimitiveList &out)
 {
-  Matrix4 mvp = m_viewProjMatrix * o->GetModelMatrix();
-  Mesh *m = o->GetMesh();
-
-  for (uint i = 0; i < o->GetMesh()->numVertices; i += 3)
+  for (uint i = 0; i < m->numVertices; i += 3)
   {
+    PIPELINE_STAT(out.stats.verticesTransformed += 3);
     Vector4 v0 = mvp * m->vertices[i];
     Vector4 v1 = mvp * m->vertices[i + 1];
     Vector4 v2 = mvp * m->vertices[i + 2];
 
-    SutherlandHodgmanTri(v0, v1, v2, m->colours[i], m->colours[i + 1], m->colours[i + 2],
+    SutherlandHodgmanTri(out, v0, v1, v2, m->colours[i], m->colours[i + 1], m->colours[i + 2],
                          m->textureCoords[i], m->textureCoords[i + 1], m->textureCoords[i + 2]);
   }
 }
 
-void SoftwareRasteriser::RasteriseTriMeshStrip(RenderObject *o)
+void SoftwareRasteriser::ProcessTriMeshStrip(const Matrix4 &mvp, Mesh *m, PrimitiveList &out)
 {
-  Matrix4 mvp = m_viewProjMatrix * o->GetModelMatrix();
-  Mesh *m = o->GetMesh();
-
-  for (uint i = 0; i < o->GetMesh()->numVertices - 2; ++i)
+  for (uint i = 0; i < m->numVertices - 2; ++i)
   {
-    Vector4 vv0 = m->vertices[i];
-    Vector4 vv1 = m->vertices[i + 1];
-    Vector4 vv2 = m->vertices[i + 2];
-
+    PIPELINE_STAT(out.stats.verticesTransformed += 3);
     Vector4 v0 = mvp * m->vertices[i];
     Vector4 v1 = mvp * m->vertices[i + 1];
     Vector4 v2 = mvp * m->vertices[i + 2];
 
-    SutherlandHodgmanTri(v0, v1, v2, m->colours[i], m->colours[i + 1], m->colours[i + 2],
+    SutherlandHodgmanTri(out, v0, v1, v2, m->colours[i], m->colours[i + 1], m->colours[i + 2],
                          m->textureCoords[i], m->textureCoords[i + 1], m->textureCoords[i + 2]);
   }
 }
 
-void SoftwareRasteriser::RasteriseTriMeshFan(RenderObject *o)
+void SoftwareRasteriser::ProcessTriMeshFan(const Matrix4 &mvp, Mesh *m, PrimitiveList &out)
 {
-  Matrix4 mvp = m_viewProjMatrix * o->GetModelMatrix();
-  Mesh *m = o->GetMesh();
   Vector4 v0 = mvp * m->vertices[0];
+  PIPELINE_STAT(out.stats.verticesTransformed++);
 
-  for (uint i = 1; i < o->GetMesh()->numVertices - 1; ++i)
+  for (uint i = 1; i < m->numVertices - 1; ++i)
   {
+    PIPELINE_STAT(out.stats.verticesTransformed += 2);
     Vector4 v1 = mvp * m->vertices[i];
     Vector4 v2 = mvp * m->vertices[i + 1];
 
-    SutherlandHodgmanTri(v0, v1, v2, m->colours[0], m->colours[i], m->colours[i + 1],
+    SutherlandHodgmanTri(out, v0, v1, v2, m->colours[0], m->colours[i], m->colours[i + 1],
                          m->textureCoords[0], m->textureCoords[i], m->textureCoords[i + 1]);
   }
 }
@@ -720,15 +3832,22 @@ BoundingBox SoftwareRasteriser::CalculateBoxForTri(const Vector4 &a, const Vecto
   box.topLeft.y = min(box.topLeft.y, c.y);
   box.topLeft.y = max(box.topLeft.y, 0.0f);
 
+  // Pixels are sampled at whole pixel steps from the top left, so it is moved into the clip
+  // rectangle by whole pixels to sample the same positions whatever the clip rectangle is
+  if (box.topLeft.x < m_clipRect.minX)
+    box.topLeft.x += ceil(m_clipRect.minX - box.topLeft.x);
+  if (box.topLeft.y < m_clipRect.minY)
+    box.topLeft.y += ceil(m_clipRect.minY - box.topLeft.y);
+
   box.bottomRight.x = a.x;
   box.bottomRight.x = max(box.bottomRight.x, b.x);
   box.bottomRight.x = max(box.bottomRight.x, c.x);
-  box.bottomRight.x = min(box.bottomRight.x, screenWidth);
+  box.bottomRight.x = min(box.bottomRight.x, (float)m_clipRect.maxX);
 
   box.bottomRight.y = a.y;
   box.bottomRight.y = max(box.bottomRight.y, b.y);
   box.bottomRight.y = max(box.bottomRight.y, c.y);
-  box.bottomRight.y = min(box.bottomRight.y, screenHeight);
+  box.bottomRight.y = min(box.bottomRight.y, (float)m_clipRect.maxY);
 
   return box;
 }
@@ -22,11 +22,33 @@ _-_-_-_-_-_-_-""  ""
 #include "RenderObject.h"
 #include "Common.h"
 #include "Window.h"
+#include "GameTimer.h"
 
 #include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
 
 using std::vector;
 
+// Define to gather per frame pipeline statistics (see PipelineStatistics), when not defined the
+// counters are compiled out entirely
+//#define PIPELINE_STATISTICS
+
+#ifdef PIPELINE_STATISTICS
+#define PIPELINE_STAT(x) x
+#else
+#define PIPELINE_STAT(x)
+#endif
+
+// Samples per pixel when multisampling is enabled
+#define MSAA_SAMPLES 4
+
+// Frames averaged by the dynamic resolution controller before each adjustment
+#define DYNAMIC_RESOLUTION_HISTORY 4
+
 enum BlendMode
 {
   BLEND_REPLACE,
@@ -41,6 +63,31 @@ enum TextureSampleMode
   SAMPLE_MIPMAP_NEAREST
 };
 
+enum DepthMode
+{
+  DEPTH_TEST_WRITE,
+  DEPTH_TEST,
+  DEPTH_DISABLED
+};
+
+// How the pixels covered by a triangle are found
+enum TriangleTraversal
+{
+  TRAVERSAL_BOUNDING_BOX, // Test every pixel in the triangle's bounding box
+  TRAVERSAL_SCANLINE      // Walk the triangle's edges and fill the spans between them
+};
+
+// Format of the colour buffer triangles, lines and points are drawn into. Frames are converted to
+// the window's BGRA format as they are presented.
+enum ColourFormat
+{
+  COLOUR_BGRA8,     // 32 bits, the window's own format
+  COLOUR_RGB565,    // 16 bits, without alpha
+  COLOUR_R11G11B10  // 32 bits, without alpha, so no smaller than BGRA8. Channels hold the same
+                    // 0-255 values as BGRA8, but give additive blending headroom to saturate at
+                    // 2047 (or 1023 for blue) rather than wrapping
+};
+
 struct BoundingBox
 {
   Vector2 topLeft;
@@ -49,6 +96,277 @@ struct BoundingBox
 
 class RenderObject;
 class Texture;
+class CommandBuffer;
+class FrameCapture;
+class ShaderProgram;
+class Impostor;
+
+// Per pixel counts that can be shown in place of the frame, to visualise overdraw
+enum HeatmapMode
+{
+  HEATMAP_OFF,
+  HEATMAP_DEPTH_TESTED,
+  HEATMAP_SHADED,
+  HEATMAP_BLENDED
+};
+
+// Counts of the work done by each pipeline stage over a frame
+struct PipelineStatistics
+{
+  PipelineStatistics()
+  {
+    Reset();
+  }
+
+  void Reset();
+  void Add(const PipelineStatistics &other);
+  void Print(std::ostream &o) const;
+
+  uint objects;
+  uint objectsOccluded; // Skipped by occlusion culling
+  uint verticesTransformed;
+
+  uint stateChangesSubmitted; // Between consecutive draws of a recorded frame, as submitted
+  uint stateChanges;          // And as processed, after any sorting
+
+  uint trianglesSubmitted;
+  uint trianglesCulled;   // Entirely outside of a clip plane
+  uint trianglesAccepted; // Entirely inside the view volume
+  uint trianglesClipped;
+  uint clippedTriangles; // Triangles produced by clipping
+
+  uint pointsSubmitted;
+  uint pointsCulled; // Outside of the view volume, or too far off screen to touch it
+
+  uint pixelsCleared; // Less than the whole viewport when rendering incrementally
+  uint pixelsTested;  // Covered by a primitive
+  uint pixelsPassed;  // Passed the depth test (if any)
+  uint pixelsBlended; // Alpha or additive blended into the colour buffer
+  uint pixelsPresented; // Copied to the window
+  uint texelsFetched[3]; // Indexed by TextureSampleMode
+};
+
+// Raster state captured with each draw
+struct DrawState
+{
+  ShaderProgram *shader; // Shades triangles in place of the texture or vertex colours, if set
+  Texture *texture;
+  TextureSampleMode sampleMode;
+  BlendMode blendMode;
+  DepthMode depthMode;
+  float pointSize; // Width and height of the squares points are drawn as, in pixels
+};
+
+// A single draw as recorded by DrawObject
+struct DrawCommand
+{
+  Mesh *mesh;
+  Matrix4 modelMatrix;
+  Matrix4 viewProjMatrix;
+  DrawState state;
+  bool occlusionCull; // Tested against the depth buffer before it is rasterised
+};
+
+// Screen space primitives produced by vertex processing and clipping. Texture coordinates have
+// been divided by w, with 1/w held in z, ready for perspective correct interpolation.
+struct ScreenTri
+{
+  Vector4 v[3];
+  Colour c[3];
+  Vector3 t[3];
+};
+
+struct ScreenLine
+{
+  Vector4 v[2];
+  Colour c[2];
+  Vector3 t[2];
+};
+
+struct ScreenPoint
+{
+  Vector4 v; // Screen position, with the depth in z
+  Colour c;
+};
+
+// Values a vertex shader passes to the fragment shader, interpolated perspective correctly across
+// each triangle. The layout is fixed so that the pipeline can treat them as an array of
+// SHADER_VARYINGS floats.
+#define SHADER_VARYINGS 12
+
+struct Varyings
+{
+  Vector4 colour; // 0 to 1 per channel
+  Vector2 texCoord;
+  Vector3 worldPos;
+  Vector3 normal;
+};
+
+// A vertex as output by a vertex shader
+struct ShadedVertex
+{
+  Vector4 pos; // Clip space
+  Varyings varyings;
+};
+
+// Screen space triangle of the programmable pipeline. The w of each vertex holds 1/w, and the
+// varyings have been divided by w.
+struct ShadedTri
+{
+  Vector4 v[3];
+  Varyings varyings[3];
+};
+
+// Per triangle setup for rasterising a ShadedTri. Edge i is opposite vertex i, and its function
+// (edgeX[i] * x) + (edgeY[i] * y) + edgeC[i] (see SetupEdgeFunction) is that vertex's weight at
+// (x, y) scaled by the triangle's area, so a pixel is covered when all three are over 0, or are 0
+// on a top or left edge. Attributes (depth, then 1/w, then each varying divided by w) are linear
+// functions of screen position in the same way as SpanGradients.
+#define SHADED_ATTRIBUTES (SHADER_VARYINGS + 2)
+
+struct ShadedTriSetup
+{
+  int xStart;
+  int yStart;
+  int xEnd; // Exclusive
+  int yEnd;
+
+  float edgeX[3];
+  float edgeY[3];
+  float edgeC[3];
+  bool topLeft[3]; // Whether each edge owns the pixels exactly on it
+
+  float base[SHADED_ATTRIBUTES];
+  float dx[SHADED_ATTRIBUTES];
+  float dy[SHADED_ATTRIBUTES];
+
+  // Only set when multisampling: the offset of each sample from its pixel, and how much that
+  // offset adds to each edge function
+  float sampleX[MSAA_SAMPLES];
+  float sampleY[MSAA_SAMPLES];
+  float sampleWeight[3][MSAA_SAMPLES];
+};
+
+// Sets up the function (edgeX * x) + (edgeY * y) + edgeC of screen position, which is 0 along the
+// edge from a to b and positive on the side of it given by sign (that of the triangle's area). It
+// is calculated from the two ends in the same order whichever way round the edge is, so triangles
+// sharing an edge evaluate exactly opposite values and each point is inside only one of them.
+// Points exactly on the edge are left to the top-left rule: as with the scanline spans rounding
+// up, left edges and flat top edges own them, which is what this returns.
+inline bool SetupEdgeFunction(const Vector4 &a, const Vector4 &b, float sign, float &edgeX,
+                              float &edgeY, float &edgeC)
+{
+  const bool swap = (b.y < a.y) || (b.y == a.y && b.x < a.x);
+  const Vector4 &p = swap ? b : a;
+  const Vector4 &q = swap ? a : b;
+  const float s = swap ? -sign : sign;
+
+  edgeX = (p.y - q.y) * s;
+  edgeY = (q.x - p.x) * s;
+  edgeC = -(((p.y - q.y) * p.x) + ((q.x - p.x) * p.y)) * s;
+  return (edgeX > 0.0f) || (edgeX == 0.0f && edgeY > 0.0f);
+}
+
+// Whether a point with the given edge function values is inside a triangle, by the top-left rule
+inline bool EdgesCover(const float *e, const bool *topLeft)
+{
+  if (e[0] < 0.0f || e[1] < 0.0f || e[2] < 0.0f)
+    return false;
+
+  // Only points exactly on an edge need the rule
+  return (e[0] > 0.0f || topLeft[0]) && (e[1] > 0.0f || topLeft[1]) && (e[2] > 0.0f || topLeft[2]);
+}
+
+// Attributes of a triangle as linear functions of screen position, for stepping them across
+// spans: value = base + (dx * x) + (dy * y). Attribute 0 is depth, followed by either the
+// texture coordinates (divided by w) or the colour.
+#define MAX_SPAN_ATTRIBUTES 5
+
+struct SpanGradients
+{
+  float base[MAX_SPAN_ATTRIBUTES];
+  float dx[MAX_SPAN_ATTRIBUTES];
+  float dy[MAX_SPAN_ATTRIBUTES];
+};
+
+// A triangle clipped against all six planes has at most nine vertices
+#define MAX_CLIP_VERTS 16
+#define MAX_CLIP_ATTRIBUTES SHADER_VARYINGS
+
+// Polygon being clipped, in structure of arrays form. Attributes are interpolated linearly in
+// clip space, so any number of them (up to MAX_CLIP_ATTRIBUTES) can be carried through.
+struct ClipPolygon
+{
+  Vector4 pos[MAX_CLIP_VERTS];
+  float attributes[MAX_CLIP_ATTRIBUTES][MAX_CLIP_VERTS];
+  int count;
+};
+
+// Screen space rectangle covering a draw's bounding box, at the depth of its nearest corner
+struct OcclusionBounds
+{
+  bool testable; // False if the box crosses the near plane, so can't be tested
+  int minX;
+  int minY;
+  int maxX; // Inclusive
+  int maxY;
+  uint depth;
+};
+
+// A run of primitives belonging to a single draw (strips and fans become triangles)
+struct PrimitiveBatch
+{
+  DrawState state;
+  PrimitiveType type;
+  uint first; // Into the list's shadedTris if the batch has a shader
+  uint count;
+  OcclusionBounds occlusion; // Only testable if the draw is occlusion culled
+};
+
+// Output of the geometry stage for any number of draws, in submission order
+struct PrimitiveList
+{
+  void Clear()
+  {
+    batches.clear();
+    tris.clear();
+    shadedTris.clear();
+    lines.clear();
+    points.clear();
+    stats.Reset();
+  }
+
+  vector<PrimitiveBatch> batches;
+  vector<ScreenTri> tris;
+  vector<ShadedTri> shadedTris; // Triangles of batches with a shader
+  vector<ScreenLine> lines;
+  vector<ScreenPoint> points;
+
+  // Geometry stage statistics for the primitives in the list
+  PipelineStatistics stats;
+
+  // Scratch space for batch transforming vertices
+  vector<Vector4> transformed;
+  vector<ShadedVertex> shadedVertices;
+  vector<int> outcodes;
+};
+
+// A frame recorded in pipelined mode, or for parallel vertex processing
+struct PipelinedFrame
+{
+  bool clear;
+  bool ready;
+  uint viewportWidth; // Render size the geometry was processed for
+  uint viewportHeight;
+  vector<DrawCommand> draws;
+
+  // One list per geometry thread, each holding a contiguous run of the draws. Rasterising the
+  // lists in order keeps submission order.
+  vector<PrimitiveList> primitives;
+  vector<uint> drawRanges; // First draw of each list, then the number of draws
+
+  PipelineStatistics stats; // Counts for the frame as a whole, such as state changes
+};
 
 class SoftwareRasteriser : public Window
 {
@@ -60,9 +378,136 @@ public:
 
   void DrawObject(RenderObject *o);
 
+  // Draws a group of distant objects as a textured quad, rendering them into its texture again
+  // when the view of them has changed enough (see Impostor.h)
+  void DrawImpostor(Impostor *impostor);
+
+  void RenderToTexture(const vector<RenderObject *> &objects, const Matrix4 &viewProjMatrix,
+                       Texture *target, uint width, uint height);
+
+  // Replays the state changes and draws recorded in a command buffer
+  void Submit(const CommandBuffer &commands);
+
   void ClearBuffers();
   void SwapBuffers();
 
+  void SetPipelined(bool pipelined);
+
+  bool IsPipelined()
+  {
+    return m_pipelined;
+  }
+
+  void SetGeometryThreads(uint threads);
+
+  uint GetGeometryThreads()
+  {
+    return m_geometryThreads;
+  }
+
+  void SetDrawSorting(bool sort);
+
+  bool IsDrawSorting()
+  {
+    return m_sortDraws;
+  }
+
+  // Skip draws whose bounding boxes are hidden behind what has already been drawn
+  void SetOcclusionCulling(bool cull)
+  {
+    m_occlusionCulling = cull;
+  }
+
+  bool IsOcclusionCulling()
+  {
+    return m_occlusionCulling;
+  }
+
+  void SetIncrementalRendering(bool incremental);
+
+  bool IsIncrementalRendering()
+  {
+    return m_incremental;
+  }
+
+  uint OcclusionQuery(RenderObject *o);
+  uint OcclusionQuery(const Vector3 &boundsMin, const Vector3 &boundsMax,
+                      const Matrix4 &modelMatrix);
+
+  // Every presented frame is also passed to the capture, which is not owned (NULL disables)
+  void SetFrameCapture(FrameCapture *capture)
+  {
+    m_frameCapture = capture;
+  }
+
+  FrameCapture *GetFrameCapture()
+  {
+    return m_frameCapture;
+  }
+
+  static bool StatisticsEnabled()
+  {
+#ifdef PIPELINE_STATISTICS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Statistics of the most recently presented frame (all zero unless PIPELINE_STATISTICS is
+  // defined)
+  const PipelineStatistics &GetFrameStatistics() const
+  {
+    return m_lastFrameStats;
+  }
+
+  // Prints the statistics of every frame as it is presented
+  void SetDumpStatistics(bool dump)
+  {
+    m_dumpStats = dump;
+  }
+
+  void SetHeatmapMode(HeatmapMode mode);
+
+  HeatmapMode GetHeatmapMode()
+  {
+    return m_heatmapMode;
+  }
+
+  void SetMultisampling(bool multisample);
+
+  bool IsMultisampled()
+  {
+    return m_multisample;
+  }
+
+  void SetColourFormat(ColourFormat format);
+
+  ColourFormat GetColourFormat()
+  {
+    return m_colourFormat;
+  }
+
+  void SetTriangleTraversal(TriangleTraversal traversal);
+
+  TriangleTraversal GetTriangleTraversal()
+  {
+    return m_triangleTraversal;
+  }
+
+  void SetDynamicResolution(float targetFrameTime, float minScale = 0.5f);
+
+  float GetTargetFrameTime()
+  {
+    return m_targetFrameTime;
+  }
+
+  // Fraction of the window's width and height currently being rendered
+  float GetResolutionScale()
+  {
+    return m_resolutionScale;
+  }
+
   void SetViewMatrix(const Matrix4 &m)
   {
     m_viewMatrix = m;
@@ -77,7 +522,7 @@ public:
 
   inline bool DepthFunc(int x, int y, float depthValue)
   {
-    if (y < 0 || x < 0 || y >= screenHeight || x >= screenWidth)
+    if (!InsideClipRect(x, y))
       return false;
 
     int index = (y * screenWidth) + x;
@@ -109,98 +554,236 @@ public:
     return m_blendState;
   }
 
+  void SetDepthMode(DepthMode mode)
+  {
+    m_depthState = mode;
+  }
+
+  DepthMode GetDepthMode()
+  {
+    return m_depthState;
+  }
+
+  // Points are drawn as squares this many pixels across, rounded to the nearest whole pixel
+  void SetPointSize(float size)
+  {
+    m_pointSizeState = max(size, 1.0f);
+  }
+
+  float GetPointSize()
+  {
+    return m_pointSizeState;
+  }
+
   bool CohenSutherlandLine(Vector4 &inA, Vector4 &inB, Colour &colA, Colour &colB, Vector3 &texA,
                            Vector3 &texB);
 
-  void SutherlandHodgmanTri(Vector4 &v0, Vector4 &v1, Vector4 &v2, const Colour &c0 = Colour(),
-                            const Colour &c1 = Colour(), const Colour &c2 = Colour(),
-                            const Vector2 &t0 = Vector2(), const Vector2 &t1 = Vector2(),
-                            const Vector2 &t2 = Vector2());
+  void SutherlandHodgmanTri(PrimitiveList &out, Vector4 &v0, Vector4 &v1, Vector4 &v2,
+                            const Colour &c0 = Colour(), const Colour &c1 = Colour(),
+                            const Colour &c2 = Colour(), const Vector2 &t0 = Vector2(),
+                            const Vector2 &t1 = Vector2(), const Vector2 &t2 = Vector2());
+
+  static void ClipPolygonToPlanes(ClipPolygon *&poly, ClipPolygon *&scratch, int numAttributes,
+                                  int clipPlanes);
 
   float ClipEdge(const Vector4 &inA, const Vector4 &inB, int axis);
   int HomogeneousOutcode(const Vector4 &in);
 
 protected:
+  // Shaders instantiate the programmable pipeline's templates for themselves
+  friend class ShaderProgram;
+  template <typename VertexShader, typename FragmentShader> friend class Shader;
+
+  typedef void (SoftwareRasteriser::*ProcessShadedFunc)(const DrawCommand &, PrimitiveList &);
+  typedef void (SoftwareRasteriser::*RasteriseShadedFunc)(const ShadedTri *, uint);
+
+  typedef void (SoftwareRasteriser::*RasteriseTriFunc)(const Vector4 &, const Vector4 &,
+                                                       const Vector4 &, const Colour &,
+                                                       const Colour &, const Colour &,
+                                                       const Vector3 &, const Vector3 &,
+                                                       const Vector3 &);
+
+  // Every permutation of RasteriseTriPermutation, RasteriseTriSpans and RasteriseTriMultisample,
+  // indexed by [textured][sample mode][blend mode][depth mode]
+  static const RasteriseTriFunc s_rasteriseTriPermutations[2][3][3][3];
+  static const RasteriseTriFunc s_rasteriseTriSpanPermutations[2][3][3][3];
+  static const RasteriseTriFunc s_rasteriseTriMultisamplePermutations[2][3][3][3];
+
+  typedef void (SoftwareRasteriser::*RasteriseLineFunc)(const Vector4 &, const Vector4 &,
+                                                        const Colour &, const Colour &,
+                                                        const Vector3 &, const Vector3 &);
+
+  // Every permutation of RasteriseLinePermutation, indexed by [depth mode]
+  static const RasteriseLineFunc s_rasteriseLinePermutations[3];
+
   Colour *GetCurrentBuffer();
 
+  void SetViewport(uint width, uint height);
+  void ClearCurrentBuffers(const ScreenRect &rect);
+  void PresentCurrentBuffer();
+  void ResolveHeatmap(Colour *buffer);
+  void ResolveSamples(Colour *buffer);
+  void ConvertColourBuffer(Colour *buffer);
+  void ConvertColourRect(Colour *buffer, const ScreenRect &rect);
+  void UpscaleViewport(const Colour *src, Colour *dest);
+
+  void SetResolutionScale(float scale);
+  void UpdateResolutionScale();
+  static Matrix4 ViewportMatrix(uint width, uint height);
+
+  void DrawMesh(Mesh *mesh, const Matrix4 &modelMatrix, Texture *texture, ShaderProgram *shader);
+  bool RenderImpostor(Impostor *impostor, const Matrix4 &inverseView, const Vector3 &direction,
+                      float distance);
+  bool ProjectBounds(const Vector3 &boundsMin, const Vector3 &boundsMax, const Matrix4 &mvp,
+                     OcclusionBounds &out, float padding = 0.0f) const;
+  uint CountVisiblePixels(const OcclusionBounds &bounds, bool stopAtFirst);
+  void ProcessDraw(const DrawCommand &cmd, PrimitiveList &out);
+  void SetRasterState(const DrawState &state);
+  void RasterisePrimitives(const PrimitiveList &list);
+  void RasteriseFrame(PipelinedFrame &frame);
+  void ResetFrame(PipelinedFrame &frame);
+  void FindRedrawRects(const PipelinedFrame &frame);
+  void FindDrawnPresentRects(const PipelinedFrame &frame, bool settingsChanged, uint tilesX,
+                             uint tilesY);
+  bool MarkDrawTiles(const DrawCommand &cmd, vector<unsigned char> &tiles, uint tilesX) const;
+  void TilesToRects(const vector<unsigned char> &tiles, uint tilesX, uint tilesY,
+                    vector<ScreenRect> &rects) const;
+
+  void ProcessFrameGeometry(PipelinedFrame &frame);
+  void SortDraws(PipelinedFrame &frame);
+  static uint CountStateChanges(const vector<DrawCommand> &draws);
+  void ProcessDrawRange(PipelinedFrame &frame, uint range);
+
+  // Draws are recorded rather than rendered straight away
+  bool IsRecording()
+  {
+    return m_pipelined || m_geometryThreads > 1 || m_sortDraws || m_incremental;
+  }
+
+  inline bool InsideClipRect(int x, int y) const
+  {
+    return x >= m_clipRect.minX && y >= m_clipRect.minY && x < m_clipRect.maxX &&
+           y < m_clipRect.maxY;
+  }
+
+  void GeometryThreadMain();
+
   void CalculateWeights(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2, const Vector4 &p,
                         float &alpha, float &beta, float &gamma);
 
-  void RasterisePointsMesh(RenderObject *o);
-  void RasteriseLinesMesh(RenderObject *o);
-  void RasteriseTriMesh(RenderObject *o);
-  void RasteriseTriMeshStrip(RenderObject *o);
-  void RasteriseTriMeshFan(RenderObject *o);
+  void ProcessPointsMesh(const Matrix4 &mvp, Mesh *m, float pointSize, PrimitiveList &out);
+  void ProcessLinesMesh(const Matrix4 &mvp, Mesh *m, PrimitiveList &out);
+  void ProcessTriMesh(const Matrix4 &mvp, Mesh *m, PrimitiveList &out);
+  void ProcessTriMeshStrip(const Matrix4 &mvp, Mesh *m, PrimitiveList &out);
+  void ProcessTriMeshFan(const Matrix4 &mvp, Mesh *m, PrimitiveList &out);
+
+  void EmitPolygon(PrimitiveList &out, Vector4 *pos, const Colour *col, Vector3 *tex, int count);
+
+  // Programmable pipeline, instantiated for each Shader (see Shader.h)
+  template <typename Program> void ProcessShadedDraw(const DrawCommand &cmd, PrimitiveList &out);
+
+  template <typename Program, bool Multisample, DepthMode Depth>
+  void RasteriseShadedTris(const ShadedTri *tris, uint count);
+
+  void AssembleShadedTris(PrimitiveType type, uint numVertices, PrimitiveList &out);
+  void ClipShadedTri(PrimitiveList &out, uint i0, uint i1, uint i2);
+  void EmitShadedPolygon(PrimitiveList &out, ShadedVertex *verts, int count);
+  bool SetupShadedTri(const ShadedTri &tri, ShadedTriSetup &setup) const;
 
   BoundingBox CalculateBoxForTri(const Vector4 &a, const Vector4 &b, const Vector4 &c);
 
   virtual void Resize();
 
+  void RasterisePoints(const ScreenPoint *points, uint count);
+
+  template <BlendMode Blend> void RasteriseSinglePixelPoints(const ScreenPoint *points, uint count);
+
   void RasteriseLine(const Vector4 &v0, const Vector4 &v1,
                      const Colour &colA = Colour(255, 255, 255, 255),
                      const Colour &colB = Colour(255, 255, 255, 255),
                      const Vector3 &texA = Vector3(0, 0, 0),
-                     const Vector3 &texB = Vector3(1, 1, 1));
+                     const Vector3 &texB = Vector3(1, 1, 1))
+  {
+    (this->*m_rasteriseLine)(v0, v1, colA, colB, texA, texB);
+  }
+
+  template <DepthMode Depth>
+  void RasteriseLinePermutation(const Vector4 &v0, const Vector4 &v1, const Colour &colA,
+                                const Colour &colB, const Vector3 &texA, const Vector3 &texB);
 
   void RasteriseTri(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
                     const Colour &c0 = Colour(), const Colour &c1 = Colour(),
                     const Colour &c2 = Colour(), const Vector3 &t0 = Vector3(),
-                    const Vector3 &t1 = Vector3(), const Vector3 &t2 = Vector3());
+                    const Vector3 &t1 = Vector3(), const Vector3 &t2 = Vector3())
+  {
+    (this->*m_rasteriseTri)(v0, v1, v2, c0, c1, c2, t0, t1, t2);
+  }
+
+  template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+  void RasteriseTriPermutation(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
+                               const Colour &c0, const Colour &c1, const Colour &c2,
+                               const Vector3 &t0, const Vector3 &t1, const Vector3 &t2);
 
+  template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+  void RasteriseTriMultisample(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
+                               const Colour &c0, const Colour &c1, const Colour &c2,
+                               const Vector3 &t0, const Vector3 &t1, const Vector3 &t2);
+
+  static int MipmapLevel(const Vector3 &subTex, Vector3 xDerivs, Vector3 yDerivs);
+
+  template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
   void RasteriseTriSpans(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
-                         const Colour &c0 = Colour(), const Colour &c1 = Colour(),
-                         const Colour &c2 = Colour(), const Vector3 &t0 = Vector3(),
-                         const Vector3 &t1 = Vector3(), const Vector3 &t2 = Vector3());
+                         const Colour &c0, const Colour &c1, const Colour &c2, const Vector3 &t0,
+                         const Vector3 &t1, const Vector3 &t2);
+
+  template <bool Textured, TextureSampleMode SampleMode, BlendMode Blend, DepthMode Depth>
+  void RasteriseTriEdgeSpans(const SpanGradients &g, const Vector4 &longTop,
+                             const Vector4 &longBottom, const Vector4 &shortTop,
+                             const Vector4 &shortBottom);
 
-  void RasteriseTriEdgeSpans(const Vector4 &v0, const Vector4 &v1, const Vector4 &v2,
-                             const Vector4 &v3);
+  void WriteSpan(uint x, uint y, const Colour *colours, const unsigned int *mask, int count);
+
+  template <BlendMode Blend>
+  void BlendColourSpan(uint x, uint y, const Colour *colours, const unsigned int *mask,
+                       int count);
 
   inline void ShadePixel(uint x, uint y, const Colour &c)
   {
-    if (y >= screenHeight)
-      return;
-    if (x >= screenWidth)
+    if (!InsideClipRect((int)x, (int)y))
       return;
 
     const int index = (y * screenWidth) + x;
     m_buffers[m_currentDrawBuffer][index] = c;
   }
 
+  // Blends a single pixel through the same kernels as spans, so there is one implementation of
+  // each blend mode and buffer format
   inline void BlendPixel(uint x, uint y, const Colour &c)
   {
-    if (y >= screenHeight)
-      return;
-    if (x >= screenWidth)
+    if (!InsideClipRect((int)x, (int)y))
       return;
 
-    const int index = (y * screenWidth) + x;
-    Colour &dest = m_buffers[m_currentDrawBuffer][index];
-
-    switch (m_blendState)
-    {
-    case BLEND_ALPHA:
-    {
-      const unsigned char sFactor = c.a;
-      const unsigned char dFactor = (255 - c.a);
-      dest.r = ((c.r * sFactor) + (dest.r * dFactor)) / 255;
-      dest.g = ((c.g * sFactor) + (dest.g * dFactor)) / 255;
-      dest.b = ((c.b * sFactor) + (dest.b * dFactor)) / 255;
-      dest.a = ((c.a * sFactor) + (dest.a * dFactor)) / 255;
-      break;
-    }
-    case BLEND_ADDITIVE:
-      dest = dest + c;
-      break;
-    default:
-      dest = c;
-    }
+    const unsigned int coverage = ~0u;
+    WriteSpan(x, y, &c, &coverage, 1);
   }
 
   int m_currentDrawBuffer;
   Texture *m_currentTexture;
 
   Colour *m_buffers[2];
-  unsigned short *m_depthBuffer;
+  unsigned short *m_depthBuffer; // MSAA_SAMPLES values per pixel when multisampling
+
+  // When multisampling, triangles are rasterised into MSAA_SAMPLES colours per pixel which are
+  // resolved into the colour buffer as the frame is presented
+  bool m_multisample;
+  vector<Colour> m_sampleBuffer;
+
+  // Otherwise they are drawn into the buffer for the colour format, which is converted into the
+  // colour buffer as the frame is presented. There's only one of each, as they are never presented
+  // directly.
+  ColourFormat m_colourFormat;
+  vector<unsigned short> m_bufferRGB565;
+  vector<unsigned int> m_bufferR11G11B10;
 
   Matrix4 m_viewMatrix;
   Matrix4 m_projectionMatrix;
@@ -211,4 +794,109 @@ protected:
 
   TextureSampleMode m_texSampleState;
   BlendMode m_blendState;
+  DepthMode m_depthState;
+  float m_pointSizeState;
+
+  // State of the batch currently being rasterised
+  DrawState m_rasterState;
+
+  // Area of the buffers the geometry stage projects to, and the area the frame being rasterised
+  // covers. Both are the window size unless dynamic resolution scaling has reduced them, and they
+  // only differ in pipelined mode while a frame processed at the previous size is rasterised.
+  // Rows are always screenWidth apart.
+  uint m_renderWidth;
+  uint m_renderHeight;
+  uint m_viewportWidth;
+  uint m_viewportHeight;
+
+  // Primitives are only rasterised inside this, which is the whole viewport unless only part of a
+  // frame is being redrawn
+  ScreenRect m_clipRect;
+
+  // Dynamic resolution scaling, disabled when the target frame time is 0
+  float m_targetFrameTime;
+  float m_minResolutionScale;
+  float m_resolutionScale;
+  GameTimer m_frameTimer;
+  float m_frameTimes[DYNAMIC_RESOLUTION_HISTORY];
+  int m_frameTimeCount;
+
+  // Window sized frame a reduced resolution frame is upscaled into
+  vector<Colour> m_upscaleBuffer;
+  vector<uint> m_upscaleColumns; // Source column and weight of each window column
+  vector<uint> m_upscaleWeights;
+
+  TriangleTraversal m_triangleTraversal;
+
+  // Triangle rasteriser for the current batch's state, selected once per batch
+  RasteriseTriFunc m_rasteriseTri;
+  RasteriseLineFunc m_rasteriseLine;
+  RasteriseShadedFunc m_rasteriseShadedTris; // For batches with a shader
+
+  // Scratch space for the span of a triangle being rasterised on a single row (per sample when
+  // multisampling)
+  vector<Colour> m_spanColours;
+  vector<unsigned int> m_spanMask;
+
+  // Primitives of the draw currently being rendered in immediate mode
+  PrimitiveList m_immediatePrimitives;
+
+  // Colour and depth buffers RenderToTexture draws into in place of the frame's, with the same
+  // row pitch
+  vector<Colour> m_textureColours;
+  vector<unsigned short> m_textureDepth;
+
+  // Pipelined mode: the main thread records one frame while the geometry thread processes the
+  // previous one
+  bool m_pipelined;
+  int m_recordFrame;
+  PipelinedFrame m_frames[2];
+
+  std::thread m_geometryThread;
+  std::mutex m_geometryMutex;
+  std::condition_variable m_geometryCond;
+  PipelinedFrame *m_geometryFrame;
+  bool m_geometryExit;
+
+  // Number of ranges the draws of a recorded frame are split into, processed as jobs
+  uint m_geometryThreads;
+
+  // Draw sorting, with scratch space used while sorting a recorded frame
+  bool m_sortDraws;
+  vector<std::pair<unsigned long long, uint> > m_drawSortKeys;
+  vector<DrawCommand> m_sortedDraws;
+  std::unordered_map<const void *, uint> m_sortTextureIds;
+  std::unordered_map<const void *, uint> m_sortMeshIds;
+
+  bool m_occlusionCulling;
+
+  // Incremental rendering. Tiles are flagged when a draw covering them changes, for this frame
+  // and the last, since the buffer being drawn into was last drawn two frames ago.
+  bool m_incremental;
+  bool m_redrawAll; // Settings have changed, so the next frames must be drawn in full
+  vector<DrawCommand> m_lastDraws;
+  vector<unsigned char> m_changedTiles[2];
+  vector<ScreenRect> m_redrawRects;
+
+  // Parts of the frame that changed since the last frame presented, unless it all may have
+  bool m_presentAll;
+  vector<ScreenRect> m_presentRects;
+
+  // Tiles covered by the draws of the frame being drawn and of the last frame presented, when
+  // they're known and the frames aren't rendered incrementally
+  vector<unsigned char> m_drawnTiles;
+  vector<unsigned char> m_presentedTiles;
+
+  FrameCapture *m_frameCapture;
+
+  // Statistics of the frame being rasterised, and of the last one presented
+  PipelineStatistics m_frameStats;
+  PipelineStatistics m_lastFrameStats;
+  uint m_statsFrame;
+  bool m_dumpStats;
+
+  // Per pixel depth tested, shaded and blended counts for the current frame, only allocated when
+  // a heatmap is shown
+  HeatmapMode m_heatmapMode;
+  vector<unsigned short> m_heatmap[3];
 };
@@ -1,4 +1,8 @@
 #include "Texture.h"
+#include "JobSystem.h"
+
+// Smallest number of rows of a mip level worth a job of their own
+const uint MIP_ROWS_PER_JOB = 16;
 
 Texture::Texture(void)
 {
@@ -12,6 +16,9 @@ Texture::Texture(void)
 
 Texture::~Texture(void)
 {
+  for (size_t i = 1; i < mipLevels.size(); ++i)
+    delete[] mipLevels[i];
+
   delete[] texels;
 }
 
@@ -20,17 +27,18 @@ Texture *Texture::TextureFromTGA(const string &filename)
   Texture *t = new Texture();
   std::ifstream file;
 
-  std::cout << "Loading TGA from(" << filename << ")" << std::endl;
+  // Textures may be loaded on several threads at once, so each line goes out in one piece
+  std::cout << "Loading TGA from(" + filename + ")\n";
   file.open(filename.c_str(), std::ios::binary);
   if (!file.is_open())
   {
-    std::cout << "TextureFromTGA file error" << std::endl;
+    std::cout << "TextureFromTGA file error\n";
     return t;
   }
 
   unsigned char TGAheader[18];
 
-  std::cout << "sizeof(TGAheader) is " << sizeof(TGAheader) << std::endl;
+  std::cout << "sizeof(TGAheader) is " + std::to_string(sizeof(TGAheader)) + "\n";
 
   file.read((char *)TGAheader, sizeof(TGAheader));
 
@@ -44,6 +52,8 @@ Texture *Texture::TextureFromTGA(const string &filename)
   file.read((char *)t->texels, size);
   file.close();
 
+  t->CreateMipMaps();
+
   return t;
 }
 
@@ -61,7 +71,7 @@ const Colour &Texture::NearestTexSample(const Vector3 &coords, int miplevel)
   return ColourAtPoint(x, y, miplevel);
 }
 
-const Colour &Texture::BilinearTexSample(const Vector3 &coords, int miplevel)
+Colour Texture::BilinearTexSample(const Vector3 &coords, int miplevel)
 {
   const int texWidth = width;
   const int texHeight = height;
@@ -88,6 +98,10 @@ void Texture::CreateMipMaps()
   int tempWidth = width;
   int tempHeight = height;
 
+  for (size_t i = 1; i < mipLevels.size(); ++i)
+    delete[] mipLevels[i];
+  mipLevels.clear();
+
   mipLevels.push_back(texels);
 
   int numLevels = 0;
@@ -105,31 +119,39 @@ void Texture::CreateMipMaps()
   }
 }
 
+/**
+ * Generates a mip level by averaging each 2x2 block of the level above it. Rows of the new level
+ * are independent, so they are generated in parallel.
+ *
+ * \param source Level above the one being generated
+ * \param dest Level to write to
+ * \param mipLevel Index of the source level
+ */
 void Texture::GenerateMipLevel(Colour *source, Colour *dest, int mipLevel)
 {
-  int sourceWidth = width >> mipLevel;
-  int sourceHeight = height >> mipLevel;
-
-  int destWidth = width >> (mipLevel + 1);
-  int destHeight = height >> (mipLevel + 1);
+  const int sourceWidth = width >> mipLevel;
 
-  int outY = 0;
+  const int destWidth = width >> (mipLevel + 1);
+  const int destHeight = height >> (mipLevel + 1);
 
-  for (int y = 0; y < sourceHeight; y += 2)
-  {
-    int outX = 0;
-    for (int x = 0; x < sourceWidth; x += 2)
+  JobSystem::ParallelFor(0, destHeight, MIP_ROWS_PER_JOB, [&](uint begin, uint end) {
+    for (uint y = begin; y < end; ++y)
     {
-      Colour out;
+      const Colour *top = source + ((y * 2) * sourceWidth);
+      const Colour *bottom = top + sourceWidth;
+      Colour *outRow = dest + (y * destWidth);
+
+      for (int x = 0; x < destWidth; ++x)
+      {
+        Colour out(0, 0, 0, 0);
 
-      out += source[(y * sourceHeight) + x] * 0.25f;
-      out += source[(y * sourceHeight) + x+1] * 0.25f;
-      out += source[((y+1) * sourceHeight) + x] * 0.25f;
-      out += source[((y+1) * sourceHeight) + x+1] * 0.25f;
+        out += top[x * 2] * 0.25f;
+        out += top[(x * 2) + 1] * 0.25f;
+        out += bottom[x * 2] * 0.25f;
+        out += bottom[(x * 2) + 1] * 0.25f;
 
-      dest[outY * destHeight + outX] = out;
-      outX++;
+        outRow[x] = out;
+      }
     }
-    outY++;
-  }
-}
\ No newline at end of file
+  });
+}
@@ -41,7 +41,7 @@ public:
   static Texture *TextureFromTGA(const string &filename);
 
   const Colour &NearestTexSample(const Vector3 &coords, int miplevel = 0);
-  const Colour &BilinearTexSample(const Vector3 &coords, int miplevel = 0);
+  Colour BilinearTexSample(const Vector3 &coords, int miplevel = 0);
 
   const Colour &ColourAtPoint(int x, int y, int mipLevel = 0)
   {
@@ -51,9 +51,9 @@ public:
     x = max(0, min(x, (int)texWidth - 1));
     y = max(0, min(y, (int)texHeight - 1));
 
-    int index = (y * texHeight) + x;
+    int index = (y * texWidth) + x;
 
-    return texels[index];
+    return mipLevels[mipLevel][index];
   }
 
   uint GetWidth()
@@ -1,5 +1,7 @@
 #include "Window.h"
 
+#ifndef HEADLESS_WINDOW
+
 Window::Window(uint width, uint height)
 {
   hasInit = false;
@@ -107,6 +109,32 @@ void Window::PresentBuffer(Colour *buffer)
   BitBlt(deviceContext, 0, 0, screenWidth, screenHeight, drawDC, 0, 0, SRCCOPY);
 }
 
+void Window::PresentBuffer(Colour *buffer, const std::vector<ScreenRect> &rects)
+{
+  if ((void *)buffer == bufferData[0])
+  {
+    SelectObject(drawDC, bitBuffers[0]);
+  }
+  else
+  {
+    SelectObject(drawDC, bitBuffers[1]);
+    // Only the changed rectangles need copying, the rest of the DIB still holds the last frame
+    if ((void *)buffer != bufferData[1])
+    {
+      CopyBufferRects(bufferData[1], buffer, screenWidth, rects);
+    }
+  }
+
+  // The DIB sections are bottom up, so the rows of each rectangle are flipped for the window
+  for (size_t i = 0; i < rects.size(); ++i)
+  {
+    const ScreenRect &rect = rects[i];
+    const int top = (int)screenHeight - rect.maxY;
+    BitBlt(deviceContext, rect.minX, top, rect.maxX - rect.minX, rect.maxY - rect.minY, drawDC,
+           rect.minX, top, SRCCOPY);
+  }
+}
+
 LRESULT Window::WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
   switch (message)
@@ -252,3 +280,5 @@ void Window::CheckMessages(MSG &msg)
   }
   }
 }
+
+#endif
@@ -5,6 +5,144 @@
 #include "Mouse.h"
 #include "Keyboard.h"
 
+#include <cstring>
+#include <vector>
+
+// Rectangle of pixels, from the min coordinates up to but not including the max
+struct ScreenRect
+{
+  int minX;
+  int minY;
+  int maxX;
+  int maxY;
+};
+
+// Copies rectangles of one screen sized buffer into another
+inline void CopyBufferRects(void *dest, const void *src, uint width,
+                            const std::vector<ScreenRect> &rects)
+{
+  for (size_t i = 0; i < rects.size(); ++i)
+  {
+    const ScreenRect &rect = rects[i];
+    const size_t bytes = (rect.maxX - rect.minX) * sizeof(unsigned int);
+    for (int y = rect.minY; y < rect.maxY; ++y)
+    {
+      const size_t offset = (y * width) + rect.minX;
+      memcpy((unsigned int *)dest + offset, (const unsigned int *)src + offset, bytes);
+    }
+  }
+}
+
+#ifdef HEADLESS_WINDOW
+
+#include <string>
+
+// Receives every frame presented by a headless window
+class FrameSink
+{
+public:
+  virtual ~FrameSink()
+  {
+  }
+
+  // buffer is bottom-up BGRA, in the same layout a Win32 DIB section would have
+  virtual void ReceiveFrame(const Colour *buffer, uint width, uint height, uint frame) = 0;
+};
+
+/*
+Off-screen stand in for the Win32 window, so the rasteriser can be built and
+benchmarked without a display. Presented frames are copied into memory (and
+optionally written out as PPM images or handed to a FrameSink), and
+UpdateWindow returns false once a scripted number of frames have been run.
+There is no OS input, so the keyboard and mouse never report anything.
+*/
+class Window
+{
+public:
+  Window(uint width, uint height);
+  ~Window(void);
+
+  void PresentBuffer(Colour *buffer);
+
+  // Presents only some rectangles of the buffer, which must be all that changed since the last
+  // buffer presented
+  void PresentBuffer(Colour *buffer, const std::vector<ScreenRect> &rects);
+
+  bool UpdateWindow();
+
+  uint GetScreenWidth() const
+  {
+    return screenWidth;
+  }
+
+  uint GetScreenHeight() const
+  {
+    return screenHeight;
+  }
+
+  // Number of frames UpdateWindow allows before quitting (0 runs forever)
+  void SetFrameLimit(uint frames)
+  {
+    frameLimit = frames;
+  }
+
+  uint GetFrameLimit() const
+  {
+    return frameLimit;
+  }
+
+  // Number of frames presented so far
+  uint GetFrameCount() const
+  {
+    return frameCount;
+  }
+
+  // Most recently presented frame
+  const Colour *GetPresentedFrame() const
+  {
+    return (const Colour *)bufferData[1];
+  }
+
+  // Writes each presented frame to <prefix><frame>.ppm (empty prefix disables)
+  void SetDumpPrefix(const std::string &prefix)
+  {
+    dumpPrefix = prefix;
+  }
+
+  // Does not take ownership of the sink, pass NULL to remove it
+  void SetFrameSink(FrameSink *sink)
+  {
+    frameSink = sink;
+  }
+
+protected:
+  void BuildBitmap();
+
+  void DumpFrame(const Colour *buffer) const;
+  void FinishPresent();
+
+  virtual void Resize(){
+
+  };
+
+  uint screenWidth;
+  uint screenHeight;
+
+  void *bufferData[2];
+
+  uint frameLimit;
+  uint frameCount;
+  uint updateCount;
+
+  std::string dumpPrefix;
+  FrameSink *frameSink;
+
+  bool forceQuit;
+  bool hasInit;
+};
+
+#else
+
 #include <windows.h>
 #include <fcntl.h>
 
@@ -23,8 +161,22 @@ public:
 
   void PresentBuffer(Colour *buffer);
 
+  // Presents only some rectangles of the buffer, which must be all that changed since the last
+  // buffer presented
+  void PresentBuffer(Colour *buffer, const std::vector<ScreenRect> &rects);
+
   bool UpdateWindow();
 
+  uint GetScreenWidth() const
+  {
+    return screenWidth;
+  }
+
+  uint GetScreenHeight() const
+  {
+    return screenHeight;
+  }
+
 protected:
   void CheckMessages(MSG &msg);
 
@@ -55,3 +207,5 @@ protected:
   bool forceQuit;
   bool hasInit;
 };
+
+#endif
@@ -1,16 +1,31 @@
 #include "SoftwareRasteriser.h"
 
+#include "Benchmark.h"
+#include "CommandBuffer.h"
+#include "DemoShaders.h"
+#include "FrameCapture.h"
+#include "GLSLShaders.h"
+#include "Impostor.h"
+#include "JobSystem.h"
 #include "Mesh.h"
+#include "SceneGenerators.h"
 #include "Texture.h"
 
-void generateRandomStarfield(vector<RenderObject *> &out, const int num = 100,
-                             const float xyFact = 1.0f, const float zFact = 1.0f);
-void generateRandomAsteroids(vector<RenderObject *> &out, const int num = 100,
-                             const float xyFact = 1.0f, const float zFact = 1.0f);
-void generateAsteroid2D(vector<RenderObject *> &out, const Vector3 &position, const float scale);
-
-int main()
+int main(int argc, char *argv[])
 {
+  // The benchmark suite creates its own rasteriser for each resolution
+  if (argc > 1 && string(argv[1]) == "-benchmark-suite")
+  {
+    BenchmarkSuiteOptions options;
+    if (!ParseBenchmarkSuiteOptions(argc - 2, argv + 2, options))
+      return 1;
+
+    JobSystem::Initialise(options.jobWorkers);
+    const int result = RunBenchmarkSuite(options);
+    JobSystem::Destroy();
+    return result;
+  }
+
   const int screenX = 800;
   const int screenY = 600;
   SoftwareRasteriser r(screenX, screenY);
@@ -20,10 +35,167 @@ int main()
   r.SetTextureSamplingMode(SAMPLE_BILINEAR);
   r.SetBlendMode(BLEND_ALPHA);
 
+  FrameCapture *capture = NULL;
+  float targetFrameTime = 0.0f;
+  uint jobWorkers = JobSystem::DefaultWorkers();
+  bool pinThreads = false;
+  bool pipelined = false;
+  bool shaders = false;
+  bool impostors = false;
+  string glslShader;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const string arg(argv[i]);
+    const bool hasValue = (i + 1 < argc);
+
+    // Stream every presented frame to a file (or stdout for "-")
+    if (arg == "-capture" && hasValue)
+    {
+      delete capture;
+      capture = new FrameCapture(argv[i + 1], r.GetScreenWidth(), r.GetScreenHeight(),
+                                 FrameCapture::FormatFromFilename(argv[i + 1]));
+      r.SetFrameCapture(capture);
+      ++i;
+    }
+    // Print pipeline statistics for every frame
+    else if (arg == "-stats")
+    {
+      if (!SoftwareRasteriser::StatisticsEnabled())
+        std::cout << "Pipeline statistics are not enabled in this build" << std::endl;
+      r.SetDumpStatistics(true);
+    }
+    // Show a heatmap of how often each pixel is depth tested, shaded or blended
+    else if (arg == "-heatmap" && hasValue)
+    {
+      const string mode(argv[i + 1]);
+      if (mode == "tested")
+        r.SetHeatmapMode(HEATMAP_DEPTH_TESTED);
+      else if (mode == "shaded")
+        r.SetHeatmapMode(HEATMAP_SHADED);
+      else if (mode == "blended")
+        r.SetHeatmapMode(HEATMAP_BLENDED);
+      ++i;
+    }
+    // Reduce the resolution when frames take longer than this many milliseconds
+    else if (arg == "-dynres" && hasValue)
+    {
+      targetFrameTime = (float)atof(argv[i + 1]);
+      ++i;
+    }
+    // Draw into another colour format, converted to the window's format as frames are presented
+    else if (arg == "-colour-format" && hasValue)
+    {
+      const string format(argv[i + 1]);
+      if (format == "rgb565")
+        r.SetColourFormat(COLOUR_RGB565);
+      else if (format == "r11g11b10")
+        r.SetColourFormat(COLOUR_R11G11B10);
+      else if (format == "bgra8")
+        r.SetColourFormat(COLOUR_BGRA8);
+      ++i;
+    }
+    // Fill triangles by walking their edges instead of testing their bounding boxes
+    else if (arg == "-scanline")
+    {
+      r.SetTriangleTraversal(TRAVERSAL_SCANLINE);
+    }
+    // 4x multisample antialiasing
+    else if (arg == "-msaa")
+    {
+      r.SetMultisampling(true);
+    }
+    // Worker threads for the job system (0 runs every job on the thread that spawns it)
+    else if (arg == "-jobs" && hasValue)
+    {
+      jobWorkers = max(atoi(argv[i + 1]), 0);
+      ++i;
+    }
+    // Light the moon per pixel with a shader
+    else if (arg == "-shaders")
+    {
+      shaders = true;
+    }
+    // Draw the moon with one of the OpenGL renderer's shaders, translated from GLSL (basic,
+    // shrink, texfade, fade or lighting)
+    else if (arg == "-glsl-shader" && hasValue)
+    {
+      glslShader = argv[i + 1];
+      ++i;
+    }
+    // Draw the distant planet and its asteroid belt as an impostor, only rendered again when the
+    // view of them changes
+    else if (arg == "-impostors")
+    {
+      impostors = true;
+    }
+    // Pin each job system worker to its own core
+    else if (arg == "-pin-threads")
+    {
+      pinThreads = true;
+    }
+    // Draw opaque objects grouped by state, and the rest after them
+    else if (arg == "-sort-draws")
+    {
+      r.SetDrawSorting(true);
+    }
+    // Skip objects hidden behind what has already been drawn
+    else if (arg == "-occlusion-cull")
+    {
+      r.SetOcclusionCulling(true);
+    }
+    // Only redraw the parts of each frame that have changed
+    else if (arg == "-incremental")
+    {
+      r.SetIncrementalRendering(true);
+    }
+    // Process each frame's geometry on another thread while the last frame is rasterised
+    else if (arg == "-pipelined")
+    {
+      pipelined = true;
+    }
+    // Share vertex processing of each frame between this many threads, which pipelining does
+    else if (arg == "-geometry-threads" && hasValue)
+    {
+      r.SetGeometryThreads(max(atoi(argv[i + 1]), 1));
+      pipelined = true;
+      ++i;
+    }
+#ifdef HEADLESS_WINDOW
+    // Headless runs are scripted from the command line
+    else if (arg == "-frames" && hasValue)
+    {
+      r.SetFrameLimit(atoi(argv[i + 1]));
+      ++i;
+    }
+    else if (arg == "-dump" && hasValue)
+    {
+      r.SetDumpPrefix(argv[i + 1]);
+      ++i;
+    }
+#endif
+  }
+
+  JobSystem::Initialise(jobWorkers, pinThreads);
+
+  if (argc > 1 && string(argv[1]) == "-benchmark")
+  {
+    BenchmarkTriPermutations(r);
+    JobSystem::Destroy();
+    return 0;
+  }
+
+  if (argc > 1 && string(argv[1]) == "-benchmark-jobs")
+  {
+    BenchmarkJobSystem();
+    JobSystem::Destroy();
+    return 0;
+  }
+
   vector<RenderObject *> drawables;
 
-  // Generate star field (random point primitives)
-  generateRandomStarfield(drawables, 10000);
+  // Generate star field (a mesh of random point primitives)
+  generateStarfieldMesh(drawables, 10000);
 
   // Generate asteroids (random line primitive shapes)
   generateRandomAsteroids(drawables, 100);
@@ -34,37 +206,100 @@ int main()
   // Blue moon (textured sphere)
   RenderObject *moon = new RenderObject();
   moon->mesh = Mesh::GenerateSphere(3.0f, 20, Colour(255, 0, 0, 255));
-  moon->texture = Texture::TextureFromTGA("../moon.tga");
   moon->modelMatrix = Matrix4::Translation(Vector3(-2.0f, -3.0f, -10.0f));
   drawables.push_back(moon);
 
   // Planet (triangle fan)
   RenderObject *planet = new RenderObject();
   planet->mesh = Mesh::GenerateDisc2D(8.0f, 30);
-  planet->texture = Texture::TextureFromTGA("../planet.tga");
   planet->modelMatrix = Matrix4::Translation(Vector3(-8.0f, -10.0f, -20.0f));
   drawables.push_back(planet);
 
   // Planet asteroid belt (triangle strip)
   RenderObject *asteroidBelt = new RenderObject();
   asteroidBelt->mesh = Mesh::GenerateRing2D(12, 10, 20);
-  asteroidBelt->texture = Texture::TextureFromTGA("../asteroid_belt.tga");
   asteroidBelt->modelMatrix = Matrix4::Translation(Vector3(-8.0f, -10.0f, -20.0f)) *
                               Matrix4::Rotation(90.0f, Vector3(1.0f, 0.0f, 0.0f));
   drawables.push_back(asteroidBelt);
 
   // Spaceship (triangles with interpolated colours and semi-transparency on windows)
   RenderObject *spaceship = new RenderObject();
-  spaceship->mesh = Mesh::LoadMeshFile("../spaceship.asciimesh");
   spaceship->modelMatrix = Matrix4::Scale(Vector3(0.5, 0.5, 0.5)) *
                            Matrix4::Translation(Vector3(2.0f, 2.0f, -2.0f)) *
                            Matrix4::Rotation(40.0f, Vector3(1.0, 1.0, 0.0)) *
                            Matrix4::Rotation(-100.0f, Vector3(0.0, 1.0, 0.0));
   drawables.push_back(spaceship);
 
+  // The asset files don't depend on each other, so they're loaded (and the textures mipmapped)
+  // in parallel
+  RenderObject *textured[] = {moon, planet, asteroidBelt};
+  const char *textureFiles[] = {"../moon.tga", "../planet.tga", "../asteroid_belt.tga"};
+  JobSystem::ParallelFor(0, 4, 1, [&](uint begin, uint end) {
+    for (uint i = begin; i < end; ++i)
+    {
+      if (i < 3)
+        textured[i]->texture = Texture::TextureFromTGA(textureFiles[i]);
+      else
+        spaceship->mesh = Mesh::LoadMeshFile("../spaceship.asciimesh");
+    }
+  });
+
+  // Shared by every object it is set on, and must outlive the command buffers recording them
+  LitShader litShader;
+  if (shaders)
+    moon->shader = &litShader;
+
+  // Paired and set up as the OpenGL renderer's demo does, with its animations half way through
+  Shader<BasicVertex, BasicFragment> basicShader;
+  Shader<ShrinkVertex, BasicFragment> shrinkShader;
+  shrinkShader.vertex.animPosition = 0.5f;
+  Shader<BasicVertex, TexfadeFragment> texfadeShader;
+  texfadeShader.fragment.animPosition = 0.5f;
+  texfadeShader.fragment.objectTextures[1] = planet->texture;
+  Shader<BasicVertex, FadeFragment> fadeShader;
+  fadeShader.fragment.animPosition = 0.5f;
+  Shader<LightingVertex, LightingFragment> lightingShader;
+  lightingShader.fragment.cameraPos = glsl::vec3(0.0f, 0.0f, 10.0f); // Where the view starts
+  lightingShader.fragment.lightPos[0] = glsl::vec3(5.0f, 10.0f, 10.0f);
+  lightingShader.fragment.lightRadius[0] = 1000.0f;
+  lightingShader.fragment.lightColour[0] = glsl::vec3(1.0f);
+  lightingShader.fragment.lightPos[1] = glsl::vec3(0.0f, 1000.0f, 0.0f);
+
+  const char *glslShaderNames[] = {"basic", "shrink", "texfade", "fade", "lighting"};
+  ShaderProgram *glslShaders[] = {&basicShader, &shrinkShader, &texfadeShader, &fadeShader,
+                                  &lightingShader};
+  for (int i = 0; i < 5; ++i)
+  {
+    if (glslShader == glslShaderNames[i])
+      moon->shader = glslShaders[i];
+  }
+
+  // Drawn normally until the camera backs away far enough for the impostor to be worth using
+  Impostor planetImpostor;
+  if (impostors)
+  {
+    planetImpostor.AddObject(planet);
+    planetImpostor.AddObject(asteroidBelt);
+  }
+
+  // Only the spaceship moves, so everything else is recorded once and replayed every frame
+  CommandBuffer staticScene;
+  for (vector<RenderObject *>::iterator it = drawables.begin(); it != drawables.end(); ++it)
+  {
+    if (*it != spaceship && (!impostors || (*it != planet && *it != asteroidBelt)))
+      staticScene.DrawObject(*it);
+  }
+
   Matrix4 viewMatrix = Matrix4::Translation(Vector3(0.0f, 0.0f, -10.0f));
   Matrix4 camRotation;
 
+  // Enabled once the scene has loaded, so loading doesn't count as a slow frame
+  r.SetDynamicResolution(targetFrameTime);
+  float resolutionScale = r.GetResolutionScale();
+
+  // Started last, as the geometry thread uses the job system
+  r.SetPipelined(pipelined);
+
   while (r.UpdateWindow())
   {
     // Move faster when holding shift
@@ -91,6 +326,43 @@ int main()
       std::cout << "Blend mode: " << mode << std::endl;
     }
 
+    // Cycle through the overdraw heatmaps
+    if (Keyboard::KeyTriggered(KEY_H))
+    {
+      if (!SoftwareRasteriser::StatisticsEnabled())
+      {
+        std::cout << "Heatmaps need PIPELINE_STATISTICS to be defined" << std::endl;
+      }
+      else
+      {
+        static const char *heatmapNames[] = {"off", "depth tested", "shaded", "blended"};
+        r.SetHeatmapMode((HeatmapMode)((r.GetHeatmapMode() + 1) % 4));
+        std::cout << "Heatmap: " << heatmapNames[r.GetHeatmapMode()] << std::endl;
+      }
+    }
+
+    // Toggle triangle traversal
+    if (Keyboard::KeyTriggered(KEY_T))
+    {
+      const bool scanline = (r.GetTriangleTraversal() == TRAVERSAL_SCANLINE);
+      r.SetTriangleTraversal(scanline ? TRAVERSAL_BOUNDING_BOX : TRAVERSAL_SCANLINE);
+      std::cout << "Triangle traversal: " << (scanline ? "bounding box" : "scanline") << std::endl;
+    }
+
+    // Toggle multisample antialiasing
+    if (Keyboard::KeyTriggered(KEY_M))
+    {
+      r.SetMultisampling(!r.IsMultisampled());
+      std::cout << "MSAA: " << (r.IsMultisampled() ? "4x" : "off") << std::endl;
+    }
+
+    // Toggle pipelined frame execution
+    if (Keyboard::KeyTriggered(KEY_P))
+    {
+      r.SetPipelined(!r.IsPipelined());
+      std::cout << "Pipelined: " << (r.IsPipelined() ? "on" : "off") << std::endl;
+    }
+
     // Handle strafe movement
     if (Keyboard::KeyDown(KEY_A))
       viewMatrix = viewMatrix * Matrix4::Translation(Vector3(movementDelta, 0.0f, 0.0f));
@@ -119,94 +391,34 @@ int main()
     r.ClearBuffers();
 
     // Draw scene objects
-    for (vector<RenderObject *>::iterator it = drawables.begin(); it != drawables.end(); ++it)
-      r.DrawObject(*it);
+    r.Submit(staticScene);
+    if (impostors)
+      r.DrawImpostor(&planetImpostor);
+    r.DrawObject(spaceship);
 
     r.SwapBuffers();
-  }
 
-  // Remove all drawables, memory is freed in the RenderObject destructor
-  drawables.clear();
-
-  return 0;
-}
-
-/**
- * Generates a star field composed of points at random positions.
- *
- * \param out Vector to add render objects to
- * \param num Number of points to generate
- * \param xyFact Span in X and Y axis
- * \param zFact Span in Z axis
- */
-void generateRandomStarfield(vector<RenderObject *> &out, const int num, const float xyFact,
-                             const float zFact)
-{
-  for (int i = 0; i < num; ++i)
-  {
-    const float x = ((float)((rand() % 100) - 50)) * xyFact;
-    const float y = ((float)((rand() % 100) - 50)) * xyFact;
-    const float z = ((float)((rand() % 100) - 50)) * zFact;
-
-    // Generate random colour
-    const int r = (rand() % 100) + 155;
-    const int g = (rand() % 100) + 155;
-    const int b = (rand() % 100) + 155;
-    Colour c = Colour(r, g, b, 255);
-
-    RenderObject *o = new RenderObject();
-    o->mesh = Mesh::GeneratePoint(Vector3(), c);
-    o->modelMatrix = Matrix4::Translation(Vector3(x, y, z));
-    out.push_back(o);
+    if (r.GetResolutionScale() != resolutionScale)
+    {
+      resolutionScale = r.GetResolutionScale();
+      std::cout << "Resolution scale: " << resolutionScale << std::endl;
+    }
   }
-}
 
-/**
- *Generates a random field of asteroids of random sizes.
- *
- * \param out Vector to add render objects to
- * \param num Number of asteroids to generate
- * \param xyFact Span in X and Y axis
- * \param zFact Span in Z axis
- */
-void generateRandomAsteroids(vector<RenderObject *> &out, const int num, const float xyFact,
-                             const float zFact)
-{
-  for (int i = 0; i < num; ++i)
+  if (capture)
   {
-    const float x = ((float)((rand() % 100) - 50)) * xyFact;
-    const float y = ((float)((rand() % 100) - 50)) * xyFact;
-    const float z = ((float)((rand() % 100) - 50)) * zFact;
-    const float scale = ((float)(rand() % 100)) / 100.0f;
-
-    generateAsteroid2D(out, Vector3(x, y, z), scale);
+    // Make sure the frame still in flight reaches the capture when pipelined
+    r.SetPipelined(false);
+    r.SetFrameCapture(NULL);
+    delete capture;
   }
-}
 
-/**
- * Generates a 2D asteroid.
- *
- * \param out Vector to add render objects to
- * \param position Position to translate to
- * \param scale Scale factor
- */
-void generateAsteroid2D(vector<RenderObject *> &out, const Vector3 &position, const float scale)
-{
-  const Matrix4 modelMat =
-      Matrix4::Translation(position) * Matrix4::Scale(Vector3(scale, scale, scale));
-
-  // Random rotation between 160 - 200
-  const float rot = (float)((rand() % 40) + 160);
-
-  RenderObject *o1 = new RenderObject();
-  o1->mesh = Mesh::GenerateNSided2D(5);
-  o1->modelMatrix = modelMat;
+  // Remove all drawables, memory is freed in the RenderObject destructor
+  drawables.clear();
 
-  RenderObject *o2 = new RenderObject();
-  o2->mesh = Mesh::GenerateNSided2D(7);
-  o2->modelMatrix = modelMat * Matrix4::Scale(Vector3(0.85f, 0.85f, 0.85f)) *
-                    Matrix4::Rotation(rot, Vector3(0.0f, 0.0f, 1.0f));
+  // Anything still using jobs has to finish with them first
+  r.SetPipelined(false);
+  JobSystem::Destroy();
 
-  out.push_back(o1);
-  out.push_back(o2);
+  return 0;
 }